@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bcache - cache of file data blocks
+ *
+ * Looking at the start or the end of a large file, or at the same
+ * file twice, should not mean reading all of it over the wire. The
+ * cache keeps blocks of BCACHE_BLOCK bytes, keyed by (handle, block
+ * number), along with the modification time, change time and size
+ * of the file they were read from. A block is only handed out for
+ * attributes that still match, which ties its coherence to that of
+ * the attribute cache, and for no longer than bcache_ttl seconds.
+ * The least recently used block makes room for a new one once
+ * bcache_size blocks are cached. Blocks shorter than BCACHE_BLOCK
+ * end at the end of the file. All entry points take a lock, so
+ * worker threads can share the cache.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <rpc/rpc.h>
+#include "bcache.h"
+
+struct bcache_entry {
+    nfs_fh3 be_fh;			/* file handle */
+    uint64 be_block;			/* block number in that file */
+    nfstime3 be_mtime;			/* file modification time */
+    nfstime3 be_ctime;			/* file change time */
+    size3 be_size;			/* and size, when it was read */
+    time_t be_fetched;			/* when it was read */
+    count3 be_len;			/* bytes of data */
+    char *be_data;			/* BCACHE_BLOCK bytes */
+    struct bcache_entry *be_next;	/* next on hash chain */
+    struct bcache_entry *be_older;	/* next older entry */
+    struct bcache_entry *be_newer;	/* next newer entry */
+};
+
+int bcache_enabled = 1;
+int bcache_size = BCACHE_SIZE;
+int bcache_ttl = BCACHE_TTL;
+u_long bcache_hits;
+u_long bcache_misses;
+
+static struct bcache_entry *hashtab[BCACHE_HASHSIZE];
+static struct bcache_entry *newest, *oldest;
+static int nentries;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static u_int hashblock(nfs_fh3 *, uint64);
+static int fhequal(nfs_fh3 *, nfs_fh3 *);
+static int current(struct bcache_entry *, fattr3 *, time_t);
+static struct bcache_entry *find(nfs_fh3 *, uint64);
+static void unhash(struct bcache_entry *);
+static void unlink_entry(struct bcache_entry *);
+static void touch(struct bcache_entry *);
+
+/*
+ * Look up block 'block' of file 'fh', as it is for attributes
+ * 'attr'. On a hit its data is copied to 'buf', its length to
+ * '*lenp', and 1 is returned. A NULL 'buf' only asks whether the
+ * block is there, without counting a hit or a miss.
+ */
+int
+bcache_read(nfs_fh3 *fh, uint64 block, fattr3 *attr, char *buf, count3 *lenp)
+{
+    struct bcache_entry *be;
+    int hit = 0;
+
+    if (!bcache_enabled)
+	return 0;
+    pthread_mutex_lock(&lock);
+    if ((be = find(fh, block)) != NULL && !current(be, attr, time(NULL))) {
+	unlink_entry(be);
+	be = NULL;
+    }
+    if (be != NULL) {
+	if (buf != NULL) {
+	    memcpy(buf, be->be_data, be->be_len);
+	    *lenp = be->be_len;
+	    touch(be);
+	    bcache_hits++;
+	}
+	hit = 1;
+    } else if (buf != NULL)
+	bcache_misses++;
+    pthread_mutex_unlock(&lock);
+    return hit;
+}
+
+/*
+ * Enter the 'len' bytes of block 'block' of file 'fh', read while
+ * the file had attributes 'attr'
+ */
+void
+bcache_enter(nfs_fh3 *fh, uint64 block, fattr3 *attr, char *data, count3 len)
+{
+    struct bcache_entry *be;
+    u_int h;
+
+    if (!bcache_enabled || bcache_size <= 0 || len > BCACHE_BLOCK)
+	return;
+    pthread_mutex_lock(&lock);
+    while (nentries > bcache_size)
+	unlink_entry(oldest);
+    if ((be = find(fh, block)) != NULL)
+	unhash(be);
+    else if (nentries == bcache_size) {
+	/* take over the buffer of the oldest block */
+	be = oldest;
+	unhash(be);
+    } else {
+	if ((be = (struct bcache_entry *) malloc(sizeof(*be))) == NULL) {
+	    pthread_mutex_unlock(&lock);
+	    return;
+	}
+	if ((be->be_data = malloc(BCACHE_BLOCK)) == NULL) {
+	    free(be);
+	    pthread_mutex_unlock(&lock);
+	    return;
+	}
+	be->be_older = newest;
+	be->be_newer = NULL;
+	if (newest != NULL)
+	    newest->be_newer = be;
+	newest = be;
+	if (oldest == NULL)
+	    oldest = be;
+	nentries++;
+    }
+    be->be_fh = *fh;
+    be->be_block = block;
+    be->be_mtime = attr->mtime;
+    be->be_ctime = attr->ctime;
+    be->be_size = attr->size;
+    be->be_fetched = time(NULL);
+    be->be_len = len;
+    memcpy(be->be_data, data, len);
+    h = hashblock(fh, block);
+    be->be_next = hashtab[h];
+    hashtab[h] = be;
+    touch(be);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Forget all blocks of file 'fh', after we changed its data ourselves:
+ * a server may keep the same times for writes in quick succession.
+ */
+void
+bcache_forget(nfs_fh3 *fh)
+{
+    struct bcache_entry *be, *next;
+
+    pthread_mutex_lock(&lock);
+    for (be = oldest; be != NULL; be = next) {
+	next = be->be_newer;
+	if (fhequal(&be->be_fh, fh))
+	    unlink_entry(be);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Empty the cache, e.g. when a new file system is mounted
+ */
+void
+bcache_purge(void)
+{
+    pthread_mutex_lock(&lock);
+    while (oldest != NULL)
+	unlink_entry(oldest);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Number of blocks in the cache
+ */
+int
+bcache_count(void)
+{
+    return nentries;
+}
+
+/*
+ * The block number is folded into the precomputed hash of the handle
+ */
+static u_int
+hashblock(nfs_fh3 *fh, uint64 block)
+{
+    u_int h = fh->hash;
+
+    h = (h ^ (u_int) block) * 16777619U;
+    h = (h ^ (u_int) (block >> 32)) * 16777619U;
+    return h & (BCACHE_HASHSIZE - 1);
+}
+
+static int
+fhequal(nfs_fh3 *a, nfs_fh3 *b)
+{
+    return a->hash == b->hash && a->data.data_len == b->data.data_len &&
+	memcmp(a->data.data_val, b->data.data_val, a->data.data_len) == 0;
+}
+
+/*
+ * A block is current while the file it came from still has the same
+ * times and size, and it has not been cached for too long
+ */
+static int
+current(struct bcache_entry *be, fattr3 *attr, time_t now)
+{
+    return now - be->be_fetched < bcache_ttl &&
+	be->be_size == attr->size &&
+	be->be_mtime.seconds == attr->mtime.seconds &&
+	be->be_mtime.nseconds == attr->mtime.nseconds &&
+	be->be_ctime.seconds == attr->ctime.seconds &&
+	be->be_ctime.nseconds == attr->ctime.nseconds;
+}
+
+static struct bcache_entry *
+find(nfs_fh3 *fh, uint64 block)
+{
+    struct bcache_entry *be;
+
+    for (be = hashtab[hashblock(fh, block)]; be != NULL; be = be->be_next)
+	if (be->be_block == block && fhequal(&be->be_fh, fh))
+	    return be;
+    return NULL;
+}
+
+/*
+ * Take an entry off its hash chain, so it can be used for another block
+ */
+static void
+unhash(struct bcache_entry *be)
+{
+    struct bcache_entry **pp;
+
+    for (pp = &hashtab[hashblock(&be->be_fh, be->be_block)]; *pp != be; pp = &(*pp)->be_next)
+	/* do nothing */;
+    *pp = be->be_next;
+}
+
+static void
+unlink_entry(struct bcache_entry *be)
+{
+    unhash(be);
+    if (be->be_newer != NULL)
+	be->be_newer->be_older = be->be_older;
+    else
+	newest = be->be_older;
+    if (be->be_older != NULL)
+	be->be_older->be_newer = be->be_newer;
+    else
+	oldest = be->be_newer;
+    nentries--;
+    free(be->be_data);
+    free(be);
+}
+
+/*
+ * Make an entry the most recently used one
+ */
+static void
+touch(struct bcache_entry *be)
+{
+    if (be == newest)
+	return;
+    if (be->be_newer != NULL)
+	be->be_newer->be_older = be->be_older;
+    if (be->be_older != NULL)
+	be->be_older->be_newer = be->be_newer;
+    else
+	oldest = be->be_newer;
+    be->be_older = newest;
+    be->be_newer = NULL;
+    newest->be_newer = be;
+    newest = be;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bcache - cache of file data blocks
+ */
+#ifndef _BCACHE_H
+#define	_BCACHE_H
+
+#include "nfs_prot.h"
+
+#define	BCACHE_BLOCK	65536	/* bytes in a block */
+#define	BCACHE_HASHSIZE	1024	/* number of hash chains (power of two) */
+#define	BCACHE_SIZE	256	/* default maximum number of cached blocks */
+#define	BCACHE_TTL	300	/* default seconds a block is kept */
+
+extern int bcache_enabled;		/* cache is in use */
+extern int bcache_size;			/* most blocks cached */
+extern int bcache_ttl;			/* seconds a block is trusted */
+extern u_long bcache_hits;		/* blocks found in the cache */
+extern u_long bcache_misses;		/* blocks that went to the server */
+
+int bcache_read(nfs_fh3 *, uint64, fattr3 *, char *, count3 *);
+void bcache_enter(nfs_fh3 *, uint64, fattr3 *, char *, count3);
+void bcache_forget(nfs_fh3 *);
+void bcache_purge(void);
+int bcache_count(void);
+
+#endif /* _BCACHE_H */
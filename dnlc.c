@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * dnlc - directory name lookup and attribute cache
+ *
+ * Every command names files relative to the current directory, so
+ * without a cache each one pays a LOOKUP round trip per component,
+ * even for names that were just listed. The cache maps (directory
+ * handle, name) to the handle and attributes of the entry. Entries
+ * expire the way the kernel client's attribute cache does: files
+ * that changed recently are trusted for a short while, files that
+ * have been stable for long are trusted longer, within the bounds
+ * of dnlc_timeo. The post-operation and weak cache consistency
+ * data returned by mutating calls keep the cache up to date. All
+ * entry points take a lock, so worker threads can share the cache.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <rpc/rpc.h>
+#include "dnlc.h"
+
+struct dnlc_entry {
+    nfs_fh3 de_dir;			/* directory handle */
+    char *de_name;			/* name in that directory */
+    nfs_fh3 de_fh;			/* handle of the entry */
+    fattr3 de_attr;			/* its attributes */
+    time_t de_fetched;			/* when they were fetched */
+    struct dnlc_entry *de_next;		/* next on name hash chain */
+    struct dnlc_entry *de_fhnext;	/* next on handle hash chain */
+    struct dnlc_entry *de_older;	/* next older entry */
+    struct dnlc_entry *de_newer;	/* next newer entry */
+};
+
+int dnlc_enabled = 1;
+struct dnlc_timeo dnlc_timeo = { 3, 60, 30, 60 };
+u_long dnlc_hits;
+u_long dnlc_misses;
+
+static struct dnlc_entry *nametab[DNLC_HASHSIZE];
+static struct dnlc_entry *fhtab[DNLC_HASHSIZE];
+static struct dnlc_entry *newest, *oldest;
+static int nentries;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static u_int hashfh(nfs_fh3 *);
+static u_int hashname(nfs_fh3 *, char *);
+static int fhequal(nfs_fh3 *, nfs_fh3 *);
+static int expired(struct dnlc_entry *, time_t);
+static struct dnlc_entry *find(nfs_fh3 *, char *);
+static void enter(nfs_fh3 *, char *, nfs_fh3 *, fattr3 *);
+static void attr_update(nfs_fh3 *, post_op_attr *);
+static void wcc_update(nfs_fh3 *, wcc_data *);
+static void unlink_entry(struct dnlc_entry *);
+static void purge_dir(nfs_fh3 *);
+
+/*
+ * Look up 'name' in directory 'dir'. On a hit the handle and
+ * attributes of the entry are copied out and 1 is returned.
+ */
+int
+dnlc_lookup(nfs_fh3 *dir, char *name, nfs_fh3 *fh, fattr3 *attr)
+{
+    struct dnlc_entry *de;
+    int hit = 0;
+
+    if (!dnlc_enabled)
+	return 0;
+    pthread_mutex_lock(&lock);
+    if ((de = find(dir, name)) != NULL && expired(de, time(NULL))) {
+	unlink_entry(de);
+	de = NULL;
+    }
+    if (de != NULL) {
+	if (fh != NULL)
+	    *fh = de->de_fh;
+	if (attr != NULL)
+	    *attr = de->de_attr;
+	dnlc_hits++;
+	hit = 1;
+    } else
+	dnlc_misses++;
+    pthread_mutex_unlock(&lock);
+    return hit;
+}
+
+/*
+ * Enter (or refresh) the binding of 'name' in directory 'dir'
+ */
+void
+dnlc_enter(nfs_fh3 *dir, char *name, nfs_fh3 *fh, fattr3 *attr)
+{
+    if (!dnlc_enabled)
+	return;
+    pthread_mutex_lock(&lock);
+    enter(dir, name, fh, attr);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Record the outcome of a call that created 'name' in directory 'dir'
+ */
+void
+dnlc_create(nfs_fh3 *dir, char *name, post_op_fh3 *fh, post_op_attr *attr,
+    wcc_data *wcc)
+{
+    struct dnlc_entry *de;
+
+    pthread_mutex_lock(&lock);
+    wcc_update(dir, wcc);
+    if (dnlc_enabled && fh->handle_follows && attr->attributes_follow)
+	enter(dir, name, &fh->post_op_fh3_u.handle,
+	    &attr->post_op_attr_u.attributes);
+    else if ((de = find(dir, name)) != NULL)
+	unlink_entry(de);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Forget about 'name' in directory 'dir'
+ */
+void
+dnlc_remove(nfs_fh3 *dir, char *name)
+{
+    struct dnlc_entry *de;
+
+    pthread_mutex_lock(&lock);
+    if ((de = find(dir, name)) != NULL)
+	unlink_entry(de);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * New attributes for object 'fh' came back from the server
+ */
+void
+dnlc_attr(nfs_fh3 *fh, post_op_attr *attr)
+{
+    pthread_mutex_lock(&lock);
+    attr_update(fh, attr);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Directory 'dir' was changed by one of our calls
+ */
+void
+dnlc_wcc(nfs_fh3 *dir, wcc_data *wcc)
+{
+    pthread_mutex_lock(&lock);
+    wcc_update(dir, wcc);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Empty the cache, e.g. when a new file system is mounted
+ */
+void
+dnlc_purge(void)
+{
+    pthread_mutex_lock(&lock);
+    while (oldest != NULL)
+	unlink_entry(oldest);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Number of names in the cache
+ */
+int
+dnlc_count(void)
+{
+    return nentries;
+}
+
+static void
+enter(nfs_fh3 *dir, char *name, nfs_fh3 *fh, fattr3 *attr)
+{
+    struct dnlc_entry *de;
+    u_int h;
+
+    if ((de = find(dir, name)) != NULL)
+	unlink_entry(de);
+    if (nentries >= DNLC_SIZE)
+	unlink_entry(oldest);
+    if ((de = (struct dnlc_entry *) malloc(sizeof(*de))) == NULL)
+	return;
+    if ((de->de_name = strdup(name)) == NULL) {
+	free(de);
+	return;
+    }
+    de->de_dir = *dir;
+    de->de_fh = *fh;
+    de->de_attr = *attr;
+    de->de_fetched = time(NULL);
+
+    h = hashname(dir, name);
+    de->de_next = nametab[h];
+    nametab[h] = de;
+    h = hashfh(fh);
+    de->de_fhnext = fhtab[h];
+    fhtab[h] = de;
+    de->de_older = newest;
+    de->de_newer = NULL;
+    if (newest != NULL)
+	newest->de_newer = de;
+    newest = de;
+    if (oldest == NULL)
+	oldest = de;
+    nentries++;
+}
+
+/*
+ * Update every name bound to 'fh' with new attributes, or forget
+ * those names when the server did not return any.
+ */
+static void
+attr_update(nfs_fh3 *fh, post_op_attr *attr)
+{
+    struct dnlc_entry *de, *next;
+    time_t now = time(NULL);
+
+    for (de = fhtab[hashfh(fh)]; de != NULL; de = next) {
+	next = de->de_fhnext;
+	if (!fhequal(&de->de_fh, fh))
+	    continue;
+	if (attr != NULL && attr->attributes_follow) {
+	    de->de_attr = attr->post_op_attr_u.attributes;
+	    de->de_fetched = now;
+	} else
+	    unlink_entry(de);
+    }
+}
+
+/*
+ * When the attributes of 'dir' from before the change do not match
+ * what we had cached, someone else changed the directory too and none
+ * of its cached names can be trusted anymore.
+ */
+static void
+wcc_update(nfs_fh3 *dir, wcc_data *wcc)
+{
+    struct dnlc_entry *de;
+    wcc_attr *before;
+
+    if (wcc->before.attributes_follow) {
+	before = &wcc->before.pre_op_attr_u.attributes;
+	for (de = fhtab[hashfh(dir)]; de != NULL; de = de->de_fhnext) {
+	    if (!fhequal(&de->de_fh, dir))
+		continue;
+	    if (de->de_attr.size != before->size ||
+	      de->de_attr.mtime.seconds != before->mtime.seconds ||
+	      de->de_attr.mtime.nseconds != before->mtime.nseconds ||
+	      de->de_attr.ctime.seconds != before->ctime.seconds ||
+	      de->de_attr.ctime.nseconds != before->ctime.nseconds) {
+		purge_dir(dir);
+		break;
+	    }
+	}
+    }
+    attr_update(dir, &wcc->after);
+}
+
+/*
+ * Handles carry their FNV-1a hash, the name is folded into it
+ */
+static u_int
+hashfh(nfs_fh3 *fh)
+{
+    return fh->hash & (DNLC_HASHSIZE - 1);
+}
+
+static u_int
+hashname(nfs_fh3 *dir, char *name)
+{
+    u_int h = dir->hash;
+
+    for (; *name != '\0'; name++)
+	h = (h ^ (u_char) *name) * 16777619U;
+    return h & (DNLC_HASHSIZE - 1);
+}
+
+static int
+fhequal(nfs_fh3 *a, nfs_fh3 *b)
+{
+    return a->hash == b->hash && a->data.data_len == b->data.data_len &&
+	memcmp(a->data.data_val, b->data.data_val, a->data.data_len) == 0;
+}
+
+/*
+ * Attributes are trusted for a tenth of the time since the object
+ * was last modified, clamped to the configured bounds.
+ */
+static int
+expired(struct dnlc_entry *de, time_t now)
+{
+    long age, ttl, min, max;
+
+    if (de->de_attr.type == NF3DIR) {
+	min = dnlc_timeo.dt_dirmin;
+	max = dnlc_timeo.dt_dirmax;
+    } else {
+	min = dnlc_timeo.dt_regmin;
+	max = dnlc_timeo.dt_regmax;
+    }
+    age = (long) de->de_fetched - (long) de->de_attr.mtime.seconds;
+    ttl = age / 10;
+    if (ttl < min)
+	ttl = min;
+    if (ttl > max)
+	ttl = max;
+    return now - de->de_fetched >= ttl;
+}
+
+static struct dnlc_entry *
+find(nfs_fh3 *dir, char *name)
+{
+    struct dnlc_entry *de;
+
+    for (de = nametab[hashname(dir, name)]; de != NULL; de = de->de_next)
+	if (strcmp(de->de_name, name) == 0 && fhequal(&de->de_dir, dir))
+	    return de;
+    return NULL;
+}
+
+static void
+unlink_entry(struct dnlc_entry *de)
+{
+    struct dnlc_entry **pp;
+
+    for (pp = &nametab[hashname(&de->de_dir, de->de_name)]; *pp != de; pp = &(*pp)->de_next)
+	/* do nothing */;
+    *pp = de->de_next;
+    for (pp = &fhtab[hashfh(&de->de_fh)]; *pp != de; pp = &(*pp)->de_fhnext)
+	/* do nothing */;
+    *pp = de->de_fhnext;
+    if (de->de_newer != NULL)
+	de->de_newer->de_older = de->de_older;
+    else
+	newest = de->de_older;
+    if (de->de_older != NULL)
+	de->de_older->de_newer = de->de_newer;
+    else
+	oldest = de->de_newer;
+    nentries--;
+    free(de->de_name);
+    free(de);
+}
+
+/*
+ * Forget all names in directory 'dir'
+ */
+static void
+purge_dir(nfs_fh3 *dir)
+{
+    struct dnlc_entry *de, *next;
+
+    for (de = oldest; de != NULL; de = next) {
+	next = de->de_newer;
+	if (fhequal(&de->de_dir, dir))
+	    unlink_entry(de);
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * dnlc - directory name lookup and attribute cache
+ */
+#ifndef _DNLC_H
+#define	_DNLC_H
+
+#include "nfs_prot.h"
+
+#define	DNLC_HASHSIZE	1024	/* number of hash chains (power of two) */
+#define	DNLC_SIZE	8192	/* maximum number of cached names */
+
+/*
+ * Attribute timeouts in seconds, with the same meaning as the
+ * acregmin, acregmax, acdirmin and acdirmax mount options.
+ */
+struct dnlc_timeo {
+    int dt_regmin;		/* minimum for non-directories */
+    int dt_regmax;		/* maximum for non-directories */
+    int dt_dirmin;		/* minimum for directories */
+    int dt_dirmax;		/* maximum for directories */
+};
+
+extern int dnlc_enabled;		/* cache is in use */
+extern struct dnlc_timeo dnlc_timeo;	/* attribute timeouts */
+extern u_long dnlc_hits;		/* lookups answered from the cache */
+extern u_long dnlc_misses;		/* lookups that went to the server */
+
+int dnlc_lookup(nfs_fh3 *, char *, nfs_fh3 *, fattr3 *);
+void dnlc_enter(nfs_fh3 *, char *, nfs_fh3 *, fattr3 *);
+void dnlc_create(nfs_fh3 *, char *, post_op_fh3 *, post_op_attr *, wcc_data *);
+void dnlc_remove(nfs_fh3 *, char *);
+void dnlc_attr(nfs_fh3 *, post_op_attr *);
+void dnlc_wcc(nfs_fh3 *, wcc_data *);
+void dnlc_purge(void);
+int dnlc_count(void);
+
+#endif /* _DNLC_H */
@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * manifest - what an earlier sync fetched, and the hashes of its blocks
+ *
+ * A sync skips files whose remote file id, size and modification time
+ * are what they were when it last fetched them, as long as nobody
+ * touched the local copy since. NFSv3 has no way of asking the server
+ * for a checksum, so a file that did change is read in full; the
+ * block hashes then tell which parts of the local copy have to be
+ * rewritten. The manifest is a text file, one line per file followed
+ * by a line with its hashes:
+ *
+ *	F <fileid> <size> <mtime> <mtime-ns> <local> <local-ns> <nblocks> <path>
+ *	H <hash> ...
+ *
+ * Backslashes and newlines in the path are escaped with a backslash.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <rpc/rpc.h>
+#include "manifest.h"
+
+#define	MF_HEADER	"# nfsshell sync manifest 1"
+
+static u_int hashpath(char *);
+static char *unescape(char *);
+static void putpath(FILE *, char *);
+static uint64 lane(uint64, uint64);
+
+/*
+ * Read a manifest file into an empty manifest. A file that does not
+ * exist yet is an empty manifest too. Returns 0, after saying why,
+ * when the file cannot be read or is not a manifest.
+ */
+int
+manifest_load(struct manifest *mf, char *file)
+{
+    struct mfentry *me = NULL;
+    unsigned long long fileid, size;
+    u_long sec, nsec, lsec, lnsec;
+    u_int nblocks, i;
+    char *line = NULL, *p, *q;
+    size_t linesize = 0;
+    int n, ok = 1, nomem = 0, lineno = 0;
+    FILE *fp;
+
+    memset(mf, 0, sizeof(*mf));
+    pthread_mutex_init(&mf->mf_lock, NULL);
+    if ((fp = fopen(file, "r")) == NULL)
+	return errno == ENOENT;
+    while (ok && getline(&line, &linesize, fp) > 0) {
+	lineno++;
+	line[strcspn(line, "\n")] = '\0';
+	if (lineno == 1) {
+	    ok = strcmp(line, MF_HEADER) == 0;
+	    continue;
+	}
+	/* the path starts right after the single blank, spaces and all */
+	if (line[0] == 'F' && sscanf(line, "F %llu %llu %lu %lu %lu %lu %u%n",
+	  &fileid, &size, &sec, &nsec, &lsec, &lnsec, &nblocks, &n) == 7 &&
+	  line[n] == ' ' && line[n + 1] != '\0') {
+	    me = NULL;
+	    if ((p = unescape(line + n + 1)) == NULL) {
+		ok = 0;
+		nomem = 1;
+		break;
+	    }
+	    if (manifest_find(mf, p) != NULL) {
+		free(p);
+		continue;
+	    }
+	    if ((me = (struct mfentry *) calloc(1, sizeof(*me))) == NULL ||
+	      (nblocks > 0 && (me->me_hash = (uint64 *)
+	      calloc(nblocks, sizeof(uint64))) == NULL)) {
+		fprintf(stderr, "manifest: out of memory\n");
+		free(me);
+		free(p);
+		ok = 0;
+		nomem = 1;
+		break;
+	    }
+	    me->me_path = p;
+	    me->me_fileid = fileid;
+	    me->me_size = size;
+	    me->me_mtime.seconds = sec;
+	    me->me_mtime.nseconds = nsec;
+	    me->me_local.tv_sec = lsec;
+	    me->me_local.tv_nsec = lnsec;
+	    me->me_nblocks = nblocks;
+	    i = hashpath(p);
+	    me->me_next = mf->mf_chain[i];
+	    mf->mf_chain[i] = me;
+	    mf->mf_count++;
+	} else if (line[0] == 'H' && me != NULL) {
+	    /* hashes the line does not have stay 0, and will not match */
+	    for (p = line + 1, i = 0; i < me->me_nblocks; i++, p = q) {
+		me->me_hash[i] = strtoull(p, &q, 16);
+		if (q == p)
+		    break;
+	    }
+	    me = NULL;
+	} else if (line[0] != '#')
+	    ok = 0;
+    }
+    if (!ok && !nomem)
+	fprintf(stderr, "%s:%d: not a sync manifest\n", file, lineno);
+    else if (ferror(fp)) {
+	perror(file);
+	ok = 0;
+    }
+    free(line);
+    fclose(fp);
+    if (!ok)
+	manifest_free(mf);
+    return ok;
+}
+
+/*
+ * Write the manifest to 'file', by way of a temporary file, so that
+ * an interrupted save leaves the old manifest. Unless 'keep' is set
+ * only the entries seen on the server are written; the number left
+ * out is returned in 'gonep'.
+ */
+int
+manifest_save(struct manifest *mf, char *file, int keep, u_long *gonep)
+{
+    struct mfentry *me;
+    char *tmp;
+    FILE *fp;
+    u_int i, b;
+    int ok;
+
+    *gonep = 0;
+    if ((tmp = malloc(strlen(file) + 5)) == NULL) {
+	fprintf(stderr, "manifest: out of memory\n");
+	return 0;
+    }
+    sprintf(tmp, "%s.new", file);
+    if ((fp = fopen(tmp, "w")) == NULL) {
+	perror(tmp);
+	free(tmp);
+	return 0;
+    }
+    fprintf(fp, "%s\n", MF_HEADER);
+    pthread_mutex_lock(&mf->mf_lock);
+    for (i = 0; i < MANIFEST_HASH; i++) {
+	for (me = mf->mf_chain[i]; me != NULL; me = me->me_next) {
+	    if (!me->me_seen && !keep) {
+		(*gonep)++;
+		continue;
+	    }
+	    fprintf(fp, "F %llu %llu %lu %lu %lu %lu %u ",
+		(unsigned long long) me->me_fileid,
+		(unsigned long long) me->me_size,
+		(u_long) me->me_mtime.seconds, (u_long) me->me_mtime.nseconds,
+		(u_long) me->me_local.tv_sec, (u_long) me->me_local.tv_nsec,
+		me->me_nblocks);
+	    putpath(fp, me->me_path);
+	    if (me->me_nblocks > 0) {
+		putc('H', fp);
+		for (b = 0; b < me->me_nblocks; b++)
+		    fprintf(fp, " %016llx", (unsigned long long) me->me_hash[b]);
+		putc('\n', fp);
+	    }
+	}
+    }
+    pthread_mutex_unlock(&mf->mf_lock);
+    ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0)
+	ok = 0;
+    if (ok && rename(tmp, file) == 0) {
+	free(tmp);
+	return 1;
+    }
+    perror(tmp);
+    (void) unlink(tmp);
+    free(tmp);
+    return 0;
+}
+
+void
+manifest_free(struct manifest *mf)
+{
+    struct mfentry *me, *next;
+    int i;
+
+    for (i = 0; i < MANIFEST_HASH; i++) {
+	for (me = mf->mf_chain[i]; me != NULL; me = next) {
+	    next = me->me_next;
+	    free(me->me_path);
+	    free(me->me_hash);
+	    free(me);
+	}
+	mf->mf_chain[i] = NULL;
+    }
+    mf->mf_count = 0;
+    pthread_mutex_destroy(&mf->mf_lock);
+}
+
+/*
+ * The entry of 'path', or NULL if it has none
+ */
+struct mfentry *
+manifest_find(struct manifest *mf, char *path)
+{
+    struct mfentry *me;
+
+    pthread_mutex_lock(&mf->mf_lock);
+    for (me = mf->mf_chain[hashpath(path)]; me != NULL; me = me->me_next)
+	if (strcmp(me->me_path, path) == 0)
+	    break;
+    pthread_mutex_unlock(&mf->mf_lock);
+    return me;
+}
+
+/*
+ * Keep an entry whose file is still there and did not change
+ */
+void
+manifest_seen(struct manifest *mf, struct mfentry *me)
+{
+    pthread_mutex_lock(&mf->mf_lock);
+    me->me_seen = 1;
+    pthread_mutex_unlock(&mf->mf_lock);
+}
+
+/*
+ * Record that 'path' was fetched when it had attributes 'attr', and
+ * that its local copy, modified at 'local', has the 'nblocks' block
+ * hashes at 'hash'. The manifest takes over the hashes, which must
+ * have been allocated with malloc.
+ */
+int
+manifest_enter(struct manifest *mf, char *path, fattr3 *attr,
+    struct timespec *local, u_int nblocks, uint64 *hash)
+{
+    struct mfentry *me;
+    char *p;
+    u_int i = hashpath(path);
+
+    pthread_mutex_lock(&mf->mf_lock);
+    for (me = mf->mf_chain[i]; me != NULL; me = me->me_next)
+	if (strcmp(me->me_path, path) == 0)
+	    break;
+    if (me == NULL) {
+	if ((me = (struct mfentry *) calloc(1, sizeof(*me))) == NULL ||
+	  (p = strdup(path)) == NULL) {
+	    pthread_mutex_unlock(&mf->mf_lock);
+	    free(me);
+	    fprintf(stderr, "manifest: out of memory\n");
+	    return 0;
+	}
+	me->me_path = p;
+	me->me_next = mf->mf_chain[i];
+	mf->mf_chain[i] = me;
+	mf->mf_count++;
+    }
+    free(me->me_hash);
+    me->me_fileid = attr->fileid;
+    me->me_size = attr->size;
+    me->me_mtime = attr->mtime;
+    me->me_local = *local;
+    me->me_nblocks = nblocks;
+    me->me_hash = hash;
+    me->me_seen = 1;
+    pthread_mutex_unlock(&mf->mf_lock);
+    return 1;
+}
+
+/*
+ * 64-bit hash of a block (the xxHash64 function). Four independent
+ * lanes take 32 bytes per round, which keeps several multipliers
+ * busy at once; the hash runs at several bytes per cycle without
+ * any machine specific code.
+ */
+#define	P1	11400714785074694791ULL
+#define	P2	14029467366897019727ULL
+#define	P3	1609587929392839161ULL
+#define	P4	9650029242287828579ULL
+#define	P5	2870177450012600261ULL
+#define	ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+uint64
+blockhash(const void *buf, size_t len)
+{
+    const u_char *p = (const u_char *) buf, *end = p + len;
+    uint64 v1 = P1 + P2, v2 = P2, v3 = 0, v4 = -P1, h, k;
+    u_int32_t w;
+
+    if (len >= 32) {
+	do {
+	    memcpy(&k, p, 8); v1 = lane(v1, k);
+	    memcpy(&k, p + 8, 8); v2 = lane(v2, k);
+	    memcpy(&k, p + 16, 8); v3 = lane(v3, k);
+	    memcpy(&k, p + 24, 8); v4 = lane(v4, k);
+	    p += 32;
+	} while (p + 32 <= end);
+	h = ROTL(v1, 1) + ROTL(v2, 7) + ROTL(v3, 12) + ROTL(v4, 18);
+	h = (h ^ lane(0, v1)) * P1 + P4;
+	h = (h ^ lane(0, v2)) * P1 + P4;
+	h = (h ^ lane(0, v3)) * P1 + P4;
+	h = (h ^ lane(0, v4)) * P1 + P4;
+    } else
+	h = P5;
+    h += len;
+    for (; p + 8 <= end; p += 8) {
+	memcpy(&k, p, 8);
+	h ^= lane(0, k);
+	h = ROTL(h, 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+	memcpy(&w, p, 4);
+	h ^= (uint64) w * P1;
+	h = ROTL(h, 23) * P2 + P3;
+	p += 4;
+    }
+    for (; p < end; p++) {
+	h ^= *p * P5;
+	h = ROTL(h, 11) * P1;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64
+lane(uint64 acc, uint64 input)
+{
+    acc += input * P2;
+    return ROTL(acc, 31) * P1;
+}
+
+static u_int
+hashpath(char *path)
+{
+    u_int h = 2166136261U;
+
+    while (*path)
+	h = (h ^ (u_char) *path++) * 16777619U;
+    return h & (MANIFEST_HASH - 1);
+}
+
+/*
+ * A copy of an escaped path, or NULL if out of memory
+ */
+static char *
+unescape(char *s)
+{
+    char *copy, *p;
+
+    if ((copy = p = malloc(strlen(s) + 1)) == NULL) {
+	fprintf(stderr, "manifest: out of memory\n");
+	return NULL;
+    }
+    for (; *s; s++) {
+	if (*s == '\\' && s[1] != '\0') {
+	    s++;
+	    *p++ = *s == 'n' ? '\n' : *s;
+	} else
+	    *p++ = *s;
+    }
+    *p = '\0';
+    return copy;
+}
+
+static void
+putpath(FILE *fp, char *path)
+{
+    for (; *path; path++) {
+	if (*path == '\\')
+	    fputs("\\\\", fp);
+	else if (*path == '\n')
+	    fputs("\\n", fp);
+	else
+	    putc(*path, fp);
+    }
+    putc('\n', fp);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * manifest - what an earlier sync fetched, and the hashes of its blocks
+ */
+#ifndef _MANIFEST_H
+#define	_MANIFEST_H
+
+#include <time.h>
+#include <pthread.h>
+#include "nfs_prot.h"
+
+#define	MANIFEST_BLOCK	(1024 * 1024) /* bytes covered by a block hash */
+#define	MANIFEST_HASH	4096	/* number of hash chains (power of two) */
+
+/*
+ * One file of a sync: the remote attributes it was fetched with, the
+ * modification time of the local copy that was then written, and a
+ * hash of every MANIFEST_BLOCK of it. The path is relative to the
+ * directory the sync goes to. Entries stay where they are until the
+ * manifest is freed, so a worker can use the one for its own file
+ * without the lock.
+ */
+struct mfentry {
+    char *me_path;		/* path name below the sync directory */
+    fileid3 me_fileid;		/* remote file id */
+    size3 me_size;		/* remote size */
+    nfstime3 me_mtime;		/* remote modification time */
+    struct timespec me_local;	/* modification time of the local copy */
+    u_int me_nblocks;		/* number of block hashes */
+    uint64 *me_hash;		/* the hashes */
+    int me_seen;		/* found on the server by this sync */
+    struct mfentry *me_next;	/* next entry in the hash chain */
+};
+
+struct manifest {
+    pthread_mutex_t mf_lock;	/* guards the chains and counts */
+    struct mfentry *mf_chain[MANIFEST_HASH]; /* entries by path */
+    u_long mf_count;		/* number of entries */
+};
+
+int manifest_load(struct manifest *, char *);
+int manifest_save(struct manifest *, char *, int, u_long *);
+void manifest_free(struct manifest *);
+struct mfentry *manifest_find(struct manifest *, char *);
+void manifest_seen(struct manifest *, struct mfentry *);
+int manifest_enter(struct manifest *, char *, fattr3 *, struct timespec *,
+    u_int, uint64 *);
+uint64 blockhash(const void *, size_t);
+
+#endif /* _MANIFEST_H */
@@ -0,0 +1,1739 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * memfs - in-memory NFSv3 and MOUNT3 server, for benchmarks and tests
+ *
+ * The server keeps a single file system in memory and exports it as
+ * /export to anyone on the loopback interface. It is built on the
+ * rpcgen server skeletons: their dispatch routines are static, so
+ * they are included here with their main renamed out of the way.
+ * Replies can be held back for a while (-d), the way a network
+ * round trip would hold them, and replies of idempotent calls can be
+ * dropped (-l); dropping only those keeps the tree the same whatever
+ * the client retransmits, but it only makes sense over UDP, a TCP
+ * client just waits for its timeout.
+ *
+ * The NFS and MOUNT services listen on ports picked by the system.
+ * They are registered with the local portmapper, and if there is
+ * none memfs answers portmapper calls itself.
+ */
+#include <rpc/rpc.h>
+
+static bool_t holdreply(SVCXPRT *, xdrproc_t, void *);
+
+#define	main	nfs_prot_svc_main
+#define	svc_sendreply	holdreply
+#include "nfs_prot_svc.c"
+#undef	main
+#define	main	mount_svc_main
+#include "mount_svc.c"
+#undef	main
+#undef	svc_sendreply
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <rpc/pmap_prot.h>
+
+#define	MEMFS_ARENA	(16 << 20) /* room for the pieces of one reply */
+#define	MEMFS_HASH	65536	/* buckets of the name table, a power of 2 */
+#define	MEMFS_XFER	65536	/* default largest READ and WRITE */
+#define	MEMFS_UDPBUF	65000	/* UDP send and receive buffers */
+#define	MEMFS_TCPBUF	(1 << 20) /* TCP send and receive buffers */
+#define	MEMFS_SOCKBUF	(4 << 20) /* UDP socket buffers */
+#define	MEMFS_NREGS	8	/* most services registered */
+
+/*
+ * A directory entry. Entries are on a list per directory, in the
+ * order of their cookies, and in one hash table for lookups.
+ */
+struct dent {
+    char *d_name;		/* entry name */
+    u_int d_dir;		/* directory it is in */
+    u_int d_ino;		/* what it refers to */
+    cookie3 d_cookie;		/* its READDIR cookie */
+    struct dent *d_next;	/* next entry of the directory */
+    struct dent *d_prev;	/* previous one */
+    struct dent *d_hnext;	/* next entry in the same bucket */
+};
+
+struct inode {
+    int i_used;			/* slot is in use */
+    ftype3 i_type;		/* file type */
+    mode3 i_mode;		/* permission bits */
+    u_int i_nlink;		/* number of links */
+    uid3 i_uid;			/* owner */
+    gid3 i_gid;			/* group */
+    char *i_data;		/* contents of a regular file */
+    size3 i_size;		/* its size */
+    size3 i_cap;		/* allocated size of i_data */
+    char *i_link;		/* target of a symbolic link */
+    specdata3 i_rdev;		/* device numbers */
+    u_int i_parent;		/* parent of a directory */
+    struct dent *i_first;	/* entries of a directory */
+    struct dent *i_last;	/* its last entry */
+    cookie3 i_nextcookie;	/* cookie of the next entry */
+    struct dent *i_hint;	/* last entry the last READDIR returned */
+    nfstime3 i_atime;		/* time of last access */
+    nfstime3 i_mtime;		/* time of last modification */
+    nfstime3 i_ctime;		/* time of last change */
+};
+
+/*
+ * A service, as the portmapper knows it
+ */
+struct reg {
+    u_long r_prog;		/* program */
+    u_long r_vers;		/* version */
+    u_long r_prot;		/* IPPROTO_UDP or IPPROTO_TCP */
+    u_short r_port;		/* port, host order */
+};
+
+/*
+ * A reply that is held back until it is due
+ */
+struct held {
+    struct timespec h_due;	/* when to send it */
+    int h_fd;			/* socket to send it on */
+    int h_stream;		/* a TCP connection, not a UDP socket */
+    struct sockaddr_storage h_addr; /* where a UDP reply goes */
+    socklen_t h_addrlen;	/* length of h_addr */
+    char *h_data;		/* the reply as it goes on the wire */
+    size_t h_len;		/* its length */
+    struct held *h_next;	/* next one due */
+};
+
+struct mounted {
+    char *m_host;		/* client */
+    char *m_dir;		/* what it mounted */
+    struct mounted *m_next;
+};
+
+static long delay;		/* microseconds every reply is held */
+static int loss;		/* percentage of idempotent replies dropped */
+static int stable;		/* report all writes as FILE_SYNC */
+static int noplus;		/* no READDIRPLUS */
+static u_int rtmax = MEMFS_XFER; /* largest READ */
+static u_int wtmax = MEMFS_XFER; /* largest WRITE */
+static char *exportpath = "/export"; /* name of the file system */
+static u_int32_t generation;	/* in every handle, differs per run */
+static char writeverf[NFS3_WRITEVERFSIZE]; /* write verifier */
+
+static char *arena;		/* pieces of the reply being built */
+static size_t arenaused;	/* bytes of it in use */
+static struct inode *inodes;	/* the inode table, slot 0 unused */
+static u_int ninodes;		/* slots in use or freed */
+static u_int maxinodes;		/* slots allocated */
+static u_int rootino;		/* inode of the root */
+static struct dent *names[MEMFS_HASH]; /* the name table */
+static struct mounted *mounted;	/* what DUMP reports */
+
+static struct reg regs[MEMFS_NREGS]; /* services */
+static int nregs;
+static int pmapself;		/* memfs is the portmapper */
+static volatile sig_atomic_t stopped; /* asked to stop */
+
+static struct held *heldfirst;	/* replies being held, oldest first */
+static struct held *heldlast;	/* the newest one */
+static int streamsink = -1;	/* file TCP replies are encoded into */
+static int dgramsink = -1;	/* socket UDP replies are sent to */
+static struct sockaddr_in dgramsinkaddr; /* its address */
+
+static void *alloc(size_t);
+static char *astrdup(char *);
+static void begin(void *, size_t);
+static int lose(void);
+static nfstime3 now3(void);
+static u_int newinode(ftype3, mode3, u_int);
+static void freeinode(u_int);
+static void mkhandle(nfs_fh3 *, u_int);
+static struct inode *getinode(nfs_fh3 *, u_int *);
+static void getattr(fattr3 *, u_int);
+static void postop(post_op_attr *, u_int);
+static void wcc(wcc_data *, u_int);
+static void setattr(u_int, sattr3 *);
+static u_int namehash(u_int, char *);
+static struct dent *dlookup(u_int, char *);
+static void denter(u_int, char *, u_int);
+static void dremove(u_int, struct dent *);
+static nfsstat3 mkobject(diropargs3 *, ftype3, sattr3 *, int, u_int *,
+    u_int *);
+static nfsstat3 rmobject(diropargs3 *, int, u_int *);
+static void pmap_program(struct svc_req *, SVCXPRT *);
+static SVCXPRT *service(int, u_long, u_long,
+    void (*)(struct svc_req *, SVCXPRT *));
+static void stop(int);
+static void mksinks(void);
+static int sendheld(void);
+
+int
+main(int argc, char **argv)
+{
+    struct pollfd *fds = NULL;
+    int i, n, opt, nfds = 0;
+    struct timeval tv;
+
+    while ((opt = getopt(argc, argv, "d:e:l:pr:sw:")) != EOF) {
+	switch (opt) {
+	case 'd':
+	    delay = atol(optarg);
+	    break;
+	case 'e':
+	    exportpath = optarg;
+	    break;
+	case 'l':
+	    loss = atoi(optarg);
+	    break;
+	case 'p':
+	    noplus = 1;
+	    break;
+	case 'r':
+	    rtmax = atoi(optarg);
+	    break;
+	case 's':
+	    stable = 1;
+	    break;
+	case 'w':
+	    wtmax = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-ps] [-d <delay-us>] [-l <loss-%%>] "
+		"[-r <rtmax>] [-w <wtmax>] [-e <export>]\n"
+		"\t-d\thold every reply this many microseconds\n"
+		"\t-l\tdrop this percentage of replies to idempotent calls\n"
+		"\t-p\tno READDIRPLUS\n"
+		"\t-s\tcommit every write right away\n"
+		"\t-r\tlargest READ\n"
+		"\t-w\tlargest WRITE\n"
+		"\t-e\tname of the exported file system\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (rtmax == 0 || wtmax == 0 || loss < 0 || loss > 100) {
+	fprintf(stderr, "memfs: bad option value\n");
+	exit(1);
+    }
+
+    gettimeofday(&tv, NULL);
+    generation = tv.tv_sec ^ tv.tv_usec;
+    memcpy(writeverf, &generation, sizeof(generation));
+    srandom(generation);
+    if ((arena = malloc(MEMFS_ARENA)) == NULL) {
+	fprintf(stderr, "memfs: out of memory\n");
+	exit(1);
+    }
+    ninodes = 1;
+    rootino = newinode(NF3DIR, 0777, 0);
+    inodes[rootino].i_parent = rootino;
+
+    (void) service(SOCK_DGRAM, NFS_PROGRAM, NFS_V3, nfs_program_3);
+    (void) service(SOCK_STREAM, NFS_PROGRAM, NFS_V3, nfs_program_3);
+    (void) service(SOCK_DGRAM, MOUNT_PROGRAM, MOUNT_V3, mount_program_3);
+    (void) service(SOCK_STREAM, MOUNT_PROGRAM, MOUNT_V3, mount_program_3);
+
+    /* tell the portmapper, or be one */
+    for (i = 0; i < nregs; i++) {
+	(void) pmap_unset(regs[i].r_prog, regs[i].r_vers);
+	if (!pmap_set(regs[i].r_prog, regs[i].r_vers, regs[i].r_prot,
+	  regs[i].r_port))
+	    break;
+    }
+    if (i < nregs) {
+	pmapself = 1;
+	(void) service(SOCK_DGRAM, PMAPPROG, PMAPVERS, pmap_program);
+	(void) service(SOCK_STREAM, PMAPPROG, PMAPVERS, pmap_program);
+    }
+
+    if (delay > 0)
+	mksinks();
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    signal(SIGPIPE, SIG_IGN);
+    while (!stopped) {
+	if (nfds < svc_max_pollfd) {
+	    nfds = svc_max_pollfd;
+	    if ((fds = realloc(fds, nfds * sizeof(*fds))) == NULL) {
+		fprintf(stderr, "memfs: out of memory\n");
+		break;
+	    }
+	}
+	memcpy(fds, svc_pollfd, svc_max_pollfd * sizeof(*fds));
+	if ((n = poll(fds, svc_max_pollfd, sendheld())) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    perror("memfs: poll");
+	    break;
+	}
+	if (n > 0)
+	    svc_getreq_poll(fds, n);
+    }
+    if (!pmapself)
+	for (i = 0; i < nregs; i++)
+	    (void) pmap_unset(regs[i].r_prog, regs[i].r_vers);
+    return 0;
+}
+
+static void
+stop(int signo)
+{
+    stopped = 1;
+}
+
+/*
+ * Create and register a UDP or TCP service on the loopback interface.
+ * Only the portmapper has a fixed port.
+ */
+static SVCXPRT *
+service(int type, u_long prog, u_long vers,
+    void (*dispatch)(struct svc_req *, SVCXPRT *))
+{
+    struct sockaddr_in sin;
+    socklen_t len;
+    SVCXPRT *xprt;
+    int s, on = 1, size = MEMFS_SOCKBUF;
+
+    if ((s = socket(AF_INET, type, 0)) < 0) {
+	perror("memfs: socket");
+	exit(1);
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (prog == PMAPPROG) {
+	sin.sin_port = htons(PMAPPORT);
+	(void) setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if (bind(s, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+	perror(prog == PMAPPROG ? "memfs: portmapper" : "memfs: bind");
+	exit(1);
+    }
+    len = sizeof(sin);
+    (void) getsockname(s, (struct sockaddr *) &sin, &len);
+    if (type == SOCK_DGRAM) {
+	(void) setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	(void) setsockopt(s, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	xprt = svcudp_bufcreate(s, MEMFS_UDPBUF, MEMFS_UDPBUF);
+    } else {
+	(void) listen(s, SOMAXCONN);
+	xprt = svctcp_create(s, MEMFS_TCPBUF, MEMFS_TCPBUF);
+    }
+    if (xprt == NULL || !svc_register(xprt, prog, vers, dispatch, 0)) {
+	fprintf(stderr, "memfs: cannot create service\n");
+	exit(1);
+    }
+    if (nregs < MEMFS_NREGS) {
+	regs[nregs].r_prog = prog;
+	regs[nregs].r_vers = vers;
+	regs[nregs].r_prot = type == SOCK_DGRAM ? IPPROTO_UDP : IPPROTO_TCP;
+	regs[nregs].r_port = ntohs(sin.sin_port);
+	nregs++;
+    }
+    return xprt;
+}
+
+/*
+ * Held replies. A reply is not sent by the dispatch routine but
+ * encoded by the RPC library into a sink, a scratch file for TCP and
+ * a socket of our own for UDP, and queued with the time it is due.
+ * The poll loop sends it then and takes new calls in the meantime,
+ * so a client with many calls in flight waits one delay for all of
+ * them, not one delay per call.
+ */
+static void
+mksinks(void)
+{
+    socklen_t len = sizeof(dgramsinkaddr);
+    FILE *fp;
+    int size = MEMFS_SOCKBUF;
+
+    if ((fp = tmpfile()) == NULL || (streamsink = dup(fileno(fp))) < 0) {
+	perror("memfs: tmpfile");
+	exit(1);
+    }
+    fclose(fp);
+    memset(&dgramsinkaddr, 0, sizeof(dgramsinkaddr));
+    dgramsinkaddr.sin_family = AF_INET;
+    dgramsinkaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((dgramsink = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+      bind(dgramsink, (struct sockaddr *) &dgramsinkaddr, len) < 0 ||
+      getsockname(dgramsink, (struct sockaddr *) &dgramsinkaddr, &len) < 0) {
+	perror("memfs: sink");
+	exit(1);
+    }
+    (void) setsockopt(dgramsink, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+static bool_t
+holdreply(SVCXPRT *xprt, xdrproc_t proc, void *res)
+{
+    struct sockaddr_storage addr;
+    struct held *hp;
+    struct netbuf *nb;
+    int stream, fd, type;
+    socklen_t len = sizeof(type);
+    bool_t ok;
+    ssize_t n;
+    off_t end;
+
+    if (delay <= 0)
+	return svc_sendreply(xprt, proc, res);
+    if (getsockopt(xprt->xp_fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+	return FALSE;
+    stream = type == SOCK_STREAM;
+    if ((hp = (struct held *) malloc(sizeof(*hp))) == NULL)
+	return FALSE;
+    memset(hp, 0, sizeof(*hp));
+
+    /* let the library encode the reply into the sink */
+    fd = xprt->xp_fd;
+    xprt->xp_fd = stream ? streamsink : dgramsink;
+    nb = svc_getrpccaller(xprt);
+    if (!stream) {
+	if (nb->len > sizeof(addr) || nb->maxlen < sizeof(dgramsinkaddr)) {
+	    xprt->xp_fd = fd;
+	    free(hp);
+	    return svc_sendreply(xprt, proc, res);
+	}
+	hp->h_addrlen = nb->len;
+	memcpy(&hp->h_addr, nb->buf, nb->len);
+	memcpy(nb->buf, &dgramsinkaddr, sizeof(dgramsinkaddr));
+	nb->len = sizeof(dgramsinkaddr);
+    }
+    ok = svc_sendreply(xprt, proc, res);
+    xprt->xp_fd = fd;
+    if (!stream) {
+	memcpy(nb->buf, &hp->h_addr, hp->h_addrlen);
+	nb->len = hp->h_addrlen;
+    }
+    if (!ok) {
+	free(hp);
+	return FALSE;
+    }
+
+    /* take it back out */
+    if (stream) {
+	if ((end = lseek(streamsink, 0, SEEK_CUR)) <= 0 ||
+	  (hp->h_data = malloc(end)) == NULL ||
+	  pread(streamsink, hp->h_data, end, 0) != end)
+	    n = -1;
+	else
+	    n = end;
+	(void) ftruncate(streamsink, 0);
+	(void) lseek(streamsink, 0, SEEK_SET);
+    } else if ((hp->h_data = malloc(MEMFS_UDPBUF)) == NULL)
+	n = -1;
+    else
+	n = recv(dgramsink, hp->h_data, MEMFS_UDPBUF, 0);
+    if (n <= 0) {
+	free(hp->h_data);
+	free(hp);
+	return FALSE;
+    }
+    hp->h_len = n;
+    hp->h_fd = fd;
+    hp->h_stream = stream;
+    clock_gettime(CLOCK_MONOTONIC, &hp->h_due);
+    hp->h_due.tv_sec += delay / 1000000;
+    hp->h_due.tv_nsec += (delay % 1000000) * 1000;
+    if (hp->h_due.tv_nsec >= 1000000000) {
+	hp->h_due.tv_sec++;
+	hp->h_due.tv_nsec -= 1000000000;
+    }
+    if (heldlast != NULL)
+	heldlast->h_next = hp;
+    else
+	heldfirst = hp;
+    heldlast = hp;
+    return TRUE;
+}
+
+/*
+ * Send the held replies that are due. Returns the poll timeout until
+ * the next one is, in milliseconds, or -1 when none is held.
+ */
+static int
+sendheld(void)
+{
+    struct timespec now;
+    struct held *hp;
+    long long left;
+    size_t off;
+    ssize_t n;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while ((hp = heldfirst) != NULL) {
+	left = (hp->h_due.tv_sec - now.tv_sec) * 1000000LL +
+	    (hp->h_due.tv_nsec - now.tv_nsec) / 1000;
+	if (left > 0)
+	    return (int) ((left + 999) / 1000);
+	if (hp->h_stream) {
+	    for (off = 0; off < hp->h_len; off += n) {
+		if ((n = write(hp->h_fd, hp->h_data + off, hp->h_len - off)) < 0) {
+		    if (errno != EINTR)
+			break;
+		    n = 0;
+		}
+	    }
+	} else
+	    (void) sendto(hp->h_fd, hp->h_data, hp->h_len, 0,
+		(struct sockaddr *) &hp->h_addr, hp->h_addrlen);
+	if ((heldfirst = hp->h_next) == NULL)
+	    heldlast = NULL;
+	free(hp->h_data);
+	free(hp);
+    }
+    return -1;
+}
+
+/*
+ * The portmapper, for when there is no other one. It only knows
+ * about memfs's own services.
+ */
+static void
+pmap_program(struct svc_req *rqstp, SVCXPRT *transp)
+{
+    struct pmap map;
+    u_long port = 0;
+    bool_t ok = TRUE;
+    int i;
+
+    switch (rqstp->rq_proc) {
+    case PMAPPROC_NULL:
+	(void) svc_sendreply(transp, (xdrproc_t) xdr_void, NULL);
+	return;
+    case PMAPPROC_SET:
+    case PMAPPROC_UNSET:
+	(void) svc_sendreply(transp, (xdrproc_t) xdr_bool, (caddr_t) &ok);
+	return;
+    case PMAPPROC_GETPORT:
+	memset(&map, 0, sizeof(map));
+	if (!svc_getargs(transp, (xdrproc_t) xdr_pmap, (caddr_t) &map)) {
+	    svcerr_decode(transp);
+	    return;
+	}
+	for (i = 0; i < nregs; i++) {
+	    if (regs[i].r_prog == map.pm_prog &&
+	      regs[i].r_vers == map.pm_vers && regs[i].r_prot == map.pm_prot) {
+		port = regs[i].r_port;
+		break;
+	    }
+	}
+	(void) svc_sendreply(transp, (xdrproc_t) xdr_u_long, (caddr_t) &port);
+	return;
+    default:
+	svcerr_noproc(transp);
+	return;
+    }
+}
+
+/*
+ * Replies are built from pieces of the arena, which is reused for
+ * every call. The rpcgen dispatch routines leave the result
+ * uninitialized, so every procedure clears it first.
+ */
+static void *
+alloc(size_t n)
+{
+    void *p;
+
+    n = (n + 7) & ~(size_t) 7;
+    if (arenaused + n > MEMFS_ARENA) {
+	fprintf(stderr, "memfs: reply too large\n");
+	exit(1);
+    }
+    p = arena + arenaused;
+    arenaused += n;
+    memset(p, 0, n);
+    return p;
+}
+
+static char *
+astrdup(char *s)
+{
+    return strcpy(alloc(strlen(s) + 1), s);
+}
+
+static void
+begin(void *res, size_t size)
+{
+    arenaused = 0;
+    if (res != NULL)
+	memset(res, 0, size);
+}
+
+/*
+ * Whether to drop the reply of an idempotent call
+ */
+static int
+lose(void)
+{
+    return loss > 0 && random() % 100 < loss;
+}
+
+static nfstime3
+now3(void)
+{
+    struct timeval tv;
+    nfstime3 t;
+
+    gettimeofday(&tv, NULL);
+    t.seconds = tv.tv_sec;
+    t.nseconds = tv.tv_usec * 1000;
+    return t;
+}
+
+static u_int
+newinode(ftype3 type, mode3 mode, u_int parent)
+{
+    struct inode *ip;
+    u_int ino;
+
+    for (ino = 1; ino < ninodes; ino++)
+	if (!inodes[ino].i_used)
+	    break;
+    if (ino == ninodes) {
+	if (ninodes >= maxinodes) {
+	    maxinodes = maxinodes ? 2 * maxinodes : 1024;
+	    inodes = realloc(inodes, maxinodes * sizeof(*inodes));
+	    if (inodes == NULL) {
+		fprintf(stderr, "memfs: out of memory\n");
+		exit(1);
+	    }
+	}
+	ninodes++;
+    }
+    ip = &inodes[ino];
+    memset(ip, 0, sizeof(*ip));
+    ip->i_used = 1;
+    ip->i_type = type;
+    ip->i_mode = mode;
+    ip->i_nlink = type == NF3DIR ? 2 : 1;
+    ip->i_parent = parent;
+    ip->i_nextcookie = 3;	/* after "." and ".." */
+    ip->i_atime = ip->i_mtime = ip->i_ctime = now3();
+    return ino;
+}
+
+static void
+freeinode(u_int ino)
+{
+    struct inode *ip = &inodes[ino];
+
+    free(ip->i_data);
+    free(ip->i_link);
+    ip->i_used = 0;
+}
+
+/*
+ * A handle is the inode number and the generation of this run
+ */
+static void
+mkhandle(nfs_fh3 *fh, u_int ino)
+{
+    u_int32_t v[2];
+
+    v[0] = htonl(ino);
+    v[1] = htonl(generation);
+    fh->data.data_len = sizeof(v);
+    memcpy(fh->data.data_val, v, sizeof(v));
+}
+
+static struct inode *
+getinode(nfs_fh3 *fh, u_int *inop)
+{
+    u_int32_t v[2];
+    u_int ino;
+
+    if (fh->data.data_len != sizeof(v))
+	return NULL;
+    memcpy(v, fh->data.data_val, sizeof(v));
+    ino = ntohl(v[0]);
+    if (ntohl(v[1]) != generation || ino == 0 || ino >= ninodes ||
+      !inodes[ino].i_used)
+	return NULL;
+    if (inop != NULL)
+	*inop = ino;
+    return &inodes[ino];
+}
+
+static void
+getattr(fattr3 *attr, u_int ino)
+{
+    struct inode *ip = &inodes[ino];
+
+    attr->type = ip->i_type;
+    attr->mode = ip->i_mode & 07777;
+    attr->nlink = ip->i_nlink;
+    attr->uid = ip->i_uid;
+    attr->gid = ip->i_gid;
+    attr->size = ip->i_type == NF3LNK ? strlen(ip->i_link) : ip->i_size;
+    attr->used = ip->i_cap;
+    attr->rdev = ip->i_rdev;
+    attr->fsid = 1;
+    attr->fileid = ino;
+    attr->atime = ip->i_atime;
+    attr->mtime = ip->i_mtime;
+    attr->ctime = ip->i_ctime;
+}
+
+static void
+postop(post_op_attr *attr, u_int ino)
+{
+    attr->attributes_follow = TRUE;
+    getattr(&attr->post_op_attr_u.attributes, ino);
+}
+
+static void
+wcc(wcc_data *w, u_int ino)
+{
+    w->before.attributes_follow = FALSE;
+    postop(&w->after, ino);
+}
+
+static void
+setattr(u_int ino, sattr3 *sa)
+{
+    struct inode *ip = &inodes[ino];
+    size3 size;
+
+    if (sa->mode.set_it)
+	ip->i_mode = sa->mode.set_mode3_u.mode;
+    if (sa->uid.set_it)
+	ip->i_uid = sa->uid.set_uid3_u.uid;
+    if (sa->gid.set_it)
+	ip->i_gid = sa->gid.set_gid3_u.gid;
+    if (sa->size.set_it && ip->i_type == NF3REG) {
+	size = sa->size.set_size3_u.size;
+	if (size > ip->i_cap) {
+	    if ((ip->i_data = realloc(ip->i_data, size)) == NULL) {
+		fprintf(stderr, "memfs: out of memory\n");
+		exit(1);
+	    }
+	    ip->i_cap = size;
+	}
+	if (size > ip->i_size)
+	    memset(ip->i_data + ip->i_size, 0, size - ip->i_size);
+	ip->i_size = size;
+	ip->i_mtime = now3();
+    }
+    if (sa->atime.set_it == SET_TO_CLIENT_TIME)
+	ip->i_atime = sa->atime.set_atime_u.atime;
+    else if (sa->atime.set_it == SET_TO_SERVER_TIME)
+	ip->i_atime = now3();
+    if (sa->mtime.set_it == SET_TO_CLIENT_TIME)
+	ip->i_mtime = sa->mtime.set_mtime_u.mtime;
+    else if (sa->mtime.set_it == SET_TO_SERVER_TIME)
+	ip->i_mtime = now3();
+    ip->i_ctime = now3();
+}
+
+static u_int
+namehash(u_int dir, char *name)
+{
+    u_int h = 2166136261U ^ dir;
+
+    while (*name)
+	h = (h ^ (unsigned char) *name++) * 16777619U;
+    return h & (MEMFS_HASH - 1);
+}
+
+static struct dent *
+dlookup(u_int dir, char *name)
+{
+    struct dent *d;
+
+    for (d = names[namehash(dir, name)]; d != NULL; d = d->d_hnext)
+	if (d->d_dir == dir && strcmp(d->d_name, name) == 0)
+	    return d;
+    return NULL;
+}
+
+static void
+denter(u_int dir, char *name, u_int ino)
+{
+    struct inode *dp = &inodes[dir];
+    struct dent *d;
+    u_int h;
+
+    if ((d = malloc(sizeof(*d))) == NULL ||
+      (d->d_name = strdup(name)) == NULL) {
+	fprintf(stderr, "memfs: out of memory\n");
+	exit(1);
+    }
+    d->d_dir = dir;
+    d->d_ino = ino;
+    d->d_cookie = dp->i_nextcookie++;
+    d->d_next = NULL;
+    if ((d->d_prev = dp->i_last) != NULL)
+	dp->i_last->d_next = d;
+    else
+	dp->i_first = d;
+    dp->i_last = d;
+    h = namehash(dir, name);
+    d->d_hnext = names[h];
+    names[h] = d;
+    dp->i_mtime = dp->i_ctime = now3();
+}
+
+static void
+dremove(u_int dir, struct dent *d)
+{
+    struct inode *dp = &inodes[dir];
+    struct dent **dpp;
+
+    for (dpp = &names[namehash(dir, d->d_name)]; *dpp != d;
+      dpp = &(*dpp)->d_hnext)
+	;
+    *dpp = d->d_hnext;
+    if (d->d_prev != NULL)
+	d->d_prev->d_next = d->d_next;
+    else
+	dp->i_first = d->d_next;
+    if (d->d_next != NULL)
+	d->d_next->d_prev = d->d_prev;
+    else
+	dp->i_last = d->d_prev;
+    if (dp->i_hint == d)
+	dp->i_hint = NULL;
+    free(d->d_name);
+    free(d);
+    dp->i_mtime = dp->i_ctime = now3();
+}
+
+/*
+ * Drop a link to an inode, which goes when the last one does
+ */
+static void
+unlinkinode(u_int ino)
+{
+    struct inode *ip = &inodes[ino];
+
+    if (ip->i_type == NF3DIR || --ip->i_nlink == 0)
+	freeinode(ino);
+    else
+	ip->i_ctime = now3();
+}
+
+/*
+ * Make a new object in a directory. An existing regular file is
+ * fine unless the create is exclusive.
+ */
+static nfsstat3
+mkobject(diropargs3 *where, ftype3 type, sattr3 *sa, int excl, u_int *inop,
+    u_int *dirp)
+{
+    struct inode *dp;
+    struct dent *d;
+    u_int dir, ino;
+
+    if ((dp = getinode(&where->dir, &dir)) == NULL)
+	return NFS3ERR_STALE;
+    if (dp->i_type != NF3DIR)
+	return NFS3ERR_NOTDIR;
+    *dirp = dir;
+    if (strlen(where->name) == 0 || strchr(where->name, '/') != NULL ||
+      strcmp(where->name, ".") == 0 || strcmp(where->name, "..") == 0)
+	return NFS3ERR_INVAL;
+    if ((d = dlookup(dir, where->name)) != NULL) {
+	if (excl || type != NF3REG || inodes[d->d_ino].i_type != NF3REG)
+	    return NFS3ERR_EXIST;
+	*inop = d->d_ino;
+	if (sa != NULL)
+	    setattr(d->d_ino, sa);
+	return NFS3_OK;
+    }
+    ino = newinode(type, type == NF3DIR ? 0755 : 0644, dir);
+    if (sa != NULL)
+	setattr(ino, sa);
+    denter(dir, where->name, ino);
+    if (type == NF3DIR)
+	inodes[dir].i_nlink++;
+    *inop = ino;
+    return NFS3_OK;
+}
+
+static nfsstat3
+rmobject(diropargs3 *what, int isdir, u_int *dirp)
+{
+    struct inode *ip;
+    struct dent *d;
+    u_int dir, ino;
+
+    if (getinode(&what->dir, &dir) == NULL)
+	return NFS3ERR_STALE;
+    *dirp = dir;
+    if ((d = dlookup(dir, what->name)) == NULL)
+	return NFS3ERR_NOENT;
+    ino = d->d_ino;
+    ip = &inodes[ino];
+    if (isdir && ip->i_type != NF3DIR)
+	return NFS3ERR_NOTDIR;
+    if (!isdir && ip->i_type == NF3DIR)
+	return NFS3ERR_ISDIR;
+    if (isdir && ip->i_first != NULL)
+	return NFS3ERR_NOTEMPTY;
+    dremove(dir, d);
+    if (isdir)
+	inodes[dir].i_nlink--;
+    unlinkinode(ino);
+    return NFS3_OK;
+}
+
+/*
+ * NFS version 3
+ */
+bool_t
+nfs3_null_3_svc(void *argp, void *result, struct svc_req *rqstp)
+{
+    begin(NULL, 0);
+    return TRUE;
+}
+
+bool_t
+nfs3_getattr_3_svc(GETATTR3args *argp, GETATTR3res *result,
+    struct svc_req *rqstp)
+{
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if (getinode(&argp->object, &ino) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    getattr(&result->GETATTR3res_u.resok.obj_attributes, ino);
+    return TRUE;
+}
+
+bool_t
+nfs3_setattr_3_svc(SETATTR3args *argp, SETATTR3res *result,
+    struct svc_req *rqstp)
+{
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (getinode(&argp->object, &ino) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    setattr(ino, &argp->new_attributes);
+    result->status = NFS3_OK;
+    wcc(&result->SETATTR3res_u.resok.obj_wcc, ino);
+    return TRUE;
+}
+
+bool_t
+nfs3_lookup_3_svc(LOOKUP3args *argp, LOOKUP3res *result,
+    struct svc_req *rqstp)
+{
+    struct inode *dp;
+    struct dent *d;
+    u_int dir, ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if ((dp = getinode(&argp->what.dir, &dir)) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    if (dp->i_type != NF3DIR) {
+	result->status = NFS3ERR_NOTDIR;
+	return TRUE;
+    }
+    if (strcmp(argp->what.name, ".") == 0)
+	ino = dir;
+    else if (strcmp(argp->what.name, "..") == 0)
+	ino = dp->i_parent;
+    else if ((d = dlookup(dir, argp->what.name)) != NULL)
+	ino = d->d_ino;
+    else {
+	result->status = NFS3ERR_NOENT;
+	postop(&result->LOOKUP3res_u.resfail.dir_attributes, dir);
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    mkhandle(&result->LOOKUP3res_u.resok.object, ino);
+    postop(&result->LOOKUP3res_u.resok.obj_attributes, ino);
+    postop(&result->LOOKUP3res_u.resok.dir_attributes, dir);
+    return TRUE;
+}
+
+bool_t
+nfs3_access_3_svc(ACCESS3args *argp, ACCESS3res *result,
+    struct svc_req *rqstp)
+{
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if (getinode(&argp->object, &ino) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    postop(&result->ACCESS3res_u.resok.obj_attributes, ino);
+    result->ACCESS3res_u.resok.access = argp->access;
+    return TRUE;
+}
+
+bool_t
+nfs3_readlink_3_svc(READLINK3args *argp, READLINK3res *result,
+    struct svc_req *rqstp)
+{
+    struct inode *ip;
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if ((ip = getinode(&argp->symlink, &ino)) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    if (ip->i_type != NF3LNK) {
+	result->status = NFS3ERR_INVAL;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    postop(&result->READLINK3res_u.resok.symlink_attributes, ino);
+    result->READLINK3res_u.resok.data = astrdup(ip->i_link);
+    return TRUE;
+}
+
+bool_t
+nfs3_read_3_svc(READ3args *argp, READ3res *result, struct svc_req *rqstp)
+{
+    struct inode *ip;
+    size3 n = 0;
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if ((ip = getinode(&argp->file, &ino)) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    if (ip->i_type != NF3REG) {
+	result->status = NFS3ERR_INVAL;
+	return TRUE;
+    }
+    if (argp->offset < ip->i_size)
+	n = MIN(ip->i_size - argp->offset, MIN(argp->count, rtmax));
+    ip->i_atime = now3();
+    result->status = NFS3_OK;
+    postop(&result->READ3res_u.resok.file_attributes, ino);
+    result->READ3res_u.resok.count = n;
+    result->READ3res_u.resok.eof = argp->offset + n >= ip->i_size;
+    result->READ3res_u.resok.data.data_len = n;
+    result->READ3res_u.resok.data.data_val = ip->i_data + argp->offset;
+    return TRUE;
+}
+
+bool_t
+nfs3_write_3_svc(WRITE3args *argp, WRITE3res *result, struct svc_req *rqstp)
+{
+    struct inode *ip;
+    size3 end, cap;
+    u_int ino, n;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if ((ip = getinode(&argp->file, &ino)) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    if (ip->i_type != NF3REG) {
+	result->status = NFS3ERR_INVAL;
+	return TRUE;
+    }
+    n = MIN(argp->data.data_len, argp->count);
+    end = argp->offset + n;
+    if (end > ip->i_cap) {
+	for (cap = ip->i_cap ? ip->i_cap : 65536; cap < end; cap *= 2)
+	    ;
+	if ((ip->i_data = realloc(ip->i_data, cap)) == NULL) {
+	    fprintf(stderr, "memfs: out of memory\n");
+	    exit(1);
+	}
+	ip->i_cap = cap;
+    }
+    if (argp->offset > ip->i_size)
+	memset(ip->i_data + ip->i_size, 0, argp->offset - ip->i_size);
+    memcpy(ip->i_data + argp->offset, argp->data.data_val, n);
+    if (end > ip->i_size)
+	ip->i_size = end;
+    ip->i_mtime = ip->i_ctime = now3();
+    result->status = NFS3_OK;
+    wcc(&result->WRITE3res_u.resok.file_wcc, ino);
+    result->WRITE3res_u.resok.count = n;
+    result->WRITE3res_u.resok.committed = stable ? FILE_SYNC : argp->stable;
+    memcpy(result->WRITE3res_u.resok.verf, writeverf, NFS3_WRITEVERFSIZE);
+    return TRUE;
+}
+
+bool_t
+nfs3_create_3_svc(CREATE3args *argp, CREATE3res *result,
+    struct svc_req *rqstp)
+{
+    u_int ino, dir = 0;
+
+    begin(result, sizeof(*result));
+    result->status = mkobject(&argp->where, NF3REG,
+	argp->how.mode == EXCLUSIVE ? NULL :
+	&argp->how.createhow3_u.obj_attributes,
+	argp->how.mode != UNCHECKED, &ino, &dir);
+    if (result->status != NFS3_OK) {
+	if (dir != 0)
+	    wcc(&result->CREATE3res_u.resfail.dir_wcc, dir);
+	return TRUE;
+    }
+    result->CREATE3res_u.resok.obj.handle_follows = TRUE;
+    mkhandle(&result->CREATE3res_u.resok.obj.post_op_fh3_u.handle, ino);
+    postop(&result->CREATE3res_u.resok.obj_attributes, ino);
+    wcc(&result->CREATE3res_u.resok.dir_wcc, dir);
+    return TRUE;
+}
+
+bool_t
+nfs3_mkdir_3_svc(MKDIR3args *argp, MKDIR3res *result, struct svc_req *rqstp)
+{
+    u_int ino, dir = 0;
+
+    begin(result, sizeof(*result));
+    result->status = mkobject(&argp->where, NF3DIR, &argp->attributes, 1,
+	&ino, &dir);
+    if (result->status != NFS3_OK) {
+	if (dir != 0)
+	    wcc(&result->MKDIR3res_u.resfail.dir_wcc, dir);
+	return TRUE;
+    }
+    result->MKDIR3res_u.resok.obj.handle_follows = TRUE;
+    mkhandle(&result->MKDIR3res_u.resok.obj.post_op_fh3_u.handle, ino);
+    postop(&result->MKDIR3res_u.resok.obj_attributes, ino);
+    wcc(&result->MKDIR3res_u.resok.dir_wcc, dir);
+    return TRUE;
+}
+
+bool_t
+nfs3_symlink_3_svc(SYMLINK3args *argp, SYMLINK3res *result,
+    struct svc_req *rqstp)
+{
+    u_int ino, dir = 0;
+
+    begin(result, sizeof(*result));
+    result->status = mkobject(&argp->where, NF3LNK,
+	&argp->symlink.symlink_attributes, 1, &ino, &dir);
+    if (result->status != NFS3_OK) {
+	if (dir != 0)
+	    wcc(&result->SYMLINK3res_u.resfail.dir_wcc, dir);
+	return TRUE;
+    }
+    if ((inodes[ino].i_link = strdup(argp->symlink.symlink_data)) == NULL) {
+	fprintf(stderr, "memfs: out of memory\n");
+	exit(1);
+    }
+    inodes[ino].i_mode = 0777;
+    result->SYMLINK3res_u.resok.obj.handle_follows = TRUE;
+    mkhandle(&result->SYMLINK3res_u.resok.obj.post_op_fh3_u.handle, ino);
+    postop(&result->SYMLINK3res_u.resok.obj_attributes, ino);
+    wcc(&result->SYMLINK3res_u.resok.dir_wcc, dir);
+    return TRUE;
+}
+
+bool_t
+nfs3_mknod_3_svc(MKNOD3args *argp, MKNOD3res *result, struct svc_req *rqstp)
+{
+    mknoddata3 *what = &argp->what;
+    sattr3 *sa = NULL;
+    u_int ino, dir = 0;
+
+    begin(result, sizeof(*result));
+    switch (what->type) {
+    case NF3CHR:
+	sa = &what->mknoddata3_u.chr_device.dev_attributes;
+	break;
+    case NF3BLK:
+	sa = &what->mknoddata3_u.blk_device.dev_attributes;
+	break;
+    case NF3SOCK:
+	sa = &what->mknoddata3_u.sock_attributes;
+	break;
+    case NF3FIFO:
+	sa = &what->mknoddata3_u.pipe_attributes;
+	break;
+    default:
+	result->status = NFS3ERR_BADTYPE;
+	return TRUE;
+    }
+    result->status = mkobject(&argp->where, what->type, sa, 1, &ino, &dir);
+    if (result->status != NFS3_OK) {
+	if (dir != 0)
+	    wcc(&result->MKNOD3res_u.resfail.dir_wcc, dir);
+	return TRUE;
+    }
+    if (what->type == NF3CHR)
+	inodes[ino].i_rdev = what->mknoddata3_u.chr_device.spec;
+    else if (what->type == NF3BLK)
+	inodes[ino].i_rdev = what->mknoddata3_u.blk_device.spec;
+    result->MKNOD3res_u.resok.obj.handle_follows = TRUE;
+    mkhandle(&result->MKNOD3res_u.resok.obj.post_op_fh3_u.handle, ino);
+    postop(&result->MKNOD3res_u.resok.obj_attributes, ino);
+    wcc(&result->MKNOD3res_u.resok.dir_wcc, dir);
+    return TRUE;
+}
+
+bool_t
+nfs3_remove_3_svc(REMOVE3args *argp, REMOVE3res *result,
+    struct svc_req *rqstp)
+{
+    u_int dir = 0;
+
+    begin(result, sizeof(*result));
+    result->status = rmobject(&argp->object, 0, &dir);
+    if (dir != 0)
+	wcc(&result->REMOVE3res_u.resok.dir_wcc, dir);
+    return TRUE;
+}
+
+bool_t
+nfs3_rmdir_3_svc(RMDIR3args *argp, RMDIR3res *result, struct svc_req *rqstp)
+{
+    u_int dir = 0;
+
+    begin(result, sizeof(*result));
+    result->status = rmobject(&argp->object, 1, &dir);
+    if (dir != 0)
+	wcc(&result->RMDIR3res_u.resok.dir_wcc, dir);
+    return TRUE;
+}
+
+bool_t
+nfs3_rename_3_svc(RENAME3args *argp, RENAME3res *result,
+    struct svc_req *rqstp)
+{
+    struct inode *fp, *tp;
+    struct dent *d, *t;
+    u_int from, to, ino;
+
+    begin(result, sizeof(*result));
+    if ((fp = getinode(&argp->from.dir, &from)) == NULL ||
+      (tp = getinode(&argp->to.dir, &to)) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    if (fp->i_type != NF3DIR || tp->i_type != NF3DIR) {
+	result->status = NFS3ERR_NOTDIR;
+	return TRUE;
+    }
+    if ((d = dlookup(from, argp->from.name)) == NULL) {
+	result->status = NFS3ERR_NOENT;
+	return TRUE;
+    }
+    ino = d->d_ino;
+    if ((t = dlookup(to, argp->to.name)) != NULL) {
+	if (t == d) {
+	    result->status = NFS3_OK;
+	    return TRUE;
+	}
+	if (inodes[t->d_ino].i_type == NF3DIR &&
+	  inodes[t->d_ino].i_first != NULL) {
+	    result->status = NFS3ERR_NOTEMPTY;
+	    return TRUE;
+	}
+	if (inodes[t->d_ino].i_type == NF3DIR)
+	    inodes[to].i_nlink--;
+	unlinkinode(t->d_ino);
+	dremove(to, t);
+    }
+    dremove(from, d);
+    denter(to, argp->to.name, ino);
+    if (inodes[ino].i_type == NF3DIR && from != to) {
+	inodes[ino].i_parent = to;
+	inodes[from].i_nlink--;
+	inodes[to].i_nlink++;
+    }
+    result->status = NFS3_OK;
+    wcc(&result->RENAME3res_u.resok.fromdir_wcc, from);
+    wcc(&result->RENAME3res_u.resok.todir_wcc, to);
+    return TRUE;
+}
+
+bool_t
+nfs3_link_3_svc(LINK3args *argp, LINK3res *result, struct svc_req *rqstp)
+{
+    struct inode *ip, *dp;
+    u_int ino, dir;
+
+    begin(result, sizeof(*result));
+    if ((ip = getinode(&argp->file, &ino)) == NULL ||
+      (dp = getinode(&argp->link.dir, &dir)) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    if (ip->i_type == NF3DIR) {
+	result->status = NFS3ERR_ISDIR;
+	return TRUE;
+    }
+    if (dp->i_type != NF3DIR) {
+	result->status = NFS3ERR_NOTDIR;
+	return TRUE;
+    }
+    if (dlookup(dir, argp->link.name) != NULL) {
+	result->status = NFS3ERR_EXIST;
+	return TRUE;
+    }
+    denter(dir, argp->link.name, ino);
+    inodes[ino].i_nlink++;
+    inodes[ino].i_ctime = now3();
+    result->status = NFS3_OK;
+    postop(&result->LINK3res_u.resok.file_attributes, ino);
+    wcc(&result->LINK3res_u.resok.linkdir_wcc, dir);
+    return TRUE;
+}
+
+/*
+ * Where a listing continues after 'cookie'. Clients read a directory
+ * in order, so the entry the last one stopped at is remembered.
+ */
+static struct dent *
+resume(struct inode *dp, cookie3 cookie)
+{
+    struct dent *d;
+
+    if (cookie == 0)
+	return dp->i_first;
+    if (dp->i_hint != NULL && dp->i_hint->d_cookie == cookie)
+	return dp->i_hint->d_next;
+    for (d = dp->i_first; d != NULL && d->d_cookie <= cookie; d = d->d_next)
+	;
+    return d;
+}
+
+bool_t
+nfs3_readdir_3_svc(READDIR3args *argp, READDIR3res *result,
+    struct svc_req *rqstp)
+{
+    struct inode *dp;
+    struct dent *d, *last = NULL;
+    entry3 **epp, *ep;
+    u_int dir, size, used = 128;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if ((dp = getinode(&argp->dir, &dir)) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    if (dp->i_type != NF3DIR) {
+	result->status = NFS3ERR_NOTDIR;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    postop(&result->READDIR3res_u.resok.dir_attributes, dir);
+    epp = &result->READDIR3res_u.resok.reply.entries;
+    for (d = resume(dp, argp->cookie); d != NULL; d = d->d_next) {
+	size = 24 + RNDUP(strlen(d->d_name));
+	if (used + size > argp->count && last != NULL)
+	    break;
+	ep = alloc(sizeof(*ep));
+	ep->fileid = d->d_ino;
+	ep->name = astrdup(d->d_name);
+	ep->cookie = d->d_cookie;
+	*epp = ep;
+	epp = &ep->nextentry;
+	used += size;
+	last = d;
+    }
+    if (last != NULL)
+	dp->i_hint = last;
+    result->READDIR3res_u.resok.reply.eof = d == NULL;
+    return TRUE;
+}
+
+bool_t
+nfs3_readdirplus_3_svc(READDIRPLUS3args *argp, READDIRPLUS3res *result,
+    struct svc_req *rqstp)
+{
+    struct inode *dp;
+    struct dent *d, *last = NULL;
+    entryplus3 **epp, *ep;
+    u_int dir, size, dsize, used = 128, dused = 0;
+
+    begin(result, sizeof(*result));
+    if (noplus) {
+	result->status = NFS3ERR_NOTSUPP;
+	return TRUE;
+    }
+    if (lose())
+	return FALSE;
+    if ((dp = getinode(&argp->dir, &dir)) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    if (dp->i_type != NF3DIR) {
+	result->status = NFS3ERR_NOTDIR;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    postop(&result->READDIRPLUS3res_u.resok.dir_attributes, dir);
+    epp = &result->READDIRPLUS3res_u.resok.reply.entries;
+    for (d = resume(dp, argp->cookie); d != NULL; d = d->d_next) {
+	dsize = 24 + RNDUP(strlen(d->d_name));
+	size = dsize + 88 + 16;	/* attributes and handle */
+	if ((used + size > argp->maxcount || dused + dsize > argp->dircount) &&
+	  last != NULL)
+	    break;
+	ep = alloc(sizeof(*ep));
+	ep->fileid = d->d_ino;
+	ep->name = astrdup(d->d_name);
+	ep->cookie = d->d_cookie;
+	postop(&ep->name_attributes, d->d_ino);
+	ep->name_handle.handle_follows = TRUE;
+	mkhandle(&ep->name_handle.post_op_fh3_u.handle, d->d_ino);
+	*epp = ep;
+	epp = &ep->nextentry;
+	used += size;
+	dused += dsize;
+	last = d;
+    }
+    if (last != NULL)
+	dp->i_hint = last;
+    result->READDIRPLUS3res_u.resok.reply.eof = d == NULL;
+    return TRUE;
+}
+
+bool_t
+nfs3_fsstat_3_svc(FSSTAT3args *argp, FSSTAT3res *result,
+    struct svc_req *rqstp)
+{
+    FSSTAT3resok *ok = &result->FSSTAT3res_u.resok;
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if (getinode(&argp->fsroot, &ino) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    postop(&ok->obj_attributes, ino);
+    ok->tbytes = 1ULL << 40;
+    ok->fbytes = ok->abytes = 1ULL << 39;
+    ok->tfiles = 1 << 24;
+    ok->ffiles = ok->afiles = (1 << 24) - ninodes;
+    return TRUE;
+}
+
+bool_t
+nfs3_fsinfo_3_svc(FSINFO3args *argp, FSINFO3res *result,
+    struct svc_req *rqstp)
+{
+    FSINFO3resok *ok = &result->FSINFO3res_u.resok;
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if (getinode(&argp->fsroot, &ino) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    postop(&ok->obj_attributes, ino);
+    ok->rtmax = ok->rtpref = rtmax;
+    ok->wtmax = ok->wtpref = wtmax;
+    ok->rtmult = ok->wtmult = 4096;
+    ok->dtpref = 8192;
+    ok->maxfilesize = 1ULL << 40;
+    ok->time_delta.seconds = 0;
+    ok->time_delta.nseconds = 1000;
+    ok->properties = FSF3_LINK | FSF3_SYMLINK | FSF3_HOMOGENEOUS |
+	FSF3_CANSETTIME;
+    return TRUE;
+}
+
+bool_t
+nfs3_pathconf_3_svc(PATHCONF3args *argp, PATHCONF3res *result,
+    struct svc_req *rqstp)
+{
+    PATHCONF3resok *ok = &result->PATHCONF3res_u.resok;
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if (getinode(&argp->object, &ino) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    postop(&ok->obj_attributes, ino);
+    ok->linkmax = 32000;
+    ok->name_max = 255;
+    ok->no_trunc = TRUE;
+    ok->case_preserving = TRUE;
+    return TRUE;
+}
+
+bool_t
+nfs3_commit_3_svc(COMMIT3args *argp, COMMIT3res *result,
+    struct svc_req *rqstp)
+{
+    u_int ino;
+
+    begin(result, sizeof(*result));
+    if (lose())
+	return FALSE;
+    if (getinode(&argp->file, &ino) == NULL) {
+	result->status = NFS3ERR_STALE;
+	return TRUE;
+    }
+    result->status = NFS3_OK;
+    wcc(&result->COMMIT3res_u.resok.file_wcc, ino);
+    memcpy(result->COMMIT3res_u.resok.verf, writeverf, NFS3_WRITEVERFSIZE);
+    return TRUE;
+}
+
+/* ARGSUSED */
+int
+nfs_program_3_freeresult(SVCXPRT *transp, xdrproc_t xdr_result,
+    caddr_t result)
+{
+    return 1;			/* it all lives in the arena */
+}
+
+/*
+ * The ACL side program is not served, but the skeleton needs it
+ */
+bool_t
+nfsacl3_null_3_svc(void *argp, void *result, struct svc_req *rqstp)
+{
+    return TRUE;
+}
+
+bool_t
+nfsacl3_getacl_3_svc(GETACL3args *argp, GETACL3res *result,
+    struct svc_req *rqstp)
+{
+    return FALSE;
+}
+
+bool_t
+nfsacl3_setacl_3_svc(SETACL3args *argp, SETACL3res *result,
+    struct svc_req *rqstp)
+{
+    return FALSE;
+}
+
+/* ARGSUSED */
+int
+nfsacl_program_3_freeresult(SVCXPRT *transp, xdrproc_t xdr_result,
+    caddr_t result)
+{
+    return 1;
+}
+
+/*
+ * MOUNT version 1 is not served either
+ */
+bool_t
+mount1_null_1_svc(void *argp, void *result, struct svc_req *rqstp)
+{
+    return TRUE;
+}
+
+bool_t
+mount1_mnt_1_svc(dirpath *argp, mountres1 *result, struct svc_req *rqstp)
+{
+    return FALSE;
+}
+
+bool_t
+mount1_dump_1_svc(void *argp, mountlist *result, struct svc_req *rqstp)
+{
+    return FALSE;
+}
+
+bool_t
+mount1_umnt_1_svc(dirpath *argp, void *result, struct svc_req *rqstp)
+{
+    return FALSE;
+}
+
+bool_t
+mount1_umntall_1_svc(void *argp, void *result, struct svc_req *rqstp)
+{
+    return FALSE;
+}
+
+bool_t
+mount1_export_1_svc(void *argp, exports *result, struct svc_req *rqstp)
+{
+    return FALSE;
+}
+
+/* ARGSUSED */
+int
+mount_program_1_freeresult(SVCXPRT *transp, xdrproc_t xdr_result,
+    caddr_t result)
+{
+    return 1;
+}
+
+/*
+ * MOUNT version 3
+ */
+bool_t
+mount3_null_3_svc(void *argp, void *result, struct svc_req *rqstp)
+{
+    begin(NULL, 0);
+    return TRUE;
+}
+
+bool_t
+mount3_mnt_3_svc(dirpath *argp, mountres3 *result, struct svc_req *rqstp)
+{
+    static int flavor = AUTH_UNIX;
+    mountres3_ok *ok = &result->mountres3_u.mountinfo;
+    struct sockaddr_in *sin;
+    struct mounted *m;
+    nfs_fh3 fh;
+
+    begin(result, sizeof(*result));
+    if (strcmp(*argp, exportpath) != 0) {
+	result->fhs_status = MNT3ERR_NOENT;
+	return TRUE;
+    }
+    mkhandle(&fh, rootino);
+    result->fhs_status = MNT3_OK;
+    ok->fhandle.fhandle3_len = fh.data.data_len;
+    memcpy(ok->fhandle.fhandle3_val, fh.data.data_val, fh.data.data_len);
+    ok->auth_flavors.auth_flavors_len = 1;
+    ok->auth_flavors.auth_flavors_val = &flavor;
+    sin = (struct sockaddr_in *) svc_getcaller(rqstp->rq_xprt);
+    if ((m = malloc(sizeof(*m))) != NULL) {
+	m->m_host = strdup(inet_ntoa(sin->sin_addr));
+	m->m_dir = strdup(*argp);
+	m->m_next = mounted;
+	mounted = m;
+    }
+    return TRUE;
+}
+
+bool_t
+mount3_dump_3_svc(void *argp, mountlist *result, struct svc_req *rqstp)
+{
+    struct mounted *m;
+    mountlist *mlp;
+
+    begin(result, sizeof(*result));
+    for (mlp = result, m = mounted; m != NULL; m = m->m_next) {
+	*mlp = alloc(sizeof(**mlp));
+	(*mlp)->ml_hostname = astrdup(m->m_host);
+	(*mlp)->ml_directory = astrdup(m->m_dir);
+	mlp = &(*mlp)->ml_next;
+    }
+    return TRUE;
+}
+
+bool_t
+mount3_umnt_3_svc(dirpath *argp, void *result, struct svc_req *rqstp)
+{
+    struct mounted **mp, *m;
+    struct sockaddr_in *sin;
+    char *host;
+
+    begin(NULL, 0);
+    sin = (struct sockaddr_in *) svc_getcaller(rqstp->rq_xprt);
+    host = inet_ntoa(sin->sin_addr);
+    for (mp = &mounted; (m = *mp) != NULL; mp = &m->m_next) {
+	if (strcmp(m->m_dir, *argp) == 0 && strcmp(m->m_host, host) == 0) {
+	    *mp = m->m_next;
+	    free(m->m_host);
+	    free(m->m_dir);
+	    free(m);
+	    break;
+	}
+    }
+    return TRUE;
+}
+
+bool_t
+mount3_umntall_3_svc(void *argp, void *result, struct svc_req *rqstp)
+{
+    struct mounted **mp, *m;
+    struct sockaddr_in *sin;
+    char *host;
+
+    begin(NULL, 0);
+    sin = (struct sockaddr_in *) svc_getcaller(rqstp->rq_xprt);
+    host = inet_ntoa(sin->sin_addr);
+    for (mp = &mounted; (m = *mp) != NULL; ) {
+	if (strcmp(m->m_host, host) == 0) {
+	    *mp = m->m_next;
+	    free(m->m_host);
+	    free(m->m_dir);
+	    free(m);
+	} else
+	    mp = &m->m_next;
+    }
+    return TRUE;
+}
+
+bool_t
+mount3_export_3_svc(void *argp, exports *result, struct svc_req *rqstp)
+{
+    begin(result, sizeof(*result));
+    *result = alloc(sizeof(**result));
+    (*result)->ex_dir = astrdup(exportpath);
+    (*result)->ex_groups = alloc(sizeof(*(*result)->ex_groups));
+    (*result)->ex_groups->gr_name = astrdup("*");
+    return TRUE;
+}
+
+/* ARGSUSED */
+int
+mount_program_3_freeresult(SVCXPRT *transp, xdrproc_t xdr_result,
+    caddr_t result)
+{
+    return 1;
+}
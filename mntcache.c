@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mntcache - persistent cache of ports, mounts and directory handles
+ *
+ * Opening a host and mounting a file system costs portmapper
+ * lookups, a MNT and an FSINFO call, and every cd walks its path one
+ * LOOKUP at a time. For short sessions against the same servers
+ * these round trips are most of the run time. The cache keeps their
+ * results in a file shared by all nfsshell processes. It is a fixed
+ * size table of records, mapped into memory; a key hashes to a short
+ * run of slots and the oldest record in that run makes room for a
+ * new one. Nothing is checked when a record is used. The caller
+ * finds out a handle is stale when the server says so, and a port
+ * is stale when the connection fails. flock(2) keeps concurrent
+ * processes out of each other's way, a mutex the threads of one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <rpc/rpc.h>
+#include "mntcache.h"
+
+#define	MC_MAGIC	0x4e534843	/* "NSHC" */
+#define	MC_VERSION	1
+
+#define	MC_PORT		1	/* key "prog/vers/proto", value mr_val[0] */
+#define	MC_MOUNT	2	/* key export, value handle and FSINFO */
+#define	MC_PATH		3	/* key export '\n' path, value handle */
+
+struct mc_record {
+    u_int32_t mr_hash;		/* hash of the key, 0 for a free slot */
+    u_int32_t mr_kind;		/* MC_PORT, MC_MOUNT or MC_PATH */
+    u_int32_t mr_addr;		/* server address */
+    u_int32_t mr_time;		/* when the record was stored */
+    char mr_key[MNTCACHE_KEYLEN]; /* the key */
+    u_int32_t mr_fhlen;		/* handle length */
+    char mr_fh[NFS3_FHSIZE];	/* handle */
+    u_int32_t mr_val[5];	/* port or FSINFO limits */
+};
+
+struct mc_header {
+    u_int32_t mh_magic;		/* MC_MAGIC */
+    u_int32_t mh_version;	/* MC_VERSION */
+    u_int32_t mh_slots;		/* number of records */
+    u_int32_t mh_recsize;	/* sizeof(struct mc_record) */
+};
+
+static char *cachefile;		/* name of the cache file */
+static int cachefd = -1;	/* open cache file */
+static struct mc_header *header; /* mapped cache file */
+static struct mc_record *records; /* its records */
+static size_t mapsize;		/* size of the mapping */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void lock(int);
+static void unlock(void);
+static u_int32_t hashkey(int, struct in_addr, char *);
+static struct mc_record *find(int, struct in_addr, char *);
+static struct mc_record *store(int, struct in_addr, char *);
+
+/*
+ * Map a cache file, creating (or reinitializing) it when it is
+ * not a cache of the right layout
+ */
+int
+mntcache_open(char *file)
+{
+    struct stat st;
+    void *map;
+
+    mntcache_close();
+    mapsize = sizeof(struct mc_header) +
+	MNTCACHE_SLOTS * sizeof(struct mc_record);
+    if ((cachefd = open(file, O_RDWR | O_CREAT, 0600)) < 0) {
+	perror(file);
+	return 0;
+    }
+    lock(LOCK_EX);
+    if (fstat(cachefd, &st) < 0 || (st.st_size != mapsize &&
+      ftruncate(cachefd, 0) < 0) || ftruncate(cachefd, mapsize) < 0) {
+	perror(file);
+	goto fail;
+    }
+    map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, cachefd, 0);
+    if (map == MAP_FAILED) {
+	perror(file);
+	goto fail;
+    }
+    header = (struct mc_header *) map;
+    records = (struct mc_record *) (header + 1);
+    if (header->mh_magic != MC_MAGIC || header->mh_version != MC_VERSION ||
+      header->mh_slots != MNTCACHE_SLOTS ||
+      header->mh_recsize != sizeof(struct mc_record)) {
+	memset(map, 0, mapsize);
+	header->mh_version = MC_VERSION;
+	header->mh_slots = MNTCACHE_SLOTS;
+	header->mh_recsize = sizeof(struct mc_record);
+	header->mh_magic = MC_MAGIC;
+    }
+    unlock();
+    if ((cachefile = strdup(file)) == NULL) {
+	fprintf(stderr, "mntcache: out of memory\n");
+	mntcache_close();
+	return 0;
+    }
+    return 1;
+
+fail:
+    unlock();
+    close(cachefd);
+    cachefd = -1;
+    return 0;
+}
+
+void
+mntcache_close(void)
+{
+    if (header != NULL)
+	munmap(header, mapsize);
+    if (cachefd >= 0)
+	close(cachefd);
+    free(cachefile);
+    cachefile = NULL;
+    header = NULL;
+    records = NULL;
+    cachefd = -1;
+}
+
+/*
+ * Name of the cache file in use, NULL if there is none
+ */
+char *
+mntcache_file(void)
+{
+    return cachefile;
+}
+
+/*
+ * Number of records in use
+ */
+int
+mntcache_count(void)
+{
+    int i, n = 0;
+
+    if (header == NULL)
+	return 0;
+    lock(LOCK_SH);
+    for (i = 0; i < MNTCACHE_SLOTS; i++)
+	if (records[i].mr_hash != 0)
+	    n++;
+    unlock();
+    return n;
+}
+
+/*
+ * Server port of a program, in network byte order. Returns 0 if
+ * it is not known.
+ */
+int
+mntcache_getport(struct in_addr addr, u_long prog, u_long vers, int proto,
+    u_short *port)
+{
+    struct mc_record *mr;
+    char key[64];
+    int found = 0;
+
+    if (header == NULL)
+	return 0;
+    snprintf(key, sizeof(key), "%lu/%lu/%d", prog, vers, proto);
+    lock(LOCK_SH);
+    if ((mr = find(MC_PORT, addr, key)) != NULL && mr->mr_val[0] != 0) {
+	*port = htons(mr->mr_val[0]);
+	found = 1;
+    }
+    unlock();
+    return found;
+}
+
+/*
+ * Remember a port (network byte order), or forget it when it is 0
+ */
+void
+mntcache_putport(struct in_addr addr, u_long prog, u_long vers, int proto,
+    u_short port)
+{
+    struct mc_record *mr;
+    char key[64];
+
+    if (header == NULL)
+	return;
+    snprintf(key, sizeof(key), "%lu/%lu/%d", prog, vers, proto);
+    lock(LOCK_EX);
+    if ((mr = store(MC_PORT, addr, key)) != NULL)
+	mr->mr_val[0] = ntohs(port);
+    unlock();
+}
+
+/*
+ * Root handle and FSINFO limits of an exported file system
+ */
+int
+mntcache_getmount(struct in_addr addr, char *export, fhandle3 *fh,
+    struct mntcache_fsinfo *fsinfo)
+{
+    struct mc_record *mr;
+    int found = 0;
+
+    if (header == NULL || strlen(export) >= MNTCACHE_KEYLEN)
+	return 0;
+    lock(LOCK_SH);
+    if ((mr = find(MC_MOUNT, addr, export)) != NULL) {
+	fh->fhandle3_len = MIN(mr->mr_fhlen, FHSIZE3);
+	memcpy(fh->fhandle3_val, mr->mr_fh, FHSIZE3);
+	fsinfo->mf_rtmax = mr->mr_val[0];
+	fsinfo->mf_rtpref = mr->mr_val[1];
+	fsinfo->mf_wtmax = mr->mr_val[2];
+	fsinfo->mf_wtpref = mr->mr_val[3];
+	fsinfo->mf_dtpref = mr->mr_val[4];
+	found = 1;
+    }
+    unlock();
+    return found;
+}
+
+void
+mntcache_putmount(struct in_addr addr, char *export, fhandle3 *fh,
+    struct mntcache_fsinfo *fsinfo)
+{
+    struct mc_record *mr;
+
+    if (header == NULL || strlen(export) >= MNTCACHE_KEYLEN)
+	return;
+    lock(LOCK_EX);
+    if ((mr = store(MC_MOUNT, addr, export)) != NULL) {
+	mr->mr_fhlen = fh->fhandle3_len;
+	memcpy(mr->mr_fh, fh->fhandle3_val, FHSIZE3);
+	mr->mr_val[0] = fsinfo->mf_rtmax;
+	mr->mr_val[1] = fsinfo->mf_rtpref;
+	mr->mr_val[2] = fsinfo->mf_wtmax;
+	mr->mr_val[3] = fsinfo->mf_wtpref;
+	mr->mr_val[4] = fsinfo->mf_dtpref;
+    }
+    unlock();
+}
+
+/*
+ * Handle of an absolute path in an exported file system
+ */
+int
+mntcache_getpath(struct in_addr addr, char *export, char *path, nfs_fh3 *fh)
+{
+    struct mc_record *mr;
+    char key[MNTCACHE_KEYLEN];
+    int found = 0;
+
+    if (header == NULL ||
+      snprintf(key, sizeof(key), "%s\n%s", export, path) >= sizeof(key))
+	return 0;
+    lock(LOCK_SH);
+    if ((mr = find(MC_PATH, addr, key)) != NULL) {
+	fh->data.data_len = MIN(mr->mr_fhlen, NFS3_FHSIZE);
+	memcpy(fh->data.data_val, mr->mr_fh, NFS3_FHSIZE);
+	fh->hash = nfs_fh3hash(fh);
+	found = 1;
+    }
+    unlock();
+    return found;
+}
+
+void
+mntcache_putpath(struct in_addr addr, char *export, char *path, nfs_fh3 *fh)
+{
+    struct mc_record *mr;
+    char key[MNTCACHE_KEYLEN];
+
+    if (header == NULL ||
+      snprintf(key, sizeof(key), "%s\n%s", export, path) >= sizeof(key))
+	return;
+    lock(LOCK_EX);
+    if ((mr = store(MC_PATH, addr, key)) != NULL) {
+	mr->mr_fhlen = fh->data.data_len;
+	memcpy(mr->mr_fh, fh->data.data_val, NFS3_FHSIZE);
+    }
+    unlock();
+}
+
+/*
+ * Forget the paths of an exported file system, and unless
+ * 'pathsonly' is set, its mount as well
+ */
+void
+mntcache_forget(struct in_addr addr, char *export, int pathsonly)
+{
+    struct mc_record *mr;
+    size_t len = strlen(export);
+    int i;
+
+    if (header == NULL)
+	return;
+    lock(LOCK_EX);
+    for (i = 0; i < MNTCACHE_SLOTS; i++) {
+	mr = &records[i];
+	if (mr->mr_hash == 0 || mr->mr_addr != addr.s_addr)
+	    continue;
+	if ((mr->mr_kind == MC_PATH && strncmp(mr->mr_key, export, len) == 0 &&
+	  mr->mr_key[len] == '\n') ||
+	  (!pathsonly && mr->mr_kind == MC_MOUNT &&
+	  strcmp(mr->mr_key, export) == 0))
+	    mr->mr_hash = 0;
+    }
+    unlock();
+}
+
+/*
+ * Lock the cache against other threads and processes
+ */
+static void
+lock(int how)
+{
+    pthread_mutex_lock(&mutex);
+    (void) flock(cachefd, how);
+}
+
+static void
+unlock(void)
+{
+    (void) flock(cachefd, LOCK_UN);
+    pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * FNV-1a over the kind, the address and the key. 0 marks a free slot,
+ * so it is never returned.
+ */
+static u_int32_t
+hashkey(int kind, struct in_addr addr, char *key)
+{
+    u_int32_t h = 2166136261U;
+    u_char *p;
+    int i;
+
+    h = (h ^ kind) * 16777619U;
+    for (i = 0, p = (u_char *) &addr.s_addr; i < sizeof(addr.s_addr); i++)
+	h = (h ^ p[i]) * 16777619U;
+    for (p = (u_char *) key; *p != '\0'; p++)
+	h = (h ^ *p) * 16777619U;
+    return h ? h : 1;
+}
+
+/*
+ * Look up a record. The caller holds the lock.
+ */
+static struct mc_record *
+find(int kind, struct in_addr addr, char *key)
+{
+    struct mc_record *mr;
+    u_int32_t h = hashkey(kind, addr, key);
+    int i;
+
+    for (i = 0; i < MNTCACHE_PROBE; i++) {
+	mr = &records[(h + i) % MNTCACHE_SLOTS];
+	if (mr->mr_hash == h && mr->mr_kind == kind &&
+	  mr->mr_addr == addr.s_addr && strcmp(mr->mr_key, key) == 0)
+	    return mr;
+    }
+    return NULL;
+}
+
+/*
+ * Find the slot a record goes in: the one holding the same key, else
+ * a free one, else the oldest in the run. The caller holds the lock
+ * exclusively and fills in the value.
+ */
+static struct mc_record *
+store(int kind, struct in_addr addr, char *key)
+{
+    struct mc_record *mr, *victim = NULL;
+    u_int32_t h = hashkey(kind, addr, key);
+    int i;
+
+    if (strlen(key) >= MNTCACHE_KEYLEN)
+	return NULL;
+    if ((mr = find(kind, addr, key)) == NULL) {
+	for (i = 0; i < MNTCACHE_PROBE; i++) {
+	    mr = &records[(h + i) % MNTCACHE_SLOTS];
+	    if (mr->mr_hash == 0) {
+		victim = mr;
+		break;
+	    }
+	    if (victim == NULL || mr->mr_time < victim->mr_time)
+		victim = mr;
+	}
+	mr = victim;
+	memset(mr, 0, sizeof(*mr));
+	mr->mr_hash = h;
+	mr->mr_kind = kind;
+	mr->mr_addr = addr.s_addr;
+	strcpy(mr->mr_key, key);
+    }
+    mr->mr_time = time(NULL);
+    return mr;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mntcache - persistent cache of ports, mounts and directory handles
+ */
+#ifndef _MNTCACHE_H
+#define	_MNTCACHE_H
+
+#include <netinet/in.h>
+#include "mount.h"
+#include "nfs_prot.h"
+
+#define	MNTCACHE_SLOTS	4096	/* records in a cache file */
+#define	MNTCACHE_KEYLEN	256	/* longest key, export and path included */
+#define	MNTCACHE_PROBE	16	/* slots searched for a key */
+
+/*
+ * The FSINFO limits of a mounted file system
+ */
+struct mntcache_fsinfo {
+    u_int mf_rtmax;		/* maximum READ size */
+    u_int mf_rtpref;		/* preferred READ size */
+    u_int mf_wtmax;		/* maximum WRITE size */
+    u_int mf_wtpref;		/* preferred WRITE size */
+    u_int mf_dtpref;		/* preferred READDIR size */
+};
+
+int mntcache_open(char *);
+void mntcache_close(void);
+char *mntcache_file(void);
+int mntcache_count(void);
+int mntcache_getport(struct in_addr, u_long, u_long, int, u_short *);
+void mntcache_putport(struct in_addr, u_long, u_long, int, u_short);
+int mntcache_getmount(struct in_addr, char *, fhandle3 *,
+    struct mntcache_fsinfo *);
+void mntcache_putmount(struct in_addr, char *, fhandle3 *,
+    struct mntcache_fsinfo *);
+int mntcache_getpath(struct in_addr, char *, char *, nfs_fh3 *);
+void mntcache_putpath(struct in_addr, char *, char *, nfs_fh3 *);
+void mntcache_forget(struct in_addr, char *, int);
+
+#endif /* _MNTCACHE_H */
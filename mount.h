@@ -8,6 +8,7 @@
 
 #include <rpc/rpc.h>
 
+#include <pthread.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -118,88 +119,88 @@ typedef struct mountres1 mountres1;
 
 #if defined(__STDC__) || defined(__cplusplus)
 #define MOUNT1_NULL 0
-extern  void * mount1_null_1(void *, CLIENT *);
-extern  void * mount1_null_1_svc(void *, struct svc_req *);
+extern  enum clnt_stat mount1_null_1(void *, void *, CLIENT *);
+extern  bool_t mount1_null_1_svc(void *, void *, struct svc_req *);
 #define MOUNT1_MNT 1
-extern  mountres1 * mount1_mnt_1(dirpath *, CLIENT *);
-extern  mountres1 * mount1_mnt_1_svc(dirpath *, struct svc_req *);
+extern  enum clnt_stat mount1_mnt_1(dirpath *, mountres1 *, CLIENT *);
+extern  bool_t mount1_mnt_1_svc(dirpath *, mountres1 *, struct svc_req *);
 #define MOUNT1_DUMP 2
-extern  mountlist * mount1_dump_1(void *, CLIENT *);
-extern  mountlist * mount1_dump_1_svc(void *, struct svc_req *);
+extern  enum clnt_stat mount1_dump_1(void *, mountlist *, CLIENT *);
+extern  bool_t mount1_dump_1_svc(void *, mountlist *, struct svc_req *);
 #define MOUNT1_UMNT 3
-extern  void * mount1_umnt_1(dirpath *, CLIENT *);
-extern  void * mount1_umnt_1_svc(dirpath *, struct svc_req *);
+extern  enum clnt_stat mount1_umnt_1(dirpath *, void *, CLIENT *);
+extern  bool_t mount1_umnt_1_svc(dirpath *, void *, struct svc_req *);
 #define MOUNT1_UMNTALL 4
-extern  void * mount1_umntall_1(void *, CLIENT *);
-extern  void * mount1_umntall_1_svc(void *, struct svc_req *);
+extern  enum clnt_stat mount1_umntall_1(void *, void *, CLIENT *);
+extern  bool_t mount1_umntall_1_svc(void *, void *, struct svc_req *);
 #define MOUNT1_EXPORT 5
-extern  exports * mount1_export_1(void *, CLIENT *);
-extern  exports * mount1_export_1_svc(void *, struct svc_req *);
+extern  enum clnt_stat mount1_export_1(void *, exports *, CLIENT *);
+extern  bool_t mount1_export_1_svc(void *, exports *, struct svc_req *);
 extern int mount_program_1_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
 #define MOUNT1_NULL 0
-extern  void * mount1_null_1();
-extern  void * mount1_null_1_svc();
+extern  enum clnt_stat mount1_null_1();
+extern  bool_t mount1_null_1_svc();
 #define MOUNT1_MNT 1
-extern  mountres1 * mount1_mnt_1();
-extern  mountres1 * mount1_mnt_1_svc();
+extern  enum clnt_stat mount1_mnt_1();
+extern  bool_t mount1_mnt_1_svc();
 #define MOUNT1_DUMP 2
-extern  mountlist * mount1_dump_1();
-extern  mountlist * mount1_dump_1_svc();
+extern  enum clnt_stat mount1_dump_1();
+extern  bool_t mount1_dump_1_svc();
 #define MOUNT1_UMNT 3
-extern  void * mount1_umnt_1();
-extern  void * mount1_umnt_1_svc();
+extern  enum clnt_stat mount1_umnt_1();
+extern  bool_t mount1_umnt_1_svc();
 #define MOUNT1_UMNTALL 4
-extern  void * mount1_umntall_1();
-extern  void * mount1_umntall_1_svc();
+extern  enum clnt_stat mount1_umntall_1();
+extern  bool_t mount1_umntall_1_svc();
 #define MOUNT1_EXPORT 5
-extern  exports * mount1_export_1();
-extern  exports * mount1_export_1_svc();
+extern  enum clnt_stat mount1_export_1();
+extern  bool_t mount1_export_1_svc();
 extern int mount_program_1_freeresult ();
 #endif /* K&R C */
 #define MOUNT_V3 3
 
 #if defined(__STDC__) || defined(__cplusplus)
 #define MOUNT3_NULL 0
-extern  void * mount3_null_3(void *, CLIENT *);
-extern  void * mount3_null_3_svc(void *, struct svc_req *);
+extern  enum clnt_stat mount3_null_3(void *, void *, CLIENT *);
+extern  bool_t mount3_null_3_svc(void *, void *, struct svc_req *);
 #define MOUNT3_MNT 1
-extern  mountres3 * mount3_mnt_3(dirpath *, CLIENT *);
-extern  mountres3 * mount3_mnt_3_svc(dirpath *, struct svc_req *);
+extern  enum clnt_stat mount3_mnt_3(dirpath *, mountres3 *, CLIENT *);
+extern  bool_t mount3_mnt_3_svc(dirpath *, mountres3 *, struct svc_req *);
 #define MOUNT3_DUMP 2
-extern  mountlist * mount3_dump_3(void *, CLIENT *);
-extern  mountlist * mount3_dump_3_svc(void *, struct svc_req *);
+extern  enum clnt_stat mount3_dump_3(void *, mountlist *, CLIENT *);
+extern  bool_t mount3_dump_3_svc(void *, mountlist *, struct svc_req *);
 #define MOUNT3_UMNT 3
-extern  void * mount3_umnt_3(dirpath *, CLIENT *);
-extern  void * mount3_umnt_3_svc(dirpath *, struct svc_req *);
+extern  enum clnt_stat mount3_umnt_3(dirpath *, void *, CLIENT *);
+extern  bool_t mount3_umnt_3_svc(dirpath *, void *, struct svc_req *);
 #define MOUNT3_UMNTALL 4
-extern  void * mount3_umntall_3(void *, CLIENT *);
-extern  void * mount3_umntall_3_svc(void *, struct svc_req *);
+extern  enum clnt_stat mount3_umntall_3(void *, void *, CLIENT *);
+extern  bool_t mount3_umntall_3_svc(void *, void *, struct svc_req *);
 #define MOUNT3_EXPORT 5
-extern  exports * mount3_export_3(void *, CLIENT *);
-extern  exports * mount3_export_3_svc(void *, struct svc_req *);
+extern  enum clnt_stat mount3_export_3(void *, exports *, CLIENT *);
+extern  bool_t mount3_export_3_svc(void *, exports *, struct svc_req *);
 extern int mount_program_3_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
 #define MOUNT3_NULL 0
-extern  void * mount3_null_3();
-extern  void * mount3_null_3_svc();
+extern  enum clnt_stat mount3_null_3();
+extern  bool_t mount3_null_3_svc();
 #define MOUNT3_MNT 1
-extern  mountres3 * mount3_mnt_3();
-extern  mountres3 * mount3_mnt_3_svc();
+extern  enum clnt_stat mount3_mnt_3();
+extern  bool_t mount3_mnt_3_svc();
 #define MOUNT3_DUMP 2
-extern  mountlist * mount3_dump_3();
-extern  mountlist * mount3_dump_3_svc();
+extern  enum clnt_stat mount3_dump_3();
+extern  bool_t mount3_dump_3_svc();
 #define MOUNT3_UMNT 3
-extern  void * mount3_umnt_3();
-extern  void * mount3_umnt_3_svc();
+extern  enum clnt_stat mount3_umnt_3();
+extern  bool_t mount3_umnt_3_svc();
 #define MOUNT3_UMNTALL 4
-extern  void * mount3_umntall_3();
-extern  void * mount3_umntall_3_svc();
+extern  enum clnt_stat mount3_umntall_3();
+extern  bool_t mount3_umntall_3_svc();
 #define MOUNT3_EXPORT 5
-extern  exports * mount3_export_3();
-extern  exports * mount3_export_3_svc();
+extern  enum clnt_stat mount3_export_3();
+extern  bool_t mount3_export_3_svc();
 extern int mount_program_3_freeresult ();
 #endif /* K&R C */
 
@@ -9,182 +9,110 @@
 /* Default timeout can be changed using clnt_control() */
 static struct timeval TIMEOUT = { 25, 0 };
 
-void *
-mount1_null_1(void *argp, CLIENT *clnt)
+enum clnt_stat 
+mount1_null_1(void *argp, void *clnt_res, CLIENT *clnt)
 {
-	static char clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT1_NULL,
+	return (clnt_call(clnt, MOUNT1_NULL,
 		(xdrproc_t) xdr_void, (caddr_t) argp,
-		(xdrproc_t) xdr_void, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return ((void *)&clnt_res);
+		(xdrproc_t) xdr_void, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-mountres1 *
-mount1_mnt_1(dirpath *argp, CLIENT *clnt)
+enum clnt_stat 
+mount1_mnt_1(dirpath *argp, mountres1 *clnt_res, CLIENT *clnt)
 {
-	static mountres1 clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT1_MNT,
+	return (clnt_call(clnt, MOUNT1_MNT,
 		(xdrproc_t) xdr_dirpath, (caddr_t) argp,
-		(xdrproc_t) xdr_mountres1, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return (&clnt_res);
+		(xdrproc_t) xdr_mountres1, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-mountlist *
-mount1_dump_1(void *argp, CLIENT *clnt)
+enum clnt_stat 
+mount1_dump_1(void *argp, mountlist *clnt_res, CLIENT *clnt)
 {
-	static mountlist clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT1_DUMP,
+	return (clnt_call(clnt, MOUNT1_DUMP,
 		(xdrproc_t) xdr_void, (caddr_t) argp,
-		(xdrproc_t) xdr_mountlist, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return (&clnt_res);
+		(xdrproc_t) xdr_mountlist, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-void *
-mount1_umnt_1(dirpath *argp, CLIENT *clnt)
+enum clnt_stat 
+mount1_umnt_1(dirpath *argp, void *clnt_res, CLIENT *clnt)
 {
-	static char clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT1_UMNT,
+	return (clnt_call(clnt, MOUNT1_UMNT,
 		(xdrproc_t) xdr_dirpath, (caddr_t) argp,
-		(xdrproc_t) xdr_void, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return ((void *)&clnt_res);
+		(xdrproc_t) xdr_void, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-void *
-mount1_umntall_1(void *argp, CLIENT *clnt)
+enum clnt_stat 
+mount1_umntall_1(void *argp, void *clnt_res, CLIENT *clnt)
 {
-	static char clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT1_UMNTALL,
+	return (clnt_call(clnt, MOUNT1_UMNTALL,
 		(xdrproc_t) xdr_void, (caddr_t) argp,
-		(xdrproc_t) xdr_void, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return ((void *)&clnt_res);
+		(xdrproc_t) xdr_void, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-exports *
-mount1_export_1(void *argp, CLIENT *clnt)
+enum clnt_stat 
+mount1_export_1(void *argp, exports *clnt_res, CLIENT *clnt)
 {
-	static exports clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT1_EXPORT,
+	return (clnt_call(clnt, MOUNT1_EXPORT,
 		(xdrproc_t) xdr_void, (caddr_t) argp,
-		(xdrproc_t) xdr_exports, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return (&clnt_res);
+		(xdrproc_t) xdr_exports, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-void *
-mount3_null_3(void *argp, CLIENT *clnt)
+enum clnt_stat 
+mount3_null_3(void *argp, void *clnt_res, CLIENT *clnt)
 {
-	static char clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT3_NULL,
+	return (clnt_call(clnt, MOUNT3_NULL,
 		(xdrproc_t) xdr_void, (caddr_t) argp,
-		(xdrproc_t) xdr_void, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return ((void *)&clnt_res);
+		(xdrproc_t) xdr_void, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-mountres3 *
-mount3_mnt_3(dirpath *argp, CLIENT *clnt)
+enum clnt_stat 
+mount3_mnt_3(dirpath *argp, mountres3 *clnt_res, CLIENT *clnt)
 {
-	static mountres3 clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT3_MNT,
+	return (clnt_call(clnt, MOUNT3_MNT,
 		(xdrproc_t) xdr_dirpath, (caddr_t) argp,
-		(xdrproc_t) xdr_mountres3, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return (&clnt_res);
+		(xdrproc_t) xdr_mountres3, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-mountlist *
-mount3_dump_3(void *argp, CLIENT *clnt)
+enum clnt_stat 
+mount3_dump_3(void *argp, mountlist *clnt_res, CLIENT *clnt)
 {
-	static mountlist clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT3_DUMP,
+	return (clnt_call(clnt, MOUNT3_DUMP,
 		(xdrproc_t) xdr_void, (caddr_t) argp,
-		(xdrproc_t) xdr_mountlist, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return (&clnt_res);
+		(xdrproc_t) xdr_mountlist, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-void *
-mount3_umnt_3(dirpath *argp, CLIENT *clnt)
+enum clnt_stat 
+mount3_umnt_3(dirpath *argp, void *clnt_res, CLIENT *clnt)
 {
-	static char clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT3_UMNT,
+	return (clnt_call(clnt, MOUNT3_UMNT,
 		(xdrproc_t) xdr_dirpath, (caddr_t) argp,
-		(xdrproc_t) xdr_void, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return ((void *)&clnt_res);
+		(xdrproc_t) xdr_void, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-void *
-mount3_umntall_3(void *argp, CLIENT *clnt)
+enum clnt_stat 
+mount3_umntall_3(void *argp, void *clnt_res, CLIENT *clnt)
 {
-	static char clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT3_UMNTALL,
+	return (clnt_call(clnt, MOUNT3_UMNTALL,
 		(xdrproc_t) xdr_void, (caddr_t) argp,
-		(xdrproc_t) xdr_void, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return ((void *)&clnt_res);
+		(xdrproc_t) xdr_void, (caddr_t) clnt_res,
+		TIMEOUT));
 }
 
-exports *
-mount3_export_3(void *argp, CLIENT *clnt)
+enum clnt_stat 
+mount3_export_3(void *argp, exports *clnt_res, CLIENT *clnt)
 {
-	static exports clnt_res;
-
-	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call (clnt, MOUNT3_EXPORT,
+	return (clnt_call(clnt, MOUNT3_EXPORT,
 		(xdrproc_t) xdr_void, (caddr_t) argp,
-		(xdrproc_t) xdr_exports, (caddr_t) &clnt_res,
-		TIMEOUT) != RPC_SUCCESS) {
-		return (NULL);
-	}
-	return (&clnt_res);
+		(xdrproc_t) xdr_exports, (caddr_t) clnt_res,
+		TIMEOUT));
 }
@@ -23,45 +23,50 @@ mount_program_1(struct svc_req *rqstp, register SVCXPRT *transp)
 		dirpath mount1_mnt_1_arg;
 		dirpath mount1_umnt_1_arg;
 	} argument;
-	char *result;
+	union {
+		mountres1 mount1_mnt_1_res;
+		mountlist mount1_dump_1_res;
+		exports mount1_export_1_res;
+	} result;
+	bool_t retval;
 	xdrproc_t _xdr_argument, _xdr_result;
-	char *(*local)(char *, struct svc_req *);
+	bool_t (*local)(char *, void *, struct svc_req *);
 
 	switch (rqstp->rq_proc) {
 	case MOUNT1_NULL:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_void;
-		local = (char *(*)(char *, struct svc_req *)) mount1_null_1_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount1_null_1_svc;
 		break;
 
 	case MOUNT1_MNT:
 		_xdr_argument = (xdrproc_t) xdr_dirpath;
 		_xdr_result = (xdrproc_t) xdr_mountres1;
-		local = (char *(*)(char *, struct svc_req *)) mount1_mnt_1_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount1_mnt_1_svc;
 		break;
 
 	case MOUNT1_DUMP:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_mountlist;
-		local = (char *(*)(char *, struct svc_req *)) mount1_dump_1_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount1_dump_1_svc;
 		break;
 
 	case MOUNT1_UMNT:
 		_xdr_argument = (xdrproc_t) xdr_dirpath;
 		_xdr_result = (xdrproc_t) xdr_void;
-		local = (char *(*)(char *, struct svc_req *)) mount1_umnt_1_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount1_umnt_1_svc;
 		break;
 
 	case MOUNT1_UMNTALL:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_void;
-		local = (char *(*)(char *, struct svc_req *)) mount1_umntall_1_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount1_umntall_1_svc;
 		break;
 
 	case MOUNT1_EXPORT:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_exports;
-		local = (char *(*)(char *, struct svc_req *)) mount1_export_1_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount1_export_1_svc;
 		break;
 
 	default:
@@ -73,14 +78,17 @@ mount_program_1(struct svc_req *rqstp, register SVCXPRT *transp)
 		svcerr_decode (transp);
 		return;
 	}
-	result = (*local)((char *)&argument, rqstp);
-	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) _xdr_result, result)) {
+	retval = (bool_t) (*local)((char *)&argument, (void *)&result, rqstp);
+	if (retval > 0 && !svc_sendreply(transp, (xdrproc_t) _xdr_result, (char *)&result)) {
 		svcerr_systemerr (transp);
 	}
 	if (!svc_freeargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
 		fprintf (stderr, "%s", "unable to free arguments");
 		exit (1);
 	}
+	if (!mount_program_1_freeresult (transp, _xdr_result, (caddr_t) &result))
+		fprintf (stderr, "%s", "unable to free results");
+
 	return;
 }
 
@@ -91,45 +99,50 @@ mount_program_3(struct svc_req *rqstp, register SVCXPRT *transp)
 		dirpath mount3_mnt_3_arg;
 		dirpath mount3_umnt_3_arg;
 	} argument;
-	char *result;
+	union {
+		mountres3 mount3_mnt_3_res;
+		mountlist mount3_dump_3_res;
+		exports mount3_export_3_res;
+	} result;
+	bool_t retval;
 	xdrproc_t _xdr_argument, _xdr_result;
-	char *(*local)(char *, struct svc_req *);
+	bool_t (*local)(char *, void *, struct svc_req *);
 
 	switch (rqstp->rq_proc) {
 	case MOUNT3_NULL:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_void;
-		local = (char *(*)(char *, struct svc_req *)) mount3_null_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount3_null_3_svc;
 		break;
 
 	case MOUNT3_MNT:
 		_xdr_argument = (xdrproc_t) xdr_dirpath;
 		_xdr_result = (xdrproc_t) xdr_mountres3;
-		local = (char *(*)(char *, struct svc_req *)) mount3_mnt_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount3_mnt_3_svc;
 		break;
 
 	case MOUNT3_DUMP:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_mountlist;
-		local = (char *(*)(char *, struct svc_req *)) mount3_dump_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount3_dump_3_svc;
 		break;
 
 	case MOUNT3_UMNT:
 		_xdr_argument = (xdrproc_t) xdr_dirpath;
 		_xdr_result = (xdrproc_t) xdr_void;
-		local = (char *(*)(char *, struct svc_req *)) mount3_umnt_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount3_umnt_3_svc;
 		break;
 
 	case MOUNT3_UMNTALL:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_void;
-		local = (char *(*)(char *, struct svc_req *)) mount3_umntall_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount3_umntall_3_svc;
 		break;
 
 	case MOUNT3_EXPORT:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_exports;
-		local = (char *(*)(char *, struct svc_req *)) mount3_export_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))mount3_export_3_svc;
 		break;
 
 	default:
@@ -141,14 +154,17 @@ mount_program_3(struct svc_req *rqstp, register SVCXPRT *transp)
 		svcerr_decode (transp);
 		return;
 	}
-	result = (*local)((char *)&argument, rqstp);
-	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) _xdr_result, result)) {
+	retval = (bool_t) (*local)((char *)&argument, (void *)&result, rqstp);
+	if (retval > 0 && !svc_sendreply(transp, (xdrproc_t) _xdr_result, (char *)&result)) {
 		svcerr_systemerr (transp);
 	}
 	if (!svc_freeargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
 		fprintf (stderr, "%s", "unable to free arguments");
 		exit (1);
 	}
+	if (!mount_program_3_freeresult (transp, _xdr_result, (caddr_t) &result))
+		fprintf (stderr, "%s", "unable to free results");
+
 	return;
 }
 
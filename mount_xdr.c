@@ -10,7 +10,12 @@ xdr_fhandle3 (XDR *xdrs, fhandle3 *objp)
 {
 	register int32_t *buf;
 
-	 if (!xdr_bytes (xdrs, (char **)&objp->fhandle3_val, (u_int *) &objp->fhandle3_len, FHSIZE3))
+	/* the handle is kept inline in fhandle3 */
+	 if (!xdr_u_int (xdrs, &objp->fhandle3_len))
+		 return FALSE;
+	 if (objp->fhandle3_len > FHSIZE3)
+		 return FALSE;
+	 if (!xdr_opaque (xdrs, objp->fhandle3_val, objp->fhandle3_len))
 		 return FALSE;
 	return TRUE;
 }
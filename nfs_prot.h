@@ -8,6 +8,7 @@
 
 #include <rpc/rpc.h>
 
+#include <pthread.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +30,7 @@ struct nfs_fh3 {
 		u_int data_len;
 		char data_val[NFS3_FHSIZE];
 	} data;
+	u_int hash;		/* nfs_fh3hash of data, not on the wire */
 };
 typedef struct nfs_fh3 nfs_fh3;
 
@@ -1003,140 +1005,140 @@ typedef struct SETACL3res SETACL3res;
 
 #if defined(__STDC__) || defined(__cplusplus)
 #define NFS3_NULL 0
-extern  void * nfs3_null_3(void *, CLIENT *);
-extern  void * nfs3_null_3_svc(void *, struct svc_req *);
+extern  enum clnt_stat nfs3_null_3(void *, void *, CLIENT *);
+extern  bool_t nfs3_null_3_svc(void *, void *, struct svc_req *);
 #define NFS3_GETATTR 1
-extern  GETATTR3res * nfs3_getattr_3(GETATTR3args *, CLIENT *);
-extern  GETATTR3res * nfs3_getattr_3_svc(GETATTR3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_getattr_3(GETATTR3args *, GETATTR3res *, CLIENT *);
+extern  bool_t nfs3_getattr_3_svc(GETATTR3args *, GETATTR3res *, struct svc_req *);
 #define NFS3_SETATTR 2
-extern  SETATTR3res * nfs3_setattr_3(SETATTR3args *, CLIENT *);
-extern  SETATTR3res * nfs3_setattr_3_svc(SETATTR3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_setattr_3(SETATTR3args *, SETATTR3res *, CLIENT *);
+extern  bool_t nfs3_setattr_3_svc(SETATTR3args *, SETATTR3res *, struct svc_req *);
 #define NFS3_LOOKUP 3
-extern  LOOKUP3res * nfs3_lookup_3(LOOKUP3args *, CLIENT *);
-extern  LOOKUP3res * nfs3_lookup_3_svc(LOOKUP3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_lookup_3(LOOKUP3args *, LOOKUP3res *, CLIENT *);
+extern  bool_t nfs3_lookup_3_svc(LOOKUP3args *, LOOKUP3res *, struct svc_req *);
 #define NFS3_ACCESS 4
-extern  ACCESS3res * nfs3_access_3(ACCESS3args *, CLIENT *);
-extern  ACCESS3res * nfs3_access_3_svc(ACCESS3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_access_3(ACCESS3args *, ACCESS3res *, CLIENT *);
+extern  bool_t nfs3_access_3_svc(ACCESS3args *, ACCESS3res *, struct svc_req *);
 #define NFS3_READLINK 5
-extern  READLINK3res * nfs3_readlink_3(READLINK3args *, CLIENT *);
-extern  READLINK3res * nfs3_readlink_3_svc(READLINK3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_readlink_3(READLINK3args *, READLINK3res *, CLIENT *);
+extern  bool_t nfs3_readlink_3_svc(READLINK3args *, READLINK3res *, struct svc_req *);
 #define NFS3_READ 6
-extern  READ3res * nfs3_read_3(READ3args *, CLIENT *);
-extern  READ3res * nfs3_read_3_svc(READ3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_read_3(READ3args *, READ3res *, CLIENT *);
+extern  bool_t nfs3_read_3_svc(READ3args *, READ3res *, struct svc_req *);
 #define NFS3_WRITE 7
-extern  WRITE3res * nfs3_write_3(WRITE3args *, CLIENT *);
-extern  WRITE3res * nfs3_write_3_svc(WRITE3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_write_3(WRITE3args *, WRITE3res *, CLIENT *);
+extern  bool_t nfs3_write_3_svc(WRITE3args *, WRITE3res *, struct svc_req *);
 #define NFS3_CREATE 8
-extern  CREATE3res * nfs3_create_3(CREATE3args *, CLIENT *);
-extern  CREATE3res * nfs3_create_3_svc(CREATE3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_create_3(CREATE3args *, CREATE3res *, CLIENT *);
+extern  bool_t nfs3_create_3_svc(CREATE3args *, CREATE3res *, struct svc_req *);
 #define NFS3_MKDIR 9
-extern  MKDIR3res * nfs3_mkdir_3(MKDIR3args *, CLIENT *);
-extern  MKDIR3res * nfs3_mkdir_3_svc(MKDIR3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_mkdir_3(MKDIR3args *, MKDIR3res *, CLIENT *);
+extern  bool_t nfs3_mkdir_3_svc(MKDIR3args *, MKDIR3res *, struct svc_req *);
 #define NFS3_SYMLINK 10
-extern  SYMLINK3res * nfs3_symlink_3(SYMLINK3args *, CLIENT *);
-extern  SYMLINK3res * nfs3_symlink_3_svc(SYMLINK3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_symlink_3(SYMLINK3args *, SYMLINK3res *, CLIENT *);
+extern  bool_t nfs3_symlink_3_svc(SYMLINK3args *, SYMLINK3res *, struct svc_req *);
 #define NFS3_MKNOD 11
-extern  MKNOD3res * nfs3_mknod_3(MKNOD3args *, CLIENT *);
-extern  MKNOD3res * nfs3_mknod_3_svc(MKNOD3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_mknod_3(MKNOD3args *, MKNOD3res *, CLIENT *);
+extern  bool_t nfs3_mknod_3_svc(MKNOD3args *, MKNOD3res *, struct svc_req *);
 #define NFS3_REMOVE 12
-extern  REMOVE3res * nfs3_remove_3(REMOVE3args *, CLIENT *);
-extern  REMOVE3res * nfs3_remove_3_svc(REMOVE3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_remove_3(REMOVE3args *, REMOVE3res *, CLIENT *);
+extern  bool_t nfs3_remove_3_svc(REMOVE3args *, REMOVE3res *, struct svc_req *);
 #define NFS3_RMDIR 13
-extern  RMDIR3res * nfs3_rmdir_3(RMDIR3args *, CLIENT *);
-extern  RMDIR3res * nfs3_rmdir_3_svc(RMDIR3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_rmdir_3(RMDIR3args *, RMDIR3res *, CLIENT *);
+extern  bool_t nfs3_rmdir_3_svc(RMDIR3args *, RMDIR3res *, struct svc_req *);
 #define NFS3_RENAME 14
-extern  RENAME3res * nfs3_rename_3(RENAME3args *, CLIENT *);
-extern  RENAME3res * nfs3_rename_3_svc(RENAME3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_rename_3(RENAME3args *, RENAME3res *, CLIENT *);
+extern  bool_t nfs3_rename_3_svc(RENAME3args *, RENAME3res *, struct svc_req *);
 #define NFS3_LINK 15
-extern  LINK3res * nfs3_link_3(LINK3args *, CLIENT *);
-extern  LINK3res * nfs3_link_3_svc(LINK3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_link_3(LINK3args *, LINK3res *, CLIENT *);
+extern  bool_t nfs3_link_3_svc(LINK3args *, LINK3res *, struct svc_req *);
 #define NFS3_READDIR 16
-extern  READDIR3res * nfs3_readdir_3(READDIR3args *, CLIENT *);
-extern  READDIR3res * nfs3_readdir_3_svc(READDIR3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_readdir_3(READDIR3args *, READDIR3res *, CLIENT *);
+extern  bool_t nfs3_readdir_3_svc(READDIR3args *, READDIR3res *, struct svc_req *);
 #define NFS3_READDIRPLUS 17
-extern  READDIRPLUS3res * nfs3_readdirplus_3(READDIRPLUS3args *, CLIENT *);
-extern  READDIRPLUS3res * nfs3_readdirplus_3_svc(READDIRPLUS3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_readdirplus_3(READDIRPLUS3args *, READDIRPLUS3res *, CLIENT *);
+extern  bool_t nfs3_readdirplus_3_svc(READDIRPLUS3args *, READDIRPLUS3res *, struct svc_req *);
 #define NFS3_FSSTAT 18
-extern  FSSTAT3res * nfs3_fsstat_3(FSSTAT3args *, CLIENT *);
-extern  FSSTAT3res * nfs3_fsstat_3_svc(FSSTAT3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_fsstat_3(FSSTAT3args *, FSSTAT3res *, CLIENT *);
+extern  bool_t nfs3_fsstat_3_svc(FSSTAT3args *, FSSTAT3res *, struct svc_req *);
 #define NFS3_FSINFO 19
-extern  FSINFO3res * nfs3_fsinfo_3(FSINFO3args *, CLIENT *);
-extern  FSINFO3res * nfs3_fsinfo_3_svc(FSINFO3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_fsinfo_3(FSINFO3args *, FSINFO3res *, CLIENT *);
+extern  bool_t nfs3_fsinfo_3_svc(FSINFO3args *, FSINFO3res *, struct svc_req *);
 #define NFS3_PATHCONF 20
-extern  PATHCONF3res * nfs3_pathconf_3(PATHCONF3args *, CLIENT *);
-extern  PATHCONF3res * nfs3_pathconf_3_svc(PATHCONF3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_pathconf_3(PATHCONF3args *, PATHCONF3res *, CLIENT *);
+extern  bool_t nfs3_pathconf_3_svc(PATHCONF3args *, PATHCONF3res *, struct svc_req *);
 #define NFS3_COMMIT 21
-extern  COMMIT3res * nfs3_commit_3(COMMIT3args *, CLIENT *);
-extern  COMMIT3res * nfs3_commit_3_svc(COMMIT3args *, struct svc_req *);
+extern  enum clnt_stat nfs3_commit_3(COMMIT3args *, COMMIT3res *, CLIENT *);
+extern  bool_t nfs3_commit_3_svc(COMMIT3args *, COMMIT3res *, struct svc_req *);
 extern int nfs_program_3_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
 #define NFS3_NULL 0
-extern  void * nfs3_null_3();
-extern  void * nfs3_null_3_svc();
+extern  enum clnt_stat nfs3_null_3();
+extern  bool_t nfs3_null_3_svc();
 #define NFS3_GETATTR 1
-extern  GETATTR3res * nfs3_getattr_3();
-extern  GETATTR3res * nfs3_getattr_3_svc();
+extern  enum clnt_stat nfs3_getattr_3();
+extern  bool_t nfs3_getattr_3_svc();
 #define NFS3_SETATTR 2
-extern  SETATTR3res * nfs3_setattr_3();
-extern  SETATTR3res * nfs3_setattr_3_svc();
+extern  enum clnt_stat nfs3_setattr_3();
+extern  bool_t nfs3_setattr_3_svc();
 #define NFS3_LOOKUP 3
-extern  LOOKUP3res * nfs3_lookup_3();
-extern  LOOKUP3res * nfs3_lookup_3_svc();
+extern  enum clnt_stat nfs3_lookup_3();
+extern  bool_t nfs3_lookup_3_svc();
 #define NFS3_ACCESS 4
-extern  ACCESS3res * nfs3_access_3();
-extern  ACCESS3res * nfs3_access_3_svc();
+extern  enum clnt_stat nfs3_access_3();
+extern  bool_t nfs3_access_3_svc();
 #define NFS3_READLINK 5
-extern  READLINK3res * nfs3_readlink_3();
-extern  READLINK3res * nfs3_readlink_3_svc();
+extern  enum clnt_stat nfs3_readlink_3();
+extern  bool_t nfs3_readlink_3_svc();
 #define NFS3_READ 6
-extern  READ3res * nfs3_read_3();
-extern  READ3res * nfs3_read_3_svc();
+extern  enum clnt_stat nfs3_read_3();
+extern  bool_t nfs3_read_3_svc();
 #define NFS3_WRITE 7
-extern  WRITE3res * nfs3_write_3();
-extern  WRITE3res * nfs3_write_3_svc();
+extern  enum clnt_stat nfs3_write_3();
+extern  bool_t nfs3_write_3_svc();
 #define NFS3_CREATE 8
-extern  CREATE3res * nfs3_create_3();
-extern  CREATE3res * nfs3_create_3_svc();
+extern  enum clnt_stat nfs3_create_3();
+extern  bool_t nfs3_create_3_svc();
 #define NFS3_MKDIR 9
-extern  MKDIR3res * nfs3_mkdir_3();
-extern  MKDIR3res * nfs3_mkdir_3_svc();
+extern  enum clnt_stat nfs3_mkdir_3();
+extern  bool_t nfs3_mkdir_3_svc();
 #define NFS3_SYMLINK 10
-extern  SYMLINK3res * nfs3_symlink_3();
-extern  SYMLINK3res * nfs3_symlink_3_svc();
+extern  enum clnt_stat nfs3_symlink_3();
+extern  bool_t nfs3_symlink_3_svc();
 #define NFS3_MKNOD 11
-extern  MKNOD3res * nfs3_mknod_3();
-extern  MKNOD3res * nfs3_mknod_3_svc();
+extern  enum clnt_stat nfs3_mknod_3();
+extern  bool_t nfs3_mknod_3_svc();
 #define NFS3_REMOVE 12
-extern  REMOVE3res * nfs3_remove_3();
-extern  REMOVE3res * nfs3_remove_3_svc();
+extern  enum clnt_stat nfs3_remove_3();
+extern  bool_t nfs3_remove_3_svc();
 #define NFS3_RMDIR 13
-extern  RMDIR3res * nfs3_rmdir_3();
-extern  RMDIR3res * nfs3_rmdir_3_svc();
+extern  enum clnt_stat nfs3_rmdir_3();
+extern  bool_t nfs3_rmdir_3_svc();
 #define NFS3_RENAME 14
-extern  RENAME3res * nfs3_rename_3();
-extern  RENAME3res * nfs3_rename_3_svc();
+extern  enum clnt_stat nfs3_rename_3();
+extern  bool_t nfs3_rename_3_svc();
 #define NFS3_LINK 15
-extern  LINK3res * nfs3_link_3();
-extern  LINK3res * nfs3_link_3_svc();
+extern  enum clnt_stat nfs3_link_3();
+extern  bool_t nfs3_link_3_svc();
 #define NFS3_READDIR 16
-extern  READDIR3res * nfs3_readdir_3();
-extern  READDIR3res * nfs3_readdir_3_svc();
+extern  enum clnt_stat nfs3_readdir_3();
+extern  bool_t nfs3_readdir_3_svc();
 #define NFS3_READDIRPLUS 17
-extern  READDIRPLUS3res * nfs3_readdirplus_3();
-extern  READDIRPLUS3res * nfs3_readdirplus_3_svc();
+extern  enum clnt_stat nfs3_readdirplus_3();
+extern  bool_t nfs3_readdirplus_3_svc();
 #define NFS3_FSSTAT 18
-extern  FSSTAT3res * nfs3_fsstat_3();
-extern  FSSTAT3res * nfs3_fsstat_3_svc();
+extern  enum clnt_stat nfs3_fsstat_3();
+extern  bool_t nfs3_fsstat_3_svc();
 #define NFS3_FSINFO 19
-extern  FSINFO3res * nfs3_fsinfo_3();
-extern  FSINFO3res * nfs3_fsinfo_3_svc();
+extern  enum clnt_stat nfs3_fsinfo_3();
+extern  bool_t nfs3_fsinfo_3_svc();
 #define NFS3_PATHCONF 20
-extern  PATHCONF3res * nfs3_pathconf_3();
-extern  PATHCONF3res * nfs3_pathconf_3_svc();
+extern  enum clnt_stat nfs3_pathconf_3();
+extern  bool_t nfs3_pathconf_3_svc();
 #define NFS3_COMMIT 21
-extern  COMMIT3res * nfs3_commit_3();
-extern  COMMIT3res * nfs3_commit_3_svc();
+extern  enum clnt_stat nfs3_commit_3();
+extern  bool_t nfs3_commit_3_svc();
 extern int nfs_program_3_freeresult ();
 #endif /* K&R C */
 
@@ -1145,26 +1147,26 @@ extern int nfs_program_3_freeresult ();
 
 #if defined(__STDC__) || defined(__cplusplus)
 #define NFSACL3_NULL 0
-extern  void * nfsacl3_null_3(void *, CLIENT *);
-extern  void * nfsacl3_null_3_svc(void *, struct svc_req *);
+extern  enum clnt_stat nfsacl3_null_3(void *, void *, CLIENT *);
+extern  bool_t nfsacl3_null_3_svc(void *, void *, struct svc_req *);
 #define NFSACL3_GETACL 1
-extern  GETACL3res * nfsacl3_getacl_3(GETACL3args *, CLIENT *);
-extern  GETACL3res * nfsacl3_getacl_3_svc(GETACL3args *, struct svc_req *);
+extern  enum clnt_stat nfsacl3_getacl_3(GETACL3args *, GETACL3res *, CLIENT *);
+extern  bool_t nfsacl3_getacl_3_svc(GETACL3args *, GETACL3res *, struct svc_req *);
 #define NFSACL3_SETACL 2
-extern  SETACL3res * nfsacl3_setacl_3(SETACL3args *, CLIENT *);
-extern  SETACL3res * nfsacl3_setacl_3_svc(SETACL3args *, struct svc_req *);
+extern  enum clnt_stat nfsacl3_setacl_3(SETACL3args *, SETACL3res *, CLIENT *);
+extern  bool_t nfsacl3_setacl_3_svc(SETACL3args *, SETACL3res *, struct svc_req *);
 extern int nfsacl_program_3_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
 #define NFSACL3_NULL 0
-extern  void * nfsacl3_null_3();
-extern  void * nfsacl3_null_3_svc();
+extern  enum clnt_stat nfsacl3_null_3();
+extern  bool_t nfsacl3_null_3_svc();
 #define NFSACL3_GETACL 1
-extern  GETACL3res * nfsacl3_getacl_3();
-extern  GETACL3res * nfsacl3_getacl_3_svc();
+extern  enum clnt_stat nfsacl3_getacl_3();
+extern  bool_t nfsacl3_getacl_3_svc();
 #define NFSACL3_SETACL 2
-extern  SETACL3res * nfsacl3_setacl_3();
-extern  SETACL3res * nfsacl3_setacl_3_svc();
+extern  enum clnt_stat nfsacl3_setacl_3();
+extern  bool_t nfsacl3_setacl_3_svc();
 extern int nfsacl_program_3_freeresult ();
 #endif /* K&R C */
 
@@ -1175,6 +1177,7 @@ extern  bool_t xdr_cookieverf3 (XDR *, cookieverf3);
 extern  bool_t xdr_uint64 (XDR *, uint64*);
 extern  bool_t xdr_cookie3 (XDR *, cookie3*);
 extern  bool_t xdr_nfs_fh3 (XDR *, nfs_fh3*);
+extern  u_int nfs_fh3hash (const nfs_fh3*);
 extern  bool_t xdr_filename3 (XDR *, filename3*);
 extern  bool_t xdr_diropargs3 (XDR *, diropargs3*);
 extern  bool_t xdr_ftype3 (XDR *, ftype3*);
@@ -1313,6 +1316,7 @@ extern bool_t xdr_cookieverf3 ();
 extern bool_t xdr_uint64 ();
 extern bool_t xdr_cookie3 ();
 extern bool_t xdr_nfs_fh3 ();
+extern u_int nfs_fh3hash ();
 extern bool_t xdr_filename3 ();
 extern bool_t xdr_diropargs3 ();
 extern bool_t xdr_ftype3 ();
@@ -42,141 +42,164 @@ nfs_program_3(struct svc_req *rqstp, register SVCXPRT *transp)
 		PATHCONF3args nfs3_pathconf_3_arg;
 		COMMIT3args nfs3_commit_3_arg;
 	} argument;
-	char *result;
+	union {
+		GETATTR3res nfs3_getattr_3_res;
+		SETATTR3res nfs3_setattr_3_res;
+		LOOKUP3res nfs3_lookup_3_res;
+		ACCESS3res nfs3_access_3_res;
+		READLINK3res nfs3_readlink_3_res;
+		READ3res nfs3_read_3_res;
+		WRITE3res nfs3_write_3_res;
+		CREATE3res nfs3_create_3_res;
+		MKDIR3res nfs3_mkdir_3_res;
+		SYMLINK3res nfs3_symlink_3_res;
+		MKNOD3res nfs3_mknod_3_res;
+		REMOVE3res nfs3_remove_3_res;
+		RMDIR3res nfs3_rmdir_3_res;
+		RENAME3res nfs3_rename_3_res;
+		LINK3res nfs3_link_3_res;
+		READDIR3res nfs3_readdir_3_res;
+		READDIRPLUS3res nfs3_readdirplus_3_res;
+		FSSTAT3res nfs3_fsstat_3_res;
+		FSINFO3res nfs3_fsinfo_3_res;
+		PATHCONF3res nfs3_pathconf_3_res;
+		COMMIT3res nfs3_commit_3_res;
+	} result;
+	bool_t retval;
 	xdrproc_t _xdr_argument, _xdr_result;
-	char *(*local)(char *, struct svc_req *);
+	bool_t (*local)(char *, void *, struct svc_req *);
 
 	switch (rqstp->rq_proc) {
 	case NFS3_NULL:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_void;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_null_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_null_3_svc;
 		break;
 
 	case NFS3_GETATTR:
 		_xdr_argument = (xdrproc_t) xdr_GETATTR3args;
 		_xdr_result = (xdrproc_t) xdr_GETATTR3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_getattr_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_getattr_3_svc;
 		break;
 
 	case NFS3_SETATTR:
 		_xdr_argument = (xdrproc_t) xdr_SETATTR3args;
 		_xdr_result = (xdrproc_t) xdr_SETATTR3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_setattr_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_setattr_3_svc;
 		break;
 
 	case NFS3_LOOKUP:
 		_xdr_argument = (xdrproc_t) xdr_LOOKUP3args;
 		_xdr_result = (xdrproc_t) xdr_LOOKUP3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_lookup_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_lookup_3_svc;
 		break;
 
 	case NFS3_ACCESS:
 		_xdr_argument = (xdrproc_t) xdr_ACCESS3args;
 		_xdr_result = (xdrproc_t) xdr_ACCESS3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_access_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_access_3_svc;
 		break;
 
 	case NFS3_READLINK:
 		_xdr_argument = (xdrproc_t) xdr_READLINK3args;
 		_xdr_result = (xdrproc_t) xdr_READLINK3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_readlink_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_readlink_3_svc;
 		break;
 
 	case NFS3_READ:
 		_xdr_argument = (xdrproc_t) xdr_READ3args;
 		_xdr_result = (xdrproc_t) xdr_READ3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_read_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_read_3_svc;
 		break;
 
 	case NFS3_WRITE:
 		_xdr_argument = (xdrproc_t) xdr_WRITE3args;
 		_xdr_result = (xdrproc_t) xdr_WRITE3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_write_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_write_3_svc;
 		break;
 
 	case NFS3_CREATE:
 		_xdr_argument = (xdrproc_t) xdr_CREATE3args;
 		_xdr_result = (xdrproc_t) xdr_CREATE3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_create_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_create_3_svc;
 		break;
 
 	case NFS3_MKDIR:
 		_xdr_argument = (xdrproc_t) xdr_MKDIR3args;
 		_xdr_result = (xdrproc_t) xdr_MKDIR3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_mkdir_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_mkdir_3_svc;
 		break;
 
 	case NFS3_SYMLINK:
 		_xdr_argument = (xdrproc_t) xdr_SYMLINK3args;
 		_xdr_result = (xdrproc_t) xdr_SYMLINK3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_symlink_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_symlink_3_svc;
 		break;
 
 	case NFS3_MKNOD:
 		_xdr_argument = (xdrproc_t) xdr_MKNOD3args;
 		_xdr_result = (xdrproc_t) xdr_MKNOD3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_mknod_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_mknod_3_svc;
 		break;
 
 	case NFS3_REMOVE:
 		_xdr_argument = (xdrproc_t) xdr_REMOVE3args;
 		_xdr_result = (xdrproc_t) xdr_REMOVE3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_remove_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_remove_3_svc;
 		break;
 
 	case NFS3_RMDIR:
 		_xdr_argument = (xdrproc_t) xdr_RMDIR3args;
 		_xdr_result = (xdrproc_t) xdr_RMDIR3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_rmdir_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_rmdir_3_svc;
 		break;
 
 	case NFS3_RENAME:
 		_xdr_argument = (xdrproc_t) xdr_RENAME3args;
 		_xdr_result = (xdrproc_t) xdr_RENAME3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_rename_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_rename_3_svc;
 		break;
 
 	case NFS3_LINK:
 		_xdr_argument = (xdrproc_t) xdr_LINK3args;
 		_xdr_result = (xdrproc_t) xdr_LINK3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_link_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_link_3_svc;
 		break;
 
 	case NFS3_READDIR:
 		_xdr_argument = (xdrproc_t) xdr_READDIR3args;
 		_xdr_result = (xdrproc_t) xdr_READDIR3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_readdir_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_readdir_3_svc;
 		break;
 
 	case NFS3_READDIRPLUS:
 		_xdr_argument = (xdrproc_t) xdr_READDIRPLUS3args;
 		_xdr_result = (xdrproc_t) xdr_READDIRPLUS3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_readdirplus_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_readdirplus_3_svc;
 		break;
 
 	case NFS3_FSSTAT:
 		_xdr_argument = (xdrproc_t) xdr_FSSTAT3args;
 		_xdr_result = (xdrproc_t) xdr_FSSTAT3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_fsstat_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_fsstat_3_svc;
 		break;
 
 	case NFS3_FSINFO:
 		_xdr_argument = (xdrproc_t) xdr_FSINFO3args;
 		_xdr_result = (xdrproc_t) xdr_FSINFO3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_fsinfo_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_fsinfo_3_svc;
 		break;
 
 	case NFS3_PATHCONF:
 		_xdr_argument = (xdrproc_t) xdr_PATHCONF3args;
 		_xdr_result = (xdrproc_t) xdr_PATHCONF3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_pathconf_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_pathconf_3_svc;
 		break;
 
 	case NFS3_COMMIT:
 		_xdr_argument = (xdrproc_t) xdr_COMMIT3args;
 		_xdr_result = (xdrproc_t) xdr_COMMIT3res;
-		local = (char *(*)(char *, struct svc_req *)) nfs3_commit_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfs3_commit_3_svc;
 		break;
 
 	default:
@@ -188,14 +211,17 @@ nfs_program_3(struct svc_req *rqstp, register SVCXPRT *transp)
 		svcerr_decode (transp);
 		return;
 	}
-	result = (*local)((char *)&argument, rqstp);
-	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) _xdr_result, result)) {
+	retval = (bool_t) (*local)((char *)&argument, (void *)&result, rqstp);
+	if (retval > 0 && !svc_sendreply(transp, (xdrproc_t) _xdr_result, (char *)&result)) {
 		svcerr_systemerr (transp);
 	}
 	if (!svc_freeargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
 		fprintf (stderr, "%s", "unable to free arguments");
 		exit (1);
 	}
+	if (!nfs_program_3_freeresult (transp, _xdr_result, (caddr_t) &result))
+		fprintf (stderr, "%s", "unable to free results");
+
 	return;
 }
 
@@ -206,27 +232,31 @@ nfsacl_program_3(struct svc_req *rqstp, register SVCXPRT *transp)
 		GETACL3args nfsacl3_getacl_3_arg;
 		SETACL3args nfsacl3_setacl_3_arg;
 	} argument;
-	char *result;
+	union {
+		GETACL3res nfsacl3_getacl_3_res;
+		SETACL3res nfsacl3_setacl_3_res;
+	} result;
+	bool_t retval;
 	xdrproc_t _xdr_argument, _xdr_result;
-	char *(*local)(char *, struct svc_req *);
+	bool_t (*local)(char *, void *, struct svc_req *);
 
 	switch (rqstp->rq_proc) {
 	case NFSACL3_NULL:
 		_xdr_argument = (xdrproc_t) xdr_void;
 		_xdr_result = (xdrproc_t) xdr_void;
-		local = (char *(*)(char *, struct svc_req *)) nfsacl3_null_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfsacl3_null_3_svc;
 		break;
 
 	case NFSACL3_GETACL:
 		_xdr_argument = (xdrproc_t) xdr_GETACL3args;
 		_xdr_result = (xdrproc_t) xdr_GETACL3res;
-		local = (char *(*)(char *, struct svc_req *)) nfsacl3_getacl_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfsacl3_getacl_3_svc;
 		break;
 
 	case NFSACL3_SETACL:
 		_xdr_argument = (xdrproc_t) xdr_SETACL3args;
 		_xdr_result = (xdrproc_t) xdr_SETACL3res;
-		local = (char *(*)(char *, struct svc_req *)) nfsacl3_setacl_3_svc;
+		local = (bool_t (*) (char *, void *,  struct svc_req *))nfsacl3_setacl_3_svc;
 		break;
 
 	default:
@@ -238,14 +268,17 @@ nfsacl_program_3(struct svc_req *rqstp, register SVCXPRT *transp)
 		svcerr_decode (transp);
 		return;
 	}
-	result = (*local)((char *)&argument, rqstp);
-	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) _xdr_result, result)) {
+	retval = (bool_t) (*local)((char *)&argument, (void *)&result, rqstp);
+	if (retval > 0 && !svc_sendreply(transp, (xdrproc_t) _xdr_result, (char *)&result)) {
 		svcerr_systemerr (transp);
 	}
 	if (!svc_freeargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
 		fprintf (stderr, "%s", "unable to free arguments");
 		exit (1);
 	}
+	if (!nfsacl_program_3_freeresult (transp, _xdr_result, (caddr_t) &result))
+		fprintf (stderr, "%s", "unable to free results");
+
 	return;
 }
 
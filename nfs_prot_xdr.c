@@ -40,11 +40,33 @@ xdr_nfs_fh3 (XDR *xdrs, nfs_fh3 *objp)
 {
 	register int32_t *buf;
 
-	 if (!xdr_bytes (xdrs, (char **)&objp->data.data_val, (u_int *) &objp->data.data_len, NFS3_FHSIZE))
+	/* the handle is kept inline in nfs_fh3 */
+	 if (!xdr_u_int (xdrs, &objp->data.data_len))
 		 return FALSE;
+	 if (objp->data.data_len > NFS3_FHSIZE)
+		 return FALSE;
+	 if (!xdr_opaque (xdrs, objp->data.data_val, objp->data.data_len))
+		 return FALSE;
+	if (xdrs->x_op == XDR_DECODE)
+		objp->hash = nfs_fh3hash (objp);
 	return TRUE;
 }
 
+/*
+ * FNV-1a hash of a handle. Decoded handles carry it in their hash
+ * field, so caches never need to run over the handle bytes again.
+ */
+u_int
+nfs_fh3hash (const nfs_fh3 *objp)
+{
+	u_int h = 2166136261U;
+	u_int i;
+
+	for (i = 0; i < objp->data.data_len && i < NFS3_FHSIZE; i++)
+		h = (h ^ (u_char) objp->data.data_val[i]) * 16777619U;
+	return h;
+}
+
 bool_t
 xdr_filename3 (XDR *xdrs, filename3 *objp)
 {
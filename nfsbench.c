@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * nfsbench - measure nfsshell against a local in-memory server
+ *
+ * The driver starts memfs, builds a test tree with nfsshell and then
+ * times the commands whose speed matters: put and get of a large
+ * file, ls -l of a large directory and cd down a deep path, once
+ * with the caches warm and once with them flushed before every cd, and
+ * a batch of chmods with the same mode on different files. Every
+ * measured command is run by a single nfsshell session between a
+ * "stats -z" and a "stats -j", so the time and the RPC counts come
+ * from nfsshell itself. Each measurement is one JSON line:
+ *
+ *	{"test":"get","run":1,"proto":"tcp",...,"seconds":0.041,
+ *	 "mb_per_s":1630.2,"rpcs":513,"us_per_rpc":79.9,...}
+ *
+ * "in_flight" is the number of calls the test kept outstanding on
+ * average. The batch runs on nfsshell's batch threads, so when the
+ * server holds its replies (-d) its chmods have to overlap; if they
+ * do not, nfsbench fails.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <rpc/rpc.h>
+#include <rpc/pmap_clnt.h>
+#include "nfs_prot.h"
+
+#define	BENCH_FILE	"bench.dat"	/* file that is put and fetched */
+#define	BENCH_SIZE	64		/* its size in MB */
+#define	BENCH_ENTRIES	2000		/* entries of the listed directory */
+#define	BENCH_DEPTH	32		/* components of the deep path */
+#define	BENCH_CDS	200		/* cd's down that path */
+#define	BENCH_CHMODS	64		/* chmods in the batch */
+#define	BENCH_OVERLAP	2		/* least in_flight of the batch */
+#define	BENCH_RUNS	3		/* times each test is run */
+#define	BENCH_WAIT	100		/* tries to reach the server, 0.1s apart */
+
+/*
+ * The tests, in the order they run
+ */
+struct test {
+    char *t_name;		/* what the JSON line calls it */
+    char *t_proc;		/* procedure whose latency is reported */
+};
+
+static struct test tests[] = {
+    { "put",	"WRITE" },
+    { "get",	"READ" },
+    { "ls",	"READDIRPLUS" },
+    { "cd",	"LOOKUP" },
+    { "cdcold",	"LOOKUP" },
+    { "chmod",	"SETATTR" },
+};
+#define	NTESTS	(sizeof(tests) / sizeof(tests[0]))
+
+static int udp;			/* mount over UDP */
+static long delay;		/* time the server holds every reply (us) */
+static int loss;		/* server reply loss (%) */
+static long size = BENCH_SIZE;
+static int entries = BENCH_ENTRIES;
+static int depth = BENCH_DEPTH;
+static int cds = BENCH_CDS;
+static int chmods = BENCH_CHMODS;
+static int runs = BENCH_RUNS;
+
+static int mkfile(char *, long);
+static int mkscript(char *);
+static pid_t startserver(char *);
+static int runshell(char *, char *, char *);
+static int report(FILE *, char *);
+static long long field(char *, char *);
+static char *procedure(char *, char *);
+
+int
+main(int argc, char **argv)
+{
+    char server[PATH_MAX], shell[PATH_MAX], dir[PATH_MAX];
+    char *srvpath = "./memfs", *shpath = "./nfsshell", *outfile = NULL;
+    char script[PATH_MAX + 16], out[PATH_MAX + 16], data[PATH_MAX + 16];
+    FILE *fp = stdout;
+    int opt, ok = 0;
+    pid_t pid;
+
+    while ((opt = getopt(argc, argv, "Ub:c:d:D:l:n:N:o:r:s:S:")) != EOF) {
+	switch (opt) {
+	case 'U':
+	    udp = 1;
+	    break;
+	case 'b':
+	    chmods = atoi(optarg);
+	    break;
+	case 'c':
+	    cds = atoi(optarg);
+	    break;
+	case 'd':
+	    delay = atol(optarg);
+	    break;
+	case 'D':
+	    depth = atoi(optarg);
+	    break;
+	case 'l':
+	    loss = atoi(optarg);
+	    break;
+	case 'n':
+	    entries = atoi(optarg);
+	    break;
+	case 'N':
+	    shpath = optarg;
+	    break;
+	case 'o':
+	    outfile = optarg;
+	    break;
+	case 'r':
+	    runs = atoi(optarg);
+	    break;
+	case 's':
+	    size = atol(optarg);
+	    break;
+	case 'S':
+	    srvpath = optarg;
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-U] [-d <delay-us>] [-l <loss-%%>] "
+		"[-s <MB>] [-n <entries>] [-D <depth>] [-c <cds>] [-b <chmods>]\n"
+		"\t[-r <runs>] "
+"[-S <memfs>] [-N <nfsshell>] [-o <file>]\n"
+		"\t-U\tmount over UDP\n"
+		"\t-d\ttime the server holds every reply\n"
+		"\t-l\tserver reply loss (use with -U)\n"
+		"\t-s\tsize of the file put and fetched\n"
+		"\t-n\tentries of the listed directory\n"
+		"\t-D\tdepth of the path cd walks\n"
+		"\t-c\tnumber of cd's down that path\n"
+		"\t-b\tnumber of chmods in the batch\n"
+		"\t-r\tnumber of runs of every test\n"
+		"\t-o\twrite the results here instead of stdout\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (size <= 0 || entries <= 0 || depth <= 0 || cds <= 0 || chmods <= 0 ||
+      runs <= 0) {
+	fprintf(stderr, "nfsbench: bad option value\n");
+	exit(1);
+    }
+    if (realpath(srvpath, server) == NULL || realpath(shpath, shell) == NULL) {
+	perror(realpath(srvpath, server) == NULL ? srvpath : shpath);
+	exit(1);
+    }
+    if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL) {
+	perror(outfile);
+	exit(1);
+    }
+
+    strcpy(dir, "/tmp/nfsbench.XXXXXX");
+    if (mkdtemp(dir) == NULL) {
+	perror("nfsbench: mkdtemp");
+	exit(1);
+    }
+    sprintf(script, "%s/script", dir);
+    sprintf(out, "%s/out", dir);
+    sprintf(data, "%s/%s", dir, BENCH_FILE);
+    if (mkfile(data, size << 20) && mkscript(script) &&
+      (pid = startserver(server)) > 0) {
+	if (runshell(shell, dir, out))
+	    ok = report(fp, out);
+	kill(pid, SIGTERM);
+	(void) waitpid(pid, NULL, 0);
+    }
+    (void) unlink(script);
+    (void) unlink(out);
+    (void) unlink(data);
+    (void) rmdir(dir);
+    if (fp != stdout)
+	fclose(fp);
+    exit(ok ? 0 : 1);
+}
+
+/*
+ * Write a file of 'len' bytes that no compression or hole detection
+ * can make smaller
+ */
+static int
+mkfile(char *path, long len)
+{
+    static u_int32_t buf[16384];
+    u_int32_t x = 2463534242U;
+    long n;
+    int fd, i;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+	perror(path);
+	return 0;
+    }
+    for (; len > 0; len -= n) {
+	for (i = 0; i < 16384; i++) {
+	    x ^= x << 13;
+	    x ^= x >> 17;
+	    x ^= x << 5;
+	    buf[i] = x;
+	}
+	n = len < (long) sizeof(buf) ? len : (long) sizeof(buf);
+	if (write(fd, buf, n) != n) {
+	    perror(path);
+	    close(fd);
+	    return 0;
+	}
+    }
+    close(fd);
+    return 1;
+}
+
+/*
+ * The nfsshell script: set up the tree, then every test 'runs' times
+ */
+static int
+mkscript(char *path)
+{
+    FILE *fp;
+    int i, j, k, r;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	perror(path);
+	return 0;
+    }
+    fprintf(fp, "host 127.0.0.1\nmount%s /export\n", udp ? " -U" : "");
+    fprintf(fp, "mkdir lsdir\ncd lsdir\n");
+    for (i = 0; i < entries; i++)
+	fprintf(fp, "mkdir e%d\n", i);
+    fprintf(fp, "cd\n");
+    for (i = 1; i <= depth; i++)
+	fprintf(fp, "mkdir d%d\ncd d%d\n", i, i);
+    fprintf(fp, "cd\nmkdir chdir\ncd chdir\n");
+    for (i = 0; i < chmods; i++)
+	fprintf(fp, "mkdir f%d\n", i);
+    fprintf(fp, "cd\n");
+
+    for (r = 0; r < runs; r++) {
+	fprintf(fp, "stats -z\nput %s\nstats -j\n", BENCH_FILE);
+	fprintf(fp, "stats -z\nget -i %s\nstats -j\nrm %s\n", BENCH_FILE,
+	    BENCH_FILE);
+	fprintf(fp, "cd lsdir\nstats -z\nls -l\nstats -j\ncd\n");
+	for (k = 0; k < 2; k++) {
+	    fprintf(fp, "stats -z\n");
+	    for (j = 0; j < cds; j++) {
+		fprintf(fp, "%scd ", k ? "cache flush\n" : "");
+		for (i = 1; i <= depth; i++)
+		    fprintf(fp, "/d%d", i);
+		fprintf(fp, "\n");
+	    }
+	    fprintf(fp, "stats -j\ncd\n");
+	}
+	fprintf(fp, "cd chdir\nstats -z\n");
+	for (i = 0; i < chmods; i++)
+	    fprintf(fp, "chmod %o f%d\n", r % 2 ? 0600 : 0644, i);
+	fprintf(fp, "stats -j\ncd\n");
+    }
+    if (fclose(fp) == EOF) {
+	perror(path);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Start the server and wait until it is registered
+ */
+static pid_t
+startserver(char *path)
+{
+    struct sockaddr_in sin;
+    char dbuf[32], lbuf[32];
+    int i, status;
+    pid_t pid;
+
+    sprintf(dbuf, "%ld", delay);
+    sprintf(lbuf, "%d", loss);
+    if ((pid = fork()) < 0) {
+	perror("nfsbench: fork");
+	return -1;
+    }
+    if (pid == 0) {
+	execl(path, path, "-d", dbuf, "-l", lbuf, (char *) NULL);
+	perror(path);
+	_exit(1);
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (i = 0; i < BENCH_WAIT; i++) {
+	if (waitpid(pid, &status, WNOHANG) == pid) {
+	    fprintf(stderr, "nfsbench: %s exited\n", path);
+	    return -1;
+	}
+	if (pmap_getport(&sin, NFS_PROGRAM, NFS_V3, IPPROTO_TCP) != 0)
+	    return pid;
+	usleep(100000);
+    }
+    fprintf(stderr, "nfsbench: %s does not answer\n", path);
+    kill(pid, SIGTERM);
+    (void) waitpid(pid, NULL, 0);
+    return -1;
+}
+
+/*
+ * Run the script with nfsshell in 'dir', its output going to 'out'
+ */
+static int
+runshell(char *path, char *dir, char *out)
+{
+    int fd, status;
+    pid_t pid;
+
+    if ((pid = fork()) < 0) {
+	perror("nfsbench: fork");
+	return 0;
+    }
+    if (pid == 0) {
+	if (chdir(dir) < 0 ||
+	  (fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+	    perror(dir);
+	    _exit(1);
+	}
+	(void) dup2(fd, 1);
+	close(fd);
+	execl(path, path, "-v", "-f", "script", (char *) NULL);
+	perror(path);
+	_exit(1);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+	fprintf(stderr, "nfsbench: %s failed\n", path);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Turn the "stats -j" lines of the output into one result line each
+ */
+static int
+report(FILE *fp, char *out)
+{
+    static char line[1 << 16];
+    long long us, rpcs, bytes, ops;
+    struct test *tp;
+    double inflight;
+    char *proc;
+    FILE *in;
+    int n = 0, ok = 1;
+
+    if ((in = fopen(out, "r")) == NULL) {
+	perror(out);
+	return 0;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+	if (strncmp(line, "{\"elapsed_us\":", 14) != 0)
+	    continue;
+	tp = &tests[n % NTESTS];
+	us = field(line, "elapsed_us");
+	rpcs = field(line, "calls");
+	ops = strncmp(tp->t_name, "cd", 2) == 0 ? cds :
+	    strcmp(tp->t_name, "ls") == 0 ? entries :
+	    strcmp(tp->t_name, "chmod") == 0 ? chmods : 1;
+	bytes = strcmp(tp->t_name, "put") == 0 ||
+	    strcmp(tp->t_name, "get") == 0 ? size << 20 : 0;
+	fprintf(fp, "{\"test\":\"%s\",\"run\":%d,\"proto\":\"%s\","
+	    "\"delay_us\":%ld,\"loss_pct\":%d,\"ops\":%lld,\"bytes\":%lld,"
+	    "\"seconds\":%.6f,\"mb_per_s\":%.3f,\"us_per_op\":%.3f,"
+	    "\"rpcs\":%lld,\"us_per_rpc\":%.3f,\"retrans\":%lld,"
+	    "\"errors\":%lld",
+	    tp->t_name, n / (int) NTESTS + 1, udp ? "udp" : "tcp", delay, loss,
+	    ops, bytes, us / 1e6, us > 0 ? bytes / (double) us : 0.0,
+	    (double) us / ops, rpcs, rpcs > 0 ? (double) us / rpcs : 0.0,
+	    field(line, "retrans"), field(line, "errors"));
+	if ((proc = procedure(line, tp->t_proc)) != NULL) {
+	    inflight = us > 0 ?
+		field(proc, "calls") * field(proc, "p50_us") / (double) us : 0.0;
+	    fprintf(fp, ",\"proc\":\"%s\",\"p50_us\":%lld,\"p99_us\":%lld,"
+		"\"in_flight\":%.2f", tp->t_proc, field(proc, "p50_us"),
+		field(proc, "p99_us"), inflight);
+	    if (strcmp(tp->t_name, "chmod") == 0 && delay > 0 && chmods > 1 &&
+	      inflight < BENCH_OVERLAP) {
+		fprintf(stderr, "nfsbench: the chmods of run %d did not "
+		    "overlap\n", n / (int) NTESTS + 1);
+		ok = 0;
+	    }
+	}
+	fprintf(fp, "}\n");
+	n++;
+    }
+    fclose(in);
+    if (n != runs * (int) NTESTS) {
+	fprintf(stderr, "nfsbench: %d of %d results\n", n,
+	    runs * (int) NTESTS);
+	return 0;
+    }
+    return ok;
+}
+
+/*
+ * The sum of all numeric fields 'name' in a JSON text
+ */
+static long long
+field(char *text, char *name)
+{
+    char key[64], *cp;
+    long long sum = 0;
+    size_t len;
+
+    len = snprintf(key, sizeof(key), "\"%s\":", name);
+    for (cp = text; (cp = strstr(cp, key)) != NULL; cp += len)
+	sum += strtoll(cp + len, NULL, 10);
+    return sum;
+}
+
+/*
+ * The statistics object of procedure 'name' in a "stats -j" line,
+ * cut off at its end
+ */
+static char *
+procedure(char *text, char *name)
+{
+    char key[64], *cp, *end;
+
+    snprintf(key, sizeof(key), "\"procedure\":\"%s\"", name);
+    if ((cp = strstr(text, key)) == NULL)
+	return NULL;
+    if ((end = strchr(cp, '}')) != NULL)
+	*end = '\0';
+    return cp;
+}
@@ -45,6 +45,9 @@
  *	- Linux modifications (and other cleanup) inspired by Marc Heuse
  *	- Porting to NFSv3 done by Michael Brown
  */
+#ifdef __linux__
+#define	_GNU_SOURCE		/* SEEK_DATA, SEEK_HOLE and fallocate */
+#endif
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
@@ -58,7 +61,13 @@
 #endif
 #include <unistd.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <rpc/rpc.h>
 #include <rpc/key_prot.h>
 #include <rpc/pmap_clnt.h>
@@ -73,6 +82,15 @@
 #include <sys/sysmacros.h>
 #include "mount.h"
 #include "nfs_prot.h"
+#include "rpcpipe.h"
+#include "dnlc.h"
+#include "bcache.h"
+#include "mntcache.h"
+#include "pathcache.h"
+#include "manifest.h"
+#include "rpcstats.h"
+#include "pattern.h"
+#include "scan.h"
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
 
@@ -92,6 +110,25 @@
  * Fundamental constants
  */
 #define	NARGVEC		100	/* maximum number of arguments */
+#define	NWINDOW		16	/* default number of READs/WRITEs in flight */
+#define	NRESEND		3	/* times to resend a file the server lost */
+#define	DIRCOUNT	8192	/* transfer sizes when FSINFO fails */
+#define	MAXXFER		1048576	/* largest READ/WRITE/READDIR we issue */
+#define	UDPXFER		8192	/* initial READ/WRITE size over UDP */
+#define	UDPMAXXFER	61440	/* largest READ/WRITE that fits a datagram */
+#define	UDPBUFSIZE	65536	/* NFS client buffers over UDP */
+#define	NWORKERS	4	/* default number of get -r worker threads */
+#define	NBATCH		8	/* default number of concurrent batch commands */
+#define	NBULK		64	/* default rm/chmod/chown calls in flight */
+#define	NWHY		32	/* distinct reasons for failure counted */
+#define	MAXCONNECT	RPCPIPE_MAXSET /* most transports per mount */
+#define	MAXPARTS	64	/* most get -P threads */
+#define	SEGSIZE		(8 * 1024 * 1024) /* bytes in a get -P segment */
+#define	SIDECAR		".nfsget" /* suffix of a get -P progress file */
+#define	SYNCFILE	".nfssync" /* suffix of a sync manifest */
+#define	HOLESIZE	4096	/* zeros get and put leave as a hole */
+#define	NHOSTPORT	4	/* MOUNT and NFS, over TCP and UDP */
+#define	RACEDELAY	250	/* ms TCP may trail UDP and still win */
 
 /*
  * File modes
@@ -120,9 +157,9 @@
 #define	CMD_GID		3	/* gid [<gid>] */
 #define	CMD_CD		4	/* cd [<path>] */
 #define	CMD_LCD		5	/* lcd [<path>] */
-#define	CMD_CAT		6	/* cat <filespec> */
-#define	CMD_LS		7	/* ls [-l] <filespec> */
-#define	CMD_GET		8	/* get <filespec> */
+#define	CMD_CAT		6	/* cat [-w <window>] <filespec> */
+#define	CMD_LS		7	/* ls [-lU] <filespec> */
+#define	CMD_GET		8	/* get [-irS] [-j <workers>] [-w <window>] <filespec> */
 #define	CMD_DF		9	/* df */
 #define	CMD_MOUNT	10	/* mount [-upTU] <path> */
 #define	CMD_UMOUNT	11	/* umount */
@@ -132,16 +169,27 @@
 #define	CMD_STATUS	15	/* status */
 #define	CMD_HELP	16	/* help */
 #define	CMD_QUIT	17	/* quit */
-#define	CMD_RM		18	/* rm <file> */
+#define	CMD_RM		18	/* rm [-r] <filespec> ... */
 #define	CMD_LN		19	/* ln <file1> <file2> */
 #define	CMD_MV		20	/* mv <file1> <file2> */
 #define	CMD_MKDIR	21	/* mkdir <dir> */
 #define	CMD_RMDIR	22	/* rmdir <dir> */
-#define	CMD_CHMOD	23	/* chmod <mode> <file> */
-#define	CMD_CHOWN	24	/* chown <uid>[.<gid>] <file> */
-#define	CMD_PUT		25	/* put <local-file> [<remote-file>] */
+#define	CMD_CHMOD	23	/* chmod [-r] <mode> <filespec> ... */
+#define	CMD_CHOWN	24	/* chown [-r] <uid>[.<gid>] <filespec> ... */
+#define	CMD_PUT		25	/* put [-z] [-w <window>] <local-file> [<remote-file>] */
 #define CMD_HANDLE	26	/* handle [<file-handle>] */
 #define	CMD_MKNOD	27	/* mknod <name> [b/c major minor] [p] */
+#define	CMD_CACHE	28	/* cache [on|off|flush|<timeouts>|blocks <n> [<ttl>]] */
+#define	CMD_STATS	29	/* stats [-jz] */
+#define	CMD_DU		30	/* du [-s] [-d <depth>] [-j <workers>] [<dir>] */
+#define	CMD_FIND	31	/* find [-j <workers>] [<dir>] [<tests>] */
+#define	CMD_TREE	32	/* tree [-L <depth>] [<dir>] */
+#define	CMD_SCAN	33	/* scan [-a] [-w <window>] [-f <file>] <host|cidr>... */
+#define	CMD_HEAD	34	/* head [-n <lines> | -c <bytes>] <filespec> */
+#define	CMD_TAIL	35	/* tail [-n <lines> | -c <bytes>] <filespec> */
+#define	CMD_HEXDUMP	36	/* hexdump [-s <offset>] [-n <length>] <filespec> */
+#define	CMD_WATCH	37	/* watch [-1] [-i <secs>] [<command>] */
+#define	CMD_SYNC	38	/* sync [-z] [-j <workers>] [-w <window>] <dir> [<local-dir>] */
 
 /*
  * Key word table
@@ -156,31 +204,370 @@ struct keyword {
     { "gid",	  CMD_GID,	"[<gid>] - set remote group id" },
     { "cd",	  CMD_CD,	"[<path>] - change remote working directory" },
     { "lcd",	  CMD_LCD,	"[<path>] - change local working directory" },
-    { "cat",	  CMD_CAT,	"<filespec> - display remote file" },
-    { "ls",	  CMD_LS,	"[-l] <filespec> - list remote directory" },
-    { "get",	  CMD_GET,	"<filespec> - get remote files" },
+    { "cat",	  CMD_CAT,	"[-w <window>] <filespec> - display remote file" },
+    { "head",	  CMD_HEAD,	"[-n <lines> | -c <bytes>] <filespec> - display start of remote file" },
+    { "tail",	  CMD_TAIL,	"[-n <lines> | -c <bytes>] <filespec> - display end of remote file" },
+    { "hexdump",  CMD_HEXDUMP,	"[-s <offset>] [-n <length>] <filespec> - dump part of remote file" },
+    { "ls",	  CMD_LS,	"[-lU] <filespec> - list remote directory" },
+    { "get",	  CMD_GET,	"[-irS] [-j <workers>] [-P <parts>] [-w <window>] <filespec> - get remote files" },
+    { "sync",	  CMD_SYNC,	"[-z] [-j <workers>] [-w <window>] <dir> [<local-dir>] - fetch what changed since the last sync" },
     { "df",	  CMD_DF,	"- file system information" },
-    { "rm",	  CMD_RM,	"<file> - delete remote file" },
+    { "du",	  CMD_DU,	"[-s] [-d <depth>] [-j <workers>] [<dir>] - space used below directories" },
+    { "find",	  CMD_FIND,	"[-j <workers>] [<dir>] [-name <pattern>] [-type <c>] [-perm [-/]<mode>] [-uid <uid>] [-gid <gid>] - find files" },
+    { "tree",	  CMD_TREE,	"[-L <depth>] [<dir>] - show directory tree" },
+    { "rm",	  CMD_RM,	"[-r] [-j <workers>] [-w <window>] <filespec> ... - delete remote files" },
     { "ln",	  CMD_LN,	"<file1> <file2> - link file" },
     { "mv",	  CMD_MV,	"<file1> <file2> - move file" },
     { "mkdir",	  CMD_MKDIR,	"<dir> - make remote directory" },
     { "rmdir",	  CMD_RMDIR,	"<dir> - remove remote directory" },
-    { "chmod",	  CMD_CHMOD,	"<mode> <file> - change mode" },
-    { "chown",	  CMD_CHOWN,	"<uid>[.<gid>] <file> -  change owner" },
-    { "put",	  CMD_PUT,	"<local-file> [<remote-file>] - put file" },
-    { "mount",	  CMD_MOUNT,	"[-upTU] [-P port] <path> - mount file system" },
+    { "chmod",	  CMD_CHMOD,	"[-r] [-j <workers>] [-w <window>] <mode> <filespec> ... - change mode" },
+    { "chown",	  CMD_CHOWN,	"[-r] [-j <workers>] [-w <window>] <uid>[.<gid>] <filespec> ... -  change owner" },
+    { "put",	  CMD_PUT,	"[-z] [-w <window>] <local-file> [<remote-file>] - put file" },
+    { "mount",	  CMD_MOUNT,	"[-upTU] [-P port] [-n conns] <path> - mount file system" },
     { "umount",	  CMD_UMOUNT,	"- umount remote file system" },
     { "umountall",CMD_UMOUNTALL,"- umount all remote file systems" },
     { "export",	  CMD_EXPORT,	"- show all exported file systems" },
     { "dump",	  CMD_DUMP,	"- show all remote mounted file systems" },
+    { "scan",	  CMD_SCAN,	"[-a] [-w <window>] [-f <file>] <host|cidr>... - probe hosts for exports, as JSON" },
     { "status",	  CMD_STATUS,	"- general status report" },
     { "help",	  CMD_HELP,	"- this help message" },
     { "quit",	  CMD_QUIT,	"- its all in the name" },
     { "bye",	  CMD_QUIT,	"- good bye" },
     { "handle",	  CMD_HANDLE,	"[<handle>] - get/set directory file handle" },
-    { "mknod",	  CMD_MKNOD,	"<name> [b/c major minor] [p] - make device" }
+    { "mknod",	  CMD_MKNOD,	"<name> [b/c major minor] [p] - make device" },
+    { "cache",	  CMD_CACHE,	"[on|off|flush|<acregmin> <acregmax> <acdirmin> <acdirmax>|blocks <n> [<ttl>]] - name and block cache" },
+    { "stats",	  CMD_STATS,	"[-jz] - RPC statistics per procedure, -j as JSON, -z to clear" },
+    { "watch",	  CMD_WATCH,	"[-1] [-i <secs>] [<command>] - show RPC rates per thread and procedure, while command runs" }
 };
  
+/*
+ * Directory entry, as read by readdirentries. The attributes and handle
+ * are only filled in when READDIRPLUS (or a LOOKUP) supplied them.
+ */
+struct direntry {
+    char *de_name;		/* entry name */
+    int de_hasattr;		/* de_attr is valid */
+    fattr3 de_attr;		/* entry attributes */
+    int de_hashandle;		/* de_handle is valid */
+    nfs_fh3 de_handle;		/* entry file handle */
+};
+
+/*
+ * A table of directory entries built by getdirentries. The names live
+ * in a string arena, a list of large chunks, rather than in a malloc'd
+ * block each.
+ */
+struct namechunk {
+    struct namechunk *nc_next;	/* next (older) chunk */
+    u_int nc_used;		/* bytes in use */
+    u_int nc_size;		/* bytes available in nc_data */
+    char nc_data[1];		/* the names */
+};
+
+struct dirtable {
+    struct direntry *dt_table;	/* the entries */
+    struct direntry *dt_ptr;	/* just beyond the last entry */
+    int dt_size;		/* number of entries allocated */
+    struct namechunk *dt_names;	/* arena holding the names */
+};
+
+#define	NAMECHUNK	16384	/* size of a name arena chunk */
+
+/*
+ * Transfer sizes. The server's limits and preferences come from
+ * FSINFO and the sizes in use start out at the preferred values.
+ * Over UDP a large call or reply travels as a train of IP fragments,
+ * and losing any one of them loses the whole datagram, so there the
+ * READ and WRITE sizes start small and grow while nothing gets lost
+ * (see adaptsize).
+ */
+struct xferprofile {
+    u_int xp_rtmax;		/* server's maximum READ size */
+    u_int xp_rtpref;		/* server's preferred READ size */
+    u_int xp_wtmax;		/* server's maximum WRITE size */
+    u_int xp_wtpref;		/* server's preferred WRITE size */
+    u_int xp_dtpref;		/* server's preferred READDIR size */
+    u_int xp_rmax;		/* largest READ size we issue */
+    u_int xp_wmax;		/* largest WRITE size we issue */
+    u_int xp_rsize;		/* READ size in use */
+    u_int xp_rceil;		/* READ size not to grow beyond */
+    u_int xp_wsize;		/* WRITE size in use */
+    u_int xp_wceil;		/* WRITE size not to grow beyond */
+    u_int xp_dsize;		/* READDIR size in use */
+};
+
+#define	XFER_KEEP	0	/* adaptsize: just return the size */
+#define	XFER_GROW	1	/* no loss, try a larger size */
+#define	XFER_SHRINK	2	/* datagrams got lost, back off */
+
+/*
+ * Port of one of the programs on the current host. All of them are
+ * looked up together when the host is opened (see getports).
+ */
+struct hostport {
+    u_long hp_prog;		/* program */
+    u_long hp_vers;		/* its version */
+    int hp_proto;		/* IPPROTO_TCP or IPPROTO_UDP */
+    int hp_valid;		/* it has been looked up */
+    int hp_cached;		/* it came from the persistent cache */
+    u_short hp_port;		/* port (network order), 0 if not registered */
+};
+
+/*
+ * Bringing up a transport. When either will do, a TCP connection and
+ * a NULL call over UDP set out together and the first to get through
+ * wins, but TCP is preferred and gets RACEDELAY ms to catch up with a
+ * UDP answer. The caller can get on with other calls meanwhile.
+ */
+struct race {
+    u_long ra_prog;		/* program to talk to */
+    u_long ra_vers;		/* its version */
+    struct sockaddr_in ra_tcpaddr; /* its TCP address */
+    struct sockaddr_in ra_udpaddr; /* its UDP address */
+    int ra_tcp;			/* TCP socket being connected, or -1 */
+    int ra_tcpcached;		/* its port came from a cache */
+    int ra_tcperr;		/* why the TCP connection failed */
+    int ra_udp;			/* UDP socket, or -1 */
+    int ra_udpcached;		/* its port came from a cache */
+    int ra_probing;		/* the NULL call is out over UDP */
+    AUTH *ra_auth;		/* credentials of the NULL call */
+    struct rpcpipe ra_pipe;	/* carries it */
+    struct rpccall ra_call;	/* the NULL call */
+};
+
+/*
+ * The calls that find out about a freshly mounted file system. They
+ * go out together, and the rest of the transport pool is set up while
+ * the replies are on their way.
+ */
+struct probe {
+    struct rpcpipe pr_pipe;	/* carries the calls */
+    int pr_open;		/* pr_pipe was opened */
+    struct rpccall pr_call[3];	/* FSINFO, GETATTR and FSSTAT */
+    nfs_fh3 pr_root;		/* arguments of all three */
+    FSINFO3res pr_fsinfo;	/* results */
+    GETATTR3res pr_getattr;
+    FSSTAT3res pr_fsstat;
+};
+
+/*
+ * get -r is carried out by a pool of worker threads, each with its
+ * own connection to the server. Every worker has a deque of tasks:
+ * it pushes the work it discovers at the tail and takes its next
+ * task from there too, so a single worker goes depth first and keeps
+ * its queue short. An idle worker steals from the head of another
+ * worker's deque, which is where the largest unexplored subtrees
+ * are. The deques are small and tasks are comparatively expensive
+ * (READDIRPLUS or a whole file), so one pool lock guards them all.
+ */
+struct task {
+    int t_type;			/* TASK_DIR, TASK_FILE or TASK_WALK */
+    nfs_fh3 t_handle;		/* remote handle */
+    size3 t_size;		/* size of a remote file */
+    char *t_path;		/* local path name, or remote for TASK_WALK */
+    int t_depth;		/* levels below the starting directory */
+    void *t_data;		/* the walk's own data for this directory */
+    struct task *t_next;	/* towards the tail of the deque */
+    struct task *t_prev;	/* towards the head of the deque */
+};
+
+#define	TASK_DIR	1	/* create directory, queue its contents */
+#define	TASK_FILE	2	/* copy a regular file */
+#define	TASK_WALK	3	/* visit the entries of a remote directory */
+
+/*
+ * The du, find and tree commands walk a remote tree with the same
+ * pool (TASK_WALK). Every entry of a directory is shown to the walk's
+ * visit function, with its attributes and handle filled in and its
+ * remote path name; a directory is descended into when that returns
+ * nonzero, and the walk's data for it is what the function left in
+ * its last argument. Once a directory's entries have all been
+ * visited the leave function gets to see its task, along with the
+ * connection of the worker that walked it. To keep memory
+ * bounded on very wide trees a worker walks a subdirectory itself,
+ * rather than queueing it, once WALKFRONTIER tasks are waiting.
+ */
+struct pool;
+typedef int (*walkvisit_t)(struct pool *, struct task *, struct direntry *,
+    char *, void **);
+typedef void (*walkleave_t)(struct pool *, struct task *, CLIENT *);
+
+#define	WALKFRONTIER	4096	/* most directories queued by a walk */
+
+struct worker {
+    pthread_t w_thread;		/* thread running this worker */
+    CLIENT *w_client;		/* its connection to the server */
+    struct task *w_head;	/* oldest task, taken by thieves */
+    struct task *w_tail;	/* newest task, taken by the owner */
+    struct pool *w_pool;	/* pool this worker belongs to */
+};
+
+struct pool {
+    pthread_mutex_t p_lock;	/* guards everything below */
+    pthread_cond_t p_cond;	/* signalled when work appears/runs out */
+    char *p_cmd;		/* command name, for messages */
+    struct worker *p_workers;	/* the workers */
+    int p_nworkers;		/* number of workers */
+    int p_next;			/* worker that gets the next initial task */
+    int p_pending;		/* tasks queued or being worked on */
+    int p_queued;		/* tasks queued only */
+    int p_window;		/* READs in flight per file */
+    int p_holes;		/* leave blocks of zeros out of the copies */
+    struct manifest *p_manifest; /* sync: what the last one fetched */
+    size_t p_rootlen;		/* sync: length of the local directory name */
+    walkvisit_t p_visit;	/* TASK_WALK: called for every entry */
+    walkleave_t p_leave;	/* TASK_WALK: called when a directory is done */
+    void *p_arg;		/* TASK_WALK: the walk's own state */
+    u_long p_dirs;		/* directories created */
+    u_long p_files;		/* files copied */
+    unsigned long long p_bytes;	/* bytes copied */
+    u_long p_errors;		/* tasks that failed */
+    u_long p_same;		/* sync: files that did not change */
+    unsigned long long p_written; /* sync: bytes written to local copies */
+};
+
+/*
+ * A get -P transfer of one large file. The file is cut into segments
+ * that a few threads fetch concurrently, each over a connection of
+ * its own. Finished segments are noted in a sidecar file next to the
+ * local copy, so an interrupted transfer resumes where it stopped.
+ */
+struct rangeget {
+    pthread_mutex_t rg_lock;	/* guards everything below */
+    nfs_fh3 rg_handle;		/* remote file */
+    size3 rg_size;		/* its size */
+    offset3 rg_end;		/* where the file turned out to end */
+    int rg_fd;			/* local copy */
+    int rg_mapped;		/* segments can be mapped */
+    int rg_window;		/* READs in flight per thread */
+    int rg_holes;		/* leave blocks of zeros out of the copy */
+    u_long rg_nseg;		/* number of segments */
+    u_long rg_next;		/* next segment to consider */
+    u_long rg_done;		/* number of segments finished */
+    char *rg_have;		/* which segments are finished */
+    FILE *rg_sidecar;		/* where finished segments are noted */
+    u_long rg_errors;		/* segments that failed */
+};
+
+struct rangeworker {
+    pthread_t rw_thread;	/* thread running this worker */
+    CLIENT *rw_client;		/* its connection to the server */
+    struct rangeget *rw_get;	/* transfer it works on */
+};
+
+/*
+ * du adds up the space used below every directory. A directory's
+ * total is complete, and printed, once its own listing and those of
+ * all its subdirectories are done; it is then added to its parent's.
+ * Files with more than one link are counted only once.
+ */
+struct dunode {
+    struct dunode *dn_parent;	/* directory this one is in */
+    int dn_refs;		/* own listing plus subdirectories not done */
+    int dn_depth;		/* levels below the starting directory */
+    unsigned long long dn_used;	/* bytes used by the subtree so far */
+    char dn_path[1];		/* remote path name */
+};
+
+struct duwalk {
+    pthread_mutex_t du_lock;	/* guards everything below and the nodes */
+    int du_depth;		/* deepest directories to report */
+    fileid3 *du_seen;		/* hash set of linked files counted */
+    u_long du_nseen;		/* number of files in it */
+    u_long du_size;		/* its number of slots */
+};
+
+/*
+ * The tests of a find, all of which an entry has to pass
+ */
+struct findwalk {
+    pthread_mutex_t fw_lock;	/* guards fw_name and the output */
+    struct pattern *fw_name;	/* -name patterns, or NULL */
+    int fw_type;		/* -type, -1 for any */
+    int fw_permop;		/* -perm: '=', '-' (all) or '/' (any), or 0 */
+    mode3 fw_perm;		/* mode bits for -perm */
+    int fw_uid;			/* -uid, -1 for any */
+    int fw_gid;			/* -gid, -1 for any */
+};
+
+/*
+ * rm, chmod and chown act on many names at once. The calls for the
+ * entries of one directory go out together, up to a window of them
+ * in flight (bulkapply). With -r the directories named are walked by
+ * a pool (TASK_WALK), and a directory itself is dealt with only once
+ * everything below it is done: rm -r then finds it empty, and chmod
+ * -r cannot lock the walk out of it halfway. Failures are counted by
+ * their reason, for the summary at the end.
+ */
+struct bulkent {
+    char *be_name;		/* name in its directory */
+    nfs_fh3 be_handle;		/* handle of the object */
+    ftype3 be_type;		/* its type */
+};
+
+struct bulkdir {
+    struct bulkdir *bd_parent;	/* directory this one is in, or NULL */
+    int bd_refs;		/* own listing plus subdirectories not done */
+    int bd_failed;		/* something below it could not be removed */
+    char *bd_path;		/* remote path name, for messages */
+    struct bulkent bd_self;	/* the directory, as an entry of its parent */
+    struct bulkent *bd_ents;	/* entries to act on */
+    int bd_nents;		/* number of entries */
+    int bd_size;		/* room in bd_ents */
+};
+
+#define	BULK_RM		1	/* REMOVE, or RMDIR for directories */
+#define	BULK_SETATTR	2	/* SETATTR of bo_attr */
+
+struct bulkop {
+    pthread_mutex_t bo_lock;	/* guards the counts and the bulkdirs */
+    char *bo_cmd;		/* command name, for messages */
+    int bo_op;			/* BULK_RM or BULK_SETATTR */
+    sattr3 bo_attr;		/* BULK_SETATTR: attributes to set */
+    int bo_recurse;		/* -r: descend into directories */
+    int bo_window;		/* calls in flight per directory */
+    int bo_nworkers;		/* workers of a -r walk */
+    u_long bo_done;		/* objects removed or changed */
+    u_long bo_failed;		/* objects that were not */
+    char *bo_why[NWHY];		/* reasons for that */
+    u_long bo_count[NWHY];	/* and how often each came up */
+    int bo_nwhy;		/* number of reasons */
+    int bo_rmdirs;		/* directories were removed */
+};
+
+/*
+ * A REMOVE, RMDIR or SETATTR on its way through the pipeline
+ */
+struct bulkcall {
+    struct rpccall bc_call;	/* the call */
+    struct bulkent *bc_ent;	/* entry it is for, NULL when the slot is free */
+    union {
+	REMOVE3args remove;
+	RMDIR3args rmdir;
+	SETATTR3args setattr;
+    } bc_args;			/* its arguments */
+    union {
+	REMOVE3res remove;
+	RMDIR3res rmdir;
+	SETATTR3res setattr;
+    } bc_res;			/* and its results */
+};
+
+/*
+ * A thread that shows the RPC rates every so often, while a command
+ * runs
+ */
+struct watcher {
+    pthread_t wt_thread;	/* thread doing so */
+    pthread_mutex_t wt_lock;	/* guards wt_stop */
+    pthread_cond_t wt_cond;	/* signalled when it has to stop */
+    FILE *wt_fp;		/* where to show them */
+    int wt_interval;		/* seconds between views */
+    int wt_brief;		/* one line per view */
+    int wt_clear;		/* redraw the screen for each view */
+    int wt_stop;		/* exit now */
+};
+
 /* run-time settable flags */
 int verbose = 1;		/* verbosity flag */
 int interact = 1;		/* interactive mode */
@@ -197,28 +584,76 @@ char *remotehost = NULL;	/* remote host name */
 struct sockaddr_in server_addr;	/* remote server address information */
 struct sockaddr_in mntserver_addr; /* remote mount server address */
 struct sockaddr_in nfsserver_addr; /* remote nfs server address */
+struct hostport hostports[NHOSTPORT] = { /* ports of the remote host */
+    { MOUNT_PROGRAM, MOUNT_V3, IPPROTO_TCP },
+    { MOUNT_PROGRAM, MOUNT_V3, IPPROTO_UDP },
+    { NFS_PROGRAM, NFS_V3, IPPROTO_TCP },
+    { NFS_PROGRAM, NFS_V3, IPPROTO_UDP },
+};
 CLIENT *mntclient = NULL;	/* mount RPC client */
-CLIENT *nfsclient = NULL;	/* nfs RPC client */
+__thread CLIENT *nfsclient = NULL; /* nfs RPC client, one per thread */
+int nfsproto;			/* transport used by nfsclient */
+CLIENT *nfsconns[MAXCONNECT];	/* transport pool, [0] is the main nfsclient */
+int connlent[MAXCONNECT];	/* pool connection is in use by a thread */
+int nnfsconns;			/* number of connections in the pool */
+int nconnect = 1;		/* pool size asked for by mount -n */
+pthread_mutex_t connlock = PTHREAD_MUTEX_INITIALIZER; /* guards connlent */
+mountres3 mountres;		/* result of the last mount call */
 mountres3 *mountpoint = NULL;	/* remote mount point */
 nfs_fh3 directory_handle;	/* current directory handle */
+nfs_fh3 root_handle;		/* handle of the mount point */
 struct timeval timeout = { 60, 0 }; /* default time out */
-int transfersize;		/* NFS default transfer size */
+struct xferprofile xfer;	/* NFS transfer sizes */
+pthread_mutex_t xferlock = PTHREAD_MUTEX_INITIALIZER; /* guards xfer sizes */
+int readdirplus = 1;		/* server supports READDIRPLUS */
 
 /* interrupt environments */
 jmp_buf intenv;			/* where to go in interrupts */
+volatile sig_atomic_t pool_stopped; /* get -r or a walk was interrupted */
+int concurrent;			/* worker threads are running commands */
+struct watcher *watching;	/* watch running a command, or NULL */
+int progress;			/* batch: seconds between progress lines */
+pthread_t shellthread;		/* the thread reading commands */
+
+/* what came from the persistent cache (see mntcache.c) */
+int mountcached;		/* the mount point handle and FSINFO */
+int cwdcached;			/* the current directory handle */
+char *cwdpath;			/* absolute path of current directory, if known */
 
 void interrupt(int);
 int command(char *);
 int ngetline(char *, int, int *, char **, int);
+void splitline(char *, int *, char **, int);
+int execute(char *, int, char **);
+struct job;
+struct runname;
+struct jobthread;
+int batch(char *, int, char **, int);
+int independent(struct job *);
+int claimnames(struct runname **, struct job *);
+struct runname *findname(struct runname **, char *, int);
+void addname(struct runname **, char *, int);
+u_int namehash(char *);
+void freenames(struct runname **);
+void runjobs(struct job *, int, struct jobthread *, int *, int);
+void dropjobthreads(struct jobthread *, int *);
+void *runjob(void *);
 void do_host(int, char **);
 void do_setuid(int, char **);
 void do_setgid(int, char **);
 void do_cd(int, char **);
 void do_lcd(int, char **);
 void do_cat(int, char **);
+void do_head(int, char **);
+void do_tail(int, char **);
+void do_hexdump(int, char **);
 void do_ls(int, char **);
 void do_get(int, char **);
+void do_sync(int, char **);
 void do_df(int, char **);
+void do_du(int, char **);
+void do_find(int, char **);
+void do_tree(int, char **);
 void do_rm(int, char **);
 void do_ln(int, char **);
 void do_mv(int, char **);
@@ -234,8 +669,16 @@ void do_umount(int, char **);
 void do_umountall(int, char **);
 void do_export(int, char **);
 void do_dump(int, char **);
+void do_scan(int, char **);
 void do_status(int, char **);
 void do_help(int, char **);
+void do_cache(int, char **);
+void do_stats(int, char **);
+void do_watch(int, char **);
+int watch_start(struct watcher *, FILE *, int, int);
+void watch_stop(struct watcher *);
+void *watcher(void *);
+void printcachestatus(void);
 
 AUTH *create_authenticator(void);
 char *nfs_error(enum nfsstat3);
@@ -243,19 +686,128 @@ int open_mount(char *);
 void close_mount(void);
 int sourceroute(char *, struct sockaddr_in *, int, int);
 int open_nfs(char *, int, int);
-mountres3 *pmap_mnt(dirpath *, struct sockaddr_in *);
-int determine_transfersize(void);
-int setup(int , struct sockaddr_in *, int, int);
+CLIENT *clone_nfsclient(void);
+CLIENT *getconn(void);
+void putconn(CLIENT *);
+void threadname(char *, int);
+void openconns(int);
+CLIENT *attach_nfsclient(struct sockaddr_in *, int, int);
+void closeconns(void);
+void setauth(void);
+struct pipeset;
+int openpipes(struct pipeset *, CLIENT *, u_int);
+void closepipes(struct pipeset *);
+int pipesbusy(struct pipeset *);
+int pipesretrans(struct pipeset *);
+int pmap_mnt(dirpath *, struct sockaddr_in *, mountres3 *);
+void determine_xferprofile(void);
+void probestart(struct probe *);
+void probefinish(struct probe *);
+void set_xferprofile(void);
+void cache_mount(void);
+int remount(void);
+int revalidate(nfs_fh3 *);
+int walkpath(char *, nfs_fh3 *);
+int walkrelative(char *, nfs_fh3 *);
+int walkparent(char *, nfs_fh3 *, char **);
+char *abspath(char *);
+u_int adaptsize(u_int *, u_int *, int);
+void getports(struct sockaddr_in *);
+int getport(struct sockaddr_in *, u_long, u_long, int);
+void forgetport(struct sockaddr_in *, u_long, u_long, int);
+void racestart(struct race *, struct sockaddr_in *, u_long, u_long,
+    int, int);
+int racefinish(struct race *, int *, struct sockaddr_in *);
+void raceabort(struct race *);
+int connectstart(struct sockaddr_in *);
+void connectwait(int *, int);
+int connectudp(struct sockaddr_in *);
+long msecsince(struct timeval *);
+void reportport(int);
 int privileged(int, struct sockaddr_in *);
 void close_nfs(void);
 
-int getdirentries(nfs_fh3 *, char ***, char ***, int);
-void printfilestatus(char *file);
+int readdirentries(CLIENT *, nfs_fh3 *, int, int, char **,
+    int (*)(struct direntry *, void *), void *);
+int getdir(CLIENT *, nfs_fh3 *, struct pattern *,
+    int (*)(struct direntry *, void *), void *);
+int getdirplus(CLIENT *, nfs_fh3 *, struct pattern *,
+    int (*)(struct direntry *, void *), void *);
+int getdirentries(CLIENT *, nfs_fh3 *, struct dirtable *, int, char **, int);
+int newdirentry(struct direntry *, void *);
+void freedirentries(struct dirtable *);
+int lsentry(struct direntry *, void *);
+int lookup(CLIENT *, nfs_fh3 *, char *, nfs_fh3 *, post_op_attr *);
+nfsstat3 lookupstatus(CLIENT *, nfs_fh3 *, char *, nfs_fh3 *, post_op_attr *,
+    int);
+nfsstat3 lookupentry(CLIENT *, nfs_fh3 *, struct direntry *, int);
+char *mapoutput(int, size3);
+int readfile(CLIENT *, nfs_fh3 *, size3, int, int, int, int);
+int readrange(CLIENT *, nfs_fh3 *, offset3, size3, int, char *, int, int,
+    int, offset3 *);
+count3 holerun(char *, count3, offset3, int);
+int writeholes(int, char *, count3, offset3);
+int punchhole(int, offset3, size3);
+struct blockreader;
+int bropen(struct blockreader *, CLIENT *, nfs_fh3 *, fattr3 *, int, int);
+void brclose(struct blockreader *);
+char *brget(struct blockreader *, uint64, count3 *);
+struct brblock *brfind(struct blockreader *, uint64);
+void brahead(struct blockreader *, uint64);
+int brstart(struct blockreader *, uint64, int);
+int brpump(struct blockreader *);
+int sameversion(fattr3 *, fattr3 *);
+int lookupfile(char *, char *, nfs_fh3 *, fattr3 *);
+int catrange(nfs_fh3 *, fattr3 *, offset3, size3, int);
+void hexline(offset3, u_char *, int);
+char *mapinput(int, size_t *);
+int nextdata(int, offset3 *, offset3 *);
+int setsize(nfs_fh3 *, size3);
+int writefile(nfs_fh3 *, int, int, int);
+void printfilestatus(struct direntry *);
+
+int getnames(nfs_fh3 *, int, char **, int, struct pool *, int, int, int);
+void getparallel(struct direntry *, int, int, int);
+int opensidecar(struct rangeget *, char *, fattr3 *);
+void *rangeworker(void *);
+int pool_init(struct pool *, char *, int, int);
+int pool_add(struct pool *, struct worker *, int, nfs_fh3 *, size3, char *);
+void pool_queue(struct pool *, struct worker *, struct task *);
+int pool_walk(struct pool *, struct worker *, nfs_fh3 *, char *, int, void *);
+struct task *pool_take(struct worker *);
+void *pool_worker(void *);
+void pool_interrupt(int);
+void pool_run(struct pool *);
+void pool_destroy(struct pool *);
+int getdirtask(struct worker *, struct task *);
+int getfiletask(struct worker *, struct task *);
+int syncsame(struct pool *, char *, fattr3 *);
+int syncfiletask(struct worker *, struct task *);
+int walktask(struct worker *, struct task *);
+int walkdir(struct worker *, struct task *);
+int getattributes(CLIENT *, nfs_fh3 *, fattr3 *);
+int walkstart(char *, nfs_fh3 *, fattr3 *);
+struct duwalk;
+int duseen(struct duwalk *, fileid3);
+int duvisit(struct pool *, struct task *, struct direntry *, char *, void **);
+void duleave(struct pool *, struct task *, CLIENT *);
+int findvisit(struct pool *, struct task *, struct direntry *, char *, void **);
+void treewalk(nfs_fh3 *, char *, int, int, u_long *, u_long *);
+int bulkinit(struct bulkop *, char *, int, int *, char ***);
+void bulk(struct bulkop *, int, char **);
+int bulkstart(struct bulkop *, struct pool *, char *);
+struct bulkdir *bulknewdir(struct bulkop *, struct bulkdir *, char *, char *,
+    nfs_fh3 *);
+int bulkadd(struct bulkop *, struct bulkdir *, char *, nfs_fh3 *, ftype3);
+int bulkvisit(struct pool *, struct task *, struct direntry *, char *, void **);
+void bulkleave(struct pool *, struct task *, CLIENT *);
+void bulkdone(CLIENT *, struct bulkop *, struct bulkdir *);
+void bulkfree(struct bulkdir *);
+int bulkapply(CLIENT *, struct bulkop *, nfs_fh3 *, char *, struct bulkent *,
+    int);
+int bulksend(struct rpcpipe *, struct bulkop *, nfs_fh3 *, struct bulkcall *);
+void bulkfail(struct bulkop *, char *, char *, char *);
 int writefiledate(time_t);
-int match(char *, int, char **);
-int matchpattern(char *, char *);
-int amatchpattern(char *, char *);
-int umatchpattern(char *, char *);
 
 
 void*
@@ -268,29 +820,47 @@ fhandle3copy(fhandle3 *dest, const fhandle3 *src)
     return memcpy(dest->fhandle3_val, src->fhandle3_val, FHSIZE3);
 }
 
+/*
+ * Handles are copied by their used length only, along with their
+ * precomputed hash
+ */
 void*
 fhandle3_to_nfs_fh3(nfs_fh3 *dest, const fhandle3 *src)
 {
-    dest->data.data_len = src->fhandle3_len;
-    return memcpy(dest->data.data_val, src->fhandle3_val, MIN(NFS3_FHSIZE,FHSIZE3));
+    dest->data.data_len = MIN(src->fhandle3_len, NFS3_FHSIZE);
+    memcpy(dest->data.data_val, src->fhandle3_val, dest->data.data_len);
+    dest->hash = nfs_fh3hash(dest);
+    return dest;
 }
 
 void*
 nfs_fh3copy(nfs_fh3 *dest, const nfs_fh3 *src)
 {
     dest->data.data_len = src->data.data_len;
-    return memcpy(dest->data.data_val, src->data.data_val, NFS3_FHSIZE);
+    dest->hash = src->hash;
+    return memcpy(dest->data.data_val, src->data.data_val, src->data.data_len);
+}
+
+int
+nfs_fh3equal(const nfs_fh3 *a, const nfs_fh3 *b)
+{
+    return a->hash == b->hash && a->data.data_len == b->data.data_len &&
+	memcmp(a->data.data_val, b->data.data_val, a->data.data_len) == 0;
 }
 
 int
 main(int argc, char **argv)
 {
-    int opt, cmd, argcount;
+    int opt, argcount;
     char *argvec[NARGVEC];
     char buffer[BUFSIZ];
+    char *script = NULL;
+    int njobs = NBATCH;
 
     /* command line option processing */
-    while ((opt = getopt(argc, argv, "vi")) != EOF) {
+    shellthread = pthread_self();
+    rpcstats_name("shell");
+    while ((opt = getopt(argc, argv, "vic:f:j:p:")) != EOF) {
 	switch (opt) {
 	case 'v':
 	    verbose = 0;
@@ -298,117 +868,192 @@ main(int argc, char **argv)
 	case 'i':
 	    interact = 0;
 	    break;
+	case 'c':
+	    if (!mntcache_open(optarg))
+		exit(1);
+	    break;
+	case 'f':
+	    script = optarg;
+	    break;
+	case 'j':
+	    njobs = atoi(optarg);
+	    break;
+	case 'p':
+	    progress = atoi(optarg);
+	    break;
 	default:
-	    fprintf(stderr, "Usage: %s [-vi]\n"
+	    fprintf(stderr, "Usage: %s [-vi] [-c <cache>] [-f <script>] [-j <jobs>] [-p <secs>] [<command> ...]\n"
 			    "\t-v\tverbose off\n"
-			    "\t-i\tinteractive mode off\n", argv[0]);
+			    "\t-i\tinteractive mode off\n"
+			    "\t-c\tkeep ports, mounts and handles in this cache file\n"
+			    "\t-f\trun the commands in script (- for stdin)\n"
+			    "\t-j\tbatch commands to run at the same time\n"
+			    "\t-p\tin batch mode, show RPC rates on stderr this often\n", argv[0]);
 	    exit(1);
 	}
     }
 
+    /* batch mode: commands from a script or the command line */
+    if (script != NULL || optind < argc) {
+	interact = 0;
+	opt = batch(script, argc - optind, argv + optind, njobs);
+	if (remotehost) close_mount();
+	exit(opt ? 0 : 1);
+    }
+
     signal(SIGINT, interrupt);
 
     /* interpreter's main command loop */
-    if (setjmp(intenv)) putchar('\n');
+    if (setjmp(intenv)) {
+	if (watching != NULL) {
+	    watch_stop(watching);
+	    watching = NULL;
+	}
+	putchar('\n');
+    }
     while (ngetline(buffer, BUFSIZ, &argcount, argvec, NARGVEC)) {
 	if (argcount == 0) continue;
-	if ((cmd = command(argvec[0])) == CMD_QUIT)
-	    break;
-	else switch (cmd) {
-	case CMD_HOST:
-	    do_host(argcount, argvec);
-	    break;
-	case CMD_UID:
-	    do_setuid(argcount, argvec);
-	    break;
-	case CMD_GID:
-	    do_setgid(argcount, argvec);
-	    break;
-	case CMD_CD:
-	    do_cd(argcount, argvec);
-	    break;
-	case CMD_LCD:
-	    do_lcd(argcount, argvec);
-	    break;
-	case CMD_CAT:
-	    do_cat(argcount, argvec);
+	if (!execute(buffer, argcount, argvec))
 	    break;
-	case CMD_LS:
-	    do_ls(argcount, argvec);
-	    break;
-	case CMD_GET:
-	    do_get(argcount, argvec);
-	    break;
-	case CMD_DF:
-	    do_df(argcount, argvec);
-	    break;
-	case CMD_RM:
-	    do_rm(argcount, argvec);
-	    break;
-	case CMD_LN:
-	    do_ln(argcount, argvec);
-	    break;
-	case CMD_MV:
-	    do_mv(argcount, argvec);
-	    break;
-	case CMD_MKDIR:
-	    do_mkdir(argcount, argvec);
-	    break;
-	case CMD_RMDIR:
-	    do_rmdir(argcount, argvec);
-	    break;
-	case CMD_CHMOD:
-	    do_chmod(argcount, argvec);
-	    break;
-	case CMD_CHOWN:
-	    do_chown(argcount, argvec);
-	    break;
-	case CMD_PUT:
-	    do_put(argcount, argvec);
-	    break;
-	case CMD_HANDLE:
-	    do_handle(argcount, argvec);
-	    break;
-	case CMD_MKNOD:
-	    do_mknod(argcount, argvec);
-	    break;
-	case CMD_MOUNT:
-	    do_mount(argcount, argvec);
-	    break;
-	case CMD_UMOUNT:
-	    do_umount(argcount, argvec);
-	    break;
-	case CMD_UMOUNTALL:
-	    do_umountall(argcount, argvec);
-	    break;
-	case CMD_EXPORT:
-	    do_export(argcount, argvec);
-	    break;
-	case CMD_DUMP:
-	    do_dump(argcount, argvec);
-	    break;
-	case CMD_STATUS:
-	    do_status(argcount, argvec);
-	    break;
-	case CMD_HELP:
-	    do_help(argcount, argvec);
-	    break;
-	case CMD_UNKNOWN:
-	    if (buffer[0] == '!') {
-		system(buffer + 1);
-		printf("!\n");
-	    } else
-	        fprintf(stderr, "%s: unrecognized command\n", argvec[0]);
-	    break;
-	default:
-	    fprintf(stderr, "internal error: '%s' not is case\n", argvec[0]);
-	    break;
-	}
     }
     if (remotehost) close_mount();
     exit(0);
 }
 
+/*
+ * Carry out a single command. Returns 0 when it was quit.
+ */
+int
+execute(char *line, int argcount, char **argvec)
+{
+    switch (command(argvec[0])) {
+    case CMD_QUIT:
+	return 0;
+    case CMD_HOST:
+	do_host(argcount, argvec);
+	break;
+    case CMD_UID:
+	do_setuid(argcount, argvec);
+	break;
+    case CMD_GID:
+	do_setgid(argcount, argvec);
+	break;
+    case CMD_CD:
+	do_cd(argcount, argvec);
+	break;
+    case CMD_LCD:
+	do_lcd(argcount, argvec);
+	break;
+    case CMD_CAT:
+	do_cat(argcount, argvec);
+	break;
+    case CMD_HEAD:
+	do_head(argcount, argvec);
+	break;
+    case CMD_TAIL:
+	do_tail(argcount, argvec);
+	break;
+    case CMD_HEXDUMP:
+	do_hexdump(argcount, argvec);
+	break;
+    case CMD_LS:
+	do_ls(argcount, argvec);
+	break;
+    case CMD_GET:
+	do_get(argcount, argvec);
+	break;
+    case CMD_DF:
+	do_df(argcount, argvec);
+	break;
+    case CMD_DU:
+	do_du(argcount, argvec);
+	break;
+    case CMD_FIND:
+	do_find(argcount, argvec);
+	break;
+    case CMD_TREE:
+	do_tree(argcount, argvec);
+	break;
+    case CMD_RM:
+	do_rm(argcount, argvec);
+	break;
+    case CMD_LN:
+	do_ln(argcount, argvec);
+	break;
+    case CMD_MV:
+	do_mv(argcount, argvec);
+	break;
+    case CMD_MKDIR:
+	do_mkdir(argcount, argvec);
+	break;
+    case CMD_RMDIR:
+	do_rmdir(argcount, argvec);
+	break;
+    case CMD_CHMOD:
+	do_chmod(argcount, argvec);
+	break;
+    case CMD_CHOWN:
+	do_chown(argcount, argvec);
+	break;
+    case CMD_PUT:
+	do_put(argcount, argvec);
+	break;
+    case CMD_HANDLE:
+	do_handle(argcount, argvec);
+	break;
+    case CMD_MKNOD:
+	do_mknod(argcount, argvec);
+	break;
+    case CMD_CACHE:
+	do_cache(argcount, argvec);
+	break;
+    case CMD_STATS:
+	do_stats(argcount, argvec);
+	break;
+    case CMD_WATCH:
+	do_watch(argcount, argvec);
+	break;
+    case CMD_SYNC:
+	do_sync(argcount, argvec);
+	break;
+    case CMD_MOUNT:
+	do_mount(argcount, argvec);
+	break;
+    case CMD_UMOUNT:
+	do_umount(argcount, argvec);
+	break;
+    case CMD_UMOUNTALL:
+	do_umountall(argcount, argvec);
+	break;
+    case CMD_EXPORT:
+	do_export(argcount, argvec);
+	break;
+    case CMD_SCAN:
+	do_scan(argcount, argvec);
+	break;
+    case CMD_DUMP:
+	do_dump(argcount, argvec);
+	break;
+    case CMD_STATUS:
+	do_status(argcount, argvec);
+	break;
+    case CMD_HELP:
+	do_help(argcount, argvec);
+	break;
+    case CMD_UNKNOWN:
+	if (line[0] == '!') {
+	    system(line + 1);
+	    printf("!\n");
+	} else
+	    fprintf(stderr, "%s: unrecognized command\n", argvec[0]);
+	break;
+    default:
+	fprintf(stderr, "internal error: '%s' not is case\n", argvec[0]);
+	break;
+    }
+    return 1;
+}
+
 void
 interrupt(int signo)
 {
@@ -423,7 +1068,6 @@ interrupt(int signo)
 int
 ngetline(char *buf, int bufsize, int *argc, char **argv, int argvsize)
 {
-    register char *p;
 
 #ifdef READLINE
     if (interact) {
@@ -442,6 +1086,18 @@ ngetline(char *buf, int bufsize, int *argc, char **argv, int argvsize)
     if (fgets(buf, bufsize, stdin) == NULL)
 	return 0;
 #endif
+    splitline(buf, argc, argv, argvsize);
+    return 1;
+}
+
+/*
+ * Break up a line into an argument vector, in place
+ */
+void
+splitline(char *buf, int *argc, char **argv, int argvsize)
+{
+    register char *p;
+
     *argc = 0;
     for (p = buf; *p == ' ' || *p == '\t'; p++)
 	/* skip white spaces */;
@@ -454,60 +1110,478 @@ ngetline(char *buf, int bufsize, int *argc, char **argv, int argvsize)
 	for (; *p == ' ' || *p == '\t'; p++)
 	   /* skip white spaces */;
     }
-    return 1;
 }
 
 /*
- * Search for command in keyword table
+ * Batch mode. The whole script is read first and then carried out
+ * in runs: a run is a sequence of commands that each only touch the
+ * names they are given, no two of which share a name. The commands
+ * of a run are handed to up to 'njobs' threads with a connection to
+ * the server each, which keeps that many commands (and their RPCs)
+ * in flight at once. All other commands (cd, mount, lcd, ls, ...)
+ * run by themselves, after everything in front of them is done and
+ * before anything behind them starts.
  */
+struct job {
+    char *j_line;		/* the command line, split up */
+    int j_argc;			/* number of arguments */
+    char *j_argv[NARGVEC];	/* the arguments */
+};
+
+struct jobrun {
+    struct job *jr_jobs;	/* commands of this run */
+    int jr_njobs;		/* number of commands */
+    int jr_next;		/* next command to start */
+    pthread_mutex_t jr_lock;	/* guards jr_next */
+};
+
+struct jobthread {
+    pthread_t jt_thread;	/* the thread */
+    CLIENT *jt_client;		/* its connection to the server */
+    struct jobrun *jt_run;	/* run it works on */
+};
+
+#define	NAMEHASH	1024	/* buckets in the names-in-run table */
+
+struct runname {
+    char *rn_name;		/* absolute path used by a command of the run */
+    int rn_used;		/* used itself, not only something below it */
+    struct runname *rn_next;	/* next name in this bucket */
+};
+
 int
-command(char *cmd)
+batch(char *script, int argc, char **argv, int njobs)
 {
-    register int i;
+    struct job *jobs = NULL, *jp;
+    struct runname *names[NAMEHASH];
+    struct jobthread *threads;
+    struct watcher wt;
+    char buffer[BUFSIZ];
+    int nalloc = 0, n = 0, i, end, nthreads = 0, watched;
+    FILE *fp = NULL;
+
+    /* gather the commands, from the script and then from argv */
+    if (script != NULL) {
+	if (strcmp(script, "-") == 0)
+	    fp = stdin;
+	else if ((fp = fopen(script, "r")) == NULL) {
+	    perror(script);
+	    return 0;
+	}
+    }
+    for (;;) {
+	if (fp != NULL) {
+	    if (fgets(buffer, sizeof(buffer), fp) == NULL) {
+		if (fp != stdin)
+		    fclose(fp);
+		fp = NULL;
+		continue;
+	    }
+	} else if (argc > 0) {
+	    strncpy(buffer, *argv++, sizeof(buffer) - 1);
+	    buffer[sizeof(buffer) - 1] = '\0';
+	    argc--;
+	} else
+	    break;
+	if (n == nalloc) {
+	    nalloc = nalloc ? 2 * nalloc : 64;
+	    if ((jobs = (struct job *) realloc(jobs, nalloc * sizeof(*jobs))) == NULL) {
+		fprintf(stderr, "batch: out of memory\n");
+		exit(1);
+	    }
+	}
+	jp = &jobs[n];
+	if ((jp->j_line = strdup(buffer)) == NULL) {
+	    fprintf(stderr, "batch: out of memory\n");
+	    exit(1);
+	}
+	splitline(jp->j_line, &jp->j_argc, jp->j_argv, NARGVEC - 1);
+	if (jp->j_argc == 0 || jp->j_argv[0][0] == '#') {
+	    free(jp->j_line);
+	    continue;
+	}
+	n++;
+    }
 
-    for (i = 0; i < sizeof(keyword)/sizeof(struct keyword); i++)
-	if (strcmp(keyword[i].kw_command, cmd) == 0)
-	    return keyword[i].kw_value;
-    return CMD_UNKNOWN;
+    if (njobs < 1)
+	njobs = 1;
+    if ((threads = (struct jobthread *)
+      calloc(njobs, sizeof(struct jobthread))) == NULL) {
+	fprintf(stderr, "batch: out of memory\n");
+	exit(1);
+    }
+    memset(names, 0, sizeof(names));
+    watched = progress > 0 && watch_start(&wt, stderr, progress, 1);
+    for (i = 0; i < n; i = end) {
+	end = i + 1;
+	if (independent(&jobs[i])) {
+	    (void) claimnames(names, &jobs[i]);
+	    while (end < n && independent(&jobs[end]) &&
+	      claimnames(names, &jobs[end]))
+		end++;
+	    freenames(names);
+	}
+	if (end - i > 1 && njobs > 1 && nfsclient != NULL)
+	    runjobs(jobs + i, end - i, threads, &nthreads, njobs);
+	else {
+	    /* host, mount, uid, ... make the connections stale */
+	    if (!independent(&jobs[i]))
+		dropjobthreads(threads, &nthreads);
+	    for (; i < end; i++)
+		if (!execute(jobs[i].j_line, jobs[i].j_argc, jobs[i].j_argv))
+		    break;
+	    if (i < end)
+		break;			/* quit */
+	}
+    }
+
+    dropjobthreads(threads, &nthreads);
+    if (watched)
+	watch_stop(&wt);
+    free(threads);
+    for (i = 0; i < n; i++)
+	free(jobs[i].j_line);
+    free(jobs);
+    return 1;
 }
 
 /*
- * Set remote host and initialize RPC channel
- * to mount daemon.
+ * Commands that act on nothing but the names they are given, and
+ * never ask questions, can run concurrently with one another. A get
+ * qualifies when it is told not to ask (-i) and gets no patterns, nor
+ * -r or -P which start worker threads of their own; an rm, chmod or
+ * chown when it gets neither -r nor patterns.
  */
-void
-do_host(int argc, char **argv)
+int
+independent(struct job *jp)
 {
-    if (argc != 2)
-	fprintf(stderr, "Usage: host <host>\n");
-    else
-	open_mount(argv[1]);
+    int i, k;
+
+    switch (command(jp->j_argv[0])) {
+    case CMD_LN:
+    case CMD_MV:
+    case CMD_MKDIR:
+    case CMD_RMDIR:
+    case CMD_MKNOD:
+    case CMD_PUT:
+	return 1;
+    case CMD_RM:
+    case CMD_CHMOD:
+    case CMD_CHOWN:
+	for (i = 1; i < jp->j_argc; i++)
+	    if (strcmp(jp->j_argv[i], "-r") == 0 ||
+	      strpbrk(jp->j_argv[i], "*?[") != NULL)
+		return 0;
+	return 1;
+    case CMD_GET:
+	for (i = 1, k = 0; i < jp->j_argc && jp->j_argv[i][0] == '-'; i++) {
+	    if (strcmp(jp->j_argv[i], "-r") == 0 ||
+	      strcmp(jp->j_argv[i], "-P") == 0)
+		return 0;
+	    if (strcmp(jp->j_argv[i], "-i") == 0)
+		k = 1;
+	    else if (strcmp(jp->j_argv[i], "-j") == 0 ||
+	      strcmp(jp->j_argv[i], "-w") == 0)
+		i++;
+	}
+	if (!k)
+	    return 0;
+	for (i = 1; i < jp->j_argc; i++)
+	    if (strpbrk(jp->j_argv[i], "*?[") != NULL)
+		return 0;
+	return 1;
+    default:
+	return 0;
+    }
 }
 
 /*
- * Set user id (updating RPC authentication info)
+ * Where the remote names are among the arguments of the commands that
+ * can share a run: after the options, of which those listed take a
+ * value, and after 'skip' other operands. 'count' is the number of
+ * remote names, 0 for all that follow and -1 for only the last one.
  */
-void
-do_setuid(int argc, char **argv)
+struct claimspec {
+    int cs_command;		/* CMD_* */
+    char *cs_valopts;		/* options that take a value */
+    int cs_skip;		/* leading operands that are no remote names */
+    int cs_count;		/* remote names */
+} claimspecs[] = {
+    { CMD_GET,		"jPw",	0,	0 },	/* get [-irS] ... <file> ... */
+    { CMD_RM,		"jw",	0,	0 },	/* rm [-r] ... <file> ... */
+    { CMD_CHMOD,	"jw",	1,	0 },	/* chmod ... <mode> <file> ... */
+    { CMD_CHOWN,	"jw",	1,	0 },	/* chown ... <uid> <file> ... */
+    { CMD_PUT,		"w",	0,	-1 },	/* put ... <local> [<remote>] */
+    { CMD_MKNOD,	"",	0,	1 },	/* mknod <name> [b/c maj min] */
+    { CMD_LN,		"",	0,	0 },
+    { CMD_MV,		"",	0,	0 },
+    { CMD_MKDIR,	"",	0,	0 },
+    { CMD_RMDIR,	"",	0,	0 },
+};
+#define	NCLAIMSPECS	(sizeof(claimspecs) / sizeof(claimspecs[0]))
+
+/*
+ * Enter the remote names a command works on in the table of the
+ * current run, as absolute paths so that "mkdir /a/b" and "put f b/x"
+ * in /a meet. Two commands collide when one's path is the other's or
+ * lies below it. Returns 0, and enters nothing, when one of the names
+ * collides with a command of the run or cannot be made absolute.
+ */
+int
+claimnames(struct runname **names, struct job *jp)
 {
-    if (argc > 3) {
-	fprintf(stderr, "Usage: uid [<uid> [<secret-key>]]\n");
-	return;
-    }
+    char *name[NARGVEC];
+    struct claimspec *cs;
+    char *cp;
+    int i, k, first, last, ok = 1, cmd = command(jp->j_argv[0]);
 
-    if (argc <= 2) {
-	authtype = AUTH_UNIX;
+    for (cs = claimspecs; cs < claimspecs + NCLAIMSPECS; cs++)
+	if (cs->cs_command == cmd)
+	    break;
+    if (cs == claimspecs + NCLAIMSPECS)
+	return 0;
+    for (first = 1; first < jp->j_argc && jp->j_argv[first][0] == '-' &&
+      jp->j_argv[first][1] != '\0'; first++)
+	if (strchr(cs->cs_valopts, jp->j_argv[first][1]) != NULL)
+	    first++;
+    first += cs->cs_skip;
+    last = jp->j_argc;
+    if (cs->cs_count < 0 && first < last)
+	first = last - 1;
+    else if (cs->cs_count > 0 && first + cs->cs_count < last)
+	last = first + cs->cs_count;
+
+    for (i = first, k = 0; i < last && ok; i++) {
+	if ((name[k] = abspath(jp->j_argv[i])) == NULL) {
+	    ok = 0;
+	    break;
+	}
+	k++;
+
+	/* the path itself, used or above a used one, or a used ancestor */
+	if (findname(names, name[k - 1], 0) != NULL)
+	    ok = 0;
+	for (cp = name[k - 1] + 1; ok && (cp = strchr(cp, '/')) != NULL; cp++) {
+	    *cp = '\0';
+	    if (findname(names, name[k - 1], 1) != NULL)
+		ok = 0;
+	    *cp = '/';
+	}
+    }
+    if (ok) {
+	for (i = 0; i < k; i++) {
+	    for (cp = name[i] + 1; (cp = strchr(cp, '/')) != NULL; cp++) {
+		*cp = '\0';
+		addname(names, name[i], 0);
+		*cp = '/';
+	    }
+	    addname(names, name[i], 1);
+	}
+    }
+    while (k > 0)
+	free(name[--k]);
+    return ok;
+}
+
+/*
+ * Look up a path in the table of the current run; with 'used' set
+ * only a path a command works on itself counts
+ */
+struct runname *
+findname(struct runname **names, char *path, int used)
+{
+    struct runname *rn;
+
+    for (rn = names[namehash(path)]; rn != NULL; rn = rn->rn_next)
+	if (strcmp(rn->rn_name, path) == 0 && (rn->rn_used || !used))
+	    return rn;
+    return NULL;
+}
+
+/*
+ * Enter a path in the table of the current run
+ */
+void
+addname(struct runname **names, char *path, int used)
+{
+    struct runname *rn;
+    u_int h;
+
+    if ((rn = findname(names, path, 0)) != NULL) {
+	rn->rn_used |= used;
+	return;
+    }
+    if ((rn = (struct runname *) malloc(sizeof(*rn))) == NULL ||
+      (rn->rn_name = strdup(path)) == NULL) {
+	fprintf(stderr, "batch: out of memory\n");
+	exit(1);
+    }
+    h = namehash(path);
+    rn->rn_used = used;
+    rn->rn_next = names[h];
+    names[h] = rn;
+}
+
+u_int
+namehash(char *path)
+{
+    u_int h;
+
+    for (h = 2166136261U; *path != '\0'; path++)
+	h = (h ^ (u_char) *path) * 16777619U;
+    return h % NAMEHASH;
+}
+
+void
+freenames(struct runname **names)
+{
+    struct runname *rn;
+    int i;
+
+    for (i = 0; i < NAMEHASH; i++) {
+	while ((rn = names[i]) != NULL) {
+	    names[i] = rn->rn_next;
+	    free(rn->rn_name);
+	    free(rn);
+	}
+    }
+}
+
+/*
+ * Run the commands of a run on up to 'njobs' threads. The threads
+ * are new for every run, but their connections to the server are
+ * kept in 'threads' and only made when a run needs more of them.
+ */
+void
+runjobs(struct job *jobs, int n, struct jobthread *threads, int *nthreads,
+    int njobs)
+{
+    struct jobthread self;
+    struct jobrun jr;
+    sigset_t set, oset;
+    int i, nstarted;
+
+    if (njobs > n)
+	njobs = n;
+    while (*nthreads < njobs - 1) {
+	if ((threads[*nthreads].jt_client = getconn()) == NULL)
+	    break;
+	(*nthreads)++;
+    }
+    jr.jr_jobs = jobs;
+    jr.jr_njobs = n;
+    jr.jr_next = 0;
+    pthread_mutex_init(&jr.jr_lock, NULL);
+
+    /* interrupts are for the main thread only */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, &oset);
+    concurrent = 1;
+    for (nstarted = 0; nstarted < njobs - 1 && nstarted < *nthreads;
+      nstarted++) {
+	threads[nstarted].jt_run = &jr;
+	if (pthread_create(&threads[nstarted].jt_thread, NULL, runjob,
+	  &threads[nstarted]) != 0) {
+	    fprintf(stderr, "batch: cannot create thread\n");
+	    break;
+	}
+    }
+    pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+    /* the main thread takes part too, with the original client */
+    self.jt_client = nfsclient;
+    self.jt_run = &jr;
+    (void) runjob(&self);
+
+    for (i = 0; i < nstarted; i++)
+	pthread_join(threads[i].jt_thread, NULL);
+    concurrent = 0;
+    pthread_mutex_destroy(&jr.jr_lock);
+}
+
+/*
+ * Give back the connections of the batch threads
+ */
+void
+dropjobthreads(struct jobthread *threads, int *nthreads)
+{
+    while (*nthreads > 0) {
+	(*nthreads)--;
+	putconn(threads[*nthreads].jt_client);
+    }
+}
+
+/*
+ * Thread body: keep taking the next command of the run until none
+ * is left
+ */
+void *
+runjob(void *arg)
+{
+    struct jobthread *jt = (struct jobthread *) arg;
+    struct jobrun *jr = jt->jt_run;
+    struct job *jp;
+
+    nfsclient = jt->jt_client;
+    threadname("batch job", -1);
+    for (;;) {
+	pthread_mutex_lock(&jr->jr_lock);
+	jp = jr->jr_next < jr->jr_njobs ? &jr->jr_jobs[jr->jr_next++] : NULL;
+	pthread_mutex_unlock(&jr->jr_lock);
+	if (jp == NULL)
+	    break;
+	(void) execute(jp->j_line, jp->j_argc, jp->j_argv);
+    }
+    return NULL;
+}
+
+/*
+ * Search for command in keyword table
+ */
+int
+command(char *cmd)
+{
+    register int i;
+
+    for (i = 0; i < sizeof(keyword)/sizeof(struct keyword); i++)
+	if (strcmp(keyword[i].kw_command, cmd) == 0)
+	    return keyword[i].kw_value;
+    return CMD_UNKNOWN;
+}
+
+/*
+ * Set remote host and initialize RPC channel
+ * to mount daemon.
+ */
+void
+do_host(int argc, char **argv)
+{
+    if (argc != 2)
+	fprintf(stderr, "Usage: host <host>\n");
+    else
+	open_mount(argv[1]);
+}
+
+/*
+ * Set user id (updating RPC authentication info)
+ */
+void
+do_setuid(int argc, char **argv)
+{
+    if (argc > 3) {
+	fprintf(stderr, "Usage: uid [<uid> [<secret-key>]]\n");
+	return;
+    }
+
+    if (argc <= 2) {
+	authtype = AUTH_UNIX;
 	uid = argc == 1 ? -2 : atoi(argv[1]);
     } else if (argc == 3) {
 	authtype = AUTH_DES;
 	memcpy(secretkey, argv[2], HEXKEYBYTES);
     }
-
-    if (nfsclient) {
-	if (nfsclient->cl_auth)
-	    auth_destroy(nfsclient->cl_auth);
-	nfsclient->cl_auth = create_authenticator();
-    }
+    setauth();
 }
 
 /*
@@ -517,11 +1591,7 @@ void
 do_setgid(int argc, char **argv)
 {
     gid = argc == 2 ? atoi(argv[1]) : -2;
-    if (nfsclient) {
-	if (nfsclient->cl_auth)
-	    auth_destroy(nfsclient->cl_auth);
-	nfsclient->cl_auth = create_authenticator();
-    }
+    setauth();
 }
 
 /*
@@ -530,11 +1600,8 @@ do_setgid(int argc, char **argv)
 void
 do_cd(int argc, char **argv)
 {
-    register char *p;
-    char *component;
-    LOOKUP3args args;
-    LOOKUP3res *res;
     nfs_fh3 handle;
+    char *path;
 
     if (mountpath == NULL) {
 	fprintf(stderr, "cd: no remote file system mounted\n");
@@ -543,13 +1610,100 @@ do_cd(int argc, char **argv)
 
     /* easy case: cd to root */
     if (argc == 1) {
-	fhandle3_to_nfs_fh3(&directory_handle, &mountpoint->mountres3_u.mountinfo.fhandle);
+	nfs_fh3copy(&directory_handle, &root_handle);
+	free(cwdpath);
+	cwdpath = strdup("/");
+	cwdcached = 0;
+	return;
+    }
+
+    /* absolute paths may be in the persistent cache */
+    if (argv[1][0] == '/' && mntcache_getpath(server_addr.sin_addr,
+      mountpath, argv[1], &handle)) {
+	nfs_fh3copy(&directory_handle, &handle);
+	free(cwdpath);
+	cwdpath = abspath(argv[1]);
+	cwdcached = 1;
+	return;
+    }
+
+    path = abspath(argv[1]);
+    if (!walkpath(argv[1], &handle)) {
+	free(path);
 	return;
     }
+    nfs_fh3copy(&directory_handle, &handle);
+    free(cwdpath);
+    cwdpath = path;
+    cwdcached = 0;
+    if (path != NULL && argv[1][0] == '/')
+	mntcache_putpath(server_addr.sin_addr, mountpath, path, &handle);
+}
+
+/*
+ * Resolve a directory path, from the root if it starts with '/' and
+ * from the current directory otherwise. The walk starts from the
+ * longest prefix of the path in the path cache, and every directory
+ * it passes is entered there.
+ */
+int
+walkpath(char *path, nfs_fh3 *fh)
+{
+    char *full, **comps, *p;
+    post_op_attr attr;
+    nfs_fh3 handle;
+    int i, n, ok = 0;
+
+    if ((full = abspath(path)) == NULL)
+	return walkrelative(path, fh);
+    if ((comps = malloc((strlen(full) / 2 + 1) * sizeof(char *))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", path);
+	free(full);
+	return 0;
+    }
+    for (n = 0, p = full; *p != '\0'; p++)
+	if (*p == '/') {
+	    *p = '\0';
+	    if (p[1] != '\0')
+		comps[n++] = p + 1;
+	}
+
+    nfs_fh3copy(&handle, &root_handle);
+    for (i = pathcache_lookup(&root_handle, comps, n, &handle); i < n; i++) {
+	if (!lookup(nfsclient, &handle, comps[i], &handle, &attr))
+	    goto out;
+	if (attr.attributes_follow) {
+	    if (attr.post_op_attr_u.attributes.type != NF3DIR) {
+		fprintf(stderr, "%s: is not a directory\n", comps[i]);
+		goto out;
+	    }
+	    pathcache_enter(&root_handle, comps, i + 1, &handle);
+	}
+    }
+    nfs_fh3copy(fh, &handle);
+    ok = 1;
+out:
+    free(comps);
+    free(full);
+    return ok;
+}
+
+/*
+ * Resolve a directory path one component at a time, without the path
+ * cache, for when the path of the current directory is not known.
+ * The path is taken apart in place.
+ */
+int
+walkrelative(char *path, nfs_fh3 *fh)
+{
+    register char *p;
+    char *component;
+    post_op_attr attr;
+    nfs_fh3 handle;
 
     /* if a directory start with '/', we search from the root */
-    if (*(p = argv[1]) == '/') {
-	fhandle3_to_nfs_fh3(&handle, &mountpoint->mountres3_u.mountinfo.fhandle);
+    if (*(p = path) == '/') {
+	nfs_fh3copy(&handle, &root_handle);
 	p++;
     } else
 	nfs_fh3copy(&handle, &directory_handle);
@@ -562,24 +1716,93 @@ do_cd(int argc, char **argv)
 	if (*p == '\0') break;
 	for (component = p; *p != '/' && *p != '\0'; p++)
 	    /* do nothing */;
-	*p++ = '\0';
-	args.what.name = component;
-	nfs_fh3copy(&args.what.dir, &handle);
-	if ((res = nfs3_lookup_3(&args, nfsclient)) == NULL) {
-	    clnt_perror(nfsclient, "nfs3_lookup");
-	    return;
-	}
-	if (res->status != NFS3_OK) {
-	    fprintf(stderr, "%s: %s\n", component, nfs_error(res->status));
-	    return;
-	}
-	if (res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.type != NF3DIR) {
+	if (*p != '\0')
+	    *p++ = '\0';
+	if (!lookup(nfsclient, &handle, component, &handle, &attr))
+	    return 0;
+	if (attr.attributes_follow && attr.post_op_attr_u.attributes.type != NF3DIR) {
 	    fprintf(stderr, "%s: is not a directory\n", component);
-	    return;
+	    return 0;
 	}
-	nfs_fh3copy(&handle, &res->LOOKUP3res_u.resok.object);
     }
-    nfs_fh3copy(&directory_handle, &handle);
+    nfs_fh3copy(fh, &handle);
+    return 1;
+}
+
+/*
+ * Find the directory that holds the last component of 'path', and
+ * return it in 'dir' and that component in 'name'. Names without a
+ * '/' are in the current directory. The path is taken apart in place.
+ */
+int
+walkparent(char *path, nfs_fh3 *dir, char **name)
+{
+    char *p;
+
+    for (p = path + strlen(path); p > path + 1 && p[-1] == '/'; )
+	*--p = '\0';
+    if ((p = strrchr(path, '/')) == NULL) {
+	nfs_fh3copy(dir, &directory_handle);
+	*name = path;
+	return 1;
+    }
+    if (p[1] == '\0') {
+	fprintf(stderr, "%s: is a directory\n", path);
+	return 0;
+    }
+    *name = p + 1;
+    if (p == path) {
+	nfs_fh3copy(dir, &root_handle);
+	return 1;
+    }
+    *p = '\0';
+    return walkpath(path, dir);
+}
+
+/*
+ * The absolute form of 'path' with "." and ".." taken out, in
+ * malloc'ed storage. Returns NULL when the path is relative and the
+ * path of the current directory is not known. Names are not looked
+ * up, which is safe as LOOKUP never follows symbolic links.
+ */
+char *
+abspath(char *path)
+{
+    char *buf, *p, *q, *end;
+    size_t n;
+
+    if (*path != '/' && cwdpath == NULL)
+	return NULL;
+    n = strlen(path) + (*path != '/' ? strlen(cwdpath) : 0) + 3;
+    if ((buf = malloc(n)) == NULL)
+	return NULL;
+    if (*path == '/')
+	strcpy(buf, path);
+    else
+	sprintf(buf, "%s/%s", cwdpath, path);
+    for (p = q = buf; *p != '\0'; p = end) {
+	while (*p == '/')
+	    p++;
+	if (*p == '\0')
+	    break;
+	for (end = p; *end != '/' && *end != '\0'; end++)
+	    /* do nothing */;
+	n = end - p;
+	if (n == 1 && p[0] == '.')
+	    continue;
+	if (n == 2 && p[0] == '.' && p[1] == '.') {
+	    while (q > buf && *--q != '/')
+		/* do nothing */;
+	    continue;
+	}
+	*q++ = '/';
+	memmove(q, p, n);
+	q += n;
+    }
+    if (q == buf)
+	*q++ = '/';
+    *q = '\0';
+    return buf;
 }
 
 /*
@@ -602,52 +1825,41 @@ do_lcd(int argc, char **argv)
 void
 do_cat(int argc, char **argv)
 {
-    LOOKUP3args dargs;
-    LOOKUP3res *dres;
-    READ3args rargs;
-    READ3res *rres;
-    long offset;
+    post_op_attr attr;
+    nfs_fh3 dir, fh;
+    char *name;
+    int window = NWINDOW;
 
     if (mountpath == NULL) {
 	fprintf(stderr, "cat: no remote file system mounted\n");
 	return;
     }
+    if (argc == 4 && strcmp(argv[1], "-w") == 0) {
+	window = atoi(argv[2]);
+	argv += 2; argc -= 2;
+    }
     if (argc != 2) {
-	fprintf(stderr, "Usage: cat <filespec>\n");
+	fprintf(stderr, "Usage: cat [-w <window>] <filespec>\n");
 	return;
     }
 
-    /* lookup name in current directory */
-    dargs.what.name = argv[1];
-    nfs_fh3copy(&dargs.what.dir, &directory_handle);
-    if ((dres = nfs3_lookup_3(&dargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_lookup");
-	return;
-    }
-    if (dres->status != NFS3_OK) {
-	fprintf(stderr, "%s: %s\n", argv[1], nfs_error(dres->status));
+    if (!walkparent(argv[1], &dir, &name) ||
+      !lookup(nfsclient, &dir, name, &fh, &attr))
 	return;
-    }
-    if (dres->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.type != NF3REG) {
-	fprintf(stderr, "%s: is not a regular file\n", argv[1]);
+    if (!attr.attributes_follow || attr.post_op_attr_u.attributes.type != NF3REG) {
+	fprintf(stderr, "%s: is not a regular file\n", name);
 	return;
     }
-    nfs_fh3copy(&rargs.file, &dres->LOOKUP3res_u.resok.object);
-    for (offset = 0; offset < dres->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.size; ) {
-	rargs.offset = offset;
-	rargs.count = transfersize;
-	if ((rres = nfs3_read_3(&rargs, nfsclient)) == NULL) {
-	    clnt_perror(nfsclient, "nfs3_read_3");
-	    break;
-        }
-	if (rres->status != NFS3_OK) {
-	    fprintf(stderr, "%s: %s\n", argv[1], nfs_error(rres->status));
-	    break;
-	}
-        fwrite(rres->READ3res_u.resok.data.data_val,
-            rres->READ3res_u.resok.data.data_len, 1, stdout);
-	offset += transfersize;
-    }
+    fflush(stdout);
+
+    /* files that fit go through the block cache, others are streamed */
+    if (bcache_enabled && attr.post_op_attr_u.attributes.size <=
+      (size3) bcache_size * BCACHE_BLOCK)
+	(void) catrange(&fh, &attr.post_op_attr_u.attributes, 0,
+	    attr.post_op_attr_u.attributes.size, window);
+    else
+	(void) readfile(nfsclient, &fh, attr.post_op_attr_u.attributes.size,
+	    fileno(stdout), 1, 0, window);
 }
 
 /*
@@ -656,55 +1868,81 @@ do_cat(int argc, char **argv)
 void
 do_ls(int argc, char **argv)
 {
-    char **table, **ptr, **p;
-    int lflag = 0;
+    struct dirtable dt;
+    struct direntry *de;
+    int lflag = 0, uflag = 0;
+    char *cp;
 
     argv++; argc--;
     if (mountpath == NULL) {
 	fprintf(stderr, "ls: no remote file system mounted\n");
 	return;
     }
-    if (argc >= 1 && strcmp(argv[0], "-l") == 0) {
+    while (argc >= 1 && argv[0][0] == '-' && argv[0][1] != '\0') {
+	for (cp = argv[0] + 1; *cp; cp++) {
+	    if (*cp == 'l')
+		lflag = 1;
+	    else if (*cp == 'U')
+		uflag = 1;
+	    else {
+		fprintf(stderr, "Usage: ls [-lU] <filespec>\n");
+		return;
+	    }
+	}
 	argv++; argc--;
-	lflag = 1;
     }
 
-    if (!getdirentries(&directory_handle, &table, &ptr, 20))
+    /* unsorted: print every entry as soon as its reply arrives */
+    if (uflag) {
+	(void) readdirentries(nfsclient, &directory_handle, lflag,
+	    argc, argv, lsentry, &lflag);
+	return;
+    }
+
+    if (!getdirentries(nfsclient, &directory_handle, &dt, argc, argv, lflag))
 	return;
-    for (p = table; p < ptr; p++) {
-	if (!match(*p, argc, argv)) continue;
+    for (de = dt.dt_table; de < dt.dt_ptr; de++) {
 	if (lflag == 1)
-	    printfilestatus(*p);
+	    printfilestatus(de);
 	else
-	    printf("%s\n", *p);
-	free(*p);
+	    printf("%s\n", de->de_name);
     }
-    free(table);
+    freedirentries(&dt);
+}
+
+/*
+ * Print a single entry as part of an unsorted listing
+ */
+int
+lsentry(struct direntry *de, void *arg)
+{
+    if (*(int *) arg)
+	printfilestatus(de);
+    else
+	printf("%s\n", de->de_name);
+    return 1;
 }
 
 /*
  * Print long listing of a files, much in the way ``ls -l'' does
  */
 void
-printfilestatus(char *file)
+printfilestatus(struct direntry *de)
 {
-    LOOKUP3args args;
-    LOOKUP3res *res;
+    fattr3 *attr = &de->de_attr;
     int mode;
 
-    args.what.name = file;
-    nfs_fh3copy(&args.what.dir, &directory_handle);
-
-    if ((res = nfs3_lookup_3(&args, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_lookup");
-	return;
-    }
-    if (res->status != NFS3_OK) {
-	fprintf(stderr, "Lookup failed: %s\n", nfs_error(res->status));
-	return;
+    /* READDIR gave us the name only */
+    if (!de->de_hasattr || (attr->type == NF3LNK && !de->de_hashandle)) {
+	if (lookupentry(nfsclient, &directory_handle, de, 1) != NFS3_OK)
+	    return;
+	if (!de->de_hasattr) {
+	    fprintf(stderr, "%s: no attributes\n", de->de_name);
+	    return;
+	}
     }
 
-    switch (res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.type) {
+    switch (attr->type) {
 	case NF3SOCK:
 	    putchar('s');
 	    break;
@@ -730,7 +1968,7 @@ printfilestatus(char *file)
 	    putchar('?');
 	    break;
     }
-    mode = res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.mode;
+    mode = attr->mode;
     if (mode & 0400) putchar('r'); else putchar('-');
     if (mode & 0200) putchar('w'); else putchar('-');
     if (mode & 0100)
@@ -749,27 +1987,25 @@ printfilestatus(char *file)
 	if (mode & 01000) putchar('t'); else putchar('x');
     else
 	if (mode & 01000) putchar('T'); else putchar('-');
-    printf("%3d%9d%6d%10ld ",
-	res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.nlink,
-	res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.uid,
-	res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.gid,
-	res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.size);
-    writefiledate(res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.ctime.seconds);
-    printf(" %s", file);
-    if (res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.type == NF3LNK) {
-	READLINK3res *rlres;
+    printf("%3d%9d%6d%10ld ", attr->nlink, attr->uid, attr->gid, attr->size);
+    writefiledate(attr->ctime.seconds);
+    printf(" %s", de->de_name);
+    if (attr->type == NF3LNK) {
+	READLINK3res rlres;
 	READLINK3args rlargs;
 
-	nfs_fh3copy(&rlargs.symlink, &res->LOOKUP3res_u.resok.object);
-	if ((rlres = nfs3_readlink_3(&rlargs, nfsclient)) == NULL) {
+	nfs_fh3copy(&rlargs.symlink, &de->de_handle);
+	memset(&rlres, 0, sizeof(rlres));
+	if (nfs3_readlink_3(&rlargs, &rlres, nfsclient) != RPC_SUCCESS) {
 	    clnt_perror(nfsclient, "nfs3_readlink");
 	    return;
 	}
-	if (res->status != NFS3_OK) {
-	    fprintf(stderr, "Lookup failed: %s\n", nfs_error(res->status));
+	if (rlres.status != NFS3_OK) {
+	    fprintf(stderr, "Readlink failed: %s\n", nfs_error(rlres.status));
 	    return;
 	}
-	printf(" -> %s\n", rlres->READLINK3res_u.resok.data);
+	printf(" -> %s\n", rlres.READLINK3res_u.resok.data);
+	xdr_free((xdrproc_t) xdr_READLINK3res, (char *) &rlres);
     } else
 	putchar('\n');
 }
@@ -791,53 +2027,118 @@ writefiledate(time_t d)
 }
 
 /*
- * Get remote files
+ * Get remote files. With -r directories are copied too, including
+ * everything below them, by a pool of worker threads. With -S blocks
+ * of zeros are left as holes in the copies; that only saves local disk
+ * space, and it rules out writing straight into the mapped file.
  */
 void
 do_get(int argc, char **argv)
 {
-    char **table, **ptr, **p;
-    char answer[512];
-    LOOKUP3args args;
-    LOOKUP3res *res;
-    READ3args rargs;
-    READ3res *rres;
-    int iflag = 0;
-    long offset;
-    FILE *fp;
+    struct pool pool;
+    int iflag = 0, rflag = 0, holes = 0;
+    int window = NWINDOW;
+    int nworkers = NWORKERS;
+    int nparts = 0;
+    nfs_fh3 dir;
+    char *name;
+    int i;
 
     argv++; argc--;
     if (mountpath == NULL) {
 	fprintf(stderr, "get: no remote file system mounted\n");
 	return;
     }
-    if (argc >= 1 && strcmp(argv[0], "-i") == 0) {
+    while (argc >= 1 && argv[0][0] == '-') {
+	if (strcmp(argv[0], "-i") == 0)
+	    iflag = 1;
+	else if (strcmp(argv[0], "-r") == 0)
+	    rflag = 1;
+	else if (strcmp(argv[0], "-S") == 0)
+	    holes = 1;
+	else if (strcmp(argv[0], "-w") == 0 && argc >= 2) {
+	    window = atoi(argv[1]);
+	    argv++; argc--;
+	} else if (strcmp(argv[0], "-j") == 0 && argc >= 2) {
+	    nworkers = atoi(argv[1]);
+	    argv++; argc--;
+	} else if (strcmp(argv[0], "-P") == 0 && argc >= 2) {
+	    nparts = atoi(argv[1]);
+	    argv++; argc--;
+	} else {
+	    fprintf(stderr, "Usage: get [-irS] [-j <workers>] [-P <parts>] "
+		"[-w <window>] <filespec>\n");
+	    return;
+	}
 	argv++; argc--;
-	iflag = 1;
     }
-
-    if (!getdirentries(&directory_handle, &table, &ptr, 20))
+    if (nparts < 0 || nparts > MAXPARTS || (nparts && rflag)) {
+	fprintf(stderr, "get: -P takes 1 to %d parts, and no -r\n", MAXPARTS);
 	return;
-    for (p = table; p < ptr; p++) {
-	/* match before going over the wire */
-	if (!match(*p, argc, argv)) continue;
+    }
 
-	/* only regular files can be transfered */
-	args.what.name = *p;
-	nfs_fh3copy(&args.what.dir, &directory_handle);
-	if ((res = nfs3_lookup_3(&args, nfsclient)) == NULL) {
-	    clnt_perror(nfsclient, "nfs3_lookup");
-	    return;
-	}
-	if (res->status != NFS3_OK) {
-	    fprintf(stderr, "Lookup failed: %s\n", nfs_error(res->status));
+    if (rflag) {
+	if (!pool_init(&pool, "get", nworkers, window))
 	    return;
+	pool.p_holes = holes;
+    }
+
+    /* names in the current directory are matched in one go */
+    for (i = 0; i < argc && strchr(argv[i], '/') == NULL; i++)
+	/* do nothing */;
+    if (i == argc)
+	(void) getnames(&directory_handle, argc, argv, iflag,
+	    rflag ? &pool : NULL, nparts, window, holes);
+    else
+	for (i = 0; i < argc; i++)
+	    if (walkparent(argv[i], &dir, &name) && !getnames(&dir, 1, &name,
+	      iflag, rflag ? &pool : NULL, nparts, window, holes))
+		break;
+
+    if (rflag) {
+	pool_run(&pool);
+	printf("%lu directories, %lu files, %llu bytes, %lu errors\n",
+	    pool.p_dirs, pool.p_files, pool.p_bytes, pool.p_errors);
+	pool_destroy(&pool);
+    }
+}
+
+/*
+ * Fetch the entries of directory 'dir' that match 'argv'. Directories
+ * are handed to 'pool' when there is one, and skipped otherwise.
+ * Returns 0 when the remaining names should not be tried.
+ */
+int
+getnames(nfs_fh3 *dir, int argc, char **argv, int iflag, struct pool *pool,
+    int nparts, int window, int holes)
+{
+    struct dirtable dt;
+    struct direntry *de;
+    char answer[512];
+    int fd, ok = 1;
+
+    if (!getdirentries(nfsclient, dir, &dt, argc, argv, 1))
+	return 1;
+    for (de = dt.dt_table; de < dt.dt_ptr; de++) {
+	if (pool != NULL && (strcmp(de->de_name, ".") == 0 ||
+	  strcmp(de->de_name, "..") == 0))
+	    continue;
+
+	/* only regular files (and directories with -r) can be transfered */
+	if (!de->de_hasattr || !de->de_hashandle) {
+	    if (lookupentry(nfsclient, dir, de, 1) != NFS3_OK) {
+		ok = 0;
+		break;
+	    }
+	    if (!de->de_hasattr)
+		continue;
 	}
-	if (res->LOOKUP3res_u.resok.obj_attributes.post_op_attr_u.attributes.type != NF3REG)
+	if (de->de_attr.type != NF3REG &&
+	  (pool == NULL || de->de_attr.type != NF3DIR))
 	    continue;
 
 	/* ask for confirmation */
-	printf("%s? ", *p);
+	printf("%s? ", de->de_name);
 	if (!iflag) {
 	    if (fgets(answer, sizeof(answer), stdin) == NULL)
 		continue;
@@ -846,1186 +2147,5519 @@ do_get(int argc, char **argv)
 	} else
 	    printf("Yes\n");
 
-	/* get actual file */
-	if ((fp = fopen(*p, "w")) == NULL) {
-	    fprintf(stderr, "get: cannot create %s\n", *p);
-	    continue;
-	}
-	nfs_fh3copy(&rargs.file, &res->LOOKUP3res_u.resok.object);
-	for (offset = 0; offset < res->LOOKUP3res_u.resok.dir_attributes.post_op_attr_u.attributes.size; ) {
-	    rargs.offset = offset;
-	    rargs.count = transfersize;
-	    if ((rres = nfs3_read_3(&rargs, nfsclient)) == NULL) {
-		clnt_perror(nfsclient, "nfs3_read");
-		break;
-            }
-	    if (rres->status != NFS3_OK) {
-		fprintf(stderr, "%s: %s\n", argv[1], nfs_error(rres->status));
+	if (pool != NULL) {
+	    if (!pool_add(pool, NULL, de->de_attr.type == NF3DIR ?
+	      TASK_DIR : TASK_FILE, &de->de_handle, de->de_attr.size,
+	      strdup(de->de_name))) {
+		ok = 0;
 		break;
 	    }
-	    fwrite(rres->READ3res_u.resok.data.data_val,
-		rres->READ3res_u.resok.data.data_len, 1, fp);
-	    offset += transfersize;
+	    continue;
 	}
-	fclose(fp);
-	free(*p);
-    }
-    free(table);
+
+	/* get actual file */
+	if (nparts > 0) {
+	    getparallel(de, nparts, window, holes);
+	    continue;
+	}
+	if ((fd = open(de->de_name, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0) {
+	    fprintf(stderr, "get: cannot create %s\n", de->de_name);
+	    continue;
+	}
+	(void) readfile(nfsclient, &de->de_handle, de->de_attr.size, fd, 0,
+	    holes, window);
+	close(fd);
+    }
+    freedirentries(&dt);
+    return ok;
 }
 
 /*
- * Show file system information
+ * Fetch a regular file with 'nparts' threads at once, resuming an
+ * earlier transfer when its sidecar says it was for the same file
  */
-/* ARGUSED */
 void
-do_df(int argc, char **argv)
+getparallel(struct direntry *de, int nparts, int window, int holes)
 {
-    FSSTAT3args args;
-    FSSTAT3res *res;
-
-    if (mountpath == NULL) {
-	fprintf(stderr, "df: no remote file system mounted\n");
+    struct rangeworker workers[MAXPARTS];
+    struct rangeget rg;
+    char sidecar[MAXPATHLEN];
+    void (*osig)(int);
+    sigset_t set, oset;
+    int i, n, resumed;
+
+    memset(&rg, 0, sizeof(rg));
+    nfs_fh3copy(&rg.rg_handle, &de->de_handle);
+    rg.rg_size = rg.rg_end = de->de_attr.size;
+    rg.rg_window = window;
+    rg.rg_holes = holes;
+    rg.rg_nseg = (rg.rg_size + SEGSIZE - 1) / SEGSIZE;
+    if ((rg.rg_have = calloc(rg.rg_nseg + 1, 1)) == NULL) {
+	fprintf(stderr, "get: out of memory\n");
 	return;
     }
-    if (argc != 1) {
-	fprintf(stderr, "Usage: df\n");
+    if ((rg.rg_fd = open(de->de_name, O_RDWR | O_CREAT, 0666)) < 0) {
+	fprintf(stderr, "get: cannot create %s\n", de->de_name);
+	free(rg.rg_have);
 	return;
     }
-    fhandle3_to_nfs_fh3(&args.fsroot, &mountpoint->mountres3_u.mountinfo.fhandle);
-    if ((res = nfs3_fsstat_3(&args, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_fsstat");
+    snprintf(sidecar, sizeof(sidecar), "%s%s", de->de_name, SIDECAR);
+    if ((resumed = opensidecar(&rg, sidecar, &de->de_attr)) < 0) {
+	close(rg.rg_fd);
+	free(rg.rg_have);
 	return;
     }
-    if (res->status != NFS3_OK) {
-	fprintf(stderr, "Df failed: %s\n", nfs_error(res->status));
-	return;
+    if (resumed)
+	printf("Resuming `%s', %lu of %lu segments done\n",
+	    de->de_name, rg.rg_done, rg.rg_nseg);
+
+    /* make room for all of it now, so segments can be mapped */
+    rg.rg_mapped = ftruncate(rg.rg_fd, rg.rg_size) == 0 && !holes &&
+	(rg.rg_size == 0 || posix_fallocate(rg.rg_fd, 0, rg.rg_size) == 0);
+
+    /* the connections are set up by the main thread */
+    if (nparts > rg.rg_nseg - rg.rg_done)
+	nparts = MAX(rg.rg_nseg - rg.rg_done, 1);
+    workers[0].rw_client = nfsclient;
+    for (n = 1; n < nparts; n++)
+	if ((workers[n].rw_client = getconn()) == NULL)
+	    break;
+    pthread_mutex_init(&rg.rg_lock, NULL);
+
+    /* interrupts are for the main thread only */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, &oset);
+    pool_stopped = 0;
+    for (i = 1; i < n; i++) {
+	workers[i].rw_get = &rg;
+	if (pthread_create(&workers[i].rw_thread, NULL, rangeworker,
+	  &workers[i]) != 0) {
+	    fprintf(stderr, "get: cannot create thread\n");
+	    break;
+	}
     }
-
-#define x res->FSSTAT3res_u.resok
-    printf("%s:%s    %ldK, %ldK used, %ldK free (%ldK useable).\n",
-	remotehost, mountpath,
-	x.tbytes/1024, (x.tbytes-x.fbytes)/1024,
-	x.fbytes/1024, x.abytes/1024);
-#undef x
+    osig = signal(SIGINT, pool_interrupt);
+    pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+    concurrent = 1;
+    workers[0].rw_get = &rg;
+    (void) rangeworker(&workers[0]);
+    while (--i > 0)
+	pthread_join(workers[i].rw_thread, NULL);
+    concurrent = 0;
+    signal(SIGINT, osig);
+
+    for (i = 1; i < n; i++)
+	putconn(workers[i].rw_client);
+    pthread_mutex_destroy(&rg.rg_lock);
+    fclose(rg.rg_sidecar);
+
+    if (rg.rg_done == rg.rg_nseg) {
+	if (rg.rg_end < rg.rg_size && ftruncate(rg.rg_fd, rg.rg_end) < 0)
+	    perror("ftruncate");
+	(void) unlink(sidecar);
+    } else
+	fprintf(stderr, "get: %s: %lu of %lu segments done%s, "
+	    "get -P again to resume\n", de->de_name, rg.rg_done, rg.rg_nseg,
+	    pool_stopped ? " (interrupted)" : "");
+    close(rg.rg_fd);
+    free(rg.rg_have);
 }
 
 /*
- * Delete a remote file
+ * Open the sidecar of a get -P transfer. When it belongs to the same
+ * remote file, with the same size and modification time, and to the
+ * same local file, which still reaches the end of the last segment it
+ * lists, those segments are taken as done and 1 is returned.
+ * Otherwise the local file is emptied, a new sidecar started and 0
+ * returned; -1 means no sidecar could be written.
+ *
+ * The first line identifies the transfer, every line after that is
+ * the number of a finished segment:
+ *	nfsget <handle> <size> <mtime> <segment size> <local dev>.<inode>
+ *	done <segment>
  */
-void
-do_rm(int argc, char **argv)
+int
+opensidecar(struct rangeget *rg, char *path, fattr3 *attr)
 {
-    REMOVE3args args;
-    REMOVE3res *res;
+    char line[2 * NFS3_FHSIZE + 128], header[2 * NFS3_FHSIZE + 128], *p;
+    u_long seg, last = 0;
+    struct stat st;
+    FILE *fp;
+    u_int i;
 
-    if (mountpath == NULL) {
-	fprintf(stderr, "rm: no remote file system mounted\n");
-	return;
+    if (fstat(rg->rg_fd, &st) < 0) {
+	perror("fstat");
+	return -1;
     }
-    if (argc != 2) {
-	fprintf(stderr, "Usage: rm <file>\n");
-	return;
-    }
-    args.object.name = argv[1];
-    nfs_fh3copy(&args.object.dir, &directory_handle);
-    if ((res = nfs3_remove_3(&args, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_remove");
-	return;
+    p = header + sprintf(header, "nfsget ");
+    for (i = 0; i < rg->rg_handle.data.data_len; i++)
+	p += sprintf(p, "%02x", rg->rg_handle.data.data_val[i] & 0xFF);
+    sprintf(p, " %llu %u.%u %u %llu.%llu\n", (unsigned long long) rg->rg_size,
+	attr->mtime.seconds, attr->mtime.nseconds, SEGSIZE,
+	(unsigned long long) st.st_dev, (unsigned long long) st.st_ino);
+
+    if ((fp = fopen(path, "r")) != NULL) {
+	if (fgets(line, sizeof(line), fp) != NULL &&
+	  strcmp(line, header) == 0) {
+	    while (fgets(line, sizeof(line), fp) != NULL)
+		if (sscanf(line, "done %lu", &seg) == 1 &&
+		  seg < rg->rg_nseg && !rg->rg_have[seg]) {
+		    rg->rg_have[seg] = 1;
+		    rg->rg_done++;
+		    last = MAX(last, seg + 1);
+		}
+	    fclose(fp);
+
+	    /* the local file may have been cut short since */
+	    if (st.st_size >= (off_t) MIN(rg->rg_size, (size3) last * SEGSIZE)) {
+		if ((rg->rg_sidecar = fopen(path, "a")) == NULL) {
+		    perror(path);
+		    return -1;
+		}
+		return 1;
+	    }
+	    memset(rg->rg_have, 0, rg->rg_nseg + 1);
+	    rg->rg_done = 0;
+	} else
+	    fclose(fp);
     }
-    if (res->status != NFS3_OK) {
-	fprintf(stderr, "Remove failed: %s\n", nfs_error(res->status));
-	return;
+
+    if (ftruncate(rg->rg_fd, 0) < 0 ||
+      (rg->rg_sidecar = fopen(path, "w")) == NULL) {
+	perror(path);
+	return -1;
     }
+    fputs(header, rg->rg_sidecar);
+    fflush(rg->rg_sidecar);
+    return 0;
 }
 
 /*
- * Link a file
+ * Thread body of a get -P transfer: fetch segments that are not done
+ * yet until none are left or the transfer is interrupted
  */
-void
-do_ln(int argc, char **argv)
+void *
+rangeworker(void *arg)
 {
-    LOOKUP3args dargs;
-    LOOKUP3res *dres;
-    LINK3args largs;
-    LINK3res *lres;
-
-    if (mountpath == NULL) {
-	fprintf(stderr, "ln: no remote file system mounted\n");
-	return;
-    }
-    if (argc != 3) {
-	fprintf(stderr, "Usage: ln <file1> <file2>\n");
-	return;
+    struct rangeworker *rw = (struct rangeworker *) arg;
+    struct rangeget *rg = rw->rw_get;
+    offset3 start, end;
+    size3 len;
+    u_long seg;
+    char *map;
+    int ok;
+
+    nfsclient = rw->rw_client;
+    threadname("get -P part", -1);
+    pthread_mutex_lock(&rg->rg_lock);
+    while (!pool_stopped) {
+	while (rg->rg_next < rg->rg_nseg && rg->rg_have[rg->rg_next])
+	    rg->rg_next++;
+	if (rg->rg_next >= rg->rg_nseg)
+	    break;
+	seg = rg->rg_next++;
+	pthread_mutex_unlock(&rg->rg_lock);
+
+	start = (offset3) seg * SEGSIZE;
+	len = MIN(SEGSIZE, rg->rg_size - start);
+	map = NULL;
+	if (rg->rg_mapped) {
+	    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		rg->rg_fd, start);
+	    if (map == MAP_FAILED)
+		map = NULL;
+	}
+	ok = readrange(rw->rw_client, &rg->rg_handle, start, len, rg->rg_fd,
+	    map, 0, rg->rg_holes, rg->rg_window, &end);
+	if (map != NULL)
+	    (void) munmap(map, len);
+
+	pthread_mutex_lock(&rg->rg_lock);
+	if (!ok) {
+	    rg->rg_errors++;
+	    continue;
+	}
+	if (end < start + len)
+	    rg->rg_end = MIN(rg->rg_end, end);
+	rg->rg_have[seg] = 1;
+	rg->rg_done++;
+	fprintf(rg->rg_sidecar, "done %lu\n", seg);
+	fflush(rg->rg_sidecar);
     }
+    pthread_mutex_unlock(&rg->rg_lock);
+    return NULL;
+}
 
-    dargs.what.name = argv[1];
-    nfs_fh3copy(&dargs.what.dir, &directory_handle);
-    if ((dres = nfs3_lookup_3(&dargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_lookup");
-	return;
+/*
+ * Set up a pool of 'nworkers' workers, each with its own client, for
+ * command 'cmd'
+ */
+int
+pool_init(struct pool *pool, char *cmd, int nworkers, int window)
+{
+    int i;
+
+    if (nworkers < 1)
+	nworkers = 1;
+    memset(pool, 0, sizeof(*pool));
+    pool->p_cmd = cmd;
+    pool->p_window = window;
+    if ((pool->p_workers = (struct worker *)
+      calloc(nworkers, sizeof(struct worker))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", cmd);
+	return 0;
     }
-    if (dres->status != NFS3_OK) {
-	fprintf(stderr, "%s: %s\n", argv[1], nfs_error(dres->status));
-	return;
+    for (i = 0; i < nworkers; i++) {
+	if ((pool->p_workers[i].w_client = getconn()) == NULL) {
+	    if (i == 0) {
+		free(pool->p_workers);
+		return 0;
+	    }
+	    fprintf(stderr, "%s: continuing with %d workers\n", cmd, i);
+	    break;
+	}
+	pool->p_workers[i].w_pool = pool;
     }
+    pool->p_nworkers = i;
+    pthread_mutex_init(&pool->p_lock, NULL);
+    pthread_cond_init(&pool->p_cond, NULL);
+    return 1;
+}
 
-    nfs_fh3copy(&largs.file, &dres->LOOKUP3res_u.resok.object);
-    largs.link.name = argv[2];
-    nfs_fh3copy(&largs.link.dir, &directory_handle);
+/*
+ * Queue a task. Tasks found by a worker go to the tail of its own
+ * deque, initial tasks ('w' is NULL) are dealt out round robin. The
+ * path name is taken over by the task.
+ */
+int
+pool_add(struct pool *pool, struct worker *w, int type, nfs_fh3 *fh,
+    size3 size, char *path)
+{
+    struct task *t;
 
-    if ((lres = nfs3_link_3(&largs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_link");
-	return;
-    }
-    if (lres->status != NFS3_OK) {
-	fprintf(stderr, "Link failed: %s\n", nfs_error(lres->status));
-	return;
+    if (path == NULL || (t = (struct task *) malloc(sizeof(*t))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pool->p_cmd);
+	free(path);
+	return 0;
     }
+    t->t_type = type;
+    nfs_fh3copy(&t->t_handle, fh);
+    t->t_size = size;
+    t->t_path = path;
+    t->t_depth = 0;
+    t->t_data = NULL;
+    pool_queue(pool, w, t);
+    return 1;
 }
 
 /*
- * Move a file or directory
+ * Queue a walk of remote directory 'fh', 'depth' levels down. Like
+ * pool_add the path name is taken over, and the walk's data for the
+ * directory is handed to the leave function even when this fails.
  */
-void
-do_mv(int argc, char **argv)
+int
+pool_walk(struct pool *pool, struct worker *w, nfs_fh3 *fh, char *path,
+    int depth, void *data)
 {
-    RENAME3args args;
-    RENAME3res *res;
-
-    if (mountpath == NULL) {
-	fprintf(stderr, "mv: no remote file system mounted\n");
-	return;
-    }
-    if (argc != 3) {
-	fprintf(stderr, "Usage: mv <file1> <file2>\n");
-	return;
-    }
-    args.from.name = argv[1];
-    nfs_fh3copy(&args.from.dir, &directory_handle);
-    args.to.name = argv[2];
-    nfs_fh3copy(&args.to.dir, &directory_handle);
-    if ((res = nfs3_rename_3(&args, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_rename");
-	return;
-    }
-    if (res->status != NFS3_OK) {
-	fprintf(stderr, "Rename failed: %s\n", nfs_error(res->status));
-	return;
+    struct task *t;
+
+    if (path == NULL || (t = (struct task *) malloc(sizeof(*t))) == NULL) {
+	struct task dummy;
+
+	fprintf(stderr, "%s: out of memory\n", pool->p_cmd);
+	memset(&dummy, 0, sizeof(dummy));
+	dummy.t_type = TASK_WALK;
+	dummy.t_path = path != NULL ? path : "";
+	dummy.t_depth = depth;
+	dummy.t_data = data;
+	if (pool->p_leave != NULL)
+	    pool->p_leave(pool, &dummy, w != NULL ? w->w_client : nfsclient);
+	free(path);
+	return 0;
     }
+    t->t_type = TASK_WALK;
+    nfs_fh3copy(&t->t_handle, fh);
+    t->t_size = 0;
+    t->t_path = path;
+    t->t_depth = depth;
+    t->t_data = data;
+    pool_queue(pool, w, t);
+    return 1;
 }
 
 /*
- * Make remote directory
+ * Put a task at the tail of the deque of worker 'w', or of the next
+ * one in turn when 'w' is NULL
  */
 void
-do_mkdir(int argc, char **argv)
+pool_queue(struct pool *pool, struct worker *w, struct task *t)
 {
-    MKDIR3args args;
-    MKDIR3res *res;
+    t->t_next = NULL;
+    pthread_mutex_lock(&pool->p_lock);
+    if (w == NULL)
+	w = &pool->p_workers[pool->p_next++ % pool->p_nworkers];
+    t->t_prev = w->w_tail;
+    if (w->w_tail != NULL)
+	w->w_tail->t_next = t;
+    else
+	w->w_head = t;
+    w->w_tail = t;
+    pool->p_pending++;
+    pool->p_queued++;
+    pthread_cond_signal(&pool->p_cond);
+    pthread_mutex_unlock(&pool->p_lock);
+}
 
-    if (mountpath == NULL) {
-	fprintf(stderr, "mkdir: no remote file system mounted\n");
-	return;
+/*
+ * Take the next task for worker 'w': the newest one of its own, or
+ * else the oldest one of somebody else. Called with the pool locked.
+ */
+struct task *
+pool_take(struct worker *w)
+{
+    struct pool *pool = w->w_pool;
+    struct worker *v;
+    struct task *t;
+    int i;
+
+    if ((t = w->w_tail) != NULL) {
+	if ((w->w_tail = t->t_prev) != NULL)
+	    w->w_tail->t_next = NULL;
+	else
+	    w->w_head = NULL;
+	pool->p_queued--;
+	return t;
     }
-    if (argc != 2) {
-	fprintf(stderr, "Usage: mkdir <directory>\n");
-	return;
+    for (i = 1; i < pool->p_nworkers; i++) {
+	v = &pool->p_workers[(w - pool->p_workers + i) % pool->p_nworkers];
+	if ((t = v->w_head) == NULL)
+	    continue;
+	if ((v->w_head = t->t_next) != NULL)
+	    v->w_head->t_prev = NULL;
+	else
+	    v->w_tail = NULL;
+	pool->p_queued--;
+	return t;
     }
+    return NULL;
+}
 
-    args.where.name = argv[1];
-    nfs_fh3copy(&args.where.dir, &directory_handle);
-    args.attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode=040755 };
-    args.attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u.uid=uid };
-    args.attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u.gid=gid };
-    args.attributes.size  = (set_size3) { .set_it=FALSE };
-    args.attributes.atime = (set_atime) { .set_it=FALSE };
-    args.attributes.mtime = (set_mtime) { .set_it=FALSE };
+/*
+ * Worker thread main loop. It ends when no task is queued or being
+ * worked on anymore, since only running tasks can create new ones.
+ */
+void *
+pool_worker(void *arg)
+{
+    struct worker *w = (struct worker *) arg;
+    struct pool *pool = w->w_pool;
+    struct task *t;
+    int ok;
 
-    if ((res = nfs3_mkdir_3(&args, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_mkdir");
-	return;
-    }
-    if (res->status != NFS3_OK) {
-	fprintf(stderr, "Make directory failed: %s\n", nfs_error(res->status));
-	return;
+    threadname(pool->p_cmd, (int) (w - pool->p_workers) + 1);
+    pthread_mutex_lock(&pool->p_lock);
+    for (;;) {
+	while ((t = pool_take(w)) == NULL && pool->p_pending > 0)
+	    pthread_cond_wait(&pool->p_cond, &pool->p_lock);
+	if (t == NULL)
+	    break;
+	pthread_mutex_unlock(&pool->p_lock);
+
+	ok = 1;
+	if (t->t_type == TASK_WALK)
+	    ok = walktask(w, t);
+	else if (!pool_stopped) {
+	    if (t->t_type == TASK_DIR)
+		ok = getdirtask(w, t);
+	    else
+		ok = getfiletask(w, t);
+	}
+
+	pthread_mutex_lock(&pool->p_lock);
+	if (!ok)
+	    pool->p_errors++;
+	if (--pool->p_pending == 0)
+	    pthread_cond_broadcast(&pool->p_cond);
+	free(t->t_path);
+	free(t);
     }
+    pthread_mutex_unlock(&pool->p_lock);
+    return NULL;
 }
 
-/* XXX */
+/*
+ * An interrupt stops a get -r or a walk at the next task boundary
+ */
 void
-do_create(int argc, char **argv)
+pool_interrupt(int signo)
 {
-    CREATE3args args;
-    CREATE3res *res;
+    pool_stopped = 1;
+}
 
-    if (mountpath == NULL) {
-	fprintf(stderr, "mkdir: no remote file system mounted\n");
-	return;
-    }
-    if (argc != 2) {
-	fprintf(stderr, "Usage: mkdir <directory>\n");
-	return;
+/*
+ * Run all queued tasks (and the ones they create) to completion
+ */
+void
+pool_run(struct pool *pool)
+{
+    void (*osig)(int);
+    sigset_t set, oset;
+    int i, n;
+
+    /* interrupts are for the main thread only */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, &oset);
+    pool_stopped = 0;
+    for (n = 0; n < pool->p_nworkers; n++) {
+	if (pthread_create(&pool->p_workers[n].w_thread, NULL,
+	  pool_worker, &pool->p_workers[n]) != 0) {
+	    fprintf(stderr, "%s: cannot create worker thread\n", pool->p_cmd);
+	    break;
+	}
     }
+    osig = signal(SIGINT, pool_interrupt);
+    pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+    concurrent = 1;
+    if (n == 0)
+	(void) pool_worker(&pool->p_workers[0]);
+    for (i = 0; i < n; i++)
+	pthread_join(pool->p_workers[i].w_thread, NULL);
+    concurrent = 0;
+
+    signal(SIGINT, osig);
+    if (pool_stopped)
+	fprintf(stderr, "%s: interrupted\n", pool->p_cmd);
+}
 
-    args.where.name = argv[1];
-    nfs_fh3copy(&args.where.dir, &directory_handle);
-    args.how.mode = EXCLUSIVE;
-    args.how.createhow3_u.obj_attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode=040755 };
-    args.how.createhow3_u.obj_attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u.uid=uid };
-    args.how.createhow3_u.obj_attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u.gid=gid };
-    args.how.createhow3_u.obj_attributes.size  = (set_size3) { .set_it=FALSE };
-    args.how.createhow3_u.obj_attributes.atime = (set_atime) { .set_it=FALSE };
-    args.how.createhow3_u.obj_attributes.mtime = (set_mtime) { .set_it=FALSE };
+void
+pool_destroy(struct pool *pool)
+{
+    int i;
 
-    if ((res = nfs3_create_3(&args, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_mkdir");
-	return;
-    }
-    if (res->status != NFS3_OK) {
-	fprintf(stderr, "Make directory failed: %s\n", nfs_error(res->status));
-	return;
-    }
+    for (i = 0; i < pool->p_nworkers; i++)
+	putconn(pool->p_workers[i].w_client);
+    free(pool->p_workers);
+    pthread_mutex_destroy(&pool->p_lock);
+    pthread_cond_destroy(&pool->p_cond);
 }
 
 /*
- * Remove remote directory
+ * Create the local counterpart of a remote directory and queue its
+ * contents. Names a hostile server could use to escape the target
+ * directory are refused.
  */
-void
-do_rmdir(int argc, char **argv)
+int
+getdirtask(struct worker *w, struct task *t)
 {
-    RMDIR3args args;
-    RMDIR3res *res;
-
-    if (mountpath == NULL) {
-	fprintf(stderr, "rmdir: no remote file system mounted\n");
-	return;
+    struct pool *pool = w->w_pool;
+    struct dirtable dt;
+    struct direntry *de;
+    READLINK3args args;
+    READLINK3res res;
+    struct stat st;
+    char *path;
+    int ok = 1;
+
+    if (mkdir(t->t_path, 0777) < 0 && (errno != EEXIST ||
+      lstat(t->t_path, &st) < 0 || !S_ISDIR(st.st_mode))) {
+	fprintf(stderr, "get: cannot create directory %s\n", t->t_path);
+	return 0;
     }
-    if (argc != 2) {
-	fprintf(stderr, "Usage: rmdir <directory>\n");
-	return;
+    if (!getdirentries(w->w_client, &t->t_handle, &dt, 0, NULL, 1))
+	return 0;
+    pthread_mutex_lock(&pool->p_lock);
+    pool->p_dirs++;
+    pthread_mutex_unlock(&pool->p_lock);
+
+    for (de = dt.dt_table; de < dt.dt_ptr && !pool_stopped; de++) {
+	if (strcmp(de->de_name, ".") == 0 || strcmp(de->de_name, "..") == 0)
+	    continue;
+	if (de->de_name[0] == '\0' || strchr(de->de_name, '/') != NULL) {
+	    fprintf(stderr, "get: %s: bad name from server\n", t->t_path);
+	    ok = 0;
+	    continue;
+	}
+	if (!de->de_hasattr || !de->de_hashandle) {
+	    if (lookupentry(w->w_client, &t->t_handle, de, 1) != NFS3_OK ||
+	      !de->de_hasattr) {
+		ok = 0;
+		continue;
+	    }
+	}
+	if ((path = malloc(strlen(t->t_path) + strlen(de->de_name) + 2)) == NULL) {
+	    fprintf(stderr, "get: out of memory\n");
+	    ok = 0;
+	    break;
+	}
+	sprintf(path, "%s/%s", t->t_path, de->de_name);
+
+	switch (de->de_attr.type) {
+	case NF3DIR:
+	    if (!pool_add(pool, w, TASK_DIR, &de->de_handle, 0, path))
+		ok = 0;
+	    break;
+	case NF3REG:
+	    if (pool->p_manifest != NULL && syncsame(pool, path, &de->de_attr)) {
+		free(path);
+		break;
+	    }
+	    if (!pool_add(pool, w, TASK_FILE, &de->de_handle,
+	      de->de_attr.size, path))
+		ok = 0;
+	    break;
+	case NF3LNK:
+	    nfs_fh3copy(&args.symlink, &de->de_handle);
+	    memset(&res, 0, sizeof(res));
+	    if (nfs3_readlink_3(&args, &res, w->w_client) != RPC_SUCCESS) {
+		clnt_perror(w->w_client, "nfs3_readlink");
+		ok = 0;
+	    } else if (res.status != NFS3_OK) {
+		fprintf(stderr, "Readlink failed: %s\n", nfs_error(res.status));
+		ok = 0;
+	    } else if (pool->p_manifest != NULL && lstat(path, &st) == 0 &&
+	      S_ISLNK(st.st_mode) && unlink(path) < 0) {
+		fprintf(stderr, "sync: cannot replace symlink %s\n", path);
+		ok = 0;
+	    } else if (symlink(res.READLINK3res_u.resok.data, path) < 0) {
+		fprintf(stderr, "get: cannot create symlink %s\n", path);
+		ok = 0;
+	    }
+	    xdr_free((xdrproc_t) xdr_READLINK3res, (char *) &res);
+	    free(path);
+	    break;
+	default:
+	    /* devices, sockets and fifos are not copied */
+	    free(path);
+	    break;
+	}
     }
+    freedirentries(&dt);
+    return ok;
+}
 
-    args.object.name = argv[1];
-    nfs_fh3copy(&args.object.dir, &directory_handle);
-    if ((res = nfs3_rmdir_3(&args, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_rmdir");
-	return;
+/*
+ * Copy a remote regular file
+ */
+int
+getfiletask(struct worker *w, struct task *t)
+{
+    struct pool *pool = w->w_pool;
+    int fd, ok;
+
+    if (pool->p_manifest != NULL)
+	return syncfiletask(w, t);
+    if ((fd = open(t->t_path, O_RDWR | O_CREAT | O_TRUNC | O_NOFOLLOW,
+      0666)) < 0) {
+	fprintf(stderr, "get: cannot create %s\n", t->t_path);
+	return 0;
     }
-    if (res->status != NFS3_OK) {
-	fprintf(stderr, "Remove directory failed: %s\n", nfs_error(res->status));
-	return;
+    ok = readfile(w->w_client, &t->t_handle, t->t_size, fd, 0, pool->p_holes,
+	pool->p_window);
+    close(fd);
+    if (ok) {
+	pthread_mutex_lock(&pool->p_lock);
+	pool->p_files++;
+	pool->p_bytes += t->t_size;
+	pthread_mutex_unlock(&pool->p_lock);
     }
+    return ok;
 }
 
 /*
- * Change mode of remote file or directory
+ * Whether regular file 'path' of a sync is still what the manifest
+ * says was fetched, given its remote attributes 'attr'. The local copy
+ * has to be as the last sync left it too.
  */
-void
-do_chmod(int argc, char **argv)
+int
+syncsame(struct pool *pool, char *path, fattr3 *attr)
 {
-    LOOKUP3args dargs;
-    LOOKUP3res *dres;
-    SETATTR3args aargs;
-    SETATTR3res *ares;
-    int mode;
+    struct mfentry *me;
+    struct stat st;
+
+    me = manifest_find(pool->p_manifest, path + pool->p_rootlen + 1);
+    if (me == NULL || me->me_fileid != attr->fileid ||
+      me->me_size != attr->size ||
+      me->me_mtime.seconds != attr->mtime.seconds ||
+      me->me_mtime.nseconds != attr->mtime.nseconds ||
+      lstat(path, &st) < 0 || !S_ISREG(st.st_mode) ||
+      st.st_size != me->me_size ||
+      st.st_mtim.tv_sec != me->me_local.tv_sec ||
+      st.st_mtim.tv_nsec != me->me_local.tv_nsec)
+	return 0;
+    manifest_seen(pool->p_manifest, me);
+    pthread_mutex_lock(&pool->p_lock);
+    pool->p_same++;
+    pthread_mutex_unlock(&pool->p_lock);
+    return 1;
+}
 
-    if (mountpath == NULL) {
-	fprintf(stderr, "chmod: no remote file system mounted\n");
-	return;
+/*
+ * Bring the local copy of a remote regular file up to date for a
+ * sync. The file is read SEGSIZE at a time, straight into memory, and
+ * only the MANIFEST_BLOCKs whose hash differs from the one the last
+ * sync wrote are written out. Those hashes only describe the local
+ * copy while nothing else has written to it.
+ */
+int
+syncfiletask(struct worker *w, struct task *t)
+{
+    struct pool *pool = w->w_pool;
+    char *key = t->t_path + pool->p_rootlen + 1;
+    struct mfentry *old;
+    struct stat st;
+    fattr3 attr;
+    offset3 off, end, b;
+    size3 len, written = 0;
+    count3 n;
+    uint64 *hash;
+    u_int nblocks;
+    char *buf;
+    int fd, trusted, ok = 1;
+
+    if (!getattributes(w->w_client, &t->t_handle, &attr))
+	return 0;
+    if ((fd = open(t->t_path, O_RDWR | O_CREAT | O_NOFOLLOW, 0666)) < 0) {
+	fprintf(stderr, "sync: cannot create %s\n", t->t_path);
+	return 0;
     }
-    if (argc != 3) {
-	fprintf(stderr, "Usage: chmod <mode> <file>\n");
-	return;
+    old = manifest_find(pool->p_manifest, key);
+    trusted = old != NULL && fstat(fd, &st) == 0 &&
+	st.st_size == old->me_size &&
+	st.st_mtim.tv_sec == old->me_local.tv_sec &&
+	st.st_mtim.tv_nsec == old->me_local.tv_nsec;
+    nblocks = (attr.size + MANIFEST_BLOCK - 1) / MANIFEST_BLOCK;
+    hash = (uint64 *) malloc(MAX(nblocks, 1) * sizeof(uint64));
+    len = MIN(attr.size, SEGSIZE);
+    if (hash == NULL || posix_memalign((void **) &buf, getpagesize(),
+      MAX(len, 1)) != 0) {
+	fprintf(stderr, "sync: out of memory\n");
+	free(hash);
+	close(fd);
+	return 0;
     }
-    if (sscanf(argv[1], "%o", &mode) != 1) {
-	fprintf(stderr, "chmod: invalid mode\n");
-	return;
+
+    for (off = 0; ok && off < attr.size; off = end) {
+	if (pool_stopped) {
+	    ok = 0;
+	    break;
+	}
+	len = MIN(attr.size - off, SEGSIZE);
+	if (!readrange(w->w_client, &t->t_handle, off, len, -1, buf, 0, 0,
+	  pool->p_window, &end)) {
+	    ok = 0;
+	    break;
+	}
+	for (b = off; b < end; b += n) {
+	    n = MIN(MANIFEST_BLOCK, end - b);
+	    hash[b / MANIFEST_BLOCK] = blockhash(buf + (b - off), n);
+	    if (trusted && b / MANIFEST_BLOCK < old->me_nblocks &&
+	      old->me_hash[b / MANIFEST_BLOCK] == hash[b / MANIFEST_BLOCK])
+		continue;
+	    if (pool->p_holes)
+		ok = writeholes(fd, buf + (b - off), n, b);
+	    else if (pwrite(fd, buf + (b - off), n, b) != n) {
+		perror("write");
+		ok = 0;
+	    }
+	    if (!ok)
+		break;
+	    written += n;
+	}
+	if (end < off + len) {
+	    /* the file got shorter; record what was there */
+	    attr.size = end;
+	    nblocks = (end + MANIFEST_BLOCK - 1) / MANIFEST_BLOCK;
+	    break;
+	}
     }
+    free(buf);
 
-    dargs.what.name = argv[2];
-    nfs_fh3copy(&dargs.what.dir, &directory_handle);
-    if ((dres = nfs3_lookup_3(&dargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_lookup");
-	return;
+    if (ok && ftruncate(fd, attr.size) < 0) {
+	perror("ftruncate");
+	ok = 0;
     }
-    if (dres->status != NFS3_OK) {
-	fprintf(stderr, "%s: %s\n", argv[2], nfs_error(dres->status));
-	return;
+    if (ok && fstat(fd, &st) < 0) {
+	perror(t->t_path);
+	ok = 0;
+    }
+    close(fd);
+    if (!ok || !manifest_enter(pool->p_manifest, key, &attr, &st.st_mtim,
+      nblocks, hash)) {
+	free(hash);
+	return 0;
     }
+    pthread_mutex_lock(&pool->p_lock);
+    pool->p_files++;
+    pool->p_bytes += attr.size;
+    pool->p_written += written;
+    pthread_mutex_unlock(&pool->p_lock);
+    return 1;
+}
 
-    nfs_fh3copy(&aargs.object, &dres->LOOKUP3res_u.resok.object);
-    aargs.new_attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode=mode };
-    aargs.new_attributes.uid   = (set_uid3)  { .set_it=FALSE };
-    aargs.new_attributes.gid   = (set_gid3)  { .set_it=FALSE };
-    aargs.new_attributes.size  = (set_size3) { .set_it=FALSE };
-    aargs.new_attributes.atime = (set_atime) { .set_it=FALSE };
-    aargs.new_attributes.mtime = (set_mtime) { .set_it=FALSE };
+/*
+ * Copy a remote directory tree, fetching only the files that changed
+ * since the last sync to the same local directory. What was fetched
+ * is kept in a manifest next to that directory.
+ */
+void
+do_sync(int argc, char **argv)
+{
+    struct manifest mf;
+    struct pool pool;
+    char *dir, *local, *file, *p, *name = NULL;
+    int nworkers = NWORKERS;
+    int window = NWINDOW;
+    int holes = 1, keep;
+    nfs_fh3 fh;
+    fattr3 attr;
+    u_long gone;
 
-    if ((ares = nfs3_setattr_3(&aargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_setattr");
+    argv++; argc--;
+    if (mountpath == NULL) {
+	fprintf(stderr, "sync: no remote file system mounted\n");
 	return;
     }
-    if (ares->status != NFS3_OK) {
-	fprintf(stderr, "Set attributes failed: %s\n", nfs_error(ares->status));
+    while (argc >= 1 && argv[0][0] == '-') {
+	if (strcmp(argv[0], "-z") == 0)
+	    holes = 0;
+	else if (strcmp(argv[0], "-w") == 0 && argc >= 2) {
+	    window = atoi(argv[1]);
+	    argv++; argc--;
+	} else if (strcmp(argv[0], "-j") == 0 && argc >= 2) {
+	    nworkers = atoi(argv[1]);
+	    argv++; argc--;
+	} else
+	    break;
+	argv++; argc--;
+    }
+    if (argc != 1 && argc != 2) {
+	fprintf(stderr, "Usage: sync [-z] [-j <workers>] [-w <window>] "
+	    "<dir> [<local-dir>]\n");
 	return;
     }
+    dir = argv[0];
+    if (argc == 2)
+	local = argv[1];
+    else {
+	/* the last component of the remote name */
+	for (p = dir + strlen(dir); p > dir && p[-1] == '/'; p--)
+	    /* do nothing */;
+	for (local = p; local > dir && local[-1] != '/'; local--)
+	    /* do nothing */;
+	if ((local = name = strndup(local, p - local)) == NULL) {
+	    fprintf(stderr, "sync: out of memory\n");
+	    return;
+	}
+    }
+    if (*local == '\0' || strcmp(local, ".") == 0 || strcmp(local, "..") == 0) {
+	fprintf(stderr, "sync: name the local directory\n");
+	goto out;
+    }
+    if (!walkstart(dir, &fh, &attr))
+	goto out;
+    if ((file = malloc(strlen(local) + strlen(SYNCFILE) + 1)) == NULL) {
+	fprintf(stderr, "sync: out of memory\n");
+	goto out;
+    }
+    sprintf(file, "%s%s", local, SYNCFILE);
+    if (!manifest_load(&mf, file)) {
+	free(file);
+	goto out;
+    }
+    if (!pool_init(&pool, "sync", nworkers, window)) {
+	manifest_free(&mf);
+	free(file);
+	goto out;
+    }
+    pool.p_holes = holes;
+    pool.p_manifest = &mf;
+    pool.p_rootlen = strlen(local);
+    if (pool_add(&pool, NULL, TASK_DIR, &fh, 0, strdup(local)))
+	pool_run(&pool);
+
+    /* entries not seen are gone, unless the walk did not get everywhere */
+    keep = pool_stopped || pool.p_errors > 0;
+    if (manifest_save(&mf, file, keep, &gone))
+	printf("%lu directories, %lu files fetched, %lu unchanged, "
+	    "%llu of %llu bytes written, %lu gone, %lu errors\n",
+	    pool.p_dirs, pool.p_files, pool.p_same, pool.p_written,
+	    pool.p_bytes, gone, pool.p_errors);
+    pool_destroy(&pool);
+    manifest_free(&mf);
+    free(file);
+out:
+    free(name);
 }
 
 /*
- * Make new device node
+ * Walk a remote directory (TASK_WALK). The leave function sees every
+ * task, an interrupted walk's too, so it can always let go of the
+ * walk's data for the directory.
  */
-void
-do_mknod(int argc, char **argv)
+int
+walktask(struct worker *w, struct task *t)
 {
-    int mode, maj, min, device;
-    CREATE3args cargs;
-    CREATE3res *cres;
+    struct pool *pool = w->w_pool;
+    int ok = 1;
+
+    if (!pool_stopped)
+	ok = walkdir(w, t);
+    if (pool->p_leave != NULL)
+	pool->p_leave(pool, t, w->w_client);
+    return ok;
+}
 
-    if (mountpath == NULL) {
-	fprintf(stderr, "mknod: no remote file system mounted\n");
-	return;
+/*
+ * Visit the entries of one directory, queueing its subdirectories or,
+ * when enough work is waiting already, walking them on the spot
+ */
+int
+walkdir(struct worker *w, struct task *t)
+{
+    struct pool *pool = w->w_pool;
+    struct dirtable dt;
+    struct direntry *de;
+    struct task sub;
+    size_t len = strlen(t->t_path);
+    void *data;
+    char *path;
+    int ok = 1, queue;
+
+    /* the order of the entries does not matter here, so no sorting */
+    memset(&dt, 0, sizeof(dt));
+    if (!readdirentries(w->w_client, &t->t_handle, 1, 0, NULL,
+      newdirentry, &dt)) {
+	fprintf(stderr, "%s: cannot read directory %s\n",
+	    pool->p_cmd, t->t_path);
+	freedirentries(&dt);
+	return 0;
     }
-    if ((argc != 3 && argc != 5) || argv[2][1] != '\0')  {
-usage:	fprintf(stderr, "Usage: mknod <name> [b/c major minor] [p]\n");
-	return;
+    pthread_mutex_lock(&pool->p_lock);
+    pool->p_dirs++;
+    pthread_mutex_unlock(&pool->p_lock);
+
+    for (de = dt.dt_table; de < dt.dt_ptr && !pool_stopped; de++) {
+	if (strcmp(de->de_name, ".") == 0 || strcmp(de->de_name, "..") == 0)
+	    continue;
+	if (de->de_name[0] == '\0' || strchr(de->de_name, '/') != NULL) {
+	    fprintf(stderr, "%s: %s: bad name from server\n",
+		pool->p_cmd, t->t_path);
+	    ok = 0;
+	    continue;
+	}
+	if (!de->de_hasattr || !de->de_hashandle) {
+	    if (lookupentry(w->w_client, &t->t_handle, de, 1) != NFS3_OK ||
+	      !de->de_hasattr) {
+		ok = 0;
+		continue;
+	    }
+	}
+	if ((path = malloc(len + strlen(de->de_name) + 2)) == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pool->p_cmd);
+	    ok = 0;
+	    break;
+	}
+	if (len > 0 && t->t_path[len - 1] == '/')
+	    sprintf(path, "%s%s", t->t_path, de->de_name);
+	else
+	    sprintf(path, "%s/%s", t->t_path, de->de_name);
+
+	data = NULL;
+	if (!pool->p_visit(pool, t, de, path, &data) ||
+	  de->de_attr.type != NF3DIR) {
+	    free(path);
+	    continue;
+	}
+	pthread_mutex_lock(&pool->p_lock);
+	queue = pool->p_queued < WALKFRONTIER;
+	pthread_mutex_unlock(&pool->p_lock);
+	if (queue) {
+	    if (!pool_walk(pool, w, &de->de_handle, path, t->t_depth + 1, data))
+		ok = 0;
+	    continue;
+	}
+	memset(&sub, 0, sizeof(sub));
+	sub.t_type = TASK_WALK;
+	nfs_fh3copy(&sub.t_handle, &de->de_handle);
+	sub.t_path = path;
+	sub.t_depth = t->t_depth + 1;
+	sub.t_data = data;
+	if (!walktask(w, &sub))
+	    ok = 0;
+	free(path);
     }
-    if (argc == 3) {
-	if (argv[2][0] != 'p')
-	    goto usage;
-	mode = IFCHR;
-	device = NF3FIFO;
-    } else if (argc == 5) {
-	switch (argv[2][0]) {
-	case 'b':
-	    mode = IFBLK;
+    freedirentries(&dt);
+    return ok;
+}
+
+/*
+ * The pipes a transfer spreads its calls over: one on the caller's
+ * own connection, plus one on every pool connection no other thread
+ * is using at the moment. Replies are waited for on all of them at
+ * once by an event loop.
+ */
+struct pipeset {
+    struct rpcpipe ps_pipe[MAXCONNECT]; /* the pipes */
+    int ps_slot[MAXCONNECT];	/* pool slot borrowed for a pipe, or -1 */
+    int ps_count;		/* number of pipes */
+    struct rpcloop ps_loop;	/* waits for the replies */
+};
+
+/*
+ * A chunk of a remote file on its way through the READ pipeline
+ */
+struct readchunk {
+    struct rpccall rk_call;	/* READ call for this chunk */
+    READ3args rk_args;		/* its arguments */
+    READ3res rk_res;		/* and its results */
+    offset3 rk_offset;		/* file offset of the chunk */
+    count3 rk_count;		/* number of bytes wanted */
+    count3 rk_filled;		/* number of bytes received */
+    char *rk_buf;		/* chunk data */
+    int rk_state;		/* see below */
+};
+
+#define	RK_FREE		0	/* slot is unused */
+#define	RK_BUSY		1	/* READ is in flight */
+#define	RK_DONE		2	/* data is waiting to be written */
+
+/*
+ * A block reader hands out the blocks of one file, from the block
+ * cache when it has them and from the server otherwise. Blocks are
+ * fetched in pieces of at most the read size, all in flight at once.
+ * When the blocks asked for go up or down one at a time, the next
+ * ones in that direction are fetched ahead; the number of blocks
+ * read ahead doubles with every further step, up to br_ramax.
+ */
+struct brblock {
+    uint64 bb_block;		/* block number */
+    char *bb_buf;		/* its data */
+    count3 bb_end;		/* its length, less when the file ends in it */
+    int bb_pending;		/* pieces in flight */
+    int bb_state;		/* see below */
+    char *bb_error;		/* why a piece failed, or NULL */
+};
+
+#define	BB_FREE		0	/* slot is unused */
+#define	BB_BUSY		1	/* READs are in flight */
+#define	BB_DONE		2	/* data is complete */
+
+struct brpiece {
+    struct readchunk bp_chunk;	/* READ of this piece, must come first */
+    struct brblock *bp_block;	/* block it is part of */
+};
+
+struct blockreader {
+    nfs_fh3 br_fh;		/* file being read */
+    fattr3 br_attr;		/* its latest attributes */
+    struct pipeset br_ps;	/* pipes the READs go out on */
+    struct brblock *br_blocks;	/* blocks being fetched */
+    int br_nblocks;		/* number of those */
+    struct brpiece *br_pieces;	/* READs for parts of them */
+    int br_npieces;		/* number of those */
+    u_int br_rsize;		/* bytes in a piece */
+    char *br_buf;		/* data of the block last handed out */
+    long long br_last;	/* number of that block, -1 if none */
+    int br_dir;			/* 1 reading up, -1 down, 0 at random */
+    int br_ra;			/* blocks to read ahead */
+    int br_ramax;		/* most blocks to read ahead */
+};
+
+/*
+ * Decode a READ result up to its data, for a call with a sink (see
+ * rpcpipe_send): the data itself is put into the sink by the pipe. On
+ * entry data_len holds the size of the sink; a reply carrying more
+ * data than that fails to decode rather than overrunning it. Nothing
+ * is allocated, so there is nothing to free either.
+ */
+bool_t
+xdr_READ3res_head(XDR *xdrs, READ3res *objp)
+{
+    READ3resok *resok = &objp->READ3res_u.resok;
+    u_int size = resok->data.data_len;
+
+    if (xdrs->x_op == XDR_FREE)
+	return TRUE;
+    if (!xdr_nfsstat3(xdrs, &objp->status))
+	return FALSE;
+    if (objp->status != NFS3_OK)
+	return xdr_post_op_attr(xdrs, &objp->READ3res_u.resfail.file_attributes);
+    if (!xdr_post_op_attr(xdrs, &resok->file_attributes))
+	return FALSE;
+    if (!xdr_count3(xdrs, &resok->count))
+	return FALSE;
+    if (!xdr_bool(xdrs, &resok->eof))
+	return FALSE;
+    if (!xdr_u_int(xdrs, &resok->data.data_len))
+	return FALSE;
+    return resok->data.data_len <= size;
+}
+
+/*
+ * Issue a READ for the part of a chunk not yet received. The reply
+ * data goes from the socket directly behind what is already in the
+ * chunk buffer, which may be part of the mapped output file.
+ */
+int
+readchunk(struct rpcpipe *rp, nfs_fh3 *fh, struct readchunk *rk)
+{
+    nfs_fh3copy(&rk->rk_args.file, fh);
+    rk->rk_args.offset = rk->rk_offset + rk->rk_filled;
+    rk->rk_args.count = rk->rk_count - rk->rk_filled;
+    memset(&rk->rk_res, 0, sizeof(rk->rk_res));
+    rk->rk_res.READ3res_u.resok.data.data_val = rk->rk_buf + rk->rk_filled;
+    rk->rk_res.READ3res_u.resok.data.data_len = rk->rk_args.count;
+    rk->rk_call.rc_sink = rk->rk_buf + rk->rk_filled;
+    rk->rk_call.rc_sinksize = rk->rk_args.count;
+    rk->rk_call.rc_data = rk;
+    rk->rk_state = RK_BUSY;
+    if (!rpcpipe_send(rp, &rk->rk_call, NFS3_READ,
+      (xdrproc_t) xdr_READ3args, (caddr_t) &rk->rk_args,
+      (xdrproc_t) xdr_READ3res_head, (caddr_t) &rk->rk_res)) {
+	clnt_perrno(rp->rp_stat);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Map the first 'size' bytes of output file 'fd', so that READ data
+ * can go from the socket straight into the page cache. The file is
+ * grown and its blocks reserved first: a store into the mapping has
+ * no way of reporting a full disk. When the file cannot be mapped
+ * (not a regular file, empty, too large) NULL is returned and the
+ * caller writes the data with pwrite instead.
+ */
+char *
+mapoutput(int fd, size3 size)
+{
+    struct stat st;
+    char *map;
+
+    if (size == 0 || size != (size_t) size ||
+      fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+	return NULL;
+    if (ftruncate(fd, size) == 0 && posix_fallocate(fd, 0, size) == 0) {
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map != MAP_FAILED)
+	    return map;
+    }
+    (void) ftruncate(fd, st.st_size);
+    return NULL;
+}
+
+/*
+ * Copy the first 'size' bytes of remote file 'fh' to file descriptor
+ * 'fd', keeping up to 'window' READ requests in flight on 'clnt' and
+ * the idle connections of the pool. Replies may come back in any
+ * order. Unless 'inorder' is set, the data goes straight into the
+ * mapped output file, or when it cannot be mapped every chunk is
+ * written at its own offset with pwrite as soon as it is complete;
+ * otherwise (pipes, terminals) completed chunks are held back until
+ * all data in front of them has been written. With 'holes' set, and
+ * not 'inorder', blocks of zeros are left as holes in the copy. That
+ * takes pwrite: a mapped file has its blocks reserved up front, and
+ * writing next to them turns small holes back into zeros on disk.
+ */
+int
+readfile(CLIENT *clnt, nfs_fh3 *fh, size3 size, int fd, int inorder,
+    int holes, int window)
+{
+    struct stat st;
+    offset3 end;
+    char *map;
+    int ok;
+
+    map = inorder || holes ? NULL : mapoutput(fd, size);
+    ok = readrange(clnt, fh, 0, size, fd, map, inorder, holes, window, &end);
+    if (map != NULL) {
+	(void) munmap(map, size);
+	if (end < size && ftruncate(fd, end) < 0) {
+	    perror("ftruncate");
+	    ok = 0;
+	}
+    } else if (ok && holes && !inorder && fstat(fd, &st) == 0 &&
+      S_ISREG(st.st_mode) && st.st_size < end && ftruncate(fd, end) < 0) {
+	/* the file ends in a hole, which nothing was written to */
+	perror("ftruncate");
+	ok = 0;
+    }
+    return ok;
+}
+
+/*
+ * The work of readfile for the 'len' bytes at offset 'start'. 'Map'
+ * is where the range is mapped, or NULL. The end of the range, or of
+ * the file if that comes first, is returned in 'endp'.
+ */
+int
+readrange(CLIENT *clnt, nfs_fh3 *fh, offset3 start, size3 len, int fd,
+    char *map, int inorder, int holes, int window, offset3 *endp)
+{
+    struct readchunk *chunks, *rk;
+    struct pipeset ps;
+    struct rpcpipe *rp;
+    struct rpccall *rc;
+    offset3 next, written, end;
+    count3 n;
+    char *buf;
+    u_int rsize;
+    int i, w, replies = 0, retrans = 0, ok = 1;
+
+    *endp = start + len;
+    if (window < 1)
+	window = 1;
+    rsize = adaptsize(&xfer.xp_rsize, &xfer.xp_rceil, XFER_KEEP);
+    if (!openpipes(&ps, clnt, xfer.xp_rmax))
+	return 0;
+    if ((chunks = (struct readchunk *) calloc(window, sizeof(*chunks))) == NULL) {
+	fprintf(stderr, "readfile: out of memory\n");
+	closepipes(&ps);
+	return 0;
+    }
+    for (i = 0; i < window && map == NULL; i++) {
+	if (posix_memalign((void **) &chunks[i].rk_buf, getpagesize(),
+	  xfer.xp_rmax) != 0) {
+	    fprintf(stderr, "readfile: out of memory\n");
+	    chunks[i].rk_buf = NULL;
+	    window = i;
+	    ok = 0;
 	    break;
-	case 'c':
-	    mode = IFCHR;
+	}
+    }
+
+    next = written = start;
+    end = start + len;
+    while (ok) {
+	/* keep the pipeline filled */
+	for (i = 0; i < window && next < end; i++) {
+	    rk = &chunks[i];
+	    if (rk->rk_state != RK_FREE)
+		continue;
+	    rk->rk_offset = next;
+	    rk->rk_count = MIN(rsize, end - next);
+	    rk->rk_filled = 0;
+	    if (map != NULL)
+		rk->rk_buf = map + (next - start);
+	    next += rk->rk_count;
+	    if (!readchunk(rpcpipe_pick(ps.ps_pipe, ps.ps_count), fh, rk)) {
+		ok = 0;
+		break;
+	    }
+	}
+	if (!ok || pipesbusy(&ps) == 0)
+	    break;
+
+	if ((rc = rpcloop_recv(&ps.ps_loop, &rp)) == NULL) {
+	    clnt_perrno(rp->rp_stat);
+	    ok = 0;
 	    break;
 	}
-	maj = atoi(argv[3]);
-	min = atoi(argv[4]);
-	device = makedev(maj, min);
+	rk = (struct readchunk *) rc->rc_data;
+	if (rp->rp_type == SOCK_DGRAM && ++replies % window == 0) {
+	    rsize = adaptsize(&xfer.xp_rsize, &xfer.xp_rceil,
+		pipesretrans(&ps) > retrans ? XFER_SHRINK : XFER_GROW);
+	    retrans = pipesretrans(&ps);
+	}
+	if (rc->rc_stat != RPC_SUCCESS) {
+	    clnt_perrno(rc->rc_stat);
+	    ok = 0;
+	} else if (rk->rk_res.status != NFS3_OK) {
+	    fprintf(stderr, "Read failed: %s\n", nfs_error(rk->rk_res.status));
+	    ok = 0;
+	} else if ((n = rk->rk_res.READ3res_u.resok.data.data_len) >
+	  rc->rc_sinklen) {
+	    fprintf(stderr, "Read failed: reply is missing data\n");
+	    ok = 0;
+	} else {
+	    rk->rk_filled += n;
+
+	    /* the file may be shorter than its attributes claimed */
+	    if (rk->rk_res.READ3res_u.resok.eof || n == 0)
+		end = MIN(end, rk->rk_offset + rk->rk_filled);
+	}
+	if (!ok)
+	    break;
+
+	/* short read, ask for the remainder */
+	if (rk->rk_filled < rk->rk_count && rk->rk_offset + rk->rk_filled < end) {
+	    if (!readchunk(rpcpipe_pick(ps.ps_pipe, ps.ps_count), fh, rk))
+		ok = 0;
+	    continue;
+	}
+	rk->rk_state = RK_DONE;
+
+	if (!inorder) {
+	    if (holes && map == NULL)
+		ok = writeholes(fd, rk->rk_buf, rk->rk_filled, rk->rk_offset);
+	    else if (map == NULL &&
+	      pwrite(fd, rk->rk_buf, rk->rk_filled, rk->rk_offset) != rk->rk_filled) {
+		perror("write");
+		ok = 0;
+	    }
+	    rk->rk_state = RK_FREE;
+	    continue;
+	}
+
+	/* write out every chunk that is next in line */
+	for (i = 0; i < window; i++) {
+	    rk = &chunks[i];
+	    if (rk->rk_state != RK_DONE)
+		continue;
+	    if (rk->rk_offset >= end) {
+		rk->rk_state = RK_FREE;		/* beyond end of file */
+		continue;
+	    }
+	    if (rk->rk_offset != written)
+		continue;
+	    for (buf = rk->rk_buf, n = rk->rk_filled; n > 0; buf += w, n -= w) {
+		if ((w = write(fd, buf, n)) < 0) {
+		    perror("write");
+		    ok = 0;
+		    break;
+		}
+	    }
+	    if (!ok)
+		break;
+	    written += rk->rk_filled;
+	    rk->rk_state = RK_FREE;
+	    i = -1;			/* rescan for the next chunk */
+	}
     }
 
-    /*
-     * Make remote device node
-     */
-    cargs.where.name = argv[1];
-    nfs_fh3copy(&cargs.where.dir, &directory_handle);
-    cargs.how.createhow3_u.obj_attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode=mode | 0777};
-    cargs.how.createhow3_u.obj_attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u = uid };
-    cargs.how.createhow3_u.obj_attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u = gid };
-    cargs.how.createhow3_u.obj_attributes.size  = (set_size3) { .set_it=TRUE, .set_size3_u = device };
-    cargs.how.createhow3_u.obj_attributes.atime = (set_atime) { .set_it=FALSE };
-    cargs.how.createhow3_u.obj_attributes.mtime = (set_mtime) { .set_it=FALSE };
-    if ((cres = nfs3_create_3(&cargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_create");
-	return;
+    for (i = 0; i < window; i++) {
+	rpccall_free(&chunks[i].rk_call);
+	if (map == NULL)
+	    free(chunks[i].rk_buf);
+    }
+    free(chunks);
+    closepipes(&ps);
+    *endp = end;
+    return ok;
+}
+
+/*
+ * Length of the run at the start of the 'len' bytes at 'buf', which
+ * are at offset 'off' of their file: of whole HOLESIZE blocks of
+ * zeros when 'zero' is set, otherwise of the data up to the first
+ * such block. A block is compared with itself one byte further on,
+ * which memcmp does with its vector loop; a block of data usually
+ * gives itself away in the first byte or two.
+ */
+count3
+holerun(char *buf, count3 len, offset3 off, int zero)
+{
+    count3 done, n;
+    int z;
+
+    for (done = 0; done < len; done += n) {
+	n = MIN(HOLESIZE - (off + done) % HOLESIZE, len - done);
+	z = n == HOLESIZE && buf[done] == 0 &&
+	    memcmp(buf + done, buf + done + 1, n - 1) == 0;
+	if (z != zero)
+	    break;
+    }
+    return done;
+}
+
+/*
+ * Store the 'len' bytes at 'buf' at offset 'off' of 'fd', with holes
+ * where they have blocks of zeros. Where holes cannot be made, which
+ * only matters when there was data before, the zeros are written.
+ */
+int
+writeholes(int fd, char *buf, count3 len, offset3 off)
+{
+    count3 n;
+    int zero;
+
+    for (zero = 0; len > 0; zero = !zero) {
+	n = holerun(buf, len, off, zero);
+	if (n > 0 && !(zero && punchhole(fd, off, n)) &&
+	  pwrite(fd, buf, n, off) != n) {
+	    perror("write");
+	    return 0;
+	}
+	buf += n;
+	off += n;
+	len -= n;
+    }
+    return 1;
+}
+
+/*
+ * Make the 'len' bytes at offset 'off' of 'fd' a hole, without
+ * changing its size. Returns 0 if the file system cannot do that.
+ */
+int
+punchhole(int fd, offset3 off, size3 len)
+{
+#ifdef FALLOC_FL_PUNCH_HOLE
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	off, len) == 0;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Prepare to read the blocks of file 'fh' with attributes 'attr'.
+ * 'Ra' blocks after the first one are read ahead right away, and up
+ * to 'ramax' once the blocks are found to be read in sequence.
+ */
+int
+bropen(struct blockreader *br, CLIENT *clnt, nfs_fh3 *fh, fattr3 *attr,
+    int ra, int ramax)
+{
+    int i, perblock;
+
+    memset(br, 0, sizeof(*br));
+    nfs_fh3copy(&br->br_fh, fh);
+    br->br_attr = *attr;
+    br->br_ramax = MAX(ramax, 0);
+    br->br_ra = MIN(MAX(ra, 0), br->br_ramax);
+    br->br_dir = br->br_ra > 0;
+    br->br_last = -1;
+    br->br_rsize = MIN(adaptsize(&xfer.xp_rsize, &xfer.xp_rceil, XFER_KEEP),
+	BCACHE_BLOCK);
+    perblock = (BCACHE_BLOCK + br->br_rsize - 1) / br->br_rsize;
+    br->br_nblocks = br->br_ramax + 1;
+    br->br_npieces = br->br_nblocks * perblock;
+    if (!openpipes(&br->br_ps, clnt, xfer.xp_rmax))
+	return 0;
+    br->br_blocks = (struct brblock *) calloc(br->br_nblocks, sizeof(struct brblock));
+    br->br_pieces = (struct brpiece *) calloc(br->br_npieces, sizeof(struct brpiece));
+    br->br_buf = malloc(BCACHE_BLOCK);
+    if (br->br_blocks == NULL || br->br_pieces == NULL || br->br_buf == NULL)
+	goto nomem;
+    for (i = 0; i < br->br_nblocks; i++)
+	if ((br->br_blocks[i].bb_buf = malloc(BCACHE_BLOCK)) == NULL)
+	    goto nomem;
+    return 1;
+
+nomem:
+    fprintf(stderr, "out of memory\n");
+    brclose(br);
+    return 0;
+}
+
+/*
+ * Wait for the READs still in flight, then release everything
+ */
+void
+brclose(struct blockreader *br)
+{
+    int i;
+
+    while (br->br_ps.ps_count > 0 && pipesbusy(&br->br_ps) > 0)
+	if (!brpump(br))
+	    break;
+    for (i = 0; br->br_pieces != NULL && i < br->br_npieces; i++)
+	rpccall_free(&br->br_pieces[i].bp_chunk.rk_call);
+    for (i = 0; br->br_blocks != NULL && i < br->br_nblocks; i++)
+	free(br->br_blocks[i].bb_buf);
+    free(br->br_pieces);
+    free(br->br_blocks);
+    free(br->br_buf);
+    br->br_pieces = NULL;
+    br->br_blocks = NULL;
+    br->br_buf = NULL;
+    if (br->br_ps.ps_count > 0)
+	closepipes(&br->br_ps);
+}
+
+/*
+ * Return block 'block', its length in '*lenp'. The data stays valid
+ * until the next call. A block shorter than BCACHE_BLOCK is the
+ * last one of the file.
+ */
+char *
+brget(struct blockreader *br, uint64 block, count3 *lenp)
+{
+    struct brblock *bb;
+    char *err;
+    int dir;
+
+    /* look for a sequential pattern */
+    if (br->br_last >= 0 && block == br->br_last + 1)
+	dir = 1;
+    else if (br->br_last >= 0 && block + 1 == br->br_last)
+	dir = -1;
+    else
+	dir = 0;
+    if (dir != 0 && dir == br->br_dir)
+	br->br_ra = br->br_ra == 0 ? 1 : MIN(br->br_ra * 2, br->br_ramax);
+    else if (dir != 0)
+	br->br_ra = MIN(1, br->br_ramax);
+    else if (br->br_last >= 0 && block != br->br_last)
+	br->br_ra = 0;
+    if (br->br_last >= 0)
+	br->br_dir = dir;
+    br->br_last = block;
+
+    if ((bb = brfind(br, block)) == NULL) {
+	if (bcache_read(&br->br_fh, block, &br->br_attr, br->br_buf, lenp)) {
+	    brahead(br, block);
+	    return br->br_buf;
+	}
+	while (!brstart(br, block, 1))
+	    if (!brpump(br))
+		return NULL;
+	bb = brfind(br, block);
+    }
+    brahead(br, block);
+    while (bb->bb_state == BB_BUSY)
+	if (!brpump(br))
+	    return NULL;
+    bb->bb_state = BB_FREE;
+    if ((err = bb->bb_error) != NULL) {
+	fprintf(stderr, "Read failed: %s\n", err);
+	return NULL;
+    }
+    memcpy(br->br_buf, bb->bb_buf, bb->bb_end);
+    *lenp = bb->bb_end;
+    return br->br_buf;
+}
+
+/*
+ * The slot of a block that is being fetched or waits to be handed out
+ */
+struct brblock *
+brfind(struct blockreader *br, uint64 block)
+{
+    int i;
+
+    for (i = 0; i < br->br_nblocks; i++)
+	if (br->br_blocks[i].bb_state != BB_FREE &&
+	  br->br_blocks[i].bb_block == block)
+	    return &br->br_blocks[i];
+    return NULL;
+}
+
+/*
+ * Fetch the blocks that come after 'block' in the direction of reading
+ */
+void
+brahead(struct blockreader *br, uint64 block)
+{
+    uint64 b;
+    int i;
+
+    if (br->br_dir == 0)
+	return;
+    for (i = 1; i <= br->br_ra; i++) {
+	if (br->br_dir < 0 && i > block)
+	    break;
+	b = block + br->br_dir * i;
+	if (b * BCACHE_BLOCK >= br->br_attr.size)
+	    break;
+	if (brfind(br, b) != NULL ||
+	  bcache_read(&br->br_fh, b, &br->br_attr, NULL, NULL))
+	    continue;
+	if (!brstart(br, b, 0))
+	    break;
+    }
+}
+
+/*
+ * Send the READs for block 'block', in a free slot or, when 'reuse'
+ * is set, in one holding a block fetched ahead. Returns 0 when there
+ * is no slot to be had.
+ */
+int
+brstart(struct blockreader *br, uint64 block, int reuse)
+{
+    struct brblock *bb = NULL;
+    struct readchunk *rk;
+    offset3 start;
+    u_int off;
+    int i, k;
+
+    for (i = 0; i < br->br_nblocks && bb == NULL; i++)
+	if (br->br_blocks[i].bb_state == BB_FREE)
+	    bb = &br->br_blocks[i];
+    for (i = 0; i < br->br_nblocks && bb == NULL && reuse; i++)
+	if (br->br_blocks[i].bb_state == BB_DONE)
+	    bb = &br->br_blocks[i];
+    if (bb == NULL)
+	return 0;
+
+    bb->bb_block = block;
+    bb->bb_end = BCACHE_BLOCK;
+    bb->bb_pending = 0;
+    bb->bb_error = NULL;
+    bb->bb_state = BB_BUSY;
+    start = block * BCACHE_BLOCK;
+    if (br->br_attr.size < start + BCACHE_BLOCK)
+	bb->bb_end = br->br_attr.size > start ? br->br_attr.size - start : 0;
+    for (off = 0, k = 0; off < bb->bb_end; off += br->br_rsize) {
+	while (br->br_pieces[k].bp_chunk.rk_state != RK_FREE)
+	    k++;
+	rk = &br->br_pieces[k].bp_chunk;
+	br->br_pieces[k].bp_block = bb;
+	rk->rk_offset = start + off;
+	rk->rk_count = MIN(br->br_rsize, BCACHE_BLOCK - off);
+	rk->rk_filled = 0;
+	rk->rk_buf = bb->bb_buf + off;
+	if (!readchunk(rpcpipe_pick(br->br_ps.ps_pipe, br->br_ps.ps_count),
+	  &br->br_fh, rk)) {
+	    rk->rk_state = RK_FREE;
+	    bb->bb_error = "cannot send request";
+	    break;
+	}
+	bb->bb_pending++;
+    }
+    if (bb->bb_pending == 0)
+	bb->bb_state = BB_DONE;
+    return 1;
+}
+
+/*
+ * Take one READ reply. A block is entered in the cache when its last
+ * piece is in. Returns 0 when the transport failed.
+ */
+int
+brpump(struct blockreader *br)
+{
+    READ3resok *resok;
+    struct brblock *bb;
+    struct readchunk *rk;
+    struct rpcpipe *rp;
+    struct rpccall *rc;
+    offset3 start;
+    count3 n;
+
+    if ((rc = rpcloop_recv(&br->br_ps.ps_loop, &rp)) == NULL) {
+	clnt_perrno(rp->rp_stat);
+	return 0;
+    }
+    rk = (struct readchunk *) rc->rc_data;
+    bb = ((struct brpiece *) rk)->bp_block;
+    start = bb->bb_block * BCACHE_BLOCK;
+    resok = &rk->rk_res.READ3res_u.resok;
+    if (rc->rc_stat != RPC_SUCCESS)
+	bb->bb_error = clnt_sperrno(rc->rc_stat);
+    else if (rk->rk_res.status != NFS3_OK)
+	bb->bb_error = nfs_error(rk->rk_res.status);
+    else if ((n = resok->data.data_len) > rc->rc_sinklen)
+	bb->bb_error = "reply is missing data";
+    else {
+	/* the file changed, the blocks read from now on are its new data */
+	if (resok->file_attributes.attributes_follow &&
+	  !sameversion(&br->br_attr, &resok->file_attributes.post_op_attr_u.attributes)) {
+	    br->br_attr = resok->file_attributes.post_op_attr_u.attributes;
+	    dnlc_attr(&br->br_fh, &resok->file_attributes);
+	}
+	rk->rk_filled += n;
+	if (resok->eof || n == 0)
+	    bb->bb_end = MIN(bb->bb_end, rk->rk_offset + rk->rk_filled - start);
+
+	/* short read, ask for the remainder */
+	if (rk->rk_filled < rk->rk_count &&
+	  rk->rk_offset + rk->rk_filled - start < bb->bb_end) {
+	    if (readchunk(rpcpipe_pick(br->br_ps.ps_pipe, br->br_ps.ps_count),
+	      &br->br_fh, rk))
+		return 1;
+	    bb->bb_error = "cannot send request";
+	}
+    }
+    rk->rk_state = RK_FREE;
+    if (--bb->bb_pending == 0) {
+	bb->bb_state = BB_DONE;
+	if (bb->bb_error == NULL)
+	    bcache_enter(&br->br_fh, bb->bb_block, &br->br_attr,
+		bb->bb_buf, bb->bb_end);
+    }
+    return 1;
+}
+
+/*
+ * Attributes describe the same version of a file's data
+ */
+int
+sameversion(fattr3 *a, fattr3 *b)
+{
+    return a->size == b->size &&
+	a->mtime.seconds == b->mtime.seconds &&
+	a->mtime.nseconds == b->mtime.nseconds &&
+	a->ctime.seconds == b->ctime.seconds &&
+	a->ctime.nseconds == b->ctime.nseconds;
+}
+
+/*
+ * Look up a regular file for head, tail and hexdump
+ */
+int
+lookupfile(char *cmd, char *name, nfs_fh3 *fh, fattr3 *attr)
+{
+    post_op_attr pattr;
+    nfs_fh3 dir;
+
+    if (!walkparent(name, &dir, &name) ||
+      !lookup(nfsclient, &dir, name, fh, &pattr))
+	return 0;
+    if (!pattr.attributes_follow && !getattributes(nfsclient, fh, attr))
+	return 0;
+    if (pattr.attributes_follow)
+	*attr = pattr.post_op_attr_u.attributes;
+    if (attr->type != NF3REG) {
+	fprintf(stderr, "%s: %s: is not a regular file\n", cmd, name);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Write 'len' bytes at offset 'start' of file 'fh' to stdout, by way
+ * of the block cache, reading up to 'window' blocks ahead
+ */
+int
+catrange(nfs_fh3 *fh, fattr3 *attr, offset3 start, size3 len, int window)
+{
+    struct blockreader br;
+    offset3 end = start + len, off;
+    uint64 block;
+    count3 n;
+    char *buf;
+    int ok = 1;
+
+    if (len == 0)
+	return 1;
+    if (!bropen(&br, nfsclient, fh, attr, window, window))
+	return 0;
+    for (block = start / BCACHE_BLOCK; ok; block++) {
+	off = block * BCACHE_BLOCK;
+	if (off >= end || off >= br.br_attr.size)
+	    break;
+	if ((buf = brget(&br, block, &n)) == NULL) {
+	    ok = 0;
+	    break;
+	}
+	if (off < start) {
+	    buf += start - off;
+	    n = n > start - off ? n - (start - off) : 0;
+	    off = start;
+	}
+	if (off + n > end)
+	    n = end - off;
+	if (fwrite(buf, 1, n, stdout) != n) {
+	    perror("write");
+	    ok = 0;
+	}
+	if (off + n >= end || n == 0)
+	    break;
+	if (((off + n) % BCACHE_BLOCK) != 0)
+	    break;			/* short block, end of file */
+    }
+    fflush(stdout);
+    brclose(&br);
+    return ok;
+}
+
+/*
+ * Display the first lines or bytes of a remote file. Only the blocks
+ * holding them are read.
+ */
+void
+do_head(int argc, char **argv)
+{
+    struct blockreader br;
+    unsigned long long count = 10;
+    int bytes = 0;
+    fattr3 attr;
+    nfs_fh3 fh;
+    uint64 block;
+    count3 n, i;
+    char *buf;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "head: no remote file system mounted\n");
+	return;
+    }
+    if (argc == 4 && (strcmp(argv[1], "-n") == 0 || strcmp(argv[1], "-c") == 0)) {
+	bytes = argv[1][1] == 'c';
+	count = strtoull(argv[2], NULL, 0);
+	argv += 2; argc -= 2;
+    }
+    if (argc != 2) {
+	fprintf(stderr, "Usage: head [-n <lines> | -c <bytes>] <filespec>\n");
+	return;
+    }
+    if (!lookupfile("head", argv[1], &fh, &attr))
+	return;
+    if (bytes) {
+	(void) catrange(&fh, &attr, 0, MIN(count, attr.size), NWINDOW);
+	return;
+    }
+    if (count == 0 || !bropen(&br, nfsclient, &fh, &attr, 0, NWINDOW))
+	return;
+    for (block = 0; block * BCACHE_BLOCK < br.br_attr.size; block++) {
+	if ((buf = brget(&br, block, &n)) == NULL)
+	    break;
+	for (i = 0; i < n && count > 0; i++)
+	    if (buf[i] == '\n')
+		count--;
+	fwrite(buf, 1, i, stdout);
+	if (count == 0 || n < BCACHE_BLOCK)
+	    break;
+    }
+    fflush(stdout);
+    brclose(&br);
+}
+
+/*
+ * Display the last lines or bytes of a remote file. The blocks are
+ * searched for line ends from the end of the file backwards.
+ */
+void
+do_tail(int argc, char **argv)
+{
+    struct blockreader br;
+    unsigned long long count = 10;
+    int bytes = 0, found = 0;
+    offset3 start = 0, end;
+    fattr3 attr;
+    nfs_fh3 fh;
+    uint64 block;
+    count3 n;
+    char *buf;
+    long i;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "tail: no remote file system mounted\n");
+	return;
+    }
+    if (argc == 4 && (strcmp(argv[1], "-n") == 0 || strcmp(argv[1], "-c") == 0)) {
+	bytes = argv[1][1] == 'c';
+	count = strtoull(argv[2], NULL, 0);
+	argv += 2; argc -= 2;
+    }
+    if (argc != 2) {
+	fprintf(stderr, "Usage: tail [-n <lines> | -c <bytes>] <filespec>\n");
+	return;
+    }
+    if (!lookupfile("tail", argv[1], &fh, &attr))
+	return;
+    if (bytes || attr.size == 0 || count == 0) {
+	start = count < attr.size ? attr.size - count : 0;
+	if (!bytes)
+	    start = attr.size;
+	(void) catrange(&fh, &attr, start, attr.size - start, NWINDOW);
+	return;
+    }
+
+    /* a line end at the very end of the file does not start a line */
+    if (!bropen(&br, nfsclient, &fh, &attr, 0, NWINDOW))
+	return;
+    end = attr.size - 1;
+    for (block = end / BCACHE_BLOCK; !found; block--) {
+	if ((buf = brget(&br, block, &n)) == NULL) {
+	    brclose(&br);
+	    return;
+	}
+	for (i = MIN(n, end - block * BCACHE_BLOCK) - 1; i >= 0; i--) {
+	    if (buf[i] == '\n' && --count == 0) {
+		start = block * BCACHE_BLOCK + i + 1;
+		found = 1;
+		break;
+	    }
+	}
+	if (block == 0)
+	    break;
+    }
+    attr = br.br_attr;
+    brclose(&br);
+    (void) catrange(&fh, &attr, start, attr.size - start, NWINDOW);
+}
+
+/*
+ * Display a part of a remote file in hexadecimal and ASCII, in the
+ * layout of hexdump -C
+ */
+void
+do_hexdump(int argc, char **argv)
+{
+    struct blockreader br;
+    unsigned long long skip = 0, length = ~0ULL;
+    u_char line[16], prev[16];
+    offset3 off, end, pos;
+    int nline = 0, same = 0, havelast = 0;
+    fattr3 attr;
+    nfs_fh3 fh;
+    uint64 block;
+    count3 n, i;
+    char *buf, *cp;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "hexdump: no remote file system mounted\n");
+	return;
+    }
+    while (argc >= 3 && argv[1][0] == '-') {
+	if (strcmp(argv[1], "-s") == 0)
+	    skip = strtoull(argv[2], &cp, 0);
+	else if (strcmp(argv[1], "-n") == 0)
+	    length = strtoull(argv[2], &cp, 0);
+	else
+	    break;
+	if (*cp != '\0')
+	    break;
+	argv += 2; argc -= 2;
+    }
+    if (argc != 2) {
+	fprintf(stderr, "Usage: hexdump [-s <offset>] [-n <length>] <filespec>\n");
+	return;
+    }
+    if (!lookupfile("hexdump", argv[1], &fh, &attr))
+	return;
+    if (!bropen(&br, nfsclient, &fh, &attr, 0, NWINDOW))
+	return;
+    pos = skip;
+    end = length > attr.size - MIN(skip, attr.size) ?
+	attr.size : skip + length;
+    for (block = skip / BCACHE_BLOCK; pos < end; block++) {
+	if ((buf = brget(&br, block, &n)) == NULL)
+	    break;
+	off = block * BCACHE_BLOCK;
+	for (i = pos - off; i < n && pos < end; i++, pos++) {
+	    line[nline++] = buf[i];
+	    if (nline < sizeof(line))
+		continue;
+	    if (havelast && memcmp(line, prev, sizeof(line)) == 0) {
+		if (!same)
+		    printf("*\n");
+		same = 1;
+	    } else {
+		hexline(pos + 1 - nline, line, nline);
+		same = 0;
+	    }
+	    memcpy(prev, line, sizeof(line));
+	    havelast = 1;
+	    nline = 0;
+	}
+	if (n < BCACHE_BLOCK)
+	    break;
+    }
+    if (nline > 0)
+	hexline(pos - nline, line, nline);
+    if (pos > skip)
+	printf("%08llx\n", (unsigned long long) pos);
+    fflush(stdout);
+    brclose(&br);
+}
+
+void
+hexline(offset3 off, u_char *line, int n)
+{
+    int i;
+
+    printf("%08llx ", (unsigned long long) off);
+    for (i = 0; i < 16; i++) {
+	if (i % 8 == 0)
+	    putchar(' ');
+	if (i < n)
+	    printf("%02x ", line[i]);
+	else
+	    printf("   ");
+    }
+    printf(" |");
+    for (i = 0; i < n; i++)
+	putchar(isprint(line[i]) ? line[i] : '.');
+    printf("|\n");
+}
+
+/*
+ * Show file system information
+ */
+/* ARGUSED */
+void
+do_df(int argc, char **argv)
+{
+    FSSTAT3args args;
+    FSSTAT3res res;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "df: no remote file system mounted\n");
+	return;
+    }
+    if (argc != 1) {
+	fprintf(stderr, "Usage: df\n");
+	return;
+    }
+    nfs_fh3copy(&args.fsroot, &root_handle);
+    memset(&res, 0, sizeof(res));
+    if (nfs3_fsstat_3(&args, &res, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_fsstat");
+	return;
+    }
+    if (res.status != NFS3_OK) {
+	fprintf(stderr, "Df failed: %s\n", nfs_error(res.status));
+	return;
+    }
+
+#define x res.FSSTAT3res_u.resok
+    printf("%s:%s    %ldK, %ldK used, %ldK free (%ldK useable).\n",
+	remotehost, mountpath,
+	x.tbytes/1024, (x.tbytes-x.fbytes)/1024,
+	x.fbytes/1024, x.abytes/1024);
+#undef x
+}
+
+/*
+ * Get the attributes of a remote object
+ */
+int
+getattributes(CLIENT *clnt, nfs_fh3 *fh, fattr3 *attr)
+{
+    GETATTR3args args;
+    GETATTR3res res;
+
+    nfs_fh3copy(&args.object, fh);
+    memset(&res, 0, sizeof(res));
+    if (nfs3_getattr_3(&args, &res, clnt) != RPC_SUCCESS) {
+	clnt_perror(clnt, "nfs3_getattr");
+	return 0;
+    }
+    if (res.status != NFS3_OK) {
+	fprintf(stderr, "Getattr failed: %s\n", nfs_error(res.status));
+	return 0;
+    }
+    *attr = res.GETATTR3res_u.resok.obj_attributes;
+    return 1;
+}
+
+/*
+ * Find the directory a walk starts from, and its attributes
+ */
+int
+walkstart(char *dir, nfs_fh3 *fh, fattr3 *attr)
+{
+    char *path;
+    int ok;
+
+    if ((path = strdup(dir)) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", dir);
+	return 0;
+    }
+    ok = walkpath(path, fh);
+    free(path);
+    if (!ok || !getattributes(nfsclient, fh, attr))
+	return 0;
+    if (attr->type != NF3DIR) {
+	fprintf(stderr, "%s: is not a directory\n", dir);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Show the space used below remote directories
+ */
+void
+do_du(int argc, char **argv)
+{
+    struct duwalk du;
+    struct dunode *root;
+    struct pool pool;
+    nfs_fh3 fh;
+    fattr3 attr;
+    int nworkers = NWORKERS;
+    char *dir = ".";
+
+    argv++; argc--;
+    if (mountpath == NULL) {
+	fprintf(stderr, "du: no remote file system mounted\n");
+	return;
+    }
+    memset(&du, 0, sizeof(du));
+    du.du_depth = INT_MAX;
+    while (argc >= 1 && argv[0][0] == '-') {
+	if (strcmp(argv[0], "-s") == 0)
+	    du.du_depth = 0;
+	else if (strcmp(argv[0], "-d") == 0 && argc >= 2) {
+	    du.du_depth = atoi(argv[1]);
+	    argv++; argc--;
+	} else if (strcmp(argv[0], "-j") == 0 && argc >= 2) {
+	    nworkers = atoi(argv[1]);
+	    argv++; argc--;
+	} else
+	    break;
+	argv++; argc--;
+    }
+    if (argc == 1)
+	dir = argv[0];
+    if (argc > 1 || (argc == 1 && dir[0] == '-')) {
+	fprintf(stderr, "Usage: du [-s] [-d <depth>] [-j <workers>] [<dir>]\n");
+	return;
+    }
+    if (!walkstart(dir, &fh, &attr))
+	return;
+    if ((root = malloc(sizeof(*root) + strlen(dir))) == NULL) {
+	fprintf(stderr, "du: out of memory\n");
+	return;
+    }
+    root->dn_parent = NULL;
+    root->dn_refs = 1;
+    root->dn_depth = 0;
+    root->dn_used = attr.used;
+    strcpy(root->dn_path, dir);
+
+    if (!pool_init(&pool, "du", nworkers, 0)) {
+	free(root);
+	return;
+    }
+    pthread_mutex_init(&du.du_lock, NULL);
+    pool.p_visit = duvisit;
+    pool.p_leave = duleave;
+    pool.p_arg = &du;
+    if (pool_walk(&pool, NULL, &fh, strdup(dir), 0, root))
+	pool_run(&pool);
+    if (pool.p_errors)
+	fprintf(stderr, "du: %lu directories could not be read completely\n",
+	    pool.p_errors);
+    pool_destroy(&pool);
+    pthread_mutex_destroy(&du.du_lock);
+    free(du.du_seen);
+}
+
+/*
+ * Remember that the file with 'fileid' has been counted. Returns 1
+ * when it was already. Called with the du walk locked.
+ */
+int
+duseen(struct duwalk *du, fileid3 fileid)
+{
+    fileid3 *old = du->du_seen, *table;
+    u_long i, n = du->du_size;
+
+    if (fileid == 0)
+	return 0;
+    if (2 * (du->du_nseen + 1) > n) {
+	n = n ? 2 * n : 1024;
+	if ((table = calloc(n, sizeof(*table))) == NULL)
+	    return 0;
+	for (i = 0; i < du->du_size; i++) {
+	    if (old[i] != 0) {
+		u_long h = (old[i] * 0x9e3779b97f4a7c15ULL) & (n - 1);
+
+		while (table[h] != 0)
+		    h = (h + 1) & (n - 1);
+		table[h] = old[i];
+	    }
+	}
+	free(old);
+	du->du_seen = table;
+	du->du_size = n;
+    }
+    i = (fileid * 0x9e3779b97f4a7c15ULL) & (du->du_size - 1);
+    for (; du->du_seen[i] != 0; i = (i + 1) & (du->du_size - 1))
+	if (du->du_seen[i] == fileid)
+	    return 1;
+    du->du_seen[i] = fileid;
+    du->du_nseen++;
+    return 0;
+}
+
+/*
+ * Count an entry in the space used by its directory. A subdirectory
+ * gets a node of its own, which holds on to the parent's.
+ */
+int
+duvisit(struct pool *pool, struct task *t, struct direntry *de, char *path,
+    void **datap)
+{
+    struct duwalk *du = (struct duwalk *) pool->p_arg;
+    struct dunode *dn = (struct dunode *) t->t_data, *sub;
+    fattr3 *attr = &de->de_attr;
+
+    if (attr->type == NF3DIR &&
+      (sub = malloc(sizeof(*sub) + strlen(path))) != NULL) {
+	sub->dn_parent = dn;
+	sub->dn_refs = 1;
+	sub->dn_depth = t->t_depth + 1;
+	sub->dn_used = attr->used;
+	strcpy(sub->dn_path, path);
+	pthread_mutex_lock(&du->du_lock);
+	dn->dn_refs++;
+	pthread_mutex_unlock(&du->du_lock);
+	*datap = sub;
+	return 1;
+    }
+    if (attr->type == NF3DIR)
+	fprintf(stderr, "du: %s: out of memory\n", path);
+    pthread_mutex_lock(&du->du_lock);
+    if (attr->type == NF3DIR || attr->nlink <= 1 || !duseen(du, attr->fileid))
+	dn->dn_used += attr->used;
+    pthread_mutex_unlock(&du->du_lock);
+    return 0;
+}
+
+/*
+ * A directory's listing is done: report every directory that this
+ * completes, innermost first. An interrupted walk reports nothing,
+ * since its totals would be too low.
+ */
+void
+duleave(struct pool *pool, struct task *t, CLIENT *clnt)
+{
+    struct duwalk *du = (struct duwalk *) pool->p_arg;
+    struct dunode *dn = (struct dunode *) t->t_data, *parent;
+
+    pthread_mutex_lock(&du->du_lock);
+    while (dn != NULL && --dn->dn_refs == 0) {
+	if (!pool_stopped && dn->dn_depth <= du->du_depth)
+	    printf("%llu\t%s\n", (dn->dn_used + 1023) / 1024, dn->dn_path);
+	if ((parent = dn->dn_parent) != NULL)
+	    parent->dn_used += dn->dn_used;
+	free(dn);
+	dn = parent;
+    }
+    pthread_mutex_unlock(&du->du_lock);
+}
+
+/*
+ * Find remote files by name, type, permissions or owner
+ */
+void
+do_find(int argc, char **argv)
+{
+    static struct { char c; ftype3 type; } types[] = {
+	{ 'f', NF3REG }, { 'd', NF3DIR }, { 'l', NF3LNK }, { 'b', NF3BLK },
+	{ 'c', NF3CHR }, { 'p', NF3FIFO }, { 's', NF3SOCK }
+    };
+    struct findwalk fw;
+    struct direntry de;
+    struct pool pool;
+    char *names[NARGVEC];
+    int nnames = 0, nworkers = NWORKERS, i;
+    char *dir = ".", *cp;
+    nfs_fh3 fh;
+
+    argv++; argc--;
+    if (mountpath == NULL) {
+	fprintf(stderr, "find: no remote file system mounted\n");
+	return;
+    }
+    memset(&fw, 0, sizeof(fw));
+    fw.fw_type = fw.fw_uid = fw.fw_gid = -1;
+    if (argc >= 2 && strcmp(argv[0], "-j") == 0) {
+	nworkers = atoi(argv[1]);
+	argv += 2; argc -= 2;
+    }
+    if (argc >= 1 && argv[0][0] != '-') {
+	dir = argv[0];
+	argv++; argc--;
+    }
+    for (; argc >= 2; argv += 2, argc -= 2) {
+	if (strcmp(argv[0], "-name") == 0)
+	    names[nnames++] = argv[1];
+	else if (strcmp(argv[0], "-type") == 0 && argv[1][1] == '\0') {
+	    for (i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+		if (types[i].c == argv[1][0])
+		    break;
+	    if (i == sizeof(types) / sizeof(types[0]))
+		break;
+	    fw.fw_type = types[i].type;
+	} else if (strcmp(argv[0], "-perm") == 0) {
+	    cp = argv[1];
+	    fw.fw_permop = (*cp == '-' || *cp == '/') ? *cp++ : '=';
+	    fw.fw_perm = strtoul(cp, &cp, 8);
+	    if (*cp != '\0' || cp == argv[1] || fw.fw_perm > 07777)
+		break;
+	} else if (strcmp(argv[0], "-uid") == 0)
+	    fw.fw_uid = atoi(argv[1]);
+	else if (strcmp(argv[0], "-gid") == 0)
+	    fw.fw_gid = atoi(argv[1]);
+	else
+	    break;
+    }
+    if (argc != 0) {
+	fprintf(stderr, "Usage: find [-j <workers>] [<dir>] [-name <pattern>] "
+	    "[-type fdlbcps] [-perm [-/]<mode>] [-uid <uid>] [-gid <gid>]\n");
+	return;
+    }
+
+    memset(&de, 0, sizeof(de));
+    if (!walkstart(dir, &fh, &de.de_attr))
+	return;
+    if (nnames > 0 && (fw.fw_name = pattern_compile(nnames, names)) == NULL) {
+	fprintf(stderr, "find: out of memory\n");
+	return;
+    }
+    if (!pool_init(&pool, "find", nworkers, 0)) {
+	pattern_free(fw.fw_name);
+	return;
+    }
+    pthread_mutex_init(&fw.fw_lock, NULL);
+    pool.p_visit = findvisit;
+    pool.p_arg = &fw;
+
+    /* the starting directory is tested like everything below it */
+    de.de_name = (cp = strrchr(dir, '/')) != NULL && cp[1] != '\0' ?
+	cp + 1 : dir;
+    de.de_hasattr = 1;
+    (void) findvisit(&pool, NULL, &de, dir, NULL);
+
+    if (pool_walk(&pool, NULL, &fh, strdup(dir), 0, NULL))
+	pool_run(&pool);
+    if (pool.p_errors)
+	fprintf(stderr, "find: %lu directories could not be read completely\n",
+	    pool.p_errors);
+    pool_destroy(&pool);
+    pthread_mutex_destroy(&fw.fw_lock);
+    pattern_free(fw.fw_name);
+}
+
+/*
+ * Print the path name of an entry that passes all tests, and descend
+ * into every directory
+ */
+int
+findvisit(struct pool *pool, struct task *t, struct direntry *de, char *path,
+    void **datap)
+{
+    struct findwalk *fw = (struct findwalk *) pool->p_arg;
+    fattr3 *attr = &de->de_attr;
+    mode3 mode = attr->mode & 07777;
+
+    if (fw->fw_type >= 0 && attr->type != fw->fw_type)
+	return 1;
+    if ((fw->fw_permop == '=' && mode != fw->fw_perm) ||
+      (fw->fw_permop == '-' && (mode & fw->fw_perm) != fw->fw_perm) ||
+      (fw->fw_permop == '/' && fw->fw_perm != 0 && (mode & fw->fw_perm) == 0))
+	return 1;
+    if ((fw->fw_uid >= 0 && attr->uid != fw->fw_uid) ||
+      (fw->fw_gid >= 0 && attr->gid != fw->fw_gid))
+	return 1;
+
+    /* the pattern's scratch space is shared, see pattern.c */
+    pthread_mutex_lock(&fw->fw_lock);
+    if (fw->fw_name == NULL || pattern_match(fw->fw_name, de->de_name))
+	printf("%s\n", path);
+    pthread_mutex_unlock(&fw->fw_lock);
+    return 1;
+}
+
+/*
+ * Show a remote directory tree
+ */
+void
+do_tree(int argc, char **argv)
+{
+    u_long ndirs = 0, nfiles = 0;
+    int maxdepth = 0;
+    char *dir = ".";
+    fattr3 attr;
+    nfs_fh3 fh;
+
+    argv++; argc--;
+    if (mountpath == NULL) {
+	fprintf(stderr, "tree: no remote file system mounted\n");
+	return;
+    }
+    if (argc >= 2 && strcmp(argv[0], "-L") == 0) {
+	maxdepth = atoi(argv[1]);
+	argv += 2; argc -= 2;
+    }
+    if (argc == 1)
+	dir = argv[0];
+    if (argc > 1 || (argc == 1 && dir[0] == '-') || maxdepth < 0) {
+	fprintf(stderr, "Usage: tree [-L <depth>] [<dir>]\n");
+	return;
+    }
+    if (!walkstart(dir, &fh, &attr))
+	return;
+    printf("%s\n", dir);
+    treewalk(&fh, "", 1, maxdepth, &ndirs, &nfiles);
+    printf("\n%lu directories, %lu files\n", ndirs, nfiles);
+}
+
+/*
+ * Print the entries of one directory of a tree, sorted, each
+ * subdirectory followed by its own. This goes depth first in order,
+ * so unlike du and find it walks with a single connection.
+ */
+void
+treewalk(nfs_fh3 *fh, char *prefix, int depth, int maxdepth, u_long *ndirs,
+    u_long *nfiles)
+{
+    struct dirtable dt;
+    struct direntry *de, *last = NULL;
+    char *sub;
+
+    if (!getdirentries(nfsclient, fh, &dt, 0, NULL, 1))
+	return;
+    for (de = dt.dt_table; de < dt.dt_ptr; de++)
+	if (strcmp(de->de_name, ".") != 0 && strcmp(de->de_name, "..") != 0)
+	    last = de;
+    for (de = dt.dt_table; de < dt.dt_ptr; de++) {
+	if (strcmp(de->de_name, ".") == 0 || strcmp(de->de_name, "..") == 0)
+	    continue;
+	if (!de->de_hasattr || !de->de_hashandle)
+	    (void) lookupentry(nfsclient, fh, de, 1);
+	printf("%s%s%s\n", prefix, de == last ? "`-- " : "|-- ", de->de_name);
+	if (!de->de_hasattr || de->de_attr.type != NF3DIR) {
+	    (*nfiles)++;
+	    continue;
+	}
+	(*ndirs)++;
+	if (maxdepth > 0 && depth >= maxdepth)
+	    continue;
+	if ((sub = malloc(strlen(prefix) + 5)) == NULL) {
+	    fprintf(stderr, "tree: out of memory\n");
+	    break;
+	}
+	sprintf(sub, "%s%s", prefix, de == last ? "    " : "|   ");
+	treewalk(&de->de_handle, sub, depth + 1, maxdepth, ndirs, nfiles);
+	free(sub);
+    }
+    freedirentries(&dt);
+}
+
+/*
+ * Delete remote files, and with -r directories with everything in them
+ */
+void
+do_rm(int argc, char **argv)
+{
+    struct bulkop bo;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "rm: no remote file system mounted\n");
+	return;
+    }
+    if (!bulkinit(&bo, "rm", BULK_RM, &argc, &argv) || argc < 1) {
+	fprintf(stderr,
+	    "Usage: rm [-r] [-j <workers>] [-w <window>] <filespec> ...\n");
+	return;
+    }
+    bulk(&bo, argc, argv);
+}
+
+/*
+ * Link a file
+ */
+void
+do_ln(int argc, char **argv)
+{
+    nfs_fh3 fh;
+    LINK3args largs;
+    LINK3res lres;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "ln: no remote file system mounted\n");
+	return;
+    }
+    if (argc != 3) {
+	fprintf(stderr, "Usage: ln <file1> <file2>\n");
+	return;
+    }
+
+    if (!lookup(nfsclient, &directory_handle, argv[1], &fh, NULL))
+	return;
+
+    nfs_fh3copy(&largs.file, &fh);
+    largs.link.name = argv[2];
+    nfs_fh3copy(&largs.link.dir, &directory_handle);
+
+    memset(&lres, 0, sizeof(lres));
+
+    if (nfs3_link_3(&largs, &lres, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_link");
+	return;
+    }
+    if (lres.status != NFS3_OK) {
+	fprintf(stderr, "Link failed: %s\n", nfs_error(lres.status));
+	return;
+    }
+    dnlc_attr(&fh, &lres.LINK3res_u.resok.file_attributes);
+    dnlc_wcc(&directory_handle, &lres.LINK3res_u.resok.linkdir_wcc);
+}
+
+/*
+ * Move a file or directory
+ */
+void
+do_mv(int argc, char **argv)
+{
+    RENAME3args args;
+    RENAME3res res;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "mv: no remote file system mounted\n");
+	return;
+    }
+    if (argc != 3) {
+	fprintf(stderr, "Usage: mv <file1> <file2>\n");
+	return;
+    }
+    args.from.name = argv[1];
+    nfs_fh3copy(&args.from.dir, &directory_handle);
+    args.to.name = argv[2];
+    nfs_fh3copy(&args.to.dir, &directory_handle);
+    memset(&res, 0, sizeof(res));
+    if (nfs3_rename_3(&args, &res, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_rename");
+	return;
+    }
+    dnlc_remove(&directory_handle, argv[1]);
+    dnlc_remove(&directory_handle, argv[2]);
+    if (res.status != NFS3_OK) {
+	fprintf(stderr, "Rename failed: %s\n", nfs_error(res.status));
+	return;
+    }
+    pathcache_remove(&directory_handle, argv[1]);
+    pathcache_remove(&directory_handle, argv[2]);
+    mntcache_forget(server_addr.sin_addr, mountpath, 1);
+    dnlc_wcc(&directory_handle, &res.RENAME3res_u.resok.fromdir_wcc);
+    dnlc_wcc(&directory_handle, &res.RENAME3res_u.resok.todir_wcc);
+}
+
+/*
+ * Make remote directory
+ */
+void
+do_mkdir(int argc, char **argv)
+{
+    MKDIR3args args;
+    MKDIR3res res;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "mkdir: no remote file system mounted\n");
+	return;
+    }
+    if (argc != 2) {
+	fprintf(stderr, "Usage: mkdir <directory>\n");
+	return;
+    }
+
+    args.where.name = argv[1];
+    nfs_fh3copy(&args.where.dir, &directory_handle);
+    args.attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode=040755 };
+    args.attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u.uid=uid };
+    args.attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u.gid=gid };
+    args.attributes.size  = (set_size3) { .set_it=FALSE };
+    args.attributes.atime = (set_atime) { .set_it=FALSE };
+    args.attributes.mtime = (set_mtime) { .set_it=FALSE };
+
+    memset(&res, 0, sizeof(res));
+
+    if (nfs3_mkdir_3(&args, &res, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_mkdir");
+	return;
+    }
+    if (res.status != NFS3_OK) {
+	fprintf(stderr, "Make directory failed: %s\n", nfs_error(res.status));
+	return;
+    }
+    dnlc_create(&directory_handle, argv[1], &res.MKDIR3res_u.resok.obj,
+	&res.MKDIR3res_u.resok.obj_attributes, &res.MKDIR3res_u.resok.dir_wcc);
+}
+
+/* XXX */
+void
+do_create(int argc, char **argv)
+{
+    CREATE3args args;
+    CREATE3res res;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "mkdir: no remote file system mounted\n");
+	return;
+    }
+    if (argc != 2) {
+	fprintf(stderr, "Usage: mkdir <directory>\n");
+	return;
+    }
+
+    args.where.name = argv[1];
+    nfs_fh3copy(&args.where.dir, &directory_handle);
+    args.how.mode = EXCLUSIVE;
+    args.how.createhow3_u.obj_attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode=040755 };
+    args.how.createhow3_u.obj_attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u.uid=uid };
+    args.how.createhow3_u.obj_attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u.gid=gid };
+    args.how.createhow3_u.obj_attributes.size  = (set_size3) { .set_it=FALSE };
+    args.how.createhow3_u.obj_attributes.atime = (set_atime) { .set_it=FALSE };
+    args.how.createhow3_u.obj_attributes.mtime = (set_mtime) { .set_it=FALSE };
+
+    memset(&res, 0, sizeof(res));
+
+    if (nfs3_create_3(&args, &res, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_mkdir");
+	return;
+    }
+    if (res.status != NFS3_OK) {
+	fprintf(stderr, "Make directory failed: %s\n", nfs_error(res.status));
+	return;
+    }
+    dnlc_create(&directory_handle, argv[1], &res.CREATE3res_u.resok.obj,
+	&res.CREATE3res_u.resok.obj_attributes, &res.CREATE3res_u.resok.dir_wcc);
+}
+
+/*
+ * Remove remote directory
+ */
+void
+do_rmdir(int argc, char **argv)
+{
+    RMDIR3args args;
+    RMDIR3res res;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "rmdir: no remote file system mounted\n");
+	return;
+    }
+    if (argc != 2) {
+	fprintf(stderr, "Usage: rmdir <directory>\n");
+	return;
+    }
+
+    args.object.name = argv[1];
+    nfs_fh3copy(&args.object.dir, &directory_handle);
+    memset(&res, 0, sizeof(res));
+    if (nfs3_rmdir_3(&args, &res, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_rmdir");
+	return;
+    }
+    dnlc_remove(&directory_handle, argv[1]);
+    if (res.status != NFS3_OK) {
+	fprintf(stderr, "Remove directory failed: %s\n", nfs_error(res.status));
+	return;
+    }
+    pathcache_remove(&directory_handle, argv[1]);
+    mntcache_forget(server_addr.sin_addr, mountpath, 1);
+    dnlc_wcc(&directory_handle, &res.RMDIR3res_u.resok.dir_wcc);
+}
+
+/*
+ * Change mode of remote files or directories
+ */
+void
+do_chmod(int argc, char **argv)
+{
+    struct bulkop bo;
+    int mode;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "chmod: no remote file system mounted\n");
+	return;
+    }
+    if (!bulkinit(&bo, "chmod", BULK_SETATTR, &argc, &argv) || argc < 2) {
+	fprintf(stderr, "Usage: chmod [-r] [-j <workers>] [-w <window>] "
+	    "<mode> <filespec> ...\n");
+	return;
+    }
+    if (sscanf(argv[0], "%o", &mode) != 1) {
+	fprintf(stderr, "chmod: invalid mode\n");
+	return;
+    }
+    bo.bo_attr.mode = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode=mode };
+    bulk(&bo, argc - 1, argv + 1);
+}
+
+/*
+ * Make new device node
+ */
+void
+do_mknod(int argc, char **argv)
+{
+    int mode, maj, min, device;
+    CREATE3args cargs;
+    CREATE3res cres;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "mknod: no remote file system mounted\n");
+	return;
+    }
+    if ((argc != 3 && argc != 5) || argv[2][1] != '\0')  {
+usage:	fprintf(stderr, "Usage: mknod <name> [b/c major minor] [p]\n");
+	return;
+    }
+    if (argc == 3) {
+	if (argv[2][0] != 'p')
+	    goto usage;
+	mode = IFCHR;
+	device = NF3FIFO;
+    } else if (argc == 5) {
+	switch (argv[2][0]) {
+	case 'b':
+	    mode = IFBLK;
+	    break;
+	case 'c':
+	    mode = IFCHR;
+	    break;
+	}
+	maj = atoi(argv[3]);
+	min = atoi(argv[4]);
+	device = makedev(maj, min);
+    }
+
+    /*
+     * Make remote device node
+     */
+    cargs.where.name = argv[1];
+    nfs_fh3copy(&cargs.where.dir, &directory_handle);
+    cargs.how.createhow3_u.obj_attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode=mode | 0777};
+    cargs.how.createhow3_u.obj_attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u = uid };
+    cargs.how.createhow3_u.obj_attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u = gid };
+    cargs.how.createhow3_u.obj_attributes.size  = (set_size3) { .set_it=TRUE, .set_size3_u = device };
+    cargs.how.createhow3_u.obj_attributes.atime = (set_atime) { .set_it=FALSE };
+    cargs.how.createhow3_u.obj_attributes.mtime = (set_mtime) { .set_it=FALSE };
+    memset(&cres, 0, sizeof(cres));
+    if (nfs3_create_3(&cargs, &cres, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_create");
+	return;
+    }
+    if (cres.status != NFS3_OK) {
+	fprintf(stderr, "WARNING: Mknod failed: %s\n", nfs_error(cres.status));
+	return;
+    }
+    dnlc_create(&directory_handle, argv[1], &cres.CREATE3res_u.resok.obj,
+	&cres.CREATE3res_u.resok.obj_attributes, &cres.CREATE3res_u.resok.dir_wcc);
+}
+
+/*
+ * Change owner (and group) of remote files or directories
+ */
+void
+do_chown(int argc, char **argv)
+{
+    struct bulkop bo;
+    int own_uid, own_gid;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "chown: no remote file system mounted\n");
+	return;
+    }
+    if (!bulkinit(&bo, "chown", BULK_SETATTR, &argc, &argv) || argc < 2) {
+	fprintf(stderr, "Usage: chown [-r] [-j <workers>] [-w <window>] "
+	    "<uid>[.<gid>] <filespec> ...\n");
+	return;
+    }
+    if (sscanf(argv[0], "%d.%d", &own_uid, &own_gid) != 2) {
+	own_gid = -1;
+	if (sscanf(argv[0], "%d", &own_uid) != 1) {
+	    fprintf(stderr, "chown: invalid uid[.gid]\n");
+	    return;
+	}
+    }
+    bo.bo_attr.uid = (set_uid3) { .set_it=TRUE, .set_uid3_u.uid = own_uid };
+    if (own_gid != -1)
+	bo.bo_attr.gid = (set_gid3) { .set_it=TRUE, .set_gid3_u.gid = own_gid };
+    bulk(&bo, argc - 1, argv + 1);
+}
+
+/*
+ * Set up a bulk operation for command 'cmd' and take its options off
+ * the argument vector. Options end at the first argument that is not
+ * one, or that looks like a negative number.
+ */
+int
+bulkinit(struct bulkop *bo, char *cmd, int op, int *argcp, char ***argvp)
+{
+    char **argv = *argvp + 1;
+    int argc = *argcp - 1;
+
+    memset(bo, 0, sizeof(*bo));
+    bo->bo_cmd = cmd;
+    bo->bo_op = op;
+    bo->bo_attr.mode  = (set_mode3) { .set_it=FALSE };
+    bo->bo_attr.uid   = (set_uid3)  { .set_it=FALSE };
+    bo->bo_attr.gid   = (set_gid3)  { .set_it=FALSE };
+    bo->bo_attr.size  = (set_size3) { .set_it=FALSE };
+    bo->bo_attr.atime = (set_atime) { .set_it=FALSE };
+    bo->bo_attr.mtime = (set_mtime) { .set_it=FALSE };
+    bo->bo_window = NBULK;
+    bo->bo_nworkers = NWORKERS;
+    while (argc >= 1 && argv[0][0] == '-' && !isdigit((u_char) argv[0][1])) {
+	if (strcmp(argv[0], "-r") == 0)
+	    bo->bo_recurse = 1;
+	else if (strcmp(argv[0], "-j") == 0 && argc >= 2) {
+	    bo->bo_nworkers = atoi(argv[1]);
+	    argv++; argc--;
+	} else if (strcmp(argv[0], "-w") == 0 && argc >= 2) {
+	    bo->bo_window = MAX(atoi(argv[1]), 1);
+	    argv++; argc--;
+	} else
+	    return 0;
+	argv++; argc--;
+    }
+    *argvp = argv;
+    *argcp = argc;
+    return 1;
+}
+
+/*
+ * Carry out a bulk operation on everything 'argv' names, and sum up
+ * what went wrong
+ */
+void
+bulk(struct bulkop *bo, int argc, char **argv)
+{
+    struct pool pool;
+    int i, ok = 1;
+
+    if (bo->bo_recurse) {
+	if (!pool_init(&pool, bo->bo_cmd, bo->bo_nworkers, 0))
+	    return;
+	pool.p_visit = bulkvisit;
+	pool.p_leave = bulkleave;
+	pool.p_arg = bo;
+    }
+    pthread_mutex_init(&bo->bo_lock, NULL);
+    pool_stopped = 0;
+    for (i = 0; i < argc && ok; i++)
+	ok = bulkstart(bo, bo->bo_recurse ? &pool : NULL, argv[i]);
+    if (bo->bo_recurse) {
+	pool_run(&pool);
+	if (pool.p_errors)
+	    fprintf(stderr, "%s: %lu directories could not be read completely\n",
+		bo->bo_cmd, pool.p_errors);
+	pool_destroy(&pool);
+    }
+
+    if (bo->bo_rmdirs)
+	mntcache_forget(server_addr.sin_addr, mountpath, 1);
+    if (bo->bo_recurse || bo->bo_failed > 0 || bo->bo_done > 1) {
+	printf("%lu %s, %lu failed\n", bo->bo_done,
+	    bo->bo_op == BULK_RM ? "removed" : "changed", bo->bo_failed);
+	for (i = 0; i < bo->bo_nwhy; i++)
+	    printf("%8lu  %s\n", bo->bo_count[i], bo->bo_why[i]);
+    }
+    pthread_mutex_destroy(&bo->bo_lock);
+}
+
+/*
+ * Act on what 'arg' names: a name or a pattern, in the current
+ * directory or below a path. Directories are queued on 'pool' for a
+ * walk, when there is one. Returns 0 when the remaining arguments
+ * should not be tried.
+ */
+int
+bulkstart(struct bulkop *bo, struct pool *pool, char *arg)
+{
+    struct dirtable dt;
+    struct direntry *de, one;
+    struct bulkdir *top, *sub;
+    char *name, *prefix, *path;
+    nfsstat3 status;
+    nfs_fh3 dir;
+    int wild, dot, ok = 1;
+
+    /* walkparent leaves the path of the directory behind in 'arg' */
+    if (!walkparent(arg, &dir, &name))
+	return 1;
+    prefix = name == arg ? "" : name == arg + 1 ? "/" : arg;
+    if ((top = bulknewdir(bo, NULL, prefix, NULL, &dir)) == NULL)
+	return 0;
+
+    memset(&dt, 0, sizeof(dt));
+    if ((wild = strpbrk(name, "*?[") != NULL)) {
+	if (!getdirentries(nfsclient, &dir, &dt, 1, &name, 1))
+	    goto out;
+    } else {
+	memset(&one, 0, sizeof(one));
+	one.de_name = name;
+	if ((status = lookupentry(nfsclient, &dir, &one, 0)) != NFS3_OK) {
+	    bulkfail(bo, prefix, name, nfs_error(status));
+	    goto out;
+	}
+	if (!newdirentry(&one, &dt))
+	    goto out;
+    }
+
+    for (de = dt.dt_table; de < dt.dt_ptr && ok; de++) {
+	dot = strcmp(de->de_name, ".") == 0 || strcmp(de->de_name, "..") == 0;
+	if (dot && (wild || bo->bo_op == BULK_RM)) {
+	    if (!wild)
+		fprintf(stderr, "%s: cannot remove `%s'\n", bo->bo_cmd, name);
+	    continue;
+	}
+	if (!de->de_hasattr || !de->de_hashandle) {
+	    if ((status = lookupentry(nfsclient, &dir, de, 0)) != NFS3_OK) {
+		bulkfail(bo, prefix, de->de_name, nfs_error(status));
+		continue;
+	    }
+	    if (!de->de_hasattr) {
+		bulkfail(bo, prefix, de->de_name, "no attributes");
+		continue;
+	    }
+	}
+	if (de->de_attr.type == NF3DIR && bo->bo_recurse) {
+	    if ((path = malloc(strlen(prefix) + strlen(de->de_name) + 2)) == NULL) {
+		fprintf(stderr, "%s: out of memory\n", bo->bo_cmd);
+		ok = 0;
+		break;
+	    }
+	    sprintf(path, "%s%s%s", prefix, *prefix != '\0' &&
+		prefix[strlen(prefix) - 1] != '/' ? "/" : "", de->de_name);
+	    if ((sub = bulknewdir(bo, top, path, de->de_name,
+	      &de->de_handle)) == NULL) {
+		free(path);
+		ok = 0;
+	    } else if (!pool_walk(pool, NULL, &de->de_handle, path, 0, sub))
+		ok = 0;
+	    continue;
+	}
+	if (de->de_attr.type == NF3DIR && bo->bo_op == BULK_RM) {
+	    bulkfail(bo, prefix, de->de_name, nfs_error(NFS3ERR_ISDIR));
+	    continue;
+	}
+	if (!bulkadd(bo, top, de->de_name, &de->de_handle, de->de_attr.type))
+	    ok = 0;
+    }
+    freedirentries(&dt);
+out:
+    bulkdone(nfsclient, bo, top);
+    return ok;
+}
+
+/*
+ * A new directory node 'path', entry 'name' of 'parent', with handle
+ * 'fh'. The node holds on to its parent until it is done.
+ */
+struct bulkdir *
+bulknewdir(struct bulkop *bo, struct bulkdir *parent, char *path, char *name,
+    nfs_fh3 *fh)
+{
+    struct bulkdir *bd;
+
+    if ((bd = (struct bulkdir *) calloc(1, sizeof(*bd))) == NULL ||
+      (bd->bd_path = strdup(path)) == NULL ||
+      (name != NULL && (bd->bd_self.be_name = strdup(name)) == NULL)) {
+	fprintf(stderr, "%s: out of memory\n", bo->bo_cmd);
+	bulkfree(bd);
+	return NULL;
+    }
+    bd->bd_parent = parent;
+    bd->bd_refs = 1;
+    nfs_fh3copy(&bd->bd_self.be_handle, fh);
+    bd->bd_self.be_type = NF3DIR;
+    if (parent != NULL) {
+	pthread_mutex_lock(&bo->bo_lock);
+	parent->bd_refs++;
+	pthread_mutex_unlock(&bo->bo_lock);
+    }
+    return bd;
+}
+
+/*
+ * Add an entry for directory 'bd' to act on. Only the thread that
+ * lists the directory adds to it, so no lock is needed.
+ */
+int
+bulkadd(struct bulkop *bo, struct bulkdir *bd, char *name, nfs_fh3 *fh,
+    ftype3 type)
+{
+    struct bulkent *ents;
+    int n;
+
+    if (bd->bd_nents == bd->bd_size) {
+	n = bd->bd_size ? 2 * bd->bd_size : 32;
+	if ((ents = (struct bulkent *) realloc(bd->bd_ents,
+	  n * sizeof(*ents))) == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", bo->bo_cmd);
+	    return 0;
+	}
+	bd->bd_ents = ents;
+	bd->bd_size = n;
+    }
+    if ((bd->bd_ents[bd->bd_nents].be_name = strdup(name)) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", bo->bo_cmd);
+	return 0;
+    }
+    nfs_fh3copy(&bd->bd_ents[bd->bd_nents].be_handle, fh);
+    bd->bd_ents[bd->bd_nents].be_type = type;
+    bd->bd_nents++;
+    return 1;
+}
+
+/*
+ * An entry found by the walk of a -r: directories get a node of their
+ * own and are descended into, everything else is added to the entries
+ * of the directory it is in
+ */
+int
+bulkvisit(struct pool *pool, struct task *t, struct direntry *de, char *path,
+    void **datap)
+{
+    struct bulkop *bo = (struct bulkop *) pool->p_arg;
+    struct bulkdir *bd = (struct bulkdir *) t->t_data;
+
+    if (de->de_attr.type == NF3DIR) {
+	if ((*datap = bulknewdir(bo, bd, path, de->de_name,
+	  &de->de_handle)) != NULL)
+	    return 1;
+    } else if (bulkadd(bo, bd, de->de_name, &de->de_handle, de->de_attr.type))
+	return 0;
+    pthread_mutex_lock(&bo->bo_lock);
+    bd->bd_failed = 1;
+    pthread_mutex_unlock(&bo->bo_lock);
+    return 0;
+}
+
+/*
+ * The listing of a directory is done, act on its entries
+ */
+void
+bulkleave(struct pool *pool, struct task *t, CLIENT *clnt)
+{
+    if (t->t_data != NULL)
+	bulkdone(clnt, (struct bulkop *) pool->p_arg,
+	    (struct bulkdir *) t->t_data);
+}
+
+/*
+ * Act on the entries of directory 'bd' and let go of it. Every
+ * directory this completes is then dealt with itself, innermost
+ * first; rm leaves a directory alone when something below it could
+ * not be removed. An interrupted walk does nothing more.
+ */
+void
+bulkdone(CLIENT *clnt, struct bulkop *bo, struct bulkdir *bd)
+{
+    struct bulkdir *parent;
+    int ok = 1;
+
+    if (!pool_stopped)
+	ok = bulkapply(clnt, bo, &bd->bd_self.be_handle, bd->bd_path,
+	    bd->bd_ents, bd->bd_nents);
+    pthread_mutex_lock(&bo->bo_lock);
+    if (!ok)
+	bd->bd_failed = 1;
+    while (bd != NULL && --bd->bd_refs == 0) {
+	if ((parent = bd->bd_parent) != NULL && !pool_stopped &&
+	  !(bo->bo_op == BULK_RM && bd->bd_failed)) {
+	    pthread_mutex_unlock(&bo->bo_lock);
+	    ok = bulkapply(clnt, bo, &parent->bd_self.be_handle,
+		parent->bd_path, &bd->bd_self, 1);
+	    pthread_mutex_lock(&bo->bo_lock);
+	} else
+	    ok = bd->bd_failed == 0;
+	if (parent != NULL && !ok)
+	    parent->bd_failed = 1;
+	bulkfree(bd);
+	bd = parent;
+    }
+    pthread_mutex_unlock(&bo->bo_lock);
+}
+
+void
+bulkfree(struct bulkdir *bd)
+{
+    int i;
+
+    if (bd == NULL)
+	return;
+    for (i = 0; i < bd->bd_nents; i++)
+	free(bd->bd_ents[i].be_name);
+    free(bd->bd_ents);
+    free(bd->bd_self.be_name);
+    free(bd->bd_path);
+    free(bd);
+}
+
+/*
+ * Remove or change the 'n' entries at 'ents' of directory 'dir',
+ * named 'path', with up to a window of calls in flight at once over
+ * the idle connections. Returns 0 when any of them failed.
+ */
+int
+bulkapply(CLIENT *clnt, struct bulkop *bo, nfs_fh3 *dir, char *path,
+    struct bulkent *ents, int n)
+{
+    struct bulkcall *calls, *bc;
+    struct pipeset ps;
+    struct rpcpipe *rp;
+    struct rpccall *rc;
+    struct bulkent *be;
+    wcc_data *wcc;
+    nfsstat3 status;
+    char *why = NULL;
+    int i, next = 0, window = MIN(bo->bo_window, n), ok = 1;
+
+    if (n == 0)
+	return 1;
+    if (!openpipes(&ps, clnt, 1024))
+	why = "cannot set up calls";
+    else if ((calls = (struct bulkcall *) calloc(window, sizeof(*calls))) == NULL) {
+	closepipes(&ps);
+	why = "out of memory";
+    }
+    if (why != NULL) {
+	for (i = 0; i < n; i++)
+	    bulkfail(bo, path, ents[i].be_name, why);
+	return 0;
+    }
+
+    for (;;) {
+	/* keep the pipeline filled */
+	for (i = 0; i < window && next < n && why == NULL; i++) {
+	    bc = &calls[i];
+	    if (bc->bc_ent != NULL)
+		continue;
+	    bc->bc_ent = &ents[next++];
+	    rp = rpcpipe_pick(ps.ps_pipe, ps.ps_count);
+	    if (!bulksend(rp, bo, dir, bc))
+		why = clnt_sperrno(rp->rp_stat);
+	}
+	if (why != NULL || pipesbusy(&ps) == 0)
+	    break;
+
+	if ((rc = rpcloop_recv(&ps.ps_loop, &rp)) == NULL) {
+	    why = clnt_sperrno(rp->rp_stat);
+	    break;
+	}
+	bc = (struct bulkcall *) rc->rc_data;
+	be = bc->bc_ent;
+	bc->bc_ent = NULL;
+	if (rc->rc_stat != RPC_SUCCESS) {
+	    bulkfail(bo, path, be->be_name, clnt_sperrno(rc->rc_stat));
+	    ok = 0;
+	    continue;
+	}
+	if (bo->bo_op == BULK_SETATTR) {
+	    status = bc->bc_res.setattr.status;
+	    dnlc_attr(&be->be_handle, &bc->bc_res.setattr.SETATTR3res_u.resok.obj_wcc.after);
+	} else {
+	    /* REMOVE3res and RMDIR3res are laid out alike */
+	    status = bc->bc_res.remove.status;
+	    wcc = &bc->bc_res.remove.REMOVE3res_u.resok.dir_wcc;
+	    dnlc_remove(dir, be->be_name);
+	    if (status == NFS3_OK && be->be_type == NF3DIR) {
+		pathcache_remove(dir, be->be_name);
+		pthread_mutex_lock(&bo->bo_lock);
+		bo->bo_rmdirs = 1;
+		pthread_mutex_unlock(&bo->bo_lock);
+	    }
+	    if (status == NFS3_OK)
+		dnlc_wcc(dir, wcc);
+	}
+	if (status != NFS3_OK) {
+	    bulkfail(bo, path, be->be_name, nfs_error(status));
+	    ok = 0;
+	    continue;
+	}
+	pthread_mutex_lock(&bo->bo_lock);
+	bo->bo_done++;
+	pthread_mutex_unlock(&bo->bo_lock);
+    }
+
+    /* the connection failed: what was not answered did not happen */
+    if (why != NULL) {
+	for (i = 0; i < window; i++)
+	    if (calls[i].bc_ent != NULL)
+		bulkfail(bo, path, calls[i].bc_ent->be_name, why);
+	for (; next < n; next++)
+	    bulkfail(bo, path, ents[next].be_name, why);
+	ok = 0;
+    }
+    for (i = 0; i < window; i++)
+	rpccall_free(&calls[i].bc_call);
+    free(calls);
+    closepipes(&ps);
+    return ok;
+}
+
+/*
+ * Issue the call for the entry of slot 'bc', in directory 'dir'
+ */
+int
+bulksend(struct rpcpipe *rp, struct bulkop *bo, nfs_fh3 *dir,
+    struct bulkcall *bc)
+{
+    struct bulkent *be = bc->bc_ent;
+
+    memset(&bc->bc_res, 0, sizeof(bc->bc_res));
+    bc->bc_call.rc_data = bc;
+    if (bo->bo_op == BULK_SETATTR) {
+	nfs_fh3copy(&bc->bc_args.setattr.object, &be->be_handle);
+	bc->bc_args.setattr.new_attributes = bo->bo_attr;
+	bc->bc_args.setattr.guard.check = FALSE;
+	return rpcpipe_send(rp, &bc->bc_call, NFS3_SETATTR,
+	    (xdrproc_t) xdr_SETATTR3args, (caddr_t) &bc->bc_args.setattr,
+	    (xdrproc_t) xdr_SETATTR3res, (caddr_t) &bc->bc_res.setattr);
+    }
+    nfs_fh3copy(&bc->bc_args.remove.object.dir, dir);
+    bc->bc_args.remove.object.name = be->be_name;
+    if (be->be_type == NF3DIR)
+	return rpcpipe_send(rp, &bc->bc_call, NFS3_RMDIR,
+	    (xdrproc_t) xdr_RMDIR3args, (caddr_t) &bc->bc_args.rmdir,
+	    (xdrproc_t) xdr_RMDIR3res, (caddr_t) &bc->bc_res.rmdir);
+    return rpcpipe_send(rp, &bc->bc_call, NFS3_REMOVE,
+	(xdrproc_t) xdr_REMOVE3args, (caddr_t) &bc->bc_args.remove,
+	(xdrproc_t) xdr_REMOVE3res, (caddr_t) &bc->bc_res.remove);
+}
+
+/*
+ * Report that 'name' in directory 'path' could not be dealt with,
+ * and count it under reason 'why'. The reasons are static strings,
+ * so they can be told apart by their address.
+ */
+void
+bulkfail(struct bulkop *bo, char *path, char *name, char *why)
+{
+    int i;
+
+    fprintf(stderr, "%s: %s%s%s: %s\n", bo->bo_cmd, path, *path != '\0' &&
+	path[strlen(path) - 1] != '/' ? "/" : "", name, why);
+    pthread_mutex_lock(&bo->bo_lock);
+    bo->bo_failed++;
+    for (i = 0; i < bo->bo_nwhy && bo->bo_why[i] != why; i++)
+	/* do nothing */;
+    if (i == bo->bo_nwhy && i < NWHY) {
+	bo->bo_why[i] = why;
+	bo->bo_count[i] = 0;
+	bo->bo_nwhy++;
+    }
+    if (i < NWHY)
+	bo->bo_count[i]++;
+    pthread_mutex_unlock(&bo->bo_lock);
+}
+
+/*
+ * Put file from local to remote
+ */
+void
+do_put(int argc, char **argv)
+{
+    CREATE3args cargs;
+    CREATE3res cres;
+    int window = NWINDOW;
+    int zflag = 0;
+    nfs_fh3 fh;
+    int fd;
+
+    if (mountpath == NULL) {
+	fprintf(stderr, "put: no remote file system mounted\n");
+	return;
+    }
+    for (;;) {
+	if (argc >= 4 && strcmp(argv[1], "-w") == 0) {
+	    window = atoi(argv[2]);
+	    argv += 2; argc -= 2;
+	} else if (argc >= 3 && strcmp(argv[1], "-z") == 0) {
+	    zflag = 1;
+	    argv++; argc--;
+	} else
+	    break;
+    }
+    if (argc != 2 && argc != 3) {
+	fprintf(stderr, "Usage: put [-z] [-w <window>] <local-file> [<remote-file>]\n");
+	return;
+    }
+
+    if ((fd = open(argv[1], O_RDONLY)) < 0) {
+	fprintf(stderr, "put: cannot open %s\n", argv[1]);
+	return;
+    }
+
+    /*
+     * Create remote file name
+     */
+    cargs.where.name = argc == 3 ? argv[2] : argv[1];
+    nfs_fh3copy(&cargs.where.dir, &directory_handle);
+    cargs.how.mode = EXCLUSIVE;
+    cargs.how.createhow3_u.obj_attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode= 0666 };
+    cargs.how.createhow3_u.obj_attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u.uid=uid };
+    cargs.how.createhow3_u.obj_attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u.gid=gid };
+    cargs.how.createhow3_u.obj_attributes.size  = (set_size3) { .set_it=FALSE };
+    cargs.how.createhow3_u.obj_attributes.atime = (set_atime) { .set_it=FALSE };
+    cargs.how.createhow3_u.obj_attributes.mtime = (set_mtime) { .set_it=FALSE };
+
+    memset(&cres, 0, sizeof(cres));
+
+    if (nfs3_create_3(&cargs, &cres, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_create");
+	close(fd);
+	return;
+    }
+    if (cres.status != NFS3_OK) {
+	fprintf(stderr, "WARNING: Create failed: %s\n", nfs_error(cres.status));
+	dnlc_remove(&directory_handle, cargs.where.name);
+    } else
+	dnlc_create(&directory_handle, cargs.where.name, &cres.CREATE3res_u.resok.obj,
+	    &cres.CREATE3res_u.resok.obj_attributes, &cres.CREATE3res_u.resok.dir_wcc);
+
+    /*
+     * Look up remote file name, to get its handle
+     */
+    if (!lookup(nfsclient, &directory_handle, cargs.where.name, &fh, NULL)) {
+	close(fd);
+	return;
+    }
+
+    /* zeros may only be left out of a file that starts out empty */
+    (void) writefile(&fh, fd, window, !zflag && cres.status == NFS3_OK);
+    close(fd);
+}
+
+/*
+ * A chunk of a local file on its way through the WRITE pipeline
+ */
+struct writechunk {
+    struct rpccall wk_call;	/* WRITE call for this chunk */
+    WRITE3args wk_args;		/* its arguments */
+    WRITE3res wk_res;		/* and its results */
+    offset3 wk_offset;		/* file offset of the chunk */
+    count3 wk_count;		/* number of bytes in the chunk */
+    count3 wk_done;		/* number of bytes accepted by the server */
+    char *wk_buf;		/* chunk data */
+    int wk_busy;		/* WRITE is in flight */
+};
+
+/*
+ * Encode WRITE arguments up to their data, which the pipe sends from
+ * where it is (see rpcpipe_send)
+ */
+bool_t
+xdr_WRITE3args_head(XDR *xdrs, WRITE3args *objp)
+{
+    if (!xdr_nfs_fh3(xdrs, &objp->file))
+	return FALSE;
+    if (!xdr_offset3(xdrs, &objp->offset))
+	return FALSE;
+    if (!xdr_count3(xdrs, &objp->count))
+	return FALSE;
+    if (!xdr_stable_how(xdrs, &objp->stable))
+	return FALSE;
+    return xdr_u_int(xdrs, &objp->data.data_len);
+}
+
+/*
+ * Issue an UNSTABLE WRITE for the part of a chunk not yet accepted
+ */
+int
+writechunk(struct rpcpipe *rp, nfs_fh3 *fh, struct writechunk *wk)
+{
+    nfs_fh3copy(&wk->wk_args.file, fh);
+    wk->wk_args.offset = wk->wk_offset + wk->wk_done;
+    wk->wk_args.count = wk->wk_count - wk->wk_done;
+    wk->wk_args.stable = UNSTABLE;
+    wk->wk_args.data.data_len = wk->wk_args.count;
+    wk->wk_args.data.data_val = wk->wk_buf + wk->wk_done;
+    memset(&wk->wk_res, 0, sizeof(wk->wk_res));
+    wk->wk_call.rc_src = wk->wk_args.data.data_val;
+    wk->wk_call.rc_srclen = wk->wk_args.data.data_len;
+    wk->wk_call.rc_data = wk;
+    wk->wk_busy = 1;
+    if (!rpcpipe_send(rp, &wk->wk_call, NFS3_WRITE,
+      (xdrproc_t) xdr_WRITE3args_head, (caddr_t) &wk->wk_args,
+      (xdrproc_t) xdr_WRITE3res, (caddr_t) &wk->wk_res)) {
+	clnt_perrno(rp->rp_stat);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Map all of local file 'fd' for writefile, so WRITE data is sent
+ * from the page cache without being copied first. Returns NULL for
+ * files that cannot be mapped (not regular, empty or too large),
+ * which are read with pread instead. The file must not be truncated
+ * while the mapping is in use.
+ */
+char *
+mapinput(int fd, size_t *sizep)
+{
+    struct stat st;
+    char *map;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+      st.st_size != (size_t) st.st_size)
+	return NULL;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+	return NULL;
+#ifdef MADV_SEQUENTIAL
+    (void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+    *sizep = st.st_size;
+    return map;
+}
+
+/*
+ * Copy local file descriptor 'fd' to remote file 'fh' using
+ * UNSTABLE writes of the current write size, up to 'window' of them in flight,
+ * spread over the idle connections of the pool, followed by a single COMMIT.
+ * The data goes out from the mapped file, or from page-aligned buffers
+ * filled with pread when it cannot be mapped. The write verifier identifies a
+ * server incarnation; when it changes, the server may have lost
+ * uncommitted data and the whole file is sent again. With 'holes' set,
+ * which is only right for a remote file that was empty, the holes of
+ * the local file and its other blocks of zeros are not sent at all;
+ * when the file ends in one, a SETATTR gives the copy its size.
+ */
+int
+writefile(nfs_fh3 *fh, int fd, int window, int holes)
+{
+    struct writechunk *chunks, *wk;
+    WRITE3resok *resok;
+    struct pipeset ps;
+    struct rpcpipe *rp;
+    struct rpccall *rc;
+    COMMIT3args cargs;
+    COMMIT3res cres;
+    writeverf3 verf;
+    offset3 next, dataend, sent;
+    struct stat st;
+    count3 n;
+    ssize_t len;
+    size_t mapsize;
+    char *map;
+    u_int wsize;
+    int i, pass, eof, unstable, verfset, stale, ok = 1;
+    int replies = 0, retrans = 0;
+
+    if (window < 1)
+	window = 1;
+    wsize = adaptsize(&xfer.xp_wsize, &xfer.xp_wceil, XFER_KEEP);
+    bcache_forget(fh);
+    if (!openpipes(&ps, nfsclient, 1024))
+	return 0;
+    if ((chunks = (struct writechunk *) calloc(window, sizeof(*chunks))) == NULL) {
+	fprintf(stderr, "writefile: out of memory\n");
+	closepipes(&ps);
+	return 0;
+    }
+    map = mapinput(fd, &mapsize);
+    for (i = 0; i < window && map == NULL; i++) {
+	if (posix_memalign((void **) &chunks[i].wk_buf, getpagesize(),
+	  xfer.xp_wmax) != 0) {
+	    fprintf(stderr, "writefile: out of memory\n");
+	    chunks[i].wk_buf = NULL;
+	    window = i;
+	    ok = 0;
+	    break;
+	}
+    }
+
+    for (pass = 0; ok && pass < NRESEND; pass++) {
+	next = dataend = sent = 0;
+	eof = unstable = verfset = stale = 0;
+	while (ok) {
+	    /* keep the pipeline filled */
+	    for (i = 0; i < window && !eof; i++) {
+		wk = &chunks[i];
+		if (wk->wk_busy)
+		    continue;
+		if (holes && next >= dataend && !nextdata(fd, &next, &dataend)) {
+		    eof = 1;
+		    break;
+		}
+		n = holes ? MIN(wsize, dataend - next) : wsize;
+		if (map != NULL) {
+		    len = next < mapsize ? MIN(n, mapsize - next) : 0;
+		    wk->wk_buf = map + next;
+		} else if ((len = pread(fd, wk->wk_buf, n, next)) < 0) {
+		    perror("read");
+		    ok = 0;
+		    break;
+		}
+		if (len == 0) {
+		    eof = 1;
+		    break;
+		}
+
+		/* step over zeros, and stop the chunk at the next ones */
+		if (holes && (n = holerun(wk->wk_buf, len, next, 1)) > 0) {
+		    next += n;
+		    i--;
+		    continue;
+		}
+		if (holes)
+		    len = holerun(wk->wk_buf, len, next, 0);
+		wk->wk_offset = next;
+		wk->wk_count = len;
+		wk->wk_done = 0;
+		next += len;
+		sent = next;
+		if (!writechunk(rpcpipe_pick(ps.ps_pipe, ps.ps_count), fh, wk)) {
+		    ok = 0;
+		    break;
+		}
+	    }
+	    if (!ok || pipesbusy(&ps) == 0)
+		break;
+
+	    if ((rc = rpcloop_recv(&ps.ps_loop, &rp)) == NULL) {
+		clnt_perrno(rp->rp_stat);
+		ok = 0;
+		break;
+	    }
+	    wk = (struct writechunk *) rc->rc_data;
+	    wk->wk_busy = 0;
+	    if (rp->rp_type == SOCK_DGRAM && ++replies % window == 0) {
+		wsize = adaptsize(&xfer.xp_wsize, &xfer.xp_wceil,
+		    pipesretrans(&ps) > retrans ? XFER_SHRINK : XFER_GROW);
+		retrans = pipesretrans(&ps);
+	    }
+	    if (rc->rc_stat != RPC_SUCCESS) {
+		clnt_perrno(rc->rc_stat);
+		ok = 0;
+	    } else if (wk->wk_res.status != NFS3_OK) {
+		fprintf(stderr, "Write failed: %s\n", nfs_error(wk->wk_res.status));
+		ok = 0;
+	    } else {
+		resok = &wk->wk_res.WRITE3res_u.resok;
+		dnlc_attr(fh, &resok->file_wcc.after);
+		if (resok->committed == UNSTABLE)
+		    unstable = 1;
+		if (!verfset) {
+		    memcpy(verf, resok->verf, sizeof(verf));
+		    verfset = 1;
+		} else if (memcmp(verf, resok->verf, sizeof(verf)) != 0)
+		    stale = 1;
+
+		/* short write, send the remainder */
+		n = MIN(resok->count, wk->wk_count - wk->wk_done);
+		if (n == 0) {
+		    fprintf(stderr, "Write failed: no data accepted\n");
+		    ok = 0;
+		} else if ((wk->wk_done += n) < wk->wk_count)
+		    ok = writechunk(rpcpipe_pick(ps.ps_pipe, ps.ps_count), fh, wk);
+	    }
+	    xdr_free((xdrproc_t) xdr_WRITE3res, (char *) &wk->wk_res);
+	}
+	if (!ok)
+	    break;
+
+	/* what was left out at the end still counts for the size */
+	if (holes && fstat(fd, &st) == 0 && MAX(next, st.st_size) > sent &&
+	  !setsize(fh, MAX(next, st.st_size))) {
+	    ok = 0;
+	    break;
+	}
+
+	/* make unstable data stable, and check nothing was lost */
+	if (unstable && !stale) {
+	    nfs_fh3copy(&cargs.file, fh);
+	    cargs.offset = 0;
+	    cargs.count = 0;
+	    memset(&cres, 0, sizeof(cres));
+	    if (nfs3_commit_3(&cargs, &cres, nfsclient) != RPC_SUCCESS) {
+		clnt_perror(nfsclient, "nfs3_commit");
+		ok = 0;
+		break;
+	    }
+	    if (cres.status != NFS3_OK) {
+		fprintf(stderr, "Commit failed: %s\n", nfs_error(cres.status));
+		ok = 0;
+		break;
+	    }
+	    dnlc_attr(fh, &cres.COMMIT3res_u.resok.file_wcc.after);
+	    if (memcmp(verf, cres.COMMIT3res_u.resok.verf, sizeof(verf)) != 0)
+		stale = 1;
+	}
+	if (!stale)
+	    break;
+	fprintf(stderr, "put: write verifier changed, sending file again\n");
+    }
+    if (ok && pass == NRESEND) {
+	fprintf(stderr, "put: server keeps losing data, giving up\n");
+	ok = 0;
+    }
+
+    for (i = 0; i < window; i++) {
+	rpccall_free(&chunks[i].wk_call);
+	if (map == NULL)
+	    free(chunks[i].wk_buf);
+    }
+    free(chunks);
+    if (map != NULL)
+	(void) munmap(map, mapsize);
+    closepipes(&ps);
+    return ok;
+}
+
+/*
+ * Move '*offp' past the hole of local file 'fd' it is in, if any, and
+ * set '*endp' to where the data found there ends. Returns 0 when
+ * there is only a hole left. Where holes cannot be found, all of the
+ * file is taken for data.
+ */
+int
+nextdata(int fd, offset3 *offp, offset3 *endp)
+{
+#ifdef SEEK_DATA
+    off_t data, hole;
+
+    if ((data = lseek(fd, *offp, SEEK_DATA)) < 0) {
+	if (errno == ENXIO)
+	    return 0;
+    } else if ((hole = lseek(fd, data, SEEK_HOLE)) > data) {
+	*offp = data;
+	*endp = hole;
+	return 1;
+    }
+#endif
+    *endp = ~(offset3) 0;
+    return 1;
+}
+
+/*
+ * Set the size of remote file 'fh'
+ */
+int
+setsize(nfs_fh3 *fh, size3 size)
+{
+    SETATTR3args aargs;
+    SETATTR3res ares;
+
+    nfs_fh3copy(&aargs.object, fh);
+    aargs.new_attributes.mode  = (set_mode3) { .set_it=FALSE };
+    aargs.new_attributes.uid   = (set_uid3)  { .set_it=FALSE };
+    aargs.new_attributes.gid   = (set_gid3)  { .set_it=FALSE };
+    aargs.new_attributes.size  = (set_size3) { .set_it=TRUE, .set_size3_u.size=size };
+    aargs.new_attributes.atime = (set_atime) { .set_it=FALSE };
+    aargs.new_attributes.mtime = (set_mtime) { .set_it=FALSE };
+    aargs.guard.check = FALSE;
+
+    memset(&ares, 0, sizeof(ares));
+
+    if (nfs3_setattr_3(&aargs, &ares, nfsclient) != RPC_SUCCESS) {
+	clnt_perror(nfsclient, "nfs3_setattr");
+	return 0;
+    }
+    if (ares.status != NFS3_OK) {
+	fprintf(stderr, "Set attributes failed: %s\n", nfs_error(ares.status));
+	return 0;
+    }
+    dnlc_attr(fh, &ares.SETATTR3res_u.resok.obj_wcc.after);
+    return 1;
+}
+
+/*
+ * Get/set file handle
+ */
+void
+do_handle(int argc, char **argv)
+{
+    int sock, port, flags;
+    register char *p;
+    register int i;
+
+    port = 0;
+    flags = 0;
+    argv++; argc--;
+    while (argc > 0 && argv[0][0] == '-') {
+	for (p = argv[0]+1; *p; p++) {
+	    switch (*p) {
+	    case 'P':
+		if (argc <= 1)
+		   goto usage;
+		argv++; argc--;
+		port = atoi(*argv);
+		break;
+	    case 'T':
+		flags |= NFS_OVER_TCP;
+		break;
+	    case 'U':
+		flags |= NFS_OVER_UDP;
+		break;
+	    default:
+		goto usage;
+	    }
+	}
+	argv++; argc--;
+    }
+    if (argc <= 1) {
+	if (mountpath == NULL) {
+	    fprintf(stderr, "handle: no remote file system mounted\n");
+	    return;
+	}
+	printf("%s:", mountpath);
+	for (i = 0, p = (char *)&directory_handle.data;
+	  i < sizeof(directory_handle.data); i++)
+	    printf(" %02x", *p++ & 0xFF);
+	printf("\n");
+	return;
+    }
+
+    if (argc != sizeof(directory_handle.data)) {
+usage:
+	fprintf(stderr, "Usage: handle [-TU] <file handle>\n");
+	return;
+    }
+
+    if (remotehost == NULL) {
+	fprintf(stderr, "handle: no host specified\n");
+	return;
+    }
+
+    /* copy handle from command line argument */
+    for (i = 0, p = (char *)&directory_handle.data;
+      i < sizeof(directory_handle.data); i++)
+	*p++ = (char) strtol(argv[i], NULL, 16);
+    if (directory_handle.data.data_len > NFS3_FHSIZE)
+	directory_handle.data.data_len = NFS3_FHSIZE;
+    directory_handle.hash = nfs_fh3hash(&directory_handle);
+    nfs_fh3copy(&root_handle, &directory_handle);
+
+    open_nfs(NULL, port, flags);
+}
+
+/*
+ * Set up a channel to the NFS server and
+ * mount remote file system.
+ */
+void
+do_mount(int argc, char **argv)
+{
+    int port, flags, nconn;
+    char *p, *path;
+
+    port = 0;
+    flags = 0;
+    nconn = 1;
+    argv++; argc--;
+    while (argc > 0 && argv[0][0] == '-') {
+	for (p = argv[0]+1; *p; p++) {
+	    switch (*p) {
+	    case 'u':
+		flags |= MOUNT_UMOUNT;
+		break;
+	    case 'n':
+		if (argc <= 1)
+		   goto usage;
+		argv++; argc--;
+		if ((nconn = atoi(*argv)) < 1 || nconn > MAXCONNECT) {
+		    fprintf(stderr, "mount: between 1 and %d connections\n",
+			MAXCONNECT);
+		    return;
+		}
+		break;
+	    case 'p':
+		flags |= THRU_PORTMAP;
+		break;
+	    case 'P':
+		if (argc <= 1)
+		   goto usage;
+		argv++; argc--;
+		port = atoi(*argv);
+		break;
+	    case 'T':
+		flags |= NFS_OVER_TCP;
+		break;
+	    case 'U':
+		flags |= NFS_OVER_UDP;
+		break;
+	    default:
+		goto usage;
+	    }
+	}
+	argv++; argc--;
+    }
+    if (argc != 1) {
+usage:
+	fprintf(stderr, "Usage: mount [-upTU] [-P port] [-n conns] <path>\n");
+	return;
+    }
+    path = argv[0];
+    if (remotehost == NULL) {
+	fprintf(stderr, "mount: no host specified\n");
+	return;
+    }
+    nconnect = nconn;
+    open_nfs(path, port, flags);
+}
+
+/*
+ * Unmount remote file system, and close
+ * RPC channel.
+ */
+/* ARGUSED */
+void
+do_umount(int argc, char **argv)
+{
+    if (argc != 1) {
+	fprintf(stderr, "Usage: umount\n");
+	return;
+    }
+    if (mountpath == NULL)
+	fprintf(stderr, "umount: no remote file system mounted\n");
+    else
+	close_nfs();
+}
+
+/*
+ * Unmount all remote file system from this host
+ */
+/* ARGUSED */
+void
+do_umountall(int argc, char **argv)
+{
+    if (argc != 1) {
+	fprintf(stderr, "Usage: umountall\n");
+	return;
+    }
+    if (remotehost == NULL) {
+	fprintf(stderr, "umountall: no host specified\n");
+	return;
+    }
+    if (mountpath != NULL) close_nfs();
+    (void) mount3_umntall_3(NULL, NULL, mntclient);
+}
+
+/*
+ * Display all exported file systems on remote system
+ */
+/* ARGUSED */
+void
+do_export(int argc, char **argv)
+{
+    exports ex, exl;
+    groups gr;
+    int hostsonly = 0;
+
+    argv++; argc--;
+    if (argc >= 1 && strcmp(argv[0], "-h") == 0) {
+	argv++; argc--;
+	hostsonly = 1;
+    }
+    if (argc != 0) {
+	fprintf(stderr, "Usage: export [-h] \n");
+	return;
+    }
+    if (remotehost == NULL) {
+	fprintf(stderr, "export: no host specified\n");
+	return;
+    }
+    memset(&exl, 0, sizeof(exl));
+    if (mount3_export_3(NULL, &exl, mntclient) != RPC_SUCCESS) {
+	clnt_perror(mntclient, "mountproc_export");
+	return;
+    }
+    printf("Export list for %s:\n", remotehost);
+    for (ex = exl; ex != NULL; ex = ex->ex_next) {
+	printf("%-25s", ex->ex_dir);
+	if (hostsonly == 0) {
+	    if ((int)strlen(ex->ex_dir) >= 25)
+		printf("\n                    ");
+	    if ((gr = ex->ex_groups) == NULL)
+		printf("everyone");
+	    while (gr) {
+		printf("%s ", gr->gr_name);
+		gr = gr->gr_next;
+	    }
+	}
+	putchar('\n');
+    }
+    xdr_free((xdrproc_t) xdr_exports, (char *) &exl);
+}
+
+/*
+ * Display all remote mounted file systems
+ */
+/* ARGUSED */
+void
+do_dump(int argc, char **argv)
+{
+    mountlist ml, mll;
+
+    if (argc != 1) {
+	fprintf(stderr, "Usage: dump\n");
+	return;
+    }
+    if (remotehost == NULL) {
+	fprintf(stderr, "dump: no host specified\n");
+	return;
+    }
+    memset(&mll, 0, sizeof(mll));
+    if (mount3_dump_3(NULL, &mll, mntclient) != RPC_SUCCESS) {
+	clnt_perror(mntclient, "mountproc_dump");
+	return;
+    }
+    for (ml = mll; ml != NULL; ml = ml->ml_next)
+	printf("%s:%s\n", ml->ml_hostname, ml->ml_directory);
+    xdr_free((xdrproc_t) xdr_mountlist, (char *) &mll);
+}
+
+/*
+ * Ask many hosts at once for their exports and mounts, independent
+ * of the current host. Hosts come from the arguments (addresses,
+ * names or a.b.c.d/n ranges) and from a file of them, one per line.
+ */
+/* ARGUSED */
+void
+do_scan(int argc, char **argv)
+{
+    struct scan sc;
+    void (*osig)(int);
+    char *file = NULL;
+    FILE *list = NULL;
+
+    memset(&sc, 0, sizeof(sc));
+    sc.sc_window = SCAN_WINDOW;
+    argv++; argc--;
+    while (argc > 0 && argv[0][0] == '-') {
+	if (strcmp(argv[0], "-a") == 0)
+	    sc.sc_all = 1;
+	else if (strcmp(argv[0], "-w") == 0 && argc > 1) {
+	    sc.sc_window = atoi(argv[1]);
+	    argv++; argc--;
+	} else if (strcmp(argv[0], "-f") == 0 && argc > 1) {
+	    file = argv[1];
+	    argv++; argc--;
+	} else
+	    break;
+	argv++; argc--;
+    }
+    if ((argc == 0 && file == NULL) || (argc > 0 && argv[0][0] == '-') ||
+      sc.sc_window <= 0) {
+	fprintf(stderr,
+	    "Usage: scan [-a] [-w <window>] [-f <file>] <host|cidr>...\n");
+	return;
+    }
+    if (file != NULL && (list = fopen(file, "r")) == NULL) {
+	perror(file);
+	return;
+    }
+    if ((sc.sc_pmapfd = privileged(SOCK_DGRAM, NULL)) == RPC_ANYSOCK)
+	sc.sc_pmapfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if ((sc.sc_mntfd = privileged(SOCK_DGRAM, NULL)) == RPC_ANYSOCK)
+	sc.sc_mntfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sc.sc_pmapfd < 0 || sc.sc_mntfd < 0) {
+	perror("scan: socket");
+	if (sc.sc_pmapfd >= 0) close(sc.sc_pmapfd);
+	if (sc.sc_mntfd >= 0) close(sc.sc_mntfd);
+	if (list != NULL) fclose(list);
+	return;
+    }
+    sc.sc_auth = create_authenticator();
+    sc.sc_out = stdout;
+    sc.sc_stop = &pool_stopped;
+
+    pool_stopped = 0;
+    osig = signal(SIGINT, pool_interrupt);
+    if (scan_run(&sc, argc, argv, list))
+	fprintf(stderr, "scan: %lu hosts probed, %lu answered%s\n",
+	    sc.sc_probed, sc.sc_answered,
+	    pool_stopped ? " (interrupted)" : "");
+    signal(SIGINT, osig);
+    auth_destroy(sc.sc_auth);
+    if (list != NULL)
+	fclose(list);
+}
+
+/*
+ * Generic status report
+ */
+/* ARGUSED */
+void
+do_status(int argc, char **argv)
+{
+    if (argc != 1) {
+	fprintf(stderr, "Usage: status\n");
+	return;
+    }
+    printf("User id      : %d\n", uid);
+    printf("Group id     : %d\n", gid);
+    if (remotehost)
+	printf("Remote host  : `%s'\n", remotehost);
+    if (mountpath)
+	printf("Mount path   : `%s'\n", mountpath);
+    if (mountpath) {
+	printf("Read size    : %u (server max %u, pref %u)\n",
+	    adaptsize(&xfer.xp_rsize, &xfer.xp_rceil, XFER_KEEP),
+	    xfer.xp_rtmax, xfer.xp_rtpref);
+	printf("Write size   : %u (server max %u, pref %u)\n",
+	    adaptsize(&xfer.xp_wsize, &xfer.xp_wceil, XFER_KEEP),
+	    xfer.xp_wtmax, xfer.xp_wtpref);
+	printf("Readdir size : %u (server pref %u)\n",
+	    xfer.xp_dsize, xfer.xp_dtpref);
+	printf("Connections  : %d %s\n", nnfsconns,
+	    nfsproto == IPPROTO_TCP ? "TCP" : "UDP");
+    }
+    printcachestatus();
+    if (mntcache_file() != NULL)
+	printf("Handle cache : `%s', %d entries%s\n", mntcache_file(),
+	    mntcache_count(), mountcached ? ", mount point from cache" : "");
+}
+
+/*
+ * Show the RPC statistics, as a table or with -j as JSON. With -z
+ * they are cleared after that, which starts a new epoch: every thread
+ * clears its own counters when it next records a call.
+ */
+void
+do_stats(int argc, char **argv)
+{
+    int jflag = 0, zflag = 0;
+    char *cp;
+
+    argv++; argc--;
+    while (argc >= 1 && argv[0][0] == '-') {
+	for (cp = argv[0] + 1; *cp; cp++) {
+	    if (*cp == 'j')
+		jflag = 1;
+	    else if (*cp == 'z')
+		zflag = 1;
+	    else
+		break;
+	}
+	if (*cp != '\0')
+	    break;
+	argv++; argc--;
+    }
+    if (argc != 0) {
+	fprintf(stderr, "Usage: stats [-jz]\n");
+	return;
+    }
+    rpcstats_print(stdout, jflag);
+    if (zflag)
+	rpcstats_reset();
+}
+
+/*
+ * Show the RPC rates once a second (or every -i seconds), per thread
+ * and per procedure, or as a single line with -1. With a command they
+ * go to stderr while it runs, otherwise to stdout until interrupted.
+ */
+void
+do_watch(int argc, char **argv)
+{
+    static struct watcher wt;	/* the main loop stops it on interrupts */
+    void (*osig)(int);
+    int interval = 1, brief = 0;
+
+    argv++; argc--;
+    while (argc >= 1 && argv[0][0] == '-') {
+	if (strcmp(argv[0], "-1") == 0)
+	    brief = 1;
+	else if (strcmp(argv[0], "-i") == 0 && argc >= 2) {
+	    interval = atoi(argv[1]);
+	    argv++; argc--;
+	} else
+	    break;
+	argv++; argc--;
+    }
+    if ((argc >= 1 && argv[0][0] == '-') || interval < 1) {
+	fprintf(stderr, "Usage: watch [-1] [-i <secs>] [<command>]\n");
+	return;
+    }
+
+    if (argc >= 1) {
+	if (command(argv[0]) == CMD_WATCH || watching != NULL) {
+	    fprintf(stderr, "watch: already watching\n");
+	    return;
+	}
+	if (!watch_start(&wt, stderr, interval, brief))
+	    return;
+	watching = &wt;
+	(void) execute(argv[0], argc, argv);
+	watching = NULL;
+	watch_stop(&wt);
+	return;
+    }
+
+    if (!interact) {
+	fprintf(stderr, "watch: no command to watch\n");
+	return;
+    }
+    pool_stopped = 0;
+    osig = signal(SIGINT, pool_interrupt);
+    while (!pool_stopped) {
+	if (!brief && isatty(fileno(stdout)))
+	    fputs("\033[H\033[2J", stdout);
+	rpcstats_top(stdout, brief);
+	fflush(stdout);
+	sleep(interval);
+    }
+    signal(SIGINT, osig);
+}
+
+/*
+ * Start a thread that shows the RPC rates on 'fp' every 'interval'
+ * seconds
+ */
+int
+watch_start(struct watcher *wt, FILE *fp, int interval, int brief)
+{
+    sigset_t set, oset;
+    int ok;
+
+    memset(wt, 0, sizeof(*wt));
+    wt->wt_fp = fp;
+    wt->wt_interval = interval;
+    wt->wt_brief = brief;
+    wt->wt_clear = !brief && isatty(fileno(fp));
+    pthread_mutex_init(&wt->wt_lock, NULL);
+    pthread_cond_init(&wt->wt_cond, NULL);
+
+    /* interrupts are for the main thread only */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, &oset);
+    ok = pthread_create(&wt->wt_thread, NULL, watcher, wt) == 0;
+    pthread_sigmask(SIG_SETMASK, &oset, NULL);
+    if (!ok) {
+	fprintf(stderr, "watch: cannot create thread\n");
+	pthread_cond_destroy(&wt->wt_cond);
+	pthread_mutex_destroy(&wt->wt_lock);
+    }
+    return ok;
+}
+
+/*
+ * Stop the watcher, after a last view of the rates
+ */
+void
+watch_stop(struct watcher *wt)
+{
+    pthread_mutex_lock(&wt->wt_lock);
+    wt->wt_stop = 1;
+    pthread_cond_signal(&wt->wt_cond);
+    pthread_mutex_unlock(&wt->wt_lock);
+    pthread_join(wt->wt_thread, NULL);
+    pthread_cond_destroy(&wt->wt_cond);
+    pthread_mutex_destroy(&wt->wt_lock);
+}
+
+void *
+watcher(void *arg)
+{
+    struct watcher *wt = (struct watcher *) arg;
+    struct timespec deadline;
+    int stop;
+
+    rpcstats_name("watch");
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    pthread_mutex_lock(&wt->wt_lock);
+    do {
+	deadline.tv_sec += wt->wt_interval;
+	while (!wt->wt_stop && pthread_cond_timedwait(&wt->wt_cond,
+	  &wt->wt_lock, &deadline) != ETIMEDOUT)
+	    /* do nothing */;
+	stop = wt->wt_stop;
+	pthread_mutex_unlock(&wt->wt_lock);
+	if (wt->wt_clear)
+	    fputs("\033[H\033[2J", wt->wt_fp);
+	rpcstats_top(wt->wt_fp, wt->wt_brief);
+	fflush(wt->wt_fp);
+	pthread_mutex_lock(&wt->wt_lock);
+    } while (!stop);
+    pthread_mutex_unlock(&wt->wt_lock);
+    return NULL;
+}
+
+/*
+ * Show or set the name, attribute and block cache parameters
+ */
+void
+do_cache(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "on") == 0)
+	dnlc_enabled = bcache_enabled = pathcache_enabled = 1;
+    else if (argc == 2 && strcmp(argv[1], "off") == 0) {
+	dnlc_enabled = bcache_enabled = pathcache_enabled = 0;
+	dnlc_purge();
+	bcache_purge();
+	pathcache_purge();
+    } else if (argc == 2 && strcmp(argv[1], "flush") == 0) {
+	dnlc_purge();
+	bcache_purge();
+	pathcache_purge();
+    } else if ((argc == 3 || argc == 4) && strcmp(argv[1], "blocks") == 0) {
+	bcache_size = MAX(atoi(argv[2]), 0);
+	if (argc == 4)
+	    bcache_ttl = atoi(argv[3]);
+	if (bcache_size == 0)
+	    bcache_purge();
+    } else if (argc == 5) {
+	dnlc_timeo.dt_regmin = atoi(argv[1]);
+	dnlc_timeo.dt_regmax = atoi(argv[2]);
+	dnlc_timeo.dt_dirmin = atoi(argv[3]);
+	dnlc_timeo.dt_dirmax = atoi(argv[4]);
+    } else if (argc != 1) {
+	fprintf(stderr,
+	    "Usage: cache [on|off|flush|<acregmin> <acregmax> <acdirmin> <acdirmax>|blocks <n> [<ttl>]]\n");
+	return;
+    }
+    printcachestatus();
+}
+
+void
+printcachestatus(void)
+{
+    u_long lookups = dnlc_hits + dnlc_misses;
+
+    if (!dnlc_enabled)
+	printf("Name cache   : off\n");
+    else
+	printf("Name cache   : %d names, %lu/%lu hits (%lu%%), timeouts %d-%ds files, %d-%ds dirs\n",
+	    dnlc_count(), dnlc_hits, lookups,
+	    lookups ? dnlc_hits * 100 / lookups : 0,
+	    dnlc_timeo.dt_regmin, dnlc_timeo.dt_regmax,
+	    dnlc_timeo.dt_dirmin, dnlc_timeo.dt_dirmax);
+    lookups = bcache_hits + bcache_misses;
+    if (!bcache_enabled)
+	printf("Block cache  : off\n");
+    else
+	printf("Block cache  : %d/%d blocks of %dK, %lu/%lu hits (%lu%%), timeout %ds\n",
+	    bcache_count(), bcache_size, BCACHE_BLOCK / 1024, bcache_hits,
+	    lookups, lookups ? bcache_hits * 100 / lookups : 0, bcache_ttl);
+    lookups = pathcache_hits + pathcache_misses;
+    if (!pathcache_enabled)
+	printf("Path cache   : off\n");
+    else
+	printf("Path cache   : %d directories, %lu/%lu components (%lu%%) from cache\n",
+	    pathcache_count(), pathcache_hits, lookups,
+	    lookups ? pathcache_hits * 100 / lookups : 0);
+}
+
+/*
+ * Simple on-line help facility
+ */
+/* ARGUSED */
+void
+do_help(int argc, char **argv)
+{
+    register int i;
+
+    for (i = 0; i < sizeof(keyword)/sizeof(struct keyword); i++) {
+	if (argc == 2 && strcmp(keyword[i].kw_command, argv[1]) != 0)
+	    continue;
+	printf("%s %s\n", keyword[i].kw_command, keyword[i].kw_help);
+    }
+}
+
+/*
+ * Open a channel to remote Mount daemon, possibly closing an
+ * already open connection. There are four possibilities here.
+ * Either the channel has a privileged port number or not, and
+ * it is a TCP stream or an UDP stream.
+ */
+int
+open_mount(char *host)
+{
+    struct race race;
+    char *tmp, *src = 0;
+    int proto, sock;
+
+    tmp = strrchr(host,':');
+    if (tmp) {
+	src = host;
+	host = tmp+1;
+    } else if ((tmp = strchr(host,'@'))) {
+	src = host;
+	host = tmp+1;
+    }
+    /* close previous mounted host */
+    if (remotehost != NULL)
+	close_mount();
+
+    /* convert hostname to IP address */
+    if (isdigit(*host)) {
+        server_addr.sin_addr.s_addr = inet_addr(host);
+    } else {
+        struct hostent *hp = gethostbyname(host);
+        if (hp == NULL) {
+            fprintf(stderr, "%s: unknown host\n", host);
+	    return 0;
+        }
+        memcpy(&server_addr.sin_addr.s_addr, hp->h_addr, hp->h_length);
+        host = (char *) hp->h_name;
+    }
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = 0;
+
+    /* set host name */
+    if ((remotehost = strdup(host)) == NULL) {
+	fprintf(stderr, "internal error: no more core for host\n");
+	return 0;
+    }
+
+    /* setup communication channel with mount daemon */
+    proto = IPPROTO_TCP;
+    mntserver_addr = server_addr;
+    if (src) {
+	sock = sourceroute(src, &mntserver_addr, MOUNT_PROGRAM, MOUNT_V3);
+    } else {
+	getports(&server_addr);
+	racestart(&race, &mntserver_addr, MOUNT_PROGRAM, MOUNT_V3, 1, 1);
+	if ((proto = racefinish(&race, &sock, &mntserver_addr)) == 0)
+	    return 0;
+	reportport(sock);
+    }
+
+    if (proto == IPPROTO_TCP)
+	mntclient = clnttcp_create(&mntserver_addr,
+	    MOUNT_PROGRAM, MOUNT_V3, &sock, 0, 0);
+    else
+	mntclient = clntudp_create(&mntserver_addr,
+	    MOUNT_PROGRAM, MOUNT_V3, timeout, &sock);
+    if (mntclient == (CLIENT *)0) {
+	clnt_pcreateerror("mount");
+	if (sock != RPC_ANYSOCK)
+	    close(sock);
+	return 0;
+    }
+    clnt_control(mntclient, CLSET_TIMEOUT, (char *)&timeout);
+    clnt_control(mntclient, CLSET_FD_CLOSE, (char *)NULL);
+    mntclient->cl_auth = create_authenticator();
+    rpcstats_attach(mntclient, MOUNT_PROGRAM);
+    if (verbose) {
+	printf("Open %s (%s) %s\n",
+	    remotehost, inet_ntoa(server_addr.sin_addr),
+	    proto == IPPROTO_TCP ? "TCP" : "UDP");
+    }
+    return 1;
+}
+
+/*
+ * Close channel to mount daemon,
+ * possibly umounting a NFS file system.
+ */
+void
+close_mount(void)
+{
+    if (mountpath) close_nfs();
+    if (verbose) printf("Close `%s'\n", remotehost);
+    free(remotehost);
+    remotehost = NULL;
+    if (mntclient) {
+	auth_destroy(mntclient->cl_auth);
+	clnt_destroy(mntclient);
+    }
+}
+
+struct in_addr
+convert_name(char *host)
+{
+    struct in_addr ret;
+
+    ret.s_addr = ~0;
+    /* convert hostname to IP address */
+    if (isdigit(*host)) {
+        ret.s_addr = inet_addr(host);
+    } else {
+        struct hostent *hp = gethostbyname(host);
+        if (hp == NULL) {
+            fprintf(stderr, "%s: unknown host\n", host);
+	    return ret;
+        }
+        memcpy(&ret.s_addr, hp->h_addr, hp->h_length);
+    }
+    return ret;
+}
+
+/*
+ * Set the source route attributes for a socket.
+ * Source route attributes have the following form:
+ *
+ * [<localaddr>]@[<host>:...]<dest>
+ */
+int
+sourceroute(char *src, struct sockaddr_in *svr, int prog, int vers)
+{
+    char *ind = strchr(src,'@');
+    char ipopts[32];
+    char *opts = ipopts+3;
+    int sock;
+
+    memset(ipopts, 0, sizeof(ipopts));
+
+    if (ind == src) {
+	sock = privileged(SOCK_STREAM, NULL);
+    } else {
+	/* convert address and bind */
+	struct sockaddr_in sin;
+
+	*ind = '\0';
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr = convert_name(src);
+
+	sock = privileged(SOCK_STREAM, &sin);
+	if (sock == RPC_ANYSOCK) {
+	    sin.sin_port = 0;
+	    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	    if (bind(sock, (struct sockaddr *)&sin, sizeof(sin)) != 0) {
+		fprintf(stderr,"Couldn't bind to src %s\n", src);
+		close(sock);
+		return RPC_ANYSOCK;
+	    }
+	} else if (verbose)
+	    printf("Bound to %s\n", src);
+    }
+    if (ind == 0)
+	return 0;
+    src = ++ind;
+
+    ipopts[0] = (char) IPOPT_LSRR;
+    ipopts[2] = (char) IPOPT_MINOFF;
+    while (src && *src) {
+	struct in_addr addr;
+	ind = strchr(src, ':');
+	if (ind)
+	    *ind++ = '\0';
+	addr = convert_name(src);
+	if (verbose)
+	    printf("Routed through %s\n", inet_ntoa(addr));
+	memcpy(opts, &addr.s_addr, 4); opts += 4;
+	src = ind;
+    }
+    ipopts[IPOPT_OLEN] = opts - ipopts;
+    while ((opts - ipopts) & 3)
+	opts++;
+    if (setsockopt(sock, IPPROTO_IP,IP_OPTIONS, ipopts, opts - ipopts) == -1) {
+	perror("setsockopt");
+	return RPC_ANYSOCK;
+    }
+
+    svr->sin_port = pmap_getport(svr, prog, vers, IPPROTO_TCP);
+    svr->sin_port = htons(svr->sin_port);
+    if (connect(sock, (struct sockaddr *) svr, sizeof(*svr)) != 0) {
+	perror("connect");
+	return RPC_ANYSOCK;
+    }
+    return sock;
+}
+
+/*
+ * Mount an NFS file system, perhaps closing a previous mounted
+ * one. The umount option fools the accounting system. The portmap
+ * option allows mounts via the portmapper and transport allows
+ * you to choose the transport type (TCP or UDP).
+ */
+int
+open_nfs(char *path, int port, int flags)
+{
+    struct mntcache_fsinfo fsinfo;
+    struct race race;
+    struct probe probe;
+    int proto, sock;
+
+    /* umount previous mounted remote file system */
+    if (mountpath != NULL)
+	close_nfs();
+    mountcached = 0;		/* set below when fsinfo comes from the cache */
+
+    /*
+     * Set out for the NFS server, over TCP or UDP or whichever gets
+     * there first, and get the mount point handle meanwhile.
+     */
+    nfsserver_addr = server_addr;
+    nfsserver_addr.sin_port = ntohs(port);
+    racestart(&race, &nfsserver_addr, NFS_PROGRAM, NFS_V3,
+	(flags & TRANSPORT_MASK) != NFS_OVER_UDP,
+	(flags & TRANSPORT_MASK) != NFS_OVER_TCP);
+
+    /*
+     * When no path is given we assume the caller
+     * set the directory file handle.
+     */
+    if (path != NULL) {
+	/*
+	 * Get file handle for this path from the mount daemon. There
+	 * are two ways to get it, either ask it directly or get it
+	 * through the port mapper.
+	 */
+	xdr_free((xdrproc_t) xdr_mountres3, (char *) &mountres);
+	memset(&mountres, 0, sizeof(mountres));
+	mountpoint = &mountres;
+	if (!(flags & THRU_PORTMAP) && mntcache_getmount(server_addr.sin_addr,
+	  path, &mountpoint->mountres3_u.mountinfo.fhandle, &fsinfo)) {
+	    /* a mount from an earlier session, checked when it fails */
+	    mountpoint->fhs_status = MNT3_OK;
+	    mountcached = 1;
+	} else if (flags & THRU_PORTMAP) {
+	    if (!pmap_mnt(&path, &mntserver_addr, mountpoint)) {
+		raceabort(&race);
+		return 0;
+	    }
+	} else if (mount3_mnt_3(&path, mountpoint, mntclient) != RPC_SUCCESS) {
+	    clnt_perror(mntclient, "mount3_mnt");
+	    raceabort(&race);
+	    return 0;
+	}
+	if (mountpoint->fhs_status != MNT3_OK) {
+            fprintf(stderr, "Mount failed: %s\n",
+		nfs_error(mountpoint->fhs_status));
+	    raceabort(&race);
+	    return 0;
+	}
+    }
+
+    if ((proto = racefinish(&race, &sock, &nfsserver_addr)) == 0)
+	return 0;
+    reportport(sock);
+    if ((nfsclient = attach_nfsclient(&nfsserver_addr, proto, sock)) == NULL)
+	return 0;
+    nfsproto = proto;
+
+    if (path != NULL) {
+	fhandle3_to_nfs_fh3(&root_handle, &mountpoint->mountres3_u.mountinfo.fhandle);
+	nfs_fh3copy(&directory_handle, &root_handle);
+
+	/* we got the file handle, unmount if don't want to get noticed */
+	if ((flags & MOUNT_UMOUNT) && !mountcached)
+	    (void) mount3_umnt_3(&path, NULL, mntclient);
+
+	/* set mount path */
+	if ((mountpath = strdup(path)) == NULL) {
+	    fprintf(stderr, "internal error: no more core for mountpath\n");
+	    return 0;
+	}
+    } else if ((mountpath = strdup("<handle>")) == NULL) {
+	fprintf(stderr, "internal error: no more core for mountpath\n");
+	return 0;
+    }
+    free(cwdpath);
+    cwdpath = path != NULL ? strdup("/") : NULL;
+    cwdcached = 0;
+
+    /* get transfer sizes, while the other connections come up */
+    if (mountcached) {
+	openconns(nconnect);
+	xfer.xp_rtmax = fsinfo.mf_rtmax;
+	xfer.xp_rtpref = fsinfo.mf_rtpref;
+	xfer.xp_wtmax = fsinfo.mf_wtmax;
+	xfer.xp_wtpref = fsinfo.mf_wtpref;
+	xfer.xp_dtpref = fsinfo.mf_dtpref;
+	set_xferprofile();
+    } else {
+	probestart(&probe);
+	openconns(nconnect);
+	probefinish(&probe);
+	if (path != NULL)
+	    cache_mount();
+    }
+    readdirplus = 1;
+    dnlc_purge();
+    bcache_purge();
+    pathcache_purge();
+
+    if (verbose) {
+	printf("Mount `%s'", mountpath);
+	if (flags & MOUNT_UMOUNT)
+	    printf(" (unmount)");
+	if (mountcached)
+	    printf(" (cached)");
+	if (proto == IPPROTO_TCP)
+	    printf(", TCP, ");
+	else
+	    printf(", UDP, ");
+	if (port != 0)
+	    printf("port %d, ", port);
+	if (nnfsconns > 1)
+	    printf("%d connections, ", nnfsconns);
+	printf("transfer size %u/%u bytes", xfer.xp_rsize, xfer.xp_wsize);
+	if (!mountcached && probe.pr_fsstat.status == NFS3_OK)
+	    printf(", %lldK free",
+		(long long) probe.pr_fsstat.FSSTAT3res_u.resok.abytes / 1024);
+	printf(".\n");
     }
-    if (cres->status != NFS3_OK)
-	fprintf(stderr, "WARNING: Mknod failed: %s\n", nfs_error(cres->status));
+    return 1;
 }
 
 /*
- * Change owner (and group) of remote file or directory
+ * Open another connection to the NFS server, using the same address,
+ * transport and credentials as 'nfsclient'. Each worker thread gets
+ * its own, since a CLIENT handle cannot be shared between threads.
  */
-void
-do_chown(int argc, char **argv)
+CLIENT *
+clone_nfsclient(void)
 {
-    LOOKUP3args dargs;
-    LOOKUP3res *dres;
-    SETATTR3args aargs;
-    SETATTR3res *ares;
-    int own_uid, own_gid;
+    struct sockaddr_in addr;
+    int sock;
 
-    if (mountpath == NULL) {
-	fprintf(stderr, "chown: no remote file system mounted\n");
-	return;
-    }
-    if (argc != 3) {
-	fprintf(stderr, "Usage: chown <uid>[.<gid>] <file>\n");
-	return;
+    if (!clnt_control(nfsclient, CLGET_SERVER_ADDR, (char *)&addr)) {
+	fprintf(stderr, "clone_nfsclient: cannot get server address\n");
+	return NULL;
     }
-    if (sscanf(argv[1], "%d.%d", &own_uid, &own_gid) != 2) {
-	own_gid = -1;
-	if (sscanf(argv[1], "%d", &own_uid) != 1) {
-	    fprintf(stderr, "chown: invalid uid[.gid]\n");
-	    return;
+    if (nfsproto == IPPROTO_TCP) {
+	sock = privileged(SOCK_STREAM, NULL);
+	if (sock != RPC_ANYSOCK &&
+	  connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+	    perror("connect");
+	    close(sock);
+	    return NULL;
 	}
-    }
-
-    dargs.what.name = argv[2];
-    nfs_fh3copy(&dargs.what.dir, &directory_handle);
-    if ((dres = nfs3_lookup_3(&dargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_lookup");
-	return;
-    }
-    if (dres->status != NFS3_OK) {
-	fprintf(stderr, "%s: %s\n", argv[2], nfs_error(dres->status));
-	return;
-    }
+    } else
+	sock = privileged(SOCK_DGRAM, NULL);
+    return attach_nfsclient(&addr, nfsproto, sock);
+}
 
-    nfs_fh3copy(&aargs.object, &dres->LOOKUP3res_u.resok.object);
-    aargs.new_attributes.mode  = (set_mode3) { .set_it=FALSE };
-    aargs.new_attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u.uid = own_uid };
-    aargs.new_attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u.gid = own_gid };
-    aargs.new_attributes.size  = (set_size3) { .set_it=FALSE };
-    aargs.new_attributes.atime = (set_atime) { .set_it=FALSE };
-    aargs.new_attributes.mtime = (set_mtime) { .set_it=FALSE };
+/*
+ * Make an NFS client handle with the current credentials on socket
+ * 'sock' (connected when it is TCP), or on a socket of its own when
+ * that is RPC_ANYSOCK. The handle closes the socket when destroyed.
+ */
+CLIENT *
+attach_nfsclient(struct sockaddr_in *addr, int proto, int sock)
+{
+    CLIENT *clnt;
 
-    if ((ares = nfs3_setattr_3(&aargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_setattr");
-	return;
-    }
-    if (ares->status != NFS3_OK) {
-	fprintf(stderr, "Set attributes failed: %s\n", nfs_error(ares->status));
-	return;
+    if (proto == IPPROTO_TCP)
+	clnt = clnttcp_create(addr, NFS_PROGRAM, NFS_V3, &sock, 0, 0);
+    else
+	clnt = clntudp_bufcreate(addr, NFS_PROGRAM, NFS_V3, timeout, &sock,
+	    UDPBUFSIZE, UDPBUFSIZE);
+    if (clnt == NULL) {
+	clnt_pcreateerror(proto == IPPROTO_TCP ?
+	    "nfs clnttcp_create" : "nfs clntudp_create");
+	if (sock != RPC_ANYSOCK)
+	    close(sock);
+	return NULL;
     }
+    clnt_control(clnt, CLSET_FD_CLOSE, (char *)NULL);
+    clnt_control(clnt, CLSET_TIMEOUT, (char *)&timeout);
+    clnt->cl_auth = create_authenticator();
+    rpcstats_attach(clnt, NFS_PROGRAM);
+    return clnt;
 }
 
 /*
- * Put file from local to remote
+ * Set up the transport pool of a mount: the main thread's 'nfsclient'
+ * plus 'count' - 1 further connections to the same server. Each has
+ * a (privileged) port of its own, so the server sees separate flows
+ * it can spread over its cores and interfaces. The TCP handshakes
+ * all go on at the same time.
  */
 void
-do_put(int argc, char **argv)
+openconns(int count)
 {
-    LOOKUP3args dargs;
-    LOOKUP3res *dres;
-    CREATE3args cargs;
-    CREATE3res *cres;
-    char buf[BUFSIZ];
-    nfs_fh3 handle;
-    FILE *fp;
-    int n;
-    long offset;
-
-    if (mountpath == NULL) {
-	fprintf(stderr, "put: no remote file system mounted\n");
-	return;
-    }
-    if (argc != 2 && argc != 3) {
-	fprintf(stderr, "Usage: put <local-file> [<remote-file>]\n");
-	return;
-    }
-
-    if ((fp = fopen(argv[1], "r")) == NULL) {
-	fprintf(stderr, "put: cannot open %s\n", argv[1]);
-	return;
-    }
-
-    /*
-     * Create remote file name
-     */
-    cargs.where.name = argc == 3 ? argv[2] : argv[1];
-    nfs_fh3copy(&cargs.where.dir, &directory_handle);
-    cargs.how.mode = EXCLUSIVE;
-    cargs.how.createhow3_u.obj_attributes.mode  = (set_mode3) { .set_it=TRUE, .set_mode3_u.mode= 0666 };
-    cargs.how.createhow3_u.obj_attributes.uid   = (set_uid3)  { .set_it=TRUE, .set_uid3_u.uid=uid };
-    cargs.how.createhow3_u.obj_attributes.gid   = (set_gid3)  { .set_it=TRUE, .set_gid3_u.gid=gid };
-    cargs.how.createhow3_u.obj_attributes.size  = (set_size3) { .set_it=FALSE };
-    cargs.how.createhow3_u.obj_attributes.atime = (set_atime) { .set_it=FALSE };
-    cargs.how.createhow3_u.obj_attributes.mtime = (set_mtime) { .set_it=FALSE };
-
-    if ((cres = nfs3_create_3(&cargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_create");
-	fclose(fp);
+    struct sockaddr_in addr;
+    int socks[MAXCONNECT];
+    CLIENT *clnt;
+    int i, n;
+
+    if (count > MAXCONNECT)
+	count = MAXCONNECT;
+    nfsconns[0] = nfsclient;
+    connlent[0] = 1;		/* always in use by the main thread */
+    nnfsconns = 1;
+    if (count <= 1)
 	return;
-    }
-    if (cres->status != NFS3_OK)
-	fprintf(stderr, "WARNING: Create failed: %s\n", nfs_error(cres->status));
-
-    /*
-     * Look up remote file name, to get its handle
-     */
-    dargs.what.name = argc == 3 ? argv[2] : argv[1];
-    nfs_fh3copy(&dargs.what.dir, &directory_handle);
-    if ((dres = nfs3_lookup_3(&dargs, nfsclient)) == NULL) {
-	clnt_perror(nfsclient, "nfs3_lookup");
-	fclose(fp);
+    if (!clnt_control(nfsclient, CLGET_SERVER_ADDR, (char *)&addr)) {
+	fprintf(stderr, "mount: cannot get server address\n");
 	return;
     }
-    if (dres->status != NFS3_OK) {
-	fprintf(stderr, "%s: %s\n", argv[1], nfs_error(dres->status));
-	fclose(fp);
-	return;
+    for (n = 1; n < count; n++) {
+	if (nfsproto != IPPROTO_TCP)
+	    socks[n] = privileged(SOCK_DGRAM, NULL);
+	else if ((socks[n] = connectstart(&addr)) < 0)
+	    break;
     }
-    nfs_fh3copy(&handle, &dres->LOOKUP3res_u.resok.object);
-
-    for (offset = 0; (n = fread(buf, 1, sizeof(buf), fp)) > 0; offset += n) {
-	WRITE3args wargs;
-	WRITE3res *wres;
-
-	nfs_fh3copy(&wargs.file, &handle);
-	wargs.offset = offset;
-	wargs.count = n;
-	wargs.data.data_len = n;
-	wargs.data.data_val = buf;
-	if ((wres = nfs3_write_3(&wargs, nfsclient)) == NULL) {
-	    clnt_perror(nfsclient, "nfs3_write");
-	    fclose(fp);
-	    return;
-	}
-	if (wres->status != NFS3_OK) {
-	    fprintf(stderr, "Write failed: %s\n", nfs_error(wres->status));
-	    fclose(fp);
-	    return;
-	}
+    if (nfsproto == IPPROTO_TCP)
+	connectwait(socks + 1, n - 1);
+    for (i = 1; i < n; i++) {
+	if (nfsproto == IPPROTO_TCP && socks[i] < 0)
+	    continue;
+	if ((clnt = attach_nfsclient(&addr, nfsproto, socks[i])) == NULL)
+	    continue;
+	nfsconns[nnfsconns] = clnt;
+	connlent[nnfsconns++] = 0;
     }
-    fclose(fp);
+    if (nnfsconns < count)
+	fprintf(stderr, "mount: continuing with %d connections\n",
+	    nnfsconns);
 }
 
 /*
- * Get/set file handle
+ * Close all connections of the pool, 'nfsclient' included
  */
 void
-do_handle(int argc, char **argv)
+closeconns(void)
 {
-    int sock, port, flags;
-    register char *p;
-    register int i;
-
-    port = 0;
-    flags = 0;
-    argv++; argc--;
-    while (argc > 0 && argv[0][0] == '-') {
-	for (p = argv[0]+1; *p; p++) {
-	    switch (*p) {
-	    case 'P':
-		if (argc <= 1)
-		   goto usage;
-		argv++; argc--;
-		port = atoi(*argv);
-		break;
-	    case 'T':
-		flags |= NFS_OVER_TCP;
-		break;
-	    case 'U':
-		flags |= NFS_OVER_UDP;
-		break;
-	    default:
-		goto usage;
-	    }
-	}
-	argv++; argc--;
-    }
-    if (argc <= 1) {
-	if (mountpath == NULL) {
-	    fprintf(stderr, "handle: no remote file system mounted\n");
-	    return;
-	}
-	printf("%s:", mountpath);
-	for (i = 0, p = (char *)&directory_handle; i < sizeof(nfs_fh3); i++)
-	    printf(" %02x", *p++ & 0xFF);
-	printf("\n");
-	return;
+    if (nnfsconns == 0 && nfsclient != NULL) {
+	nfsconns[0] = nfsclient;
+	nnfsconns = 1;
     }
-
-    if (argc != sizeof(nfs_fh3)) {
-usage:
-	fprintf(stderr, "Usage: handle [-TU] <file handle>\n");
-	return;
+    while (nnfsconns > 0) {
+	nnfsconns--;
+	auth_destroy(nfsconns[nnfsconns]->cl_auth);
+	clnt_destroy(nfsconns[nnfsconns]);
     }
+    nfsclient = NULL;
+}
 
-    if (remotehost == NULL) {
-	fprintf(stderr, "handle: no host specified\n");
-	return;
+/*
+ * Get a connection for a worker thread: an idle one from the pool
+ * when there is one, otherwise a new one that putconn will close.
+ */
+CLIENT *
+getconn(void)
+{
+    int i;
+
+    pthread_mutex_lock(&connlock);
+    for (i = 1; i < nnfsconns; i++) {
+	if (!connlent[i]) {
+	    connlent[i] = 1;
+	    pthread_mutex_unlock(&connlock);
+	    return nfsconns[i];
+	}
     }
-
-    /* copy handle from command line argument */
-    for (i = 0, p = (char *)&directory_handle; i < sizeof(nfs_fh3); i++)
-	*p++ = (char) strtol(argv[i], NULL, 16);
-
-    open_nfs(NULL, port, flags);
+    pthread_mutex_unlock(&connlock);
+    return clone_nfsclient();
 }
 
 /*
- * Set up a channel to the NFS server and
- * mount remote file system.
+ * Give back a connection obtained from getconn
  */
 void
-do_mount(int argc, char **argv)
+putconn(CLIENT *clnt)
 {
-    int port, flags;
-    char *p, *path;
+    int i;
 
-    port = 0;
-    flags = 0;
-    argv++; argc--;
-    while (argc > 0 && argv[0][0] == '-') {
-	for (p = argv[0]+1; *p; p++) {
-	    switch (*p) {
-	    case 'u':
-		flags |= MOUNT_UMOUNT;
-		break;
-	    case 'p':
-		flags |= THRU_PORTMAP;
-		break;
-	    case 'P':
-		if (argc <= 1)
-		   goto usage;
-		argv++; argc--;
-		port = atoi(*argv);
-		break;
-	    case 'T':
-		flags |= NFS_OVER_TCP;
-		break;
-	    case 'U':
-		flags |= NFS_OVER_UDP;
-		break;
-	    default:
-		goto usage;
-	    }
+    pthread_mutex_lock(&connlock);
+    for (i = 1; i < nnfsconns; i++) {
+	if (nfsconns[i] == clnt) {
+	    connlent[i] = 0;
+	    pthread_mutex_unlock(&connlock);
+	    return;
 	}
-	argv++; argc--;
-    }
-    if (argc != 1) {
-usage:
-	fprintf(stderr, "Usage: mount [-upTU] [-P port] <path>\n");
-	return;
-    }
-    path = argv[0];
-    if (remotehost == NULL) {
-	fprintf(stderr, "mount: no host specified\n");
-	return;
     }
-    open_nfs(path, port, flags);
+    pthread_mutex_unlock(&connlock);
+    auth_destroy(clnt->cl_auth);
+    clnt_destroy(clnt);
 }
 
 /*
- * Unmount remote file system, and close
- * RPC channel.
+ * Tell rpcstats what a worker thread does; n numbers the workers of
+ * one command, or is -1. The shell's own thread keeps its name even
+ * when it takes part in the work.
  */
-/* ARGUSED */
 void
-do_umount(int argc, char **argv)
+threadname(char *what, int n)
 {
-    if (argc != 1) {
-	fprintf(stderr, "Usage: umount\n");
+    char name[RPCSTATS_NAMELEN];
+
+    if (pthread_equal(pthread_self(), shellthread))
 	return;
-    }
-    if (mountpath == NULL)
-	fprintf(stderr, "umount: no remote file system mounted\n");
+    if (n < 0)
+	snprintf(name, sizeof(name), "%s", what);
     else
-	close_nfs();
+	snprintf(name, sizeof(name), "%s worker %d", what, n);
+    rpcstats_name(name);
 }
 
 /*
- * Unmount all remote file system from this host
+ * Give every connection of the mount the current credentials
  */
-/* ARGUSED */
 void
-do_umountall(int argc, char **argv)
+setauth(void)
 {
-    if (argc != 1) {
-	fprintf(stderr, "Usage: umountall\n");
+    int i;
+
+    if (nfsclient == NULL)
 	return;
+    if (nnfsconns == 0) {
+	if (nfsclient->cl_auth)
+	    auth_destroy(nfsclient->cl_auth);
+	nfsclient->cl_auth = create_authenticator();
     }
-    if (remotehost == NULL) {
-	fprintf(stderr, "umountall: no host specified\n");
-	return;
+    for (i = 0; i < nnfsconns; i++) {
+	if (nfsconns[i]->cl_auth)
+	    auth_destroy(nfsconns[i]->cl_auth);
+	nfsconns[i]->cl_auth = create_authenticator();
     }
-    if (mountpath != NULL) close_nfs();
-    (void) mount3_umntall_3(NULL, mntclient);
 }
 
 /*
- * Display all exported file systems on remote system
+ * Open the pipes of a transfer: one on 'clnt', and one on each pool
+ * connection that is idle, which is lent to the transfer until
+ * closepipes. Calls go to the pipe with the fewest in flight.
  */
-/* ARGUSED */
-void
-do_export(int argc, char **argv)
+int
+openpipes(struct pipeset *ps, CLIENT *clnt, u_int bufsize)
 {
-    exports ex, *exp;
-    groups gr;
-    int hostsonly = 0;
+    struct rpcpipe *rp;
+    int i;
 
-    argv++; argc--;
-    if (argc >= 1 && strcmp(argv[0], "-h") == 0) {
-	argv++; argc--;
-	hostsonly = 1;
-    }
-    if (argc != 0) {
-	fprintf(stderr, "Usage: export [-h] \n");
-	return;
-    }
-    if (remotehost == NULL) {
-	fprintf(stderr, "export: no host specified\n");
-	return;
+    ps->ps_count = 0;
+    if (!rpcloop_open(&ps->ps_loop)) {
+	clnt_perrno(RPC_SYSTEMERROR);
+	return 0;
     }
-    if ((exp = mount3_export_3(NULL, mntclient)) == NULL) {
-	clnt_perror(mntclient, "mountproc_export");
-	return;
+    if (!rpcpipe_open(&ps->ps_pipe[0], clnt, NFS_PROGRAM, NFS_V3, bufsize) ||
+      !rpcloop_add(&ps->ps_loop, &ps->ps_pipe[0])) {
+	clnt_perrno(ps->ps_pipe[0].rp_stat);
+	free(ps->ps_pipe[0].rp_buf);
+	rpcloop_close(&ps->ps_loop);
+	return 0;
     }
-    printf("Export list for %s:\n", remotehost);
-    for (ex = *exp; ex != NULL; ex = ex->ex_next) {
-	printf("%-25s", ex->ex_dir);
-	if (hostsonly == 0) {
-	    if ((int)strlen(ex->ex_dir) >= 25)
-		printf("\n                    ");
-	    if ((gr = ex->ex_groups) == NULL)
-		printf("everyone");
-	    while (gr) {
-		printf("%s ", gr->gr_name);
-		gr = gr->gr_next;
-	    }
+    ps->ps_slot[0] = -1;
+    ps->ps_count = 1;
+
+    pthread_mutex_lock(&connlock);
+    for (i = 1; i < nnfsconns; i++) {
+	if (connlent[i] || nfsconns[i] == clnt)
+	    continue;
+	rp = &ps->ps_pipe[ps->ps_count];
+	if (!rpcpipe_open(rp, nfsconns[i], NFS_PROGRAM, NFS_V3, bufsize) ||
+	  !rpcloop_add(&ps->ps_loop, rp)) {
+	    free(rp->rp_buf);
+	    continue;
 	}
-	putchar('\n');
+	connlent[i] = 1;
+	ps->ps_slot[ps->ps_count++] = i;
     }
+    pthread_mutex_unlock(&connlock);
+    return 1;
 }
 
 /*
- * Display all remote mounted file systems
+ * Close the pipes of a transfer and give back the borrowed connections
  */
-/* ARGUSED */
 void
-do_dump(int argc, char **argv)
+closepipes(struct pipeset *ps)
 {
-    mountlist ml, *mlp;
+    int i;
 
-    if (argc != 1) {
-	fprintf(stderr, "Usage: dump\n");
-	return;
-    }
-    if (remotehost == NULL) {
-	fprintf(stderr, "dump: no host specified\n");
-	return;
-    }
-    if ((mlp = mount3_dump_3(NULL, mntclient)) == NULL) {
-	clnt_perror(mntclient, "mountproc_dump");
-	return;
+    pthread_mutex_lock(&connlock);
+    for (i = 0; i < ps->ps_count; i++) {
+	rpcpipe_close(&ps->ps_pipe[i]);
+	if (ps->ps_slot[i] >= 0)
+	    connlent[ps->ps_slot[i]] = 0;
     }
-    for (ml = *mlp; ml != NULL; ml = ml->ml_next)
-	printf("%s:%s\n", ml->ml_hostname, ml->ml_directory);
+    pthread_mutex_unlock(&connlock);
+    rpcloop_close(&ps->ps_loop);
+    ps->ps_count = 0;
 }
 
 /*
- * Generic status report
+ * Number of calls in flight on all pipes of a transfer
  */
-/* ARGUSED */
-void
-do_status(int argc, char **argv)
+int
+pipesbusy(struct pipeset *ps)
 {
-    if (argc != 1) {
-	fprintf(stderr, "Usage: status\n");
-	return;
-    }
-    printf("User id      : %d\n", uid);
-    printf("Group id     : %d\n", gid);
-    if (remotehost)
-	printf("Remote host  : `%s'\n", remotehost);
-    if (mountpath)
-	printf("Mount path   : `%s'\n", mountpath);
-    printf("Transfer size: %d\n", transfersize);
+    int i, n;
+
+    for (i = n = 0; i < ps->ps_count; i++)
+	n += ps->ps_pipe[i].rp_outstanding;
+    return n;
 }
 
 /*
- * Simple on-line help facility
+ * Number of UDP retransmissions on all pipes of a transfer
  */
-/* ARGUSED */
-void
-do_help(int argc, char **argv)
+int
+pipesretrans(struct pipeset *ps)
 {
-    register int i;
+    int i, n;
 
-    for (i = 0; i < sizeof(keyword)/sizeof(struct keyword); i++) {
-	if (argc == 2 && strcmp(keyword[i].kw_command, argv[1]) != 0)
-	    continue;
-	printf("%s %s\n", keyword[i].kw_command, keyword[i].kw_help);
-    }
+    for (i = n = 0; i < ps->ps_count; i++)
+	n += ps->ps_pipe[i].rp_retrans;
+    return n;
 }
 
 /*
- * Open a channel to remote Mount daemon, possibly closing an
- * already open connection. There are four possibilities here.
- * Either the channel has a privileged port number or not, and
- * it is a TCP stream or an UDP stream.
+ * Make a mount call via the port mapper
  */
 int
-open_mount(char *host)
+pmap_mnt(dirpath *argp, struct sockaddr_in *server_addr, mountres3 *res)
 {
-    char *tmp, *src = 0;
-    int proto, sock;
+    enum clnt_stat stat;
+    u_long port;
 
-    tmp = strrchr(host,':');
-    if (tmp) {
-	src = host;
-	host = tmp+1;
-    } else if ((tmp = strchr(host,'@'))) {
-	src = host;
-	host = tmp+1;
+    if ((stat = pmap_rmtcall(server_addr, MOUNT_PROGRAM, MOUNT_V3,
+      MOUNT3_MNT, (xdrproc_t)xdr_dirpath, (caddr_t) argp,
+      (xdrproc_t) xdr_mountres3, (caddr_t)res, timeout, &port)) != RPC_SUCCESS){
+	clnt_perrno(stat);
+	return 0;
     }
-    /* close previous mounted host */
-    if (remotehost != NULL)
-	close_mount();
+    return 1;
 
-    /* convert hostname to IP address */
-    if (isdigit(*host)) {
-        server_addr.sin_addr.s_addr = inet_addr(host);
-    } else {
-        struct hostent *hp = gethostbyname(host);
-        if (hp == NULL) {
-            fprintf(stderr, "%s: unknown host\n", host);
-	    return 0;
-        }
-        memcpy(&server_addr.sin_addr.s_addr, hp->h_addr, hp->h_length);
-        host = (char *) hp->h_name;
-    }
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = 0;
+/*
+       enum clnt_stat pmap_rmtcall(struct sockaddr_in *addr,
+                           unsigned long prognum, unsigned long versnum,
+                           unsigned long procnum,
+                           xdrproc_t inproc, char *in,
+                           xdrproc_t outproc, char *out,
+                           struct timeval tout, unsigned long *portp);
+*/
 
-    /* set host name */
-    if ((remotehost = strdup(host)) == NULL) {
-	fprintf(stderr, "internal error: no more core for host\n");
-	return 0;
-    }
+}
 
-    /* setup communication channel with mount daemon */
-    proto = IPPROTO_TCP;
-    mntserver_addr = server_addr;
-    if (src)
-	sock = sourceroute(src, &mntserver_addr, MOUNT_PROGRAM, MOUNT_V3);
-    else
-	sock = setup(SOCK_STREAM, &mntserver_addr, MOUNT_PROGRAM, MOUNT_V3);
+/*
+ * Determine NFS server's transfer sizes and pick the ones to use
+ */
+void
+determine_xferprofile(void)
+{
+    struct probe probe;
 
-    if ((mntclient = clnttcp_create(&mntserver_addr,
-      MOUNT_PROGRAM, MOUNT_V3, &sock, 0, 0)) == (CLIENT *)0) {
-	clnt_pcreateerror("mount/tcp");
-	if (sock != RPC_ANYSOCK)
-	    close(sock);
-	proto = IPPROTO_UDP;
-	sock = setup(SOCK_DGRAM, &mntserver_addr, MOUNT_PROGRAM, MOUNT_V3);
-	if ((mntclient = clntudp_create(&mntserver_addr,
-	  MOUNT_PROGRAM, MOUNT_V3, timeout, &sock)) == (CLIENT *)0) {
-	    clnt_pcreateerror("mount");
-	    if (sock != RPC_ANYSOCK)
-		close(sock);
-	    return 0;
+    probestart(&probe);
+    probefinish(&probe);
+}
+
+/*
+ * Send FSINFO, GETATTR and FSSTAT for the mount point all at once
+ */
+void
+probestart(struct probe *pr)
+{
+    memset(pr, 0, sizeof(*pr));
+    pr->pr_fsinfo.status = NFS3ERR_SERVERFAULT;
+    pr->pr_getattr.status = NFS3ERR_SERVERFAULT;
+    pr->pr_fsstat.status = NFS3ERR_SERVERFAULT;
+    nfs_fh3copy(&pr->pr_root, &directory_handle);
+    if (!rpcpipe_open(&pr->pr_pipe, nfsclient, NFS_PROGRAM, NFS_V3,
+      RPCSMALLMSGSIZE))
+	return;
+    pr->pr_open = 1;
+    (void) rpcpipe_send(&pr->pr_pipe, &pr->pr_call[0], NFS3_FSINFO,
+	(xdrproc_t) xdr_nfs_fh3, (caddr_t) &pr->pr_root,
+	(xdrproc_t) xdr_FSINFO3res, (caddr_t) &pr->pr_fsinfo);
+    (void) rpcpipe_send(&pr->pr_pipe, &pr->pr_call[1], NFS3_GETATTR,
+	(xdrproc_t) xdr_nfs_fh3, (caddr_t) &pr->pr_root,
+	(xdrproc_t) xdr_GETATTR3res, (caddr_t) &pr->pr_getattr);
+    (void) rpcpipe_send(&pr->pr_pipe, &pr->pr_call[2], NFS3_FSSTAT,
+	(xdrproc_t) xdr_nfs_fh3, (caddr_t) &pr->pr_root,
+	(xdrproc_t) xdr_FSSTAT3res, (caddr_t) &pr->pr_fsstat);
+}
+
+/*
+ * Collect the replies to probestart and set the transfer sizes. A
+ * mount point whose attributes cannot be had is no good, but let the
+ * commands that use it say so too.
+ */
+void
+probefinish(struct probe *pr)
+{
+    FSINFO3resok *resok = &pr->pr_fsinfo.FSINFO3res_u.resok;
+    nfsstat3 *status[3];
+    int i, got[3] = { 0, 0, 0 };
+    struct rpccall *rc;
+
+    status[0] = &pr->pr_fsinfo.status;
+    status[1] = &pr->pr_getattr.status;
+    status[2] = &pr->pr_fsstat.status;
+    if (pr->pr_open) {
+	while (pr->pr_pipe.rp_outstanding > 0) {
+	    if ((rc = rpcpipe_recv(&pr->pr_pipe)) == NULL)
+		break;
+	    got[rc - pr->pr_call] = rc->rc_stat == RPC_SUCCESS;
 	}
+	rpcpipe_close(&pr->pr_pipe);
+	for (i = 0; i < 3; i++)
+	    rpccall_free(&pr->pr_call[i]);
     }
-    clnt_control(mntclient, CLSET_TIMEOUT, (char *)&timeout);
-    clnt_control(mntclient, CLSET_FD_CLOSE, (char *)NULL);
-    mntclient->cl_auth = create_authenticator();
-    if (verbose) {
-	printf("Open %s (%s) %s\n",
-	    remotehost, inet_ntoa(server_addr.sin_addr),
-	    proto == IPPROTO_TCP ? "TCP" : "UDP");
+    for (i = 0; i < 3; i++)
+	if (!got[i])
+	    *status[i] = NFS3ERR_SERVERFAULT;
+    if (got[1] && pr->pr_getattr.status != NFS3_OK)
+	fprintf(stderr, "Warning: mount point: %s\n",
+	    nfs_error(pr->pr_getattr.status));
+
+    if (pr->pr_fsinfo.status != NFS3_OK) {
+	xfer.xp_rtmax = xfer.xp_rtpref = DIRCOUNT;
+	xfer.xp_wtmax = xfer.xp_wtpref = DIRCOUNT;
+	xfer.xp_dtpref = DIRCOUNT;
+    } else {
+	xfer.xp_rtmax = resok->rtmax;
+	xfer.xp_rtpref = resok->rtpref;
+	xfer.xp_wtmax = resok->wtmax;
+	xfer.xp_wtpref = resok->wtpref;
+	xfer.xp_dtpref = resok->dtpref;
     }
-    return 1;
+    set_xferprofile();
 }
 
 /*
- * Close channel to mount daemon,
- * possibly umounting a NFS file system.
+ * Pick the transfer sizes to use from the server's limits
  */
 void
-close_mount(void)
+set_xferprofile(void)
 {
-    if (mountpath) close_nfs();
-    if (verbose) printf("Close `%s'\n", remotehost);
-    free(remotehost);
-    remotehost = NULL;
-    if (mntclient) {
-	auth_destroy(mntclient->cl_auth);
-	clnt_destroy(mntclient);
+    u_int cap = nfsproto == IPPROTO_UDP ? UDPMAXXFER : MAXXFER;
+
+    /* a preference beyond the maximum (or none at all) means the maximum */
+    xfer.xp_rmax = xfer.xp_rtpref;
+    if (xfer.xp_rmax == 0 || xfer.xp_rmax > xfer.xp_rtmax)
+	xfer.xp_rmax = xfer.xp_rtmax;
+    xfer.xp_wmax = xfer.xp_wtpref;
+    if (xfer.xp_wmax == 0 || xfer.xp_wmax > xfer.xp_wtmax)
+	xfer.xp_wmax = xfer.xp_wtmax;
+    xfer.xp_rmax = MAX(MIN(xfer.xp_rmax, cap), 512);
+    xfer.xp_wmax = MAX(MIN(xfer.xp_wmax, cap), 512);
+    xfer.xp_dsize = xfer.xp_dtpref ? xfer.xp_dtpref : DIRCOUNT;
+    xfer.xp_dsize = MAX(MIN(xfer.xp_dsize, xfer.xp_rmax), 512);
+
+    xfer.xp_rceil = xfer.xp_rmax;
+    xfer.xp_wceil = xfer.xp_wmax;
+    if (nfsproto == IPPROTO_UDP) {
+	xfer.xp_rsize = MIN(UDPXFER, xfer.xp_rmax);
+	xfer.xp_wsize = MIN(UDPXFER, xfer.xp_wmax);
+    } else {
+	xfer.xp_rsize = xfer.xp_rmax;
+	xfer.xp_wsize = xfer.xp_wmax;
     }
 }
 
-struct in_addr
-convert_name(char *host)
+/*
+ * Enter the current mount point and its FSINFO limits in the
+ * persistent cache
+ */
+void
+cache_mount(void)
 {
-    struct in_addr ret;
+    struct mntcache_fsinfo fsinfo;
+
+    fsinfo.mf_rtmax = xfer.xp_rtmax;
+    fsinfo.mf_rtpref = xfer.xp_rtpref;
+    fsinfo.mf_wtmax = xfer.xp_wtmax;
+    fsinfo.mf_wtpref = xfer.xp_wtpref;
+    fsinfo.mf_dtpref = xfer.xp_dtpref;
+    mntcache_putmount(server_addr.sin_addr, mountpath,
+	&mountpoint->mountres3_u.mountinfo.fhandle, &fsinfo);
+}
 
-    ret.s_addr = ~0;
-    /* convert hostname to IP address */
-    if (isdigit(*host)) {
-        ret.s_addr = inet_addr(host);
-    } else {
-        struct hostent *hp = gethostbyname(host);
-        if (hp == NULL) {
-            fprintf(stderr, "%s: unknown host\n", host);
-	    return ret;
-        }
-        memcpy(&ret.s_addr, hp->h_addr, hp->h_length);
+/*
+ * Mount the current path again, after the cached mount point
+ * handle turned out to be stale
+ */
+int
+remount(void)
+{
+    xdr_free((xdrproc_t) xdr_mountres3, (char *) &mountres);
+    memset(&mountres, 0, sizeof(mountres));
+    mountcached = 0;
+    if (mount3_mnt_3(&mountpath, mountpoint, mntclient) != RPC_SUCCESS) {
+	clnt_perror(mntclient, "mount3_mnt");
+	return 0;
     }
-    return ret;
+    if (mountpoint->fhs_status != MNT3_OK) {
+	fprintf(stderr, "Mount failed: %s\n",
+	    nfs_error(mountpoint->fhs_status));
+	return 0;
+    }
+    fhandle3_to_nfs_fh3(&root_handle, &mountpoint->mountres3_u.mountinfo.fhandle);
+    nfs_fh3copy(&directory_handle, &root_handle);
+    determine_xferprofile();
+    cache_mount();
+    dnlc_purge();
+    bcache_purge();
+    pathcache_purge();
+    return 1;
 }
 
 /*
- * Set the source route attributes for a socket.
- * Source route attributes have the following form:
- *
- * [<localaddr>]@[<host>:...]<dest>
+ * The server called 'fh' stale. If it is the mount point or the
+ * current directory and came from the persistent cache, get a fresh
+ * one: mount again, or walk the path of the current directory again.
+ * Returns 1 when *fh was replaced and the call should be retried.
  */
 int
-sourceroute(char *src, struct sockaddr_in *svr, int prog, int vers)
+revalidate(nfs_fh3 *fh)
 {
-    char *ind = strchr(src,'@');
-    char ipopts[32];
-    char *opts = ipopts+3;
-    int sock;
+    nfs_fh3 handle;
+    int isroot, iscwd;
+    char *path;
 
-    memset(ipopts, 0, sizeof(ipopts));
+    if (concurrent || mountpath == NULL || (!mountcached && !cwdcached))
+	return 0;
+    isroot = mountcached && nfs_fh3equal(fh, &root_handle);
+    iscwd = nfs_fh3equal(fh, &directory_handle);
+    if (!isroot && !(iscwd && (cwdcached || mountcached)))
+	return 0;
 
-    if (ind == src) {
-	sock = privileged(SOCK_STREAM, NULL);
-    } else {
-	/* convert address and bind */
-	struct sockaddr_in sin;
+    if (verbose)
+	printf("Stale cached handle, looking up `%s' again\n", mountpath);
+    mntcache_forget(server_addr.sin_addr, mountpath, !isroot);
+    if (mountcached && !remount())
+	return 0;
 
-	*ind = '\0';
-	memset(&sin, 0, sizeof(sin));
-	sin.sin_family = AF_INET;
-	sin.sin_addr = convert_name(src);
+    /* remount left us in the root, go back to where we were */
+    cwdcached = 0;
+    if (cwdpath != NULL && strcmp(cwdpath, "/") != 0) {
+	if ((path = strdup(cwdpath)) == NULL || !walkpath(path, &handle)) {
+	    free(path);
+	    return 0;
+	}
+	free(path);
+	nfs_fh3copy(&directory_handle, &handle);
+	mntcache_putpath(server_addr.sin_addr, mountpath, cwdpath, &handle);
+    } else
+	nfs_fh3copy(&directory_handle, &root_handle);
 
-	sock = privileged(SOCK_STREAM, &sin);
-	if (sock == RPC_ANYSOCK) {
-	    sin.sin_port = 0;
-	    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	    if (bind(sock, (struct sockaddr *)&sin, sizeof(sin)) != 0) {
-		fprintf(stderr,"Couldn't bind to src %s\n", src);
-		close(sock);
-		return RPC_ANYSOCK;
-	    }
-	} else if (verbose)
-	    printf("Bound to %s\n", src);
+    if (fh != &directory_handle) {
+	if (iscwd)
+	    nfs_fh3copy(fh, &directory_handle);
+	else
+	    nfs_fh3copy(fh, &root_handle);
     }
-    if (ind == 0)
-	return 0;
-    src = ++ind;
+    return 1;
+}
 
-    ipopts[0] = (char) IPOPT_LSRR;
-    ipopts[2] = (char) IPOPT_MINOFF;
-    while (src && *src) {
-	struct in_addr addr;
-	ind = strchr(src, ':');
-	if (ind)
-	    *ind++ = '\0';
-	addr = convert_name(src);
-	if (verbose)
-	    printf("Routed through %s\n", inet_ntoa(addr));
-	memcpy(opts, &addr.s_addr, 4); opts += 4;
-	src = ind;
+/*
+ * Adjust a UDP transfer size after a window full of calls. Without
+ * retransmissions the size is doubled, up to its ceiling; when calls
+ * had to be sent again the size is halved and the ceiling comes down
+ * with it, so we do not keep probing a size the path cannot carry.
+ * Returns the size to use from now on.
+ */
+u_int
+adaptsize(u_int *size, u_int *ceil, int how)
+{
+    u_int n;
+
+    pthread_mutex_lock(&xferlock);
+    if (how == XFER_GROW && *size < *ceil)
+	*size = MIN(*size * 2, *ceil);
+    else if (how == XFER_SHRINK && *size > UDPXFER) {
+	*size = MAX(*size / 2, UDPXFER);
+	*ceil = *size;
     }
-    ipopts[IPOPT_OLEN] = opts - ipopts;
-    while ((opts - ipopts) & 3)
-	opts++;
-    if (setsockopt(sock, IPPROTO_IP,IP_OPTIONS, ipopts, opts - ipopts) == -1) {
-	perror("setsockopt");
-	return RPC_ANYSOCK;
+    n = *size;
+    pthread_mutex_unlock(&xferlock);
+    return n;
+}
+
+/*
+ * Look up the ports of MOUNT and NFS, over TCP and UDP, on host 'svr'.
+ * What the persistent cache does not know is asked of the portmapper
+ * in one go: the GETPORT calls travel over a single datagram socket,
+ * so together they take one round trip rather than one each.
+ */
+void
+getports(struct sockaddr_in *svr)
+{
+    struct rpccall calls[NHOSTPORT];
+    struct pmap maps[NHOSTPORT];
+    u_long ports[NHOSTPORT];
+    struct sockaddr_in addr;
+    struct hostport *hp;
+    struct rpcpipe rp;
+    struct rpccall *rc;
+    AUTH *auth = NULL;
+    int i, s, n = 0;
+
+    memset(calls, 0, sizeof(calls));
+    for (i = 0; i < NHOSTPORT; i++) {
+	hp = &hostports[i];
+	hp->hp_valid = 1;
+	hp->hp_port = 0;
+	hp->hp_cached = mntcache_getport(svr->sin_addr,
+	    hp->hp_prog, hp->hp_vers, hp->hp_proto, &hp->hp_port);
+	if (!hp->hp_cached)
+	    n++;
     }
+    if (n == 0)
+	return;
 
-    svr->sin_port = pmap_getport(svr, prog, vers, IPPROTO_TCP);
-    svr->sin_port = htons(svr->sin_port);
-    if (connect(sock, (struct sockaddr *) svr, sizeof(*svr)) != 0) {
-	perror("connect");
-	return RPC_ANYSOCK;
+    /* unanswered ones stay unregistered, as with pmap_getport */
+    addr = *svr;
+    addr.sin_port = htons(PMAPPORT);
+    if ((s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+	perror("portmap socket");
+	return;
+    }
+    if (connect(s, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      (auth = authnone_create()) == NULL ||
+      !rpcpipe_openfd(&rp, s, auth, PMAPPROG, PMAPVERS, RPCSMALLMSGSIZE)) {
+	perror("portmap");
+	if (auth != NULL)
+	    auth_destroy(auth);
+	close(s);
+	return;
+    }
+    rp.rp_addr = addr;
+    rp.rp_timeout = timeout;
+    for (i = n = 0; i < NHOSTPORT; i++) {
+	hp = &hostports[i];
+	if (hp->hp_cached)
+	    continue;
+	maps[i].pm_prog = hp->hp_prog;
+	maps[i].pm_vers = hp->hp_vers;
+	maps[i].pm_prot = hp->hp_proto;
+	maps[i].pm_port = 0;
+	ports[i] = 0;
+	if (rpcpipe_send(&rp, &calls[i], PMAPPROC_GETPORT,
+	  (xdrproc_t) xdr_pmap, (caddr_t) &maps[i],
+	  (xdrproc_t) xdr_u_long, (caddr_t) &ports[i]))
+	    n++;
+    }
+    for (; n > 0; n--) {
+	if ((rc = rpcpipe_recv(&rp)) == NULL) {
+	    fprintf(stderr, "portmap: %s\n", clnt_sperrno(rp.rp_stat));
+	    break;
+	}
+	if (rc->rc_stat != RPC_SUCCESS)
+	    continue;
+	hp = &hostports[rc - calls];
+	hp->hp_port = htons((u_short) ports[rc - calls]);
+	if (hp->hp_port != 0)
+	    mntcache_putport(svr->sin_addr,
+		hp->hp_prog, hp->hp_vers, hp->hp_proto, hp->hp_port);
     }
-    return sock;
+    rpcpipe_close(&rp);
+    for (i = 0; i < NHOSTPORT; i++)
+	rpccall_free(&calls[i]);
+    auth_destroy(auth);
+    close(s);
 }
 
 /*
- * Mount an NFS file system, perhaps closing a previous mounted
- * one. The umount option fools the accounting system. The portmap
- * option allows mounts via the portmapper and transport allows
- * you to choose the transport type (TCP or UDP).
+ * Fill in the port of program 'prog' on 'svr', from what getports
+ * found, the persistent cache or else the portmapper. Returns 1 when
+ * the port came from a cache and may be out of date.
  */
 int
-open_nfs(char *path, int port, int flags)
+getport(struct sockaddr_in *svr, u_long prog, u_long vers, int proto)
 {
-    int proto, sock;
-
-    /* umount previous mounted remote file system */
-    if (mountpath != NULL)
-	close_nfs();
-
-    /* set up an connection with the NFS server */
-    switch (flags & TRANSPORT_MASK) {
-    case NFS_OVER_UDP:
-	/* try using NFS over UDP (standard Sun setup) */
-	proto = IPPROTO_UDP;
-	nfsserver_addr = server_addr;
-	nfsserver_addr.sin_port = ntohs(port);
-	sock = setup(SOCK_DGRAM, &mntserver_addr, NFS_PROGRAM, NFS_V3);
-	if ((nfsclient = clntudp_create(&nfsserver_addr,
-	  NFS_PROGRAM, NFS_V3, timeout, &sock)) == (CLIENT *)0) {
-	    clnt_pcreateerror("nfs clntudp_create");
-	    if (sock != RPC_ANYSOCK)
-		close(sock);
-	    return 0;
-	}
-	break;
-    case NFS_OVER_TCP:
-	/* try using NFS over TCP (standard Sun setup) */
-	proto = IPPROTO_TCP;
-	nfsserver_addr = server_addr;
-	nfsserver_addr.sin_port = ntohs(port);
-	sock = setup(SOCK_STREAM, &mntserver_addr, NFS_PROGRAM, NFS_V3);
-	if ((nfsclient = clnttcp_create(&nfsserver_addr,
-	  NFS_PROGRAM, NFS_V3, &sock, 0, 0)) == (CLIENT *)0) {
-	    clnt_pcreateerror("nfs clnttcp_create");
-	    if (sock != RPC_ANYSOCK)
-		close(sock);
-	    return 0;
-	}
-	break;
-    default:
-	/* try using NFS over TCP, if that fails try UDP */
-	proto = IPPROTO_TCP;
-	nfsserver_addr = server_addr;
-	nfsserver_addr.sin_port = ntohs(port);
-	sock = setup(SOCK_STREAM, &mntserver_addr, NFS_PROGRAM, NFS_V3);
-	if ((nfsclient = clnttcp_create(&nfsserver_addr,
-	  NFS_PROGRAM, NFS_V3, &sock, 0, 0)) == (CLIENT *)0) {
-	    proto = IPPROTO_UDP;
-	    nfsserver_addr = server_addr;
-	    nfsserver_addr.sin_port = ntohs(port);
-	    if (sock != RPC_ANYSOCK)
-		close(sock);
-	    sock = setup(SOCK_DGRAM, &mntserver_addr, NFS_PROGRAM, NFS_V3);
-	    if ((nfsclient = clntudp_create(&nfsserver_addr,
-	      NFS_PROGRAM, NFS_V3, timeout, &sock)) == (CLIENT *)0) {
-		clnt_pcreateerror("nfs clntudp_create");
-		if (sock != RPC_ANYSOCK)
-		    close(sock);
-		return 0;
+    struct hostport *hp;
+    int i;
+
+    if (svr->sin_addr.s_addr == server_addr.sin_addr.s_addr) {
+	for (i = 0; i < NHOSTPORT; i++) {
+	    hp = &hostports[i];
+	    if (hp->hp_valid && hp->hp_prog == prog &&
+	      hp->hp_vers == vers && hp->hp_proto == proto) {
+		svr->sin_port = hp->hp_port;
+		return hp->hp_cached;
 	    }
 	}
     }
-    clnt_control(nfsclient, CLSET_TIMEOUT, (char *)&timeout);
-    clnt_control(mntclient, CLSET_FD_CLOSE, (char *)NULL);
-    nfsclient->cl_auth = create_authenticator();
+    if (mntcache_getport(svr->sin_addr, prog, vers, proto, &svr->sin_port))
+	return 1;
+    svr->sin_port = htons(pmap_getport(svr, prog, vers, proto));
+    if (svr->sin_port != 0)
+	mntcache_putport(svr->sin_addr, prog, vers, proto, svr->sin_port);
+    return 0;
+}
+
+/*
+ * Drop a port that turned out to be out of date, so that getport
+ * asks the portmapper again
+ */
+void
+forgetport(struct sockaddr_in *svr, u_long prog, u_long vers, int proto)
+{
+    int i;
+
+    mntcache_putport(svr->sin_addr, prog, vers, proto, 0);
+    if (svr->sin_addr.s_addr != server_addr.sin_addr.s_addr)
+	return;
+    for (i = 0; i < NHOSTPORT; i++)
+	if (hostports[i].hp_prog == prog && hostports[i].hp_vers == vers &&
+	  hostports[i].hp_proto == proto)
+	    hostports[i].hp_valid = 0;
+}
+
+/*
+ * Set out for program 'prog' on 'svr' over TCP, UDP or both. An
+ * explicit port in 'svr' is used as is for either.
+ */
+void
+racestart(struct race *ra, struct sockaddr_in *svr, u_long prog, u_long vers,
+    int tcp, int udp)
+{
+    memset(ra, 0, sizeof(*ra));
+    ra->ra_prog = prog;
+    ra->ra_vers = vers;
+    ra->ra_tcp = ra->ra_udp = -1;
+    ra->ra_tcpaddr = ra->ra_udpaddr = *svr;
+    if (tcp) {
+	if (svr->sin_port == 0)
+	    ra->ra_tcpcached = getport(&ra->ra_tcpaddr,
+		prog, vers, IPPROTO_TCP);
+	if ((ra->ra_tcp = connectstart(&ra->ra_tcpaddr)) < 0)
+	    ra->ra_tcperr = errno;
+    }
+    if (udp) {
+	if (svr->sin_port == 0)
+	    ra->ra_udpcached = getport(&ra->ra_udpaddr,
+		prog, vers, IPPROTO_UDP);
+	ra->ra_udp = connectudp(&ra->ra_udpaddr);
+    }
 
     /*
-     * When no path is given we assume the caller
-     * set the directory file handle.
+     * UDP gets through without an answer to a call, unless it has to
+     * beat TCP or its port is one the server may have moved from
      */
-    if (path != NULL) {
-	/*
-	 * Get file handle for this path from the mount daemon. There
-	 * are two ways to get it, either ask it directly or get it
-	 * through the port mapper.
-	 */
-	if (flags & THRU_PORTMAP) {
-	    if ((mountpoint = pmap_mnt(&path, &mntserver_addr)) == NULL)
-		return 0;
-	} else if ((mountpoint = mount3_mnt_3(&path, mntclient)) == NULL) {
-	    clnt_perror(mntclient, "mount3_mnt");
-	    return 0;
+    if (!tcp && !ra->ra_udpcached)
+	return;
+    if (ra->ra_udp < 0 || (ra->ra_auth = authnone_create()) == NULL)
+	return;
+    if (rpcpipe_openfd(&ra->ra_pipe, ra->ra_udp, ra->ra_auth,
+      prog, vers, RPCSMALLMSGSIZE)) {
+	ra->ra_pipe.rp_addr = ra->ra_udpaddr;
+	ra->ra_pipe.rp_timeout = timeout;
+	ra->ra_probing = rpcpipe_send(&ra->ra_pipe, &ra->ra_call, NULLPROC,
+	    (xdrproc_t) xdr_void, NULL, (xdrproc_t) xdr_void, NULL);
+    }
+}
+
+/*
+ * Wait for the winner of a race. Returns its protocol, with the
+ * socket in 'sockp' and the server address in 'svr', or 0 when
+ * neither got through.
+ */
+int
+racefinish(struct race *ra, int *sockp, struct sockaddr_in *svr)
+{
+    struct timeval start, answered;
+    struct pollfd pfd[2];
+    struct rpccall *rc;
+    int i, n, err, proto = 0, udpok = 0;
+    long wait;
+    socklen_t len;
+
+    gettimeofday(&start, NULL);
+    while (proto == 0) {
+	if (ra->ra_tcp < 0) {
+	    if (ra->ra_udp < 0)
+		break;
+	    if (!ra->ra_probing || udpok) {
+		proto = IPPROTO_UDP;
+		break;
+	    }
+	    /* only UDP is left, let rpcpipe retransmit the call */
+	    rc = rpcpipe_recv(&ra->ra_pipe);
+	    if (rc != NULL && rc->rc_stat == RPC_SUCCESS) {
+		proto = IPPROTO_UDP;
+		break;
+	    }
+	    rpcpipe_close(&ra->ra_pipe);
+	    ra->ra_probing = 0;
+	    close(ra->ra_udp);
+	    ra->ra_udp = -1;
+	    if (ra->ra_udpcached) {
+		/* the server moved since, trust the portmapper */
+		forgetport(&ra->ra_udpaddr,
+		    ra->ra_prog, ra->ra_vers, IPPROTO_UDP);
+		ra->ra_udpcached = getport(&ra->ra_udpaddr,
+		    ra->ra_prog, ra->ra_vers, IPPROTO_UDP);
+		ra->ra_udp = connectudp(&ra->ra_udpaddr);
+		continue;
+	    }
+	    break;
 	}
-	if (mountpoint->fhs_status != MNT3_OK) {
-            fprintf(stderr, "Mount failed: %s\n",
-		nfs_error(mountpoint->fhs_status));
-	    return 0;
+	wait = timeout.tv_sec * 1000L + timeout.tv_usec / 1000 -
+	    msecsince(&start);
+	if (udpok)
+	    wait = MIN(wait, RACEDELAY - msecsince(&answered));
+	if (wait <= 0) {
+	    if (udpok)
+		proto = IPPROTO_UDP;
+	    else
+		ra->ra_tcperr = ETIMEDOUT;
+	    break;
 	}
-	fhandle3_to_nfs_fh3(&directory_handle, &mountpoint->mountres3_u.mountinfo.fhandle);
 
-	/* we got the file handle, unmount if don't want to get noticed */
-	if (flags & MOUNT_UMOUNT)
-	    (void) mount3_umnt_3(&path, mntclient);
+	n = 0;
+	pfd[n].fd = ra->ra_tcp;
+	pfd[n++].events = POLLOUT;
+	if (ra->ra_probing && !udpok) {
+	    pfd[n].fd = ra->ra_udp;
+	    pfd[n++].events = POLLIN;
+	}
+	for (i = 0; i < n; i++)
+	    pfd[i].revents = 0;
+	if (poll(pfd, n, (int) wait) < 0 && errno != EINTR) {
+	    ra->ra_tcperr = errno;
+	    break;
+	}
 
-	/* set mount path */
-	if ((mountpath = strdup(path)) == NULL) {
-	    fprintf(stderr, "internal error: no more core for mountpath\n");
-	    return 0;
+	if (n > 1 && pfd[1].revents != 0) {
+	    rc = rpcpipe_recv(&ra->ra_pipe);
+	    if (rc != NULL && rc->rc_stat == RPC_SUCCESS) {
+		udpok = 1;
+		gettimeofday(&answered, NULL);
+	    } else {
+		rpcpipe_close(&ra->ra_pipe);
+		ra->ra_probing = 0;
+		close(ra->ra_udp);
+		ra->ra_udp = -1;
+	    }
+	}
+	if (pfd[0].revents != 0) {
+	    len = sizeof(err);
+	    if (getsockopt(ra->ra_tcp, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+		err = errno;
+	    if (err == 0) {
+		proto = IPPROTO_TCP;
+		break;
+	    }
+	    close(ra->ra_tcp);
+	    ra->ra_tcp = -1;
+	    ra->ra_tcperr = err;
+	    if (ra->ra_tcpcached) {
+		/* the server moved since */
+		forgetport(&ra->ra_tcpaddr,
+		    ra->ra_prog, ra->ra_vers, IPPROTO_TCP);
+		ra->ra_tcpcached = getport(&ra->ra_tcpaddr,
+		    ra->ra_prog, ra->ra_vers, IPPROTO_TCP);
+		if ((ra->ra_tcp = connectstart(&ra->ra_tcpaddr)) < 0)
+		    ra->ra_tcperr = errno;
+	    }
 	}
-    } else if ((mountpath = strdup("<handle>")) == NULL) {
-	fprintf(stderr, "internal error: no more core for mountpath\n");
-	return 0;
     }
 
-    /* get transfer size */
-    transfersize = determine_transfersize();
-
-    if (verbose) {
-	printf("Mount `%s'", mountpath);
-	if (flags & MOUNT_UMOUNT)
-	    printf(" (unmount)");
-	if (proto == IPPROTO_TCP)
-	    printf(", TCP, ");
-	else
-	    printf(", UDP, ");
-	if (port != 0)
-	    printf("port %d, ", port);
-	printf("transfer size %d bytes.\n", transfersize);
+    if (proto == IPPROTO_TCP) {
+	fcntl(ra->ra_tcp, F_SETFL, fcntl(ra->ra_tcp, F_GETFL) & ~O_NONBLOCK);
+	*sockp = ra->ra_tcp;
+	*svr = ra->ra_tcpaddr;
+	ra->ra_tcp = -1;
+    } else if (proto == IPPROTO_UDP) {
+	*sockp = ra->ra_udp;
+	*svr = ra->ra_udpaddr;
+	ra->ra_udp = -1;
+    } else {
+	if (ra->ra_tcperr != 0)
+	    fprintf(stderr, "connect: %s\n", strerror(ra->ra_tcperr));
+	if (ra->ra_pipe.rp_stat != RPC_SUCCESS)
+	    fprintf(stderr, "udp: %s\n", clnt_sperrno(ra->ra_pipe.rp_stat));
     }
-    return 1;
+    raceabort(ra);
+    return proto;
 }
 
 /*
- * Make a mount call via the port mapper
+ * Call off a race, closing what is left of it
  */
-mountres3 *
-pmap_mnt(dirpath *argp, struct sockaddr_in *server_addr)
+void
+raceabort(struct race *ra)
 {
-    enum clnt_stat stat;
-    static mountres3 res;
-    u_long port;
-
-    memset(&res, 0, sizeof(res));
-    if ((stat = pmap_rmtcall(server_addr, MOUNT_PROGRAM, MOUNT_V3,
-      MOUNT3_MNT, (xdrproc_t)xdr_dirpath, (caddr_t) argp,
-      (xdrproc_t) xdr_mountres3, (caddr_t)&res, timeout, &port)) != RPC_SUCCESS){
-	clnt_perrno(stat);
-	return NULL;
-    }
-    return &res;
+    if (ra->ra_tcp >= 0)
+	close(ra->ra_tcp);
+    rpcpipe_close(&ra->ra_pipe);
+    rpccall_free(&ra->ra_call);
+    ra->ra_probing = 0;
+    if (ra->ra_udp >= 0)
+	close(ra->ra_udp);
+    if (ra->ra_auth != NULL)
+	auth_destroy(ra->ra_auth);
+    ra->ra_tcp = ra->ra_udp = -1;
+    ra->ra_auth = NULL;
+}
 
 /*
-       enum clnt_stat pmap_rmtcall(struct sockaddr_in *addr,
-                           unsigned long prognum, unsigned long versnum,
-                           unsigned long procnum,
-                           xdrproc_t inproc, char *in,
-                           xdrproc_t outproc, char *out,
-                           struct timeval tout, unsigned long *portp);
-*/
-
+ * Start connecting a TCP socket (a privileged one when possible) to
+ * 'svr' without waiting for the handshake. Returns the socket, or -1
+ * with errno set.
+ */
+int
+connectstart(struct sockaddr_in *svr)
+{
+    int s, err;
+
+    if ((s = privileged(SOCK_STREAM, NULL)) == RPC_ANYSOCK &&
+      (s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+	return -1;
+    if (fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) < 0 ||
+      (connect(s, (struct sockaddr *) svr, sizeof(*svr)) != 0 &&
+      errno != EINPROGRESS)) {
+	err = errno;
+	close(s);
+	errno = err;
+	return -1;
+    }
+    return s;
 }
 
 /*
+ * Wait for the 'n' connections started by connectstart in 'socks'.
+ * Those that fail are closed and set to -1, the others are made
+ * blocking again.
+ */
 void
-copy_nfs_fh3(nfs_fh3 dst, nfs_fh3 src)
+connectwait(int *socks, int n)
 {
-
+    struct pollfd pfd[MAXCONNECT];
+    int done[MAXCONNECT];
+    struct timeval start;
+    int i, left, err;
+    long wait;
+    socklen_t len;
+
+    if (n > MAXCONNECT)
+	n = MAXCONNECT;
+    memset(done, 0, sizeof(done));
+    gettimeofday(&start, NULL);
+    for (;;) {
+	for (i = left = 0; i < n; i++) {
+	    pfd[i].fd = done[i] ? -1 : socks[i];
+	    pfd[i].events = POLLOUT;
+	    pfd[i].revents = 0;
+	    if (pfd[i].fd >= 0)
+		left++;
+	}
+	wait = timeout.tv_sec * 1000L + timeout.tv_usec / 1000 -
+	    msecsince(&start);
+	if (left == 0 || wait <= 0)
+	    break;
+	if (poll(pfd, n, (int) wait) < 0 && errno != EINTR)
+	    break;
+	for (i = 0; i < n; i++) {
+	    if (pfd[i].fd < 0 || pfd[i].revents == 0)
+		continue;
+	    len = sizeof(err);
+	    if (getsockopt(socks[i], SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+		err = errno;
+	    if (err != 0) {
+		fprintf(stderr, "connect: %s\n", strerror(err));
+		close(socks[i]);
+		socks[i] = -1;
+	    } else
+		fcntl(socks[i], F_SETFL,
+		    fcntl(socks[i], F_GETFL) & ~O_NONBLOCK);
+	    done[i] = 1;
+	}
+    }
+    for (i = 0; i < n; i++) {
+	if (socks[i] >= 0 && !done[i]) {
+	    fprintf(stderr, "connect: %s\n", strerror(ETIMEDOUT));
+	    close(socks[i]);
+	    socks[i] = -1;
+	}
+    }
 }
-*/
 
 /*
- * Determine NFS server's transfer size
+ * Open a UDP socket (a privileged one when possible) connected to
+ * 'svr'. Returns the socket, or -1.
  */
 int
-determine_transfersize(void)
+connectudp(struct sockaddr_in *svr)
+{
+    int s;
+
+    if ((s = privileged(SOCK_DGRAM, NULL)) == RPC_ANYSOCK &&
+      (s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+	return -1;
+    if (connect(s, (struct sockaddr *) svr, sizeof(*svr)) != 0) {
+	close(s);
+	return -1;
+    }
+    return s;
+}
+
+/*
+ * Milliseconds gone by since 'then'
+ */
+long
+msecsince(struct timeval *then)
 {
-    FSINFO3args args = { 0 };
-    FSINFO3res *res;
+    struct timeval now;
 
-    nfs_fh3copy(&args.fsroot, &directory_handle);
-    if ((res = nfs3_fsinfo_3(&args, nfsclient)) == NULL)
-	return 8192;
-    if (res->status != NFS3_OK)
-	return 8192;
-    return res->FSINFO3res_u.resok.wtmax;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - then->tv_sec) * 1000L +
+	(now.tv_usec - then->tv_usec) / 1000;
 }
 
 /*
- * Setup a connection to host "svr", program "prog" and version "vers"
- * using a privileged port.
+ * Say so when the connection to a server got a privileged port. The
+ * other connections of a mount come from the same range, so this is
+ * only done for the first.
  */
-int
-setup(int type, struct sockaddr_in *svr, int prog, int vers)
+void
+reportport(int sock)
 {
-    int s = privileged(type, NULL);
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
 
-    if (s != RPC_ANYSOCK) {
-	svr->sin_port = pmap_getport(svr, prog, vers,
-	    type == SOCK_STREAM ? IPPROTO_TCP: IPPROTO_UDP);
-	svr->sin_port = htons(svr->sin_port);
-	if (connect(s, (struct sockaddr *) svr, sizeof(*svr)) != 0) {
-	    perror("connect");
-	    return RPC_ANYSOCK;
-	}
-    }
-    return s;
+    if (verbose && getsockname(sock, (struct sockaddr *) &sin, &len) == 0 &&
+      ntohs(sin.sin_port) < IPPORT_RESERVED)
+	fprintf(stderr, "Using a privileged port (%d)\n", ntohs(sin.sin_port));
 }
 
 /*
@@ -2049,11 +7683,8 @@ privileged(int type, struct sockaddr_in *sinp)
 	return RPC_ANYSOCK;
     for (;;) {
 	sinp->sin_port = htons((u_short)lport);
-	if (bind(s, (struct sockaddr *)sinp, sizeof(*sinp)) >= 0) {
-	    if (verbose)
-		fprintf(stderr, "Using a privileged port (%d)\n", lport);
+	if (bind(s, (struct sockaddr *)sinp, sizeof(*sinp)) >= 0)
 	    return s;
-	}
 	if (errno != EADDRINUSE && errno != EADDRNOTAVAIL) {
 	    close(s);
 	    return RPC_ANYSOCK;
@@ -2075,13 +7706,15 @@ close_nfs(void)
 {
     if (mountpath == NULL) return;
     if (verbose) printf("Unmount `%s'\n", mountpath);
-    (void) mount3_umnt_3(&mountpath, mntclient);
+    (void) mount3_umnt_3(&mountpath, NULL, mntclient);
     free(mountpath);
     mountpath = NULL;
-    if (nfsclient) {
-	auth_destroy(nfsclient->cl_auth);
-	clnt_destroy(nfsclient);
-    }
+    mountcached = 0;
+    cwdcached = 0;
+    dnlc_purge();
+    bcache_purge();
+    pathcache_purge();
+    closeconns();
 }
 
 /*
@@ -2109,147 +7742,325 @@ create_authenticator(void)
 }
 
 /*
- * Read all entries (names) in directory 'dirhandle' into
- * a dynamically build table. It is up to the caller to free
- * this table.
+ * Read directory 'dirhandle' and call 'fn' for every entry whose name
+ * matches one of the patterns in 'argv' (or every entry when 'argc' is
+ * 0) as soon as the reply carrying it has been decoded. The entry
+ * passed to 'fn', name included, is only valid for the duration of
+ * the call; 'fn' returns 0 to stop the listing. When 'plus' is set
+ * READDIRPLUS is used, which brings along the attributes and file
+ * handle of every entry. Servers that do not support it get plain
+ * READDIR from then on.
  */
 int
-getdirentries(nfs_fh3 *dirhandle, char ***table, char ***ptr, int nentries)
+readdirentries(CLIENT *clnt, nfs_fh3 *dirhandle, int plus, int argc,
+    char **argv, int (*fn)(struct direntry *, void *), void *arg)
 {
-    READDIR3args args;
-    READDIR3res *res;
-    entry3 *ep;
-    int dircmp();
-    char **last;
+    struct pattern *pt;
+    int ok = -1;
 
-    *ptr = *table = (char **) calloc(nentries, sizeof(char *));
-    last = *ptr + nentries;
-    if (*ptr == NULL) {
-	fprintf(stderr, "getdirentries: out of memory\n");
+    if ((pt = pattern_compile(argc, argv)) == NULL) {
+	fprintf(stderr, "readdir: out of memory\n");
 	return 0;
     }
+    if (plus && readdirplus) {
+	if ((ok = getdirplus(clnt, dirhandle, pt, fn, arg)) < 0)
+	    readdirplus = 0;
+    }
+    if (ok < 0)
+	ok = getdir(clnt, dirhandle, pt, fn, arg);
+    pattern_free(pt);
+    return ok;
+}
+
+/*
+ * Read directory entries (names only) using READDIR
+ */
+int
+getdir(CLIENT *clnt, nfs_fh3 *dirhandle, struct pattern *pt,
+    int (*fn)(struct direntry *, void *), void *arg)
+{
+    READDIR3args args;
+    READDIR3res res;
+    struct direntry de;
+    entry3 *ep;
+    bool_t eof;
 
+    memset(&args, 0, sizeof(args));
     nfs_fh3copy(&args.dir, dirhandle);
+    args.count = xfer.xp_dsize;
+    do {
+	memset(&res, 0, sizeof(res));
+	if (nfs3_readdir_3(&args, &res, clnt) != RPC_SUCCESS) {
+	    clnt_perror(clnt, "nfs3_readdir");
+	    return 0;
+	}
+	if (res.status == NFS3ERR_STALE && args.cookie == 0 &&
+	  revalidate(dirhandle)) {
+	    nfs_fh3copy(&args.dir, dirhandle);
+	    eof = FALSE;
+	    continue;
+	}
+	if (res.status != NFS3_OK) {
+	    fprintf(stderr, "Readdir failed: %s\n", nfs_error(res.status));
+	    return 0;
+	}
+	eof = res.READDIR3res_u.resok.reply.eof;
+	if (res.READDIR3res_u.resok.reply.entries == NULL)
+	    eof = TRUE;
+	memcpy(args.cookieverf, res.READDIR3res_u.resok.cookieverf, NFS3_COOKIEVERFSIZE);
+	for (ep = res.READDIR3res_u.resok.reply.entries; ep != NULL; ep = ep->nextentry) {
+	    args.cookie = ep->cookie;
+	    if (!pattern_match(pt, ep->name))
+		continue;
+	    memset(&de, 0, sizeof(de));
+	    de.de_name = ep->name;
+	    if (!(*fn)(&de, arg)) {
+		xdr_free((xdrproc_t) xdr_READDIR3res, (char *) &res);
+		return 0;
+	    }
+	}
+	xdr_free((xdrproc_t) xdr_READDIR3res, (char *) &res);
+    } while (!eof);
+    return 1;
+}
 
-    memset(&args.cookie, 0, sizeof(args.cookie));
-    args.count = 8192;
-    for (;;) {
-        if ((res = nfs3_readdir_3(&args, nfsclient)) == NULL) {
-            clnt_perror(nfsclient, "nfs3_readdir");
-            break;
-        }
-        if (res->status != NFS3_OK) {
-            fprintf(stderr, "Readdir failed: %s\n", nfs_error(res->status));
-            break;
-        }
+/*
+ * Read directory entries, with their attributes and handles, using
+ * READDIRPLUS. Returns -1 when the server does not support it.
+ */
+int
+getdirplus(CLIENT *clnt, nfs_fh3 *dirhandle, struct pattern *pt,
+    int (*fn)(struct direntry *, void *), void *arg)
+{
+    READDIRPLUS3args args;
+    READDIRPLUS3res res;
+    enum clnt_stat stat;
+    struct direntry de;
+    entryplus3 *ep;
+    bool_t eof;
+    int first = 1;
 
-        ep = res->READDIR3res_u.resok.reply.entries;
-        while (ep != NULL) {
-	    if (*ptr == last) {
-		*table = (char **)realloc(*table, 2*nentries*sizeof(char *));
-		if (*table == NULL) {
-		    fprintf(stderr, "getdirentries: out of memory\n");
-		    exit(1);
-		}
-		*ptr = *table + nentries;
-		last = *ptr + nentries;
-		nentries *= 2;
+    memset(&args, 0, sizeof(args));
+    nfs_fh3copy(&args.dir, dirhandle);
+    args.dircount = xfer.xp_dsize;
+    args.maxcount = xfer.xp_rmax;
+    do {
+	memset(&res, 0, sizeof(res));
+	if ((stat = nfs3_readdirplus_3(&args, &res, clnt)) != RPC_SUCCESS) {
+	    if (stat == RPC_PROCUNAVAIL && first)
+		return -1;
+	    clnt_perror(clnt, "nfs3_readdirplus");
+	    return 0;
+	}
+	if (res.status == NFS3ERR_NOTSUPP && first)
+	    return -1;
+	if (res.status == NFS3ERR_STALE && first && revalidate(dirhandle)) {
+	    nfs_fh3copy(&args.dir, dirhandle);
+	    eof = FALSE;
+	    continue;
+	}
+	if (res.status != NFS3_OK) {
+	    fprintf(stderr, "Readdirplus failed: %s\n", nfs_error(res.status));
+	    return 0;
+	}
+	first = 0;
+	eof = res.READDIRPLUS3res_u.resok.reply.eof;
+	if (res.READDIRPLUS3res_u.resok.reply.entries == NULL)
+	    eof = TRUE;
+	memcpy(args.cookieverf, res.READDIRPLUS3res_u.resok.cookieverf, NFS3_COOKIEVERFSIZE);
+	for (ep = res.READDIRPLUS3res_u.resok.reply.entries; ep != NULL; ep = ep->nextentry) {
+	    args.cookie = ep->cookie;
+	    memset(&de, 0, sizeof(de));
+	    de.de_name = ep->name;
+	    if (ep->name_attributes.attributes_follow) {
+		de.de_attr = ep->name_attributes.post_op_attr_u.attributes;
+		de.de_hasattr = 1;
 	    }
-	    if ((*(*ptr)++ = strdup(ep->name)) == NULL)
+	    if (ep->name_handle.handle_follows) {
+		nfs_fh3copy(&de.de_handle, &ep->name_handle.post_op_fh3_u.handle);
+		de.de_hashandle = 1;
+	    }
+	    if (de.de_hasattr && de.de_hashandle)
+		dnlc_enter(dirhandle, de.de_name, &de.de_handle, &de.de_attr);
+	    if (!pattern_match(pt, ep->name))
+		continue;
+	    if (!(*fn)(&de, arg)) {
+		xdr_free((xdrproc_t) xdr_READDIRPLUS3res, (char *) &res);
 		return 0;
+	    }
+	}
+	xdr_free((xdrproc_t) xdr_READDIRPLUS3res, (char *) &res);
+    } while (!eof);
+    return 1;
+}
 
-            if (ep->nextentry == NULL)
-                break;
-            ep = ep->nextentry;
-        }
-        if (res->READDIR3res_u.resok.reply.eof)
-            break;
-        memcpy(&args.cookie, &ep->cookie, sizeof(args.cookie));
+/*
+ * Read the entries in directory 'dirhandle' that match 'argv' into a
+ * table, sorted by name. It is up to the caller to free this table
+ * (freedirentries).
+ */
+int
+getdirentries(CLIENT *clnt, nfs_fh3 *dirhandle, struct dirtable *dt,
+    int argc, char **argv, int plus)
+{
+    int dircmp();
+
+    memset(dt, 0, sizeof(*dt));
+    if (!readdirentries(clnt, dirhandle, plus, argc, argv, newdirentry, dt)) {
+	freedirentries(dt);
+	return 0;
     }
-    qsort(*table, *ptr - *table, sizeof(char **), dircmp);
+    if (dt->dt_table != NULL)
+	qsort(dt->dt_table, dt->dt_ptr - dt->dt_table, sizeof(struct direntry), dircmp);
     return 1;
 }
 
+/*
+ * Append a copy of entry 'de' to a directory table, growing it as
+ * needed. The name is copied into the table's arena.
+ */
 int
-dircmp(char **p, char **q)
+newdirentry(struct direntry *de, void *arg)
 {
-    return strcmp(*p, *q);
+    struct dirtable *dt = (struct dirtable *) arg;
+    struct namechunk *nc;
+    struct direntry *table;
+    int n = dt->dt_ptr - dt->dt_table;
+    u_int len = strlen(de->de_name) + 1;
+
+    if (n == dt->dt_size) {
+	dt->dt_size = dt->dt_size ? 2 * dt->dt_size : 32;
+	table = (struct direntry *) realloc(dt->dt_table,
+	    dt->dt_size * sizeof(*table));
+	if (table == NULL) {
+	    fprintf(stderr, "getdirentries: out of memory\n");
+	    exit(1);
+	}
+	dt->dt_table = table;
+	dt->dt_ptr = table + n;
+    }
+    if ((nc = dt->dt_names) == NULL || nc->nc_size - nc->nc_used < len) {
+	nc = (struct namechunk *) malloc(sizeof(*nc) + MAX(len, NAMECHUNK));
+	if (nc == NULL) {
+	    fprintf(stderr, "getdirentries: out of memory\n");
+	    return 0;
+	}
+	nc->nc_next = dt->dt_names;
+	nc->nc_used = 0;
+	nc->nc_size = MAX(len, NAMECHUNK);
+	dt->dt_names = nc;
+    }
+    *dt->dt_ptr = *de;
+    dt->dt_ptr->de_name = memcpy(nc->nc_data + nc->nc_used, de->de_name, len);
+    nc->nc_used += len;
+    dt->dt_ptr++;
+    return 1;
 }
 
 /*
- * Match string against a normal shell pattern (*?[])
+ * Free a table built by getdirentries
  */
-int
-match(char *s, int argc, char **argv)
+void
+freedirentries(struct dirtable *dt)
 {
-    register int i;
+    struct namechunk *nc;
 
-    if (argc == 0) return 1;
-    for (i = 0; i < argc; i++)
-	if (matchpattern(s, argv[i]))
-	    return 1;
-    return 0;
+    while ((nc = dt->dt_names) != NULL) {
+	dt->dt_names = nc->nc_next;
+	free(nc);
+    }
+    free(dt->dt_table);
+    dt->dt_table = dt->dt_ptr = NULL;
 }
 
+/*
+ * Look up 'name' in directory 'dirhandle', trying the name cache
+ * before asking the server. The handle is returned in 'fh' and, when
+ * 'attr' is not NULL, the attributes of the object in 'attr'.
+ */
 int
-matchpattern(char *s, char *p)
+lookup(CLIENT *clnt, nfs_fh3 *dirhandle, char *name, nfs_fh3 *fh,
+    post_op_attr *attr)
 {
-    if (*s == '.' && *p != '.')
-	return 0;
-    return amatchpattern(s, p);
+    return lookupstatus(clnt, dirhandle, name, fh, attr, 1) == NFS3_OK;
 }
 
-int
-amatchpattern(char *s, char *p)
+/*
+ * Look up 'name' as lookup() does, and return its status. A failed
+ * call is reported right away and returned as NFS3ERR_IO; an NFS
+ * error is only reported when 'report' is set.
+ */
+nfsstat3
+lookupstatus(CLIENT *clnt, nfs_fh3 *dirhandle, char *name, nfs_fh3 *fh,
+    post_op_attr *attr, int report)
 {
-    register int scc;
-    int c, cc, ok, lc;
+    LOOKUP3args args;
+    LOOKUP3res res;
+    fattr3 fattr;
 
-    if ((scc = *s++))
-	if ((scc &= 0177) == 0)
-	    scc = 0200;
+    if (dnlc_lookup(dirhandle, name, fh, &fattr)) {
+	if (attr != NULL) {
+	    attr->attributes_follow = TRUE;
+	    attr->post_op_attr_u.attributes = fattr;
+	}
+	return NFS3_OK;
+    }
 
-    switch (c = *p++) {
-    case '[':
-	ok = 0;
-	lc = 077777;
-	while ((cc = *p++)) {
-	    if (cc == ']') {
-		if (ok)
-		    return amatchpattern(s, p);
-		else
-		    return 0;
-	    } else if (cc == '-') {
-		if (lc <= scc && scc <= (c = *p++))
-		    ok++;
-	    } else
-		if (scc == (lc = cc))
-		    ok++;
+    args.what.name = name;
+    nfs_fh3copy(&args.what.dir, dirhandle);
+    memset(&res, 0, sizeof(res));
+    if (nfs3_lookup_3(&args, &res, clnt) != RPC_SUCCESS) {
+	clnt_perror(clnt, "nfs3_lookup");
+	return NFS3ERR_IO;
+    }
+    if (res.status == NFS3ERR_STALE) {
+	pathcache_forget(dirhandle);
+	if (revalidate(dirhandle)) {
+	    xdr_free((xdrproc_t) xdr_LOOKUP3res, (char *) &res);
+	    return lookupstatus(clnt, dirhandle, name, fh, attr, report);
 	}
-	return 0;
-    case '*':
-	return umatchpattern(--s, p);
-    case '\0':
-	return !scc;
-    default:
-	if (c != scc)
-	    return 0;
-    case '?':
-	if (scc)
-	    return amatchpattern(s, p);
-	return 0;
     }
+    if (res.status != NFS3_OK) {
+	if (report)
+	    fprintf(stderr, "%s: %s\n", name, nfs_error(res.status));
+	return res.status;
+    }
+    dnlc_attr(dirhandle, &res.LOOKUP3res_u.resok.dir_attributes);
+    if (res.LOOKUP3res_u.resok.obj_attributes.attributes_follow)
+	dnlc_enter(dirhandle, name, &res.LOOKUP3res_u.resok.object,
+	    &res.LOOKUP3res_u.resok.obj_attributes.post_op_attr_u.attributes);
+    nfs_fh3copy(fh, &res.LOOKUP3res_u.resok.object);
+    if (attr != NULL)
+	*attr = res.LOOKUP3res_u.resok.obj_attributes;
+    return NFS3_OK;
+}
+
+/*
+ * Fill in the attributes and handle of a directory entry that
+ * READDIR did not supply. Returns the status of the lookup, which
+ * is reported as lookupstatus() does.
+ */
+nfsstat3
+lookupentry(CLIENT *clnt, nfs_fh3 *dirhandle, struct direntry *de, int report)
+{
+    post_op_attr attr;
+    nfsstat3 status;
+
+    if ((status = lookupstatus(clnt, dirhandle, de->de_name, &de->de_handle,
+      &attr, report)) != NFS3_OK)
+	return status;
+    de->de_hashandle = 1;
+    if (attr.attributes_follow) {
+	de->de_attr = attr.post_op_attr_u.attributes;
+	de->de_hasattr = 1;
+    }
+    return NFS3_OK;
 }
 
 int
-umatchpattern(char *s, char *p)
+dircmp(struct direntry *p, struct direntry *q)
 {
-    if (*p == '\0')
-	return 1;
-    while (*s != '\0')
-	if (amatchpattern(s++, p))
-	    return 1;
-    return 0;
+    return strcmp(p->de_name, q->de_name);
 }
 
 /*
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pathcache - absolute path to directory handle cache
+ *
+ * The name cache answers one component at a time and lets entries
+ * expire with their attributes, so a deep path still costs a round
+ * trip per component once its entries have timed out. This cache is
+ * a trie of the directories below the root of the mounted file
+ * system: every directory a path walk has gone through is kept with
+ * its handle, and a walk starts from the longest prefix of its path
+ * that is in the trie. Another client may rename or replace a
+ * directory behind our back, so an entry is taken on trust only for
+ * the minimum directory attribute timeout of the name cache; after
+ * that the walk looks the name up again, which renews the entry.
+ * Entries also go away when one of our own calls removes or renames
+ * the directory, when the server calls a handle stale, or when a
+ * different file system is mounted. Names
+ * are hashed together with the handle of their parent, so wide
+ * directories do not make the walk slower. All entry points take a
+ * lock, so worker threads can share the cache.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <rpc/rpc.h>
+#include "pathcache.h"
+#include "dnlc.h"
+
+struct pathnode {
+    char *pn_name;			/* name in the parent directory */
+    nfs_fh3 pn_fh;			/* handle of the directory */
+    time_t pn_fetched;			/* when it was looked up */
+    struct pathnode *pn_parent;		/* parent directory */
+    struct pathnode *pn_child;		/* first cached subdirectory */
+    struct pathnode *pn_sibling;	/* next subdirectory of the parent */
+    struct pathnode *pn_next;		/* next on name hash chain */
+    struct pathnode *pn_fhnext;		/* next on handle hash chain */
+};
+
+int pathcache_enabled = 1;
+u_long pathcache_hits;
+u_long pathcache_misses;
+
+static struct pathnode root = { "" };	/* root of the mounted file system */
+static int rootset;			/* root.pn_fh is valid */
+static struct pathnode *nametab[PATHCACHE_HASHSIZE];
+static struct pathnode *fhtab[PATHCACHE_HASHSIZE];
+static int nentries;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static u_int hashfh(nfs_fh3 *);
+static u_int hashname(struct pathnode *, char *);
+static int fhequal(nfs_fh3 *, nfs_fh3 *);
+static void adopt(nfs_fh3 *);
+static struct pathnode *find(struct pathnode *, char *);
+static struct pathnode *walk(char **, int);
+static void unlink_root(void);
+static void unlink_tree(struct pathnode *);
+static void purge(void);
+
+/*
+ * Find the longest prefix of the path made of the 'n' components in
+ * 'comps' that is in the cache, below the root with handle 'rootfh'.
+ * Returns the number of components in that prefix, and when it is
+ * not empty the handle of the directory it names in 'fh'.
+ */
+int
+pathcache_lookup(nfs_fh3 *rootfh, char **comps, int n, nfs_fh3 *fh)
+{
+    struct pathnode *pn, *pp;
+    time_t now = time(NULL);
+    int i;
+
+    if (!pathcache_enabled)
+	return 0;
+    pthread_mutex_lock(&lock);
+    adopt(rootfh);
+    for (pn = &root, i = 0; i < n; pn = pp, i++)
+	if ((pp = find(pn, comps[i])) == NULL ||
+	  now - pp->pn_fetched >= dnlc_timeo.dt_dirmin)
+	    break;
+    if (i > 0)
+	*fh = pn->pn_fh;
+    pathcache_hits += i;
+    pathcache_misses += n - i;
+    pthread_mutex_unlock(&lock);
+    return i;
+}
+
+/*
+ * Enter directory 'fh' under the path made of the 'n' components in
+ * 'comps', or renew the entry when it is there already. Only the
+ * last component is added, the path leading to it has to be in the
+ * cache already.
+ */
+void
+pathcache_enter(nfs_fh3 *rootfh, char **comps, int n, nfs_fh3 *fh)
+{
+    struct pathnode *parent, *pn;
+    u_int h;
+
+    if (!pathcache_enabled || n < 1)
+	return;
+    pthread_mutex_lock(&lock);
+    adopt(rootfh);
+    if ((parent = walk(comps, n - 1)) == NULL)
+	goto out;
+    if ((pn = find(parent, comps[n - 1])) != NULL) {
+	if (fhequal(&pn->pn_fh, fh)) {
+	    pn->pn_fetched = time(NULL);
+	    goto out;
+	}
+	unlink_tree(pn);
+    }
+    if (nentries >= PATHCACHE_SIZE) {
+	purge();
+	goto out;
+    }
+    if ((pn = (struct pathnode *) malloc(sizeof(*pn))) == NULL)
+	goto out;
+    if ((pn->pn_name = strdup(comps[n - 1])) == NULL) {
+	free(pn);
+	goto out;
+    }
+    pn->pn_fh = *fh;
+    pn->pn_fetched = time(NULL);
+    pn->pn_parent = parent;
+    pn->pn_child = NULL;
+    pn->pn_sibling = parent->pn_child;
+    parent->pn_child = pn;
+    h = hashname(parent, pn->pn_name);
+    pn->pn_next = nametab[h];
+    nametab[h] = pn;
+    h = hashfh(fh);
+    pn->pn_fhnext = fhtab[h];
+    fhtab[h] = pn;
+    nentries++;
+out:
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Forget about 'name' in directory 'dir', and everything below it
+ */
+void
+pathcache_remove(nfs_fh3 *dir, char *name)
+{
+    struct pathnode *pn, *pp;
+
+    pthread_mutex_lock(&lock);
+again:
+    for (pn = fhtab[hashfh(dir)]; pn != NULL; pn = pn->pn_fhnext) {
+	if (!fhequal(&pn->pn_fh, dir) || (pp = find(pn, name)) == NULL)
+	    continue;
+	unlink_tree(pp);
+	goto again;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Handle 'fh' went stale, forget every path leading to it
+ */
+void
+pathcache_forget(nfs_fh3 *fh)
+{
+    struct pathnode *pn;
+
+    pthread_mutex_lock(&lock);
+again:
+    for (pn = fhtab[hashfh(fh)]; pn != NULL; pn = pn->pn_fhnext) {
+	if (!fhequal(&pn->pn_fh, fh))
+	    continue;
+	if (pn == &root) {
+	    purge();
+	    unlink_root();
+	} else
+	    unlink_tree(pn);
+	goto again;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Empty the cache
+ */
+void
+pathcache_purge(void)
+{
+    pthread_mutex_lock(&lock);
+    purge();
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Number of directories in the cache
+ */
+int
+pathcache_count(void)
+{
+    return nentries;
+}
+
+/*
+ * Handles carry their FNV-1a hash, names are folded into the hash of
+ * their parent
+ */
+static u_int
+hashfh(nfs_fh3 *fh)
+{
+    return fh->hash & (PATHCACHE_HASHSIZE - 1);
+}
+
+static u_int
+hashname(struct pathnode *parent, char *name)
+{
+    u_int h = parent->pn_fh.hash;
+
+    for (; *name != '\0'; name++)
+	h = (h ^ (u_char) *name) * 16777619U;
+    return h & (PATHCACHE_HASHSIZE - 1);
+}
+
+static int
+fhequal(nfs_fh3 *a, nfs_fh3 *b)
+{
+    return a->hash == b->hash && a->data.data_len == b->data.data_len &&
+	memcmp(a->data.data_val, b->data.data_val, a->data.data_len) == 0;
+}
+
+/*
+ * Paths are relative to the root of the mounted file system; a walk
+ * from a different root means a different file system.
+ */
+static void
+adopt(nfs_fh3 *rootfh)
+{
+    u_int h;
+
+    if (rootset && fhequal(&root.pn_fh, rootfh))
+	return;
+    purge();
+    if (rootset)
+	unlink_root();
+    root.pn_fh = *rootfh;
+    h = hashfh(rootfh);
+    root.pn_fhnext = fhtab[h];
+    fhtab[h] = &root;
+    rootset = 1;
+}
+
+static struct pathnode *
+find(struct pathnode *parent, char *name)
+{
+    struct pathnode *pn;
+
+    for (pn = nametab[hashname(parent, name)]; pn != NULL; pn = pn->pn_next)
+	if (pn->pn_parent == parent && strcmp(pn->pn_name, name) == 0)
+	    return pn;
+    return NULL;
+}
+
+/*
+ * The directory named by the first 'n' components of 'comps', or
+ * NULL when it is not in the cache
+ */
+static struct pathnode *
+walk(char **comps, int n)
+{
+    struct pathnode *pn;
+    int i;
+
+    for (pn = &root, i = 0; pn != NULL && i < n; i++)
+	pn = find(pn, comps[i]);
+    return pn;
+}
+
+static void
+unlink_root(void)
+{
+    struct pathnode **pp;
+
+    for (pp = &fhtab[hashfh(&root.pn_fh)]; *pp != &root; pp = &(*pp)->pn_fhnext)
+	/* do nothing */;
+    *pp = root.pn_fhnext;
+    rootset = 0;
+}
+
+/*
+ * Remove a directory and all its cached subdirectories
+ */
+static void
+unlink_tree(struct pathnode *pn)
+{
+    struct pathnode **pp;
+
+    while (pn->pn_child != NULL)
+	unlink_tree(pn->pn_child);
+    for (pp = &pn->pn_parent->pn_child; *pp != pn; pp = &(*pp)->pn_sibling)
+	/* do nothing */;
+    *pp = pn->pn_sibling;
+    for (pp = &nametab[hashname(pn->pn_parent, pn->pn_name)]; *pp != pn; pp = &(*pp)->pn_next)
+	/* do nothing */;
+    *pp = pn->pn_next;
+    for (pp = &fhtab[hashfh(&pn->pn_fh)]; *pp != pn; pp = &(*pp)->pn_fhnext)
+	/* do nothing */;
+    *pp = pn->pn_fhnext;
+    nentries--;
+    free(pn->pn_name);
+    free(pn);
+}
+
+static void
+purge(void)
+{
+    while (root.pn_child != NULL)
+	unlink_tree(root.pn_child);
+}
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pattern - shell file name patterns compiled into a DFA
+ *
+ * Commands like ls and get filter directory entries with csh style
+ * patterns: '*', '?' and '[...]' classes with ranges, where a name
+ * starting with a dot only matches patterns that start with a dot.
+ * Trying every pattern on every name with a backtracker takes
+ * exponential time on patterns like *a*a*a*b. Instead, all patterns
+ * of a command are combined into one NFA, whose states are positions
+ * in the patterns, and subset construction turns that into a DFA.
+ * A name is then matched in a single pass over its bytes. A DFA
+ * state that only leaves on one byte (the typical state inside a
+ * '*') is skipped over with memchr. If the DFA would grow beyond
+ * PATTERN_MAXSTATES, names are matched by running the NFA instead,
+ * which is still linear in the length of the name.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "pattern.h"
+
+#define	WORDBITS	(8 * sizeof(u_long))
+#define	ISSET(set, i)	((set)[(i) / WORDBITS] & (1UL << ((i) % WORDBITS)))
+#define	SET(set, i)	((set)[(i) / WORDBITS] |= 1UL << ((i) % WORDBITS))
+
+#define	SKIP_NONE	-1	/* ds_skip: several bytes leave the state */
+#define	SKIP_ALL	256	/* ds_skip: no byte leaves the state */
+
+/*
+ * One NFA state: the pattern position it stands for matches a byte
+ * from a set, or any string for a '*'. The state after the last
+ * position of a pattern accepts.
+ */
+struct token {
+    u_char t_set[256 / 8];	/* bytes that advance to the next state */
+    int t_star;			/* '*': stay here on any byte, or move on */
+    int t_accept;		/* end of a pattern */
+};
+
+struct dstate {
+    u_long *ds_set;		/* NFA states it stands for */
+    int ds_accept;		/* one of them accepts */
+    int ds_skip;		/* only byte that leaves the state, or SKIP_* */
+    int ds_next[256];		/* transition on each byte */
+};
+
+struct pattern {
+    int pt_all;			/* no patterns given, everything matches */
+    int pt_nstates;		/* number of NFA states */
+    struct token *pt_tok;	/* the NFA states */
+    int pt_words;		/* u_longs in a set of NFA states */
+    u_long *pt_start;		/* initial NFA states */
+    u_long *pt_dotstart;	/* initial NFA states for names with a dot */
+    u_long *pt_cur, *pt_nxt;	/* scratch sets for running the NFA */
+    struct dstate *pt_dfa;	/* DFA states, 0 is the dead state */
+    int pt_ndfa;		/* number of DFA states, 0 if not built */
+    int pt_dfastart;		/* initial DFA state */
+    int pt_dfadot;		/* initial DFA state for names with a dot */
+};
+
+static int parse(u_char *, struct token *);
+static void closure(struct pattern *, u_long *);
+static void step(struct pattern *, u_long *, int, u_long *);
+static int dfastate(struct pattern *, u_long *);
+static int builddfa(struct pattern *);
+static void freedfa(struct pattern *);
+static int nfamatch(struct pattern *, u_char *);
+
+/*
+ * Compile patterns 'argv[0..argc-1]'; a name matches when it matches
+ * any of them. No patterns at all match every name. Returns NULL when
+ * out of memory.
+ */
+struct pattern *
+pattern_compile(int argc, char **argv)
+{
+    struct pattern *pt;
+    int i, n, len;
+
+    if ((pt = (struct pattern *) calloc(1, sizeof(*pt))) == NULL)
+	return NULL;
+    if (argc == 0) {
+	pt->pt_all = 1;
+	return pt;
+    }
+    for (i = len = 0; i < argc; i++)
+	len += strlen(argv[i]) + 1;
+    if ((pt->pt_tok = (struct token *) calloc(len, sizeof(struct token))) == NULL) {
+	free(pt);
+	return NULL;
+    }
+    pt->pt_words = (len + WORDBITS - 1) / WORDBITS;
+    pt->pt_start = (u_long *) calloc(4 * pt->pt_words, sizeof(u_long));
+    if (pt->pt_start == NULL) {
+	pattern_free(pt);
+	return NULL;
+    }
+    pt->pt_dotstart = pt->pt_start + pt->pt_words;
+    pt->pt_cur = pt->pt_dotstart + pt->pt_words;
+    pt->pt_nxt = pt->pt_cur + pt->pt_words;
+
+    for (i = n = 0; i < argc; i++) {
+	SET(pt->pt_start, n);
+	if (argv[i][0] == '.')
+	    SET(pt->pt_dotstart, n);
+	n += parse((u_char *) argv[i], pt->pt_tok + n);
+	pt->pt_tok[n++].t_accept = 1;
+    }
+    pt->pt_nstates = n;
+    closure(pt, pt->pt_start);
+    closure(pt, pt->pt_dotstart);
+    if (!builddfa(pt))
+	freedfa(pt);		/* too big, run the NFA */
+    return pt;
+}
+
+/*
+ * Does 'name' match the compiled patterns?
+ */
+int
+pattern_match(struct pattern *pt, char *name)
+{
+    u_char *s = (u_char *) name, *end;
+    struct dstate *ds;
+    int st;
+
+    if (pt->pt_all)
+	return 1;
+    if (pt->pt_ndfa == 0)
+	return nfamatch(pt, s);
+    st = *s == '.' ? pt->pt_dfadot : pt->pt_dfastart;
+    for (end = s + strlen(name); st != 0 && s < end; st = ds->ds_next[*s++]) {
+	ds = &pt->pt_dfa[st];
+	if (ds->ds_skip == SKIP_ALL)
+	    break;
+	if (ds->ds_skip != SKIP_NONE &&
+	  (s = memchr(s, ds->ds_skip, end - s)) == NULL)
+	    break;
+    }
+    return pt->pt_dfa[st].ds_accept;
+}
+
+void
+pattern_free(struct pattern *pt)
+{
+    if (pt == NULL)
+	return;
+    freedfa(pt);
+    free(pt->pt_start);
+    free(pt->pt_tok);
+    free(pt);
+}
+
+/*
+ * Turn one pattern into NFA states, returns how many. Classes end
+ * at the first ']'; a class that is not closed matches nothing.
+ */
+static int
+parse(u_char *p, struct token *tok)
+{
+    struct token *t = tok;
+    int c, lc, hi;
+
+    while ((c = *p++) != '\0') {
+	switch (c) {
+	case '*':
+	    if (t > tok && t[-1].t_star)
+		continue;	/* ** is the same as * */
+	    t->t_star = 1;
+	    break;
+	case '?':
+	    memset(t->t_set, 0xFF, sizeof(t->t_set));
+	    break;
+	case '[':
+	    for (lc = -1; (c = *p) != '\0' && c != ']'; p++) {
+		if (c == '-' && lc >= 0 && p[1] != '\0' && p[1] != ']') {
+		    for (hi = *++p; lc <= hi; lc++)
+			t->t_set[lc / 8] |= 1 << (lc % 8);
+		    lc = -1;
+		} else {
+		    t->t_set[c / 8] |= 1 << (c % 8);
+		    lc = c;
+		}
+	    }
+	    if (c == '\0') {
+		memset(t->t_set, 0, sizeof(t->t_set));
+		return t - tok + 1;
+	    }
+	    p++;
+	    break;
+	default:
+	    t->t_set[c / 8] |= 1 << (c % 8);
+	    break;
+	}
+	t++;
+    }
+    return t - tok;
+}
+
+/*
+ * Add the states reachable without consuming a byte: a '*' may match
+ * the empty string. Such moves only go forward, so one pass will do.
+ */
+static void
+closure(struct pattern *pt, u_long *set)
+{
+    int i;
+
+    for (i = 0; i < pt->pt_nstates; i++)
+	if (pt->pt_tok[i].t_star && ISSET(set, i))
+	    SET(set, i + 1);
+}
+
+/*
+ * The NFA states reached from 'from' on byte 'c'
+ */
+static void
+step(struct pattern *pt, u_long *from, int c, u_long *to)
+{
+    struct token *t;
+    int i;
+
+    memset(to, 0, pt->pt_words * sizeof(u_long));
+    for (i = 0; i < pt->pt_nstates; i++) {
+	if (!ISSET(from, i))
+	    continue;
+	t = &pt->pt_tok[i];
+	if (t->t_star)
+	    SET(to, i);
+	else if (!t->t_accept && (t->t_set[c / 8] & (1 << (c % 8))))
+	    SET(to, i + 1);
+    }
+    closure(pt, to);
+}
+
+/*
+ * Find or add the DFA state for a set of NFA states. Returns -1 when
+ * the DFA is full or memory runs out.
+ */
+static int
+dfastate(struct pattern *pt, u_long *set)
+{
+    struct dstate *ds;
+    size_t size = pt->pt_words * sizeof(u_long);
+    int i;
+
+    for (i = 0; i < pt->pt_ndfa; i++)
+	if (memcmp(pt->pt_dfa[i].ds_set, set, size) == 0)
+	    return i;
+    if (pt->pt_ndfa == PATTERN_MAXSTATES)
+	return -1;
+    if (pt->pt_ndfa % 16 == 0) {
+	ds = (struct dstate *) realloc(pt->pt_dfa,
+	    (pt->pt_ndfa + 16) * sizeof(struct dstate));
+	if (ds == NULL)
+	    return -1;
+	pt->pt_dfa = ds;
+    }
+    ds = &pt->pt_dfa[pt->pt_ndfa];
+    if ((ds->ds_set = (u_long *) malloc(size)) == NULL)
+	return -1;
+    memcpy(ds->ds_set, set, size);
+    ds->ds_accept = 0;
+    for (i = 0; i < pt->pt_nstates; i++)
+	if (pt->pt_tok[i].t_accept && ISSET(set, i))
+	    ds->ds_accept = 1;
+    ds->ds_skip = SKIP_NONE;
+    return pt->pt_ndfa++;
+}
+
+/*
+ * Subset construction of the whole DFA, the dead state first.
+ * Returns 0 if it does not fit.
+ */
+static int
+builddfa(struct pattern *pt)
+{
+    struct dstate *ds;
+    int i, c, next, leave;
+
+    memset(pt->pt_cur, 0, pt->pt_words * sizeof(u_long));
+    if (dfastate(pt, pt->pt_cur) != 0 ||
+      (pt->pt_dfastart = dfastate(pt, pt->pt_start)) < 0 ||
+      (pt->pt_dfadot = dfastate(pt, pt->pt_dotstart)) < 0)
+	return 0;
+
+    /* states are added behind the one being worked on */
+    for (i = 0; i < pt->pt_ndfa; i++) {
+	pt->pt_dfa[i].ds_next[0] = 0;	/* names have no NUL bytes */
+	for (c = 1; c < 256; c++) {
+	    step(pt, pt->pt_dfa[i].ds_set, c, pt->pt_nxt);
+	    if ((next = dfastate(pt, pt->pt_nxt)) < 0)
+		return 0;
+	    pt->pt_dfa[i].ds_next[c] = next;
+	}
+	ds = &pt->pt_dfa[i];
+	for (c = 1, leave = 0; c < 256; c++) {
+	    if (ds->ds_next[c] == i)
+		continue;
+	    ds->ds_skip = leave++ ? SKIP_NONE : c;
+	}
+	if (leave == 0)
+	    ds->ds_skip = SKIP_ALL;
+    }
+    return 1;
+}
+
+static void
+freedfa(struct pattern *pt)
+{
+    int i;
+
+    for (i = 0; i < pt->pt_ndfa; i++)
+	free(pt->pt_dfa[i].ds_set);
+    free(pt->pt_dfa);
+    pt->pt_dfa = NULL;
+    pt->pt_ndfa = 0;
+}
+
+/*
+ * Match by keeping track of all NFA states at once
+ */
+static int
+nfamatch(struct pattern *pt, u_char *s)
+{
+    u_long *cur = pt->pt_cur, *nxt = pt->pt_nxt, *tmp;
+    size_t size = pt->pt_words * sizeof(u_long);
+    int i;
+
+    memcpy(cur, *s == '.' ? pt->pt_dotstart : pt->pt_start, size);
+    for (; *s != '\0'; s++) {
+	step(pt, cur, *s, nxt);
+	tmp = cur, cur = nxt, nxt = tmp;
+    }
+    for (i = 0; i < pt->pt_nstates; i++)
+	if (pt->pt_tok[i].t_accept && ISSET(cur, i))
+	    return 1;
+    return 0;
+}
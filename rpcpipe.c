@@ -0,0 +1,1051 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * rpcpipe - keep several RPC calls in flight on one transport
+ *
+ * The rpcgen stubs send a call and block until its reply is in, so
+ * bulk transfers pay a full round trip per request. A pipe borrows
+ * the socket and credentials of an open CLIENT handle, encodes calls
+ * itself with the usual xdr routines, and matches replies to calls
+ * by transaction id. Over UDP it retransmits calls that have not
+ * been answered, with a timeout that follows the measured round trip
+ * time; over TCP it does the record marking itself.
+ *
+ * An event loop (rpcloop) waits on many pipes at once with epoll, so
+ * a single thread can keep calls in flight on any number of
+ * transports, to one server or to many, and have every reply handed
+ * to the completion function of its call.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <rpc/rpc.h>
+#include "rpcpipe.h"
+#include "rpcstats.h"
+
+/*
+ * Worst case size of a call header: xid, direction, rpc version,
+ * program, version, procedure and two opaque auth structures.
+ */
+#define	RPCHDRSIZE	(6 * BYTES_PER_XDR_UNIT + \
+			 2 * (2 * BYTES_PER_XDR_UNIT + MAX_AUTH_BYTES))
+
+#define	LAST_FRAG	0x80000000	/* record mark: last fragment */
+
+/* XDR padding behind 'n' bytes of opaque data */
+#define	XDRPAD(n)	((BYTES_PER_XDR_UNIT - (n) % BYTES_PER_XDR_UNIT) % \
+			 BYTES_PER_XDR_UNIT)
+
+/*
+ * How much of a long reply is read before its bulk data: enough for
+ * a reply header with the largest verifier and the fixed part of
+ * results like READ3resok. Must not exceed RPCHDRSIZE.
+ */
+#define	RPCPEEK		640
+
+static int expire(struct rpcpipe *, struct timeval *, long *);
+static struct rpccall *match(struct rpcpipe *, int);
+static struct rpccall *lookup(struct rpcpipe *, u_int);
+static void finish(struct rpcpipe *, struct rpccall *, u_int);
+static void takeoff(struct rpcpipe *, struct rpccall *);
+static void sample(struct rpcpipe *, struct rpccall *);
+static int transmit(struct rpcpipe *, struct rpccall *);
+static int receive(struct rpcpipe *, struct rpccall **);
+static int recvsink(struct rpcpipe *, u_int, struct rpccall **);
+static int recvdgram(struct rpcpipe *, struct rpccall **);
+static int readall(struct rpcpipe *, char *, u_int);
+static u_int decode(struct rpcpipe *, struct rpccall *, char *, u_int);
+static void fillsink(struct rpccall *, char *, u_int);
+static long elapsed(struct timeval *, struct timeval *);
+static long busyloop(struct rpcloop *);
+
+/*
+ * Set up a pipe on the transport of an existing client handle.
+ * Bufsize is the largest reply the caller expects to receive.
+ */
+int
+rpcpipe_open(struct rpcpipe *rp, CLIENT *clnt, u_long prog, u_long vers,
+    u_int bufsize)
+{
+    struct sockaddr_storage ss;
+    int fd;
+    socklen_t len;
+
+    if (!clnt_control(clnt, CLGET_FD, (char *)&fd)) {
+	memset(rp, 0, sizeof(*rp));
+	rp->rp_stat = RPC_FAILED;
+	return 0;
+    }
+    if (!rpcpipe_openfd(rp, fd, clnt->cl_auth, prog, vers, bufsize))
+	return 0;
+    memset(&ss, 0, sizeof(ss));
+    if (!clnt_control(clnt, CLGET_SERVER_ADDR, (char *)&ss)) {
+	len = sizeof(ss);
+	if (getpeername(rp->rp_fd, (struct sockaddr *)&ss, &len) < 0) {
+	    rpcpipe_close(rp);
+	    rp->rp_stat = RPC_SYSTEMERROR;
+	    return 0;
+	}
+    }
+    memcpy(&rp->rp_addr, &ss, sizeof(rp->rp_addr));
+    (void) clnt_control(clnt, CLGET_TIMEOUT, (char *)&rp->rp_timeout);
+    return 1;
+}
+
+/*
+ * Set up a pipe on a bare socket. A datagram socket need not be
+ * connected to anything, as long as every call says where it goes
+ * (rc_addr).
+ */
+int
+rpcpipe_openfd(struct rpcpipe *rp, int fd, AUTH *auth, u_long prog,
+    u_long vers, u_int bufsize)
+{
+    struct timeval now;
+    socklen_t len;
+
+    memset(rp, 0, sizeof(*rp));
+    rp->rp_fd = fd;
+    len = sizeof(rp->rp_type);
+    if (getsockopt(rp->rp_fd, SOL_SOCKET, SO_TYPE, &rp->rp_type, &len) < 0) {
+	rp->rp_stat = RPC_SYSTEMERROR;
+	return 0;
+    }
+    rp->rp_timeout.tv_sec = 60;
+    rp->rp_timeout.tv_usec = 0;
+    rp->rp_retry.tv_sec = RPCPIPE_INITRTO / 1000;
+    rp->rp_retry.tv_usec = (RPCPIPE_INITRTO % 1000) * 1000;
+    rp->rp_minrto = RPCPIPE_MINRTO;
+    rp->rp_srtt = -1;
+    rp->rp_auth = auth;
+    rp->rp_prog = prog;
+    rp->rp_vers = vers;
+    gettimeofday(&now, NULL);
+    rp->rp_xid = getpid() ^ now.tv_sec ^ (now.tv_usec << 12);
+
+    rp->rp_bufsize = bufsize + RPCHDRSIZE;
+    if ((rp->rp_buf = malloc(rp->rp_bufsize)) == NULL) {
+	rp->rp_stat = RPC_SYSTEMERROR;
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Tear down a pipe. Calls still in flight are forgotten, their
+ * replies will be discarded by whoever reads the socket next.
+ */
+void
+rpcpipe_close(struct rpcpipe *rp)
+{
+    struct rpccall *rc;
+
+    if (rp->rp_loop != NULL)
+	rpcloop_remove(rp->rp_loop, rp);
+    for (rc = rp->rp_calls; rc != NULL; rc = rc->rc_next)
+	rpcstats_abandon(rp->rp_prog, rc->rc_proc);
+    rp->rp_calls = NULL;
+    memset(rp->rp_hash, 0, sizeof(rp->rp_hash));
+    rp->rp_outstanding = 0;
+    rp->rp_sinks = 0;
+    free(rp->rp_buf);
+    rp->rp_buf = NULL;
+}
+
+/*
+ * Release the message buffer of a call slot
+ */
+void
+rpccall_free(struct rpccall *rc)
+{
+    free(rc->rc_msg);
+    rc->rc_msg = NULL;
+    rc->rc_size = 0;
+}
+
+/*
+ * Encode and send a call. The result will be decoded into 'res'
+ * by 'xres' once the matching reply shows up in rpcpipe_recv.
+ *
+ * When the caller has set rc_sink, 'xres' decodes the reply only up
+ * to its bulk data: a trailing opaque whose length word it has just
+ * read. The bytes after that go straight from the socket to rc_sink
+ * when the reply is long (up to rc_sinksize, the rest such as XDR
+ * padding is dropped), and rc_sinklen says how many were stored.
+ *
+ * Likewise, when rc_src is set 'xargs' encodes the arguments up to
+ * the length word of their bulk data, and the rc_srclen bytes at
+ * rc_src are sent behind them without being copied. They must stay
+ * put until the reply is in, since UDP calls may be retransmitted.
+ */
+int
+rpcpipe_send(struct rpcpipe *rp, struct rpccall *rc, u_long proc,
+    xdrproc_t xargs, caddr_t args, xdrproc_t xres, caddr_t res)
+{
+    struct rpc_msg msg;
+    u_int32_t xproc = proc, mark;
+    u_int size, hdr;
+    XDR xdrs;
+
+    hdr = rp->rp_type == SOCK_STREAM ? BYTES_PER_XDR_UNIT : 0;
+    size = hdr + RPCHDRSIZE + xdr_sizeof(xargs, args);
+    if (size > rc->rc_size) {
+	free(rc->rc_msg);
+	if ((rc->rc_msg = malloc(size)) == NULL) {
+	    rc->rc_size = 0;
+	    rp->rp_stat = RPC_SYSTEMERROR;
+	    return 0;
+	}
+	rc->rc_size = size;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.rm_xid = rc->rc_xid = rp->rp_xid++;
+    msg.rm_direction = CALL;
+    msg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+    msg.rm_call.cb_prog = rp->rp_prog;
+    msg.rm_call.cb_vers = rp->rp_vers;
+    xdrmem_create(&xdrs, rc->rc_msg + hdr, rc->rc_size - hdr, XDR_ENCODE);
+    if (!xdr_callhdr(&xdrs, &msg) || !xdr_u_int32_t(&xdrs, &xproc) ||
+      !AUTH_MARSHALL(rp->rp_auth, &xdrs) || !(*xargs)(&xdrs, args)) {
+	XDR_DESTROY(&xdrs);
+	rp->rp_stat = RPC_CANTENCODEARGS;
+	return 0;
+    }
+    rc->rc_len = hdr + XDR_GETPOS(&xdrs);
+    XDR_DESTROY(&xdrs);
+    if (rc->rc_src == NULL)
+	rc->rc_srclen = 0;
+    if (hdr) {
+	mark = htonl(LAST_FRAG | (rc->rc_len - hdr + rc->rc_srclen +
+	    XDRPAD(rc->rc_srclen)));
+	memcpy(rc->rc_msg, &mark, sizeof(mark));
+    }
+
+    rc->rc_proc = proc;
+    rc->rc_xres = xres;
+    rc->rc_res = res;
+    rc->rc_stat = RPC_SUCCESS;
+    rc->rc_retrans = 0;
+    rc->rc_rto = rpcpipe_rto(rp);
+    if (!transmit(rp, rc))
+	return 0;
+    rc->rc_first = rc->rc_sent;
+    rc->rc_prev = NULL;
+    if ((rc->rc_next = rp->rp_calls) != NULL)
+	rc->rc_next->rc_prev = rc;
+    rp->rp_calls = rc;
+    rc->rc_hnext = rp->rp_hash[rc->rc_xid & (RPCPIPE_HASH - 1)];
+    rp->rp_hash[rc->rc_xid & (RPCPIPE_HASH - 1)] = rc;
+    rp->rp_outstanding++;
+    if (rc->rc_sink != NULL)
+	rp->rp_sinks++;
+    rpcstats_sent(rp->rp_prog, proc);
+    return 1;
+}
+
+/*
+ * Wait for the reply to any of the outstanding calls, retransmitting
+ * UDP calls that have not been answered in time. Returns the call the
+ * reply belongs to; its rc_stat tells whether the result was decoded.
+ * NULL means the transport failed or a call timed out (see rp_stat),
+ * in which case the call is taken off the pipe and left in rp_expired.
+ */
+struct rpccall *
+rpcpipe_recv(struct rpcpipe *rp)
+{
+    return rpcpipe_recvany(rp, 1, NULL);
+}
+
+/*
+ * Like rpcpipe_recv, but wait on all 'n' pipes of a set at once.
+ * The pipe the reply (or the failure) came from is returned in
+ * 'from' when that is not NULL.
+ */
+struct rpccall *
+rpcpipe_recvany(struct rpcpipe *rps, int n, struct rpcpipe **from)
+{
+    struct pollfd pfd[RPCPIPE_MAXSET];
+    struct rpcpipe *rp;
+    struct rpccall *rc;
+    struct timeval now;
+    long wait;
+    int i, busy, len;
+
+    if (n > RPCPIPE_MAXSET)
+	n = RPCPIPE_MAXSET;
+    for (;;) {
+	/* time out stale calls, retransmit and compute how long to wait */
+	gettimeofday(&now, NULL);
+	wait = -1;
+	for (i = busy = 0; i < n; i++) {
+	    rp = &rps[i];
+	    pfd[i].fd = -1;
+	    pfd[i].events = POLLIN;
+	    pfd[i].revents = 0;
+	    if (rp->rp_calls == NULL)
+		continue;
+	    if (from != NULL)
+		*from = rp;
+	    if (!expire(rp, &now, &wait))
+		return NULL;
+	    pfd[i].fd = rp->rp_fd;
+	    busy++;
+	}
+	if (busy == 0) {
+	    rps[0].rp_stat = RPC_FAILED;
+	    if (from != NULL)
+		*from = &rps[0];
+	    return NULL;
+	}
+
+	if ((len = poll(pfd, n, (int) wait)) < 0 && errno != EINTR) {
+	    for (i = 0; i < n; i++)
+		if (pfd[i].fd >= 0)
+		    break;
+	    rps[i].rp_stat = RPC_CANTRECV;
+	    if (from != NULL)
+		*from = &rps[i];
+	    return NULL;
+	}
+	if (len <= 0)
+	    continue;
+
+	for (i = 0; i < n; i++) {
+	    if (pfd[i].fd < 0 || pfd[i].revents == 0)
+		continue;
+	    rp = &rps[i];
+	    if (from != NULL)
+		*from = rp;
+	    if ((len = receive(rp, &rc)) < 0)
+		return NULL;
+	    if (rc != NULL || (rc = match(rp, len)) != NULL)
+		return rc;
+	}
+    }
+}
+
+/*
+ * Expire the calls of a pipe that have been outstanding too long and
+ * retransmit UDP calls that are due. 'wait' is lowered to the time
+ * until the next deadline of the pipe (-1 means none yet). Returns 0
+ * when a call timed out or the transport failed.
+ */
+static int
+expire(struct rpcpipe *rp, struct timeval *now, long *wait)
+{
+    struct rpccall *rc, *next;
+    long timeout, t;
+
+    timeout = rp->rp_timeout.tv_sec * 1000L + rp->rp_timeout.tv_usec / 1000;
+    for (rc = rp->rp_calls; rc != NULL; rc = next) {
+	next = rc->rc_next;
+	t = timeout - elapsed(now, &rc->rc_first);
+	if (t <= 0) {
+	    rpcstats_record(rp->rp_prog, rc->rc_proc, &rc->rc_first,
+		rc->rc_len + rc->rc_srclen, rc->rc_retrans, RPC_TIMEDOUT);
+	    takeoff(rp, rc);
+	    rc->rc_stat = RPC_TIMEDOUT;
+	    rp->rp_expired = rc;
+	    rp->rp_stat = RPC_TIMEDOUT;
+	    return 0;
+	}
+	if (*wait < 0 || t < *wait) *wait = t;
+	if (rp->rp_type != SOCK_DGRAM)
+	    continue;
+	t = rc->rc_rto - elapsed(now, &rc->rc_sent);
+	if (t <= 0) {
+	    if (!transmit(rp, rc)) {
+		if (rc->rc_addr == NULL)
+		    return 0;
+
+		/* only the destination of this one is unreachable */
+		rpcstats_record(rp->rp_prog, rc->rc_proc, &rc->rc_first,
+		    rc->rc_len + rc->rc_srclen, rc->rc_retrans, rp->rp_stat);
+		takeoff(rp, rc);
+		rc->rc_stat = rp->rp_stat;
+		rp->rp_expired = rc;
+		return 0;
+	    }
+	    rp->rp_retrans++;
+	    rc->rc_retrans++;
+
+	    /* back off, and keep new calls from going out too soon */
+	    rc->rc_rto = MIN(2 * rc->rc_rto, timeout);
+	    if (rp->rp_backoff < rc->rc_retrans)
+		rp->rp_backoff = MIN(rc->rc_retrans, 16);
+	    t = rc->rc_rto;
+	}
+	if (t < *wait) *wait = t;
+    }
+    return 1;
+}
+
+/*
+ * Find the call a received reply of 'len' bytes belongs to, take it
+ * off the pipe and decode the result. Returns NULL for stray replies.
+ */
+static struct rpccall *
+match(struct rpcpipe *rp, int len)
+{
+    struct rpccall *rc;
+    u_int pos;
+
+    if ((rc = lookup(rp, len)) == NULL)
+	return NULL;		/* duplicate or stale reply */
+    pos = decode(rp, rc, rp->rp_buf, len);
+    if (rc->rc_sink != NULL && rc->rc_stat == RPC_SUCCESS)
+	fillsink(rc, rp->rp_buf + pos, len - pos);
+    finish(rp, rc, len);
+    return rc;
+}
+
+/*
+ * Find the outstanding call with the transaction id at the start of
+ * the receive buffer, which holds 'len' bytes
+ */
+static struct rpccall *
+lookup(struct rpcpipe *rp, u_int len)
+{
+    struct rpccall *rc;
+    u_int32_t xid;
+
+    if (len < sizeof(xid))
+	return NULL;
+    memcpy(&xid, rp->rp_buf, sizeof(xid));
+    xid = ntohl(xid);
+    for (rc = rp->rp_hash[xid & (RPCPIPE_HASH - 1)]; rc != NULL;
+      rc = rc->rc_hnext)
+	if (rc->rc_xid == xid)
+	    break;
+    return rc;
+}
+
+/*
+ * Take a call whose reply of 'len' bytes has been dealt with off the pipe
+ */
+static void
+finish(struct rpcpipe *rp, struct rpccall *rc, u_int len)
+{
+    takeoff(rp, rc);
+    if (rc->rc_stat == RPC_SUCCESS)
+	sample(rp, rc);
+    rpcstats_record(rp->rp_prog, rc->rc_proc, &rc->rc_first,
+	rc->rc_len + rc->rc_srclen + len, rc->rc_retrans, rc->rc_stat);
+}
+
+/*
+ * Remove a call from the list and the xid table of outstanding calls
+ */
+static void
+takeoff(struct rpcpipe *rp, struct rpccall *rc)
+{
+    struct rpccall **rcp;
+
+    if (rc->rc_prev != NULL)
+	rc->rc_prev->rc_next = rc->rc_next;
+    else
+	rp->rp_calls = rc->rc_next;
+    if (rc->rc_next != NULL)
+	rc->rc_next->rc_prev = rc->rc_prev;
+    for (rcp = &rp->rp_hash[rc->rc_xid & (RPCPIPE_HASH - 1)]; *rcp != NULL;
+      rcp = &(*rcp)->rc_hnext) {
+	if (*rcp == rc) {
+	    *rcp = rc->rc_hnext;
+	    break;
+	}
+    }
+    rp->rp_outstanding--;
+    if (rc->rc_sink != NULL)
+	rp->rp_sinks--;
+}
+
+/*
+ * Fold the round trip time of an answered call into the estimate.
+ * Following Karn, calls that were retransmitted are not timed: the
+ * reply could be to any of the transmissions.
+ */
+static void
+sample(struct rpcpipe *rp, struct rpccall *rc)
+{
+    struct timeval now;
+    long rtt;
+
+    if (rc->rc_retrans > 0)
+	return;
+    gettimeofday(&now, NULL);
+    rtt = (now.tv_sec - rc->rc_first.tv_sec) * 1000000L +
+	(now.tv_usec - rc->rc_first.tv_usec);
+    if (rp->rp_srtt < 0) {
+	rp->rp_srtt = rtt;
+	rp->rp_rttvar = rtt / 2;
+    } else {
+	rp->rp_rttvar += ((rtt > rp->rp_srtt ? rtt - rp->rp_srtt :
+	    rp->rp_srtt - rtt) - rp->rp_rttvar) / 4;
+	rp->rp_srtt += (rtt - rp->rp_srtt) / 8;
+    }
+    rp->rp_backoff = 0;
+}
+
+/*
+ * The retransmission timeout for a new call, in milliseconds: the
+ * smoothed round trip time plus four times its deviation, doubled
+ * for every retransmission since the estimate was last confirmed.
+ * Until something was measured it is rp_retry.
+ */
+long
+rpcpipe_rto(struct rpcpipe *rp)
+{
+    long rto, timeout;
+
+    if (rp->rp_srtt < 0)
+	rto = rp->rp_retry.tv_sec * 1000L + rp->rp_retry.tv_usec / 1000;
+    else if ((rto = (rp->rp_srtt + 4 * rp->rp_rttvar) / 1000) < rp->rp_minrto)
+	rto = rp->rp_minrto;
+    rto <<= rp->rp_backoff;
+    timeout = rp->rp_timeout.tv_sec * 1000L + rp->rp_timeout.tv_usec / 1000;
+    if (rto > timeout)
+	rto = timeout;
+    return rto > 0 ? rto : 1;
+}
+
+/*
+ * Pick the pipe of a set with the fewest calls in flight, so
+ * requests spread evenly over the transports.
+ */
+struct rpcpipe *
+rpcpipe_pick(struct rpcpipe *rps, int n)
+{
+    struct rpcpipe *best;
+    int i;
+
+    for (best = &rps[0], i = 1; i < n; i++)
+	if (rps[i].rp_outstanding < best->rp_outstanding)
+	    best = &rps[i];
+    return best;
+}
+
+/*
+ * Set up an event loop without any pipes
+ */
+int
+rpcloop_open(struct rpcloop *rl)
+{
+    memset(rl, 0, sizeof(*rl));
+    return (rl->rl_fd = epoll_create1(EPOLL_CLOEXEC)) >= 0;
+}
+
+/*
+ * Tear down an event loop. Its pipes are left alone, apart from no
+ * longer belonging to it.
+ */
+void
+rpcloop_close(struct rpcloop *rl)
+{
+    struct rpcpipe *rp;
+
+    for (rp = rl->rl_pipes; rp != NULL; rp = rp->rp_lnext)
+	rp->rp_loop = NULL;
+    rl->rl_pipes = NULL;
+    rl->rl_npipes = 0;
+    if (rl->rl_fd >= 0)
+	close(rl->rl_fd);
+    rl->rl_fd = -1;
+}
+
+/*
+ * Add a pipe to an event loop. No two pipes of a loop may share a
+ * transport.
+ */
+int
+rpcloop_add(struct rpcloop *rl, struct rpcpipe *rp)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = rp;
+    if (epoll_ctl(rl->rl_fd, EPOLL_CTL_ADD, rp->rp_fd, &ev) < 0) {
+	rp->rp_stat = RPC_SYSTEMERROR;
+	return 0;
+    }
+    rp->rp_loop = rl;
+    rp->rp_lnext = rl->rl_pipes;
+    rl->rl_pipes = rp;
+    rl->rl_npipes++;
+    return 1;
+}
+
+/*
+ * Take a pipe out of its event loop, forgetting about any readiness
+ * of its transport that was seen but not dealt with yet
+ */
+void
+rpcloop_remove(struct rpcloop *rl, struct rpcpipe *rp)
+{
+    struct rpcpipe **rpp;
+    int i;
+
+    for (rpp = &rl->rl_pipes; *rpp != NULL; rpp = &(*rpp)->rp_lnext) {
+	if (*rpp == rp) {
+	    *rpp = rp->rp_lnext;
+	    rl->rl_npipes--;
+	    break;
+	}
+    }
+    for (i = rl->rl_cur; i < rl->rl_nready; i++)
+	if (rl->rl_events[i].data.ptr == rp)
+	    rl->rl_events[i].data.ptr = NULL;
+    (void) epoll_ctl(rl->rl_fd, EPOLL_CTL_DEL, rp->rp_fd, NULL);
+    rp->rp_loop = NULL;
+    rp->rp_lnext = NULL;
+}
+
+/*
+ * Like rpcpipe_recvany, for all pipes of an event loop. A transport
+ * that fails while it has no calls in flight is just taken out of
+ * the loop.
+ */
+struct rpccall *
+rpcloop_recv(struct rpcloop *rl, struct rpcpipe **from)
+{
+    struct rpcpipe *rp, *busy;
+    struct rpccall *rc;
+    struct timeval now;
+    long wait;
+    int n, len;
+
+    if (from != NULL)
+	*from = rl->rl_pipes;
+    for (;;) {
+	/* time out stale calls, retransmit and compute how long to wait */
+	gettimeofday(&now, NULL);
+	wait = -1;
+	for (busy = NULL, rp = rl->rl_pipes; rp != NULL; rp = rp->rp_lnext) {
+	    if (rp->rp_calls == NULL)
+		continue;
+	    if (from != NULL)
+		*from = rp;
+	    if (!expire(rp, &now, &wait))
+		return NULL;
+	    busy = rp;
+	}
+	if (busy == NULL) {
+	    if (rl->rl_pipes != NULL)
+		rl->rl_pipes->rp_stat = RPC_FAILED;
+	    return NULL;
+	}
+
+	/* deal with what the last epoll_wait reported before asking again */
+	if (rl->rl_cur == rl->rl_nready) {
+	    rl->rl_cur = rl->rl_nready = 0;
+	    n = epoll_wait(rl->rl_fd, rl->rl_events, RPCLOOP_EVENTS, (int) wait);
+	    if (n < 0 && errno != EINTR) {
+		busy->rp_stat = RPC_CANTRECV;
+		if (from != NULL)
+		    *from = busy;
+		return NULL;
+	    }
+	    rl->rl_nready = MAX(n, 0);
+	}
+	while (rl->rl_cur < rl->rl_nready) {
+	    if ((rp = rl->rl_events[rl->rl_cur++].data.ptr) == NULL)
+		continue;
+	    if (from != NULL)
+		*from = rp;
+	    if ((len = receive(rp, &rc)) < 0) {
+		if (rp->rp_calls == NULL) {
+		    rpcloop_remove(rl, rp);
+		    continue;
+		}
+		return NULL;
+	    }
+	    if (rc != NULL || (rc = match(rp, len)) != NULL)
+		return rc;
+	}
+    }
+}
+
+/*
+ * Hand every reply to the completion function (rc_done) of its call,
+ * until no calls are in flight anymore. Completion functions may send
+ * further calls on any pipe of the loop. A call that times out is
+ * completed with rc_stat set to RPC_TIMEDOUT; when a transport fails,
+ * all calls in flight on it complete with the failure and the pipe
+ * leaves the loop.
+ */
+void
+rpcloop_run(struct rpcloop *rl)
+{
+    struct rpcpipe *rp;
+    struct rpccall *rc;
+
+    while (busyloop(rl) > 0) {
+	if ((rc = rpcloop_recv(rl, &rp)) == NULL) {
+	    if ((rc = rp->rp_expired) == NULL) {
+		while ((rc = rp->rp_calls) != NULL) {
+		    takeoff(rp, rc);
+		    rc->rc_stat = rp->rp_stat;
+		    rpcstats_record(rp->rp_prog, rc->rc_proc, &rc->rc_first,
+			rc->rc_len + rc->rc_srclen, rc->rc_retrans,
+			rc->rc_stat);
+		    if (rc->rc_done != NULL)
+			(*rc->rc_done)(rp, rc);
+		}
+		rpcloop_remove(rl, rp);
+		continue;
+	    }
+	}
+	if (rc->rc_done != NULL)
+	    (*rc->rc_done)(rp, rc);
+    }
+}
+
+/*
+ * Count the calls in flight on the pipes of a loop, and clear their
+ * record of expired calls so that a new one stands out
+ */
+static long
+busyloop(struct rpcloop *rl)
+{
+    struct rpcpipe *rp;
+    long n = 0;
+
+    for (rp = rl->rl_pipes; rp != NULL; rp = rp->rp_lnext) {
+	rp->rp_expired = NULL;
+	n += rp->rp_outstanding;
+    }
+    return n;
+}
+
+/*
+ * (Re)transmit a call over the pipe's transport. The encoded part and
+ * the bulk data, if any, go out together with a single sendmsg.
+ */
+static int
+transmit(struct rpcpipe *rp, struct rpccall *rc)
+{
+    static char zeros[BYTES_PER_XDR_UNIT];
+    struct iovec iov[3], *iop;
+    struct pollfd pfd;
+    struct msghdr msg;
+    int n, niov;
+
+    iov[0].iov_base = rc->rc_msg;
+    iov[0].iov_len = rc->rc_len;
+    iov[1].iov_base = rc->rc_src;
+    iov[1].iov_len = rc->rc_srclen;
+    iov[2].iov_base = zeros;
+    iov[2].iov_len = XDRPAD(rc->rc_srclen);
+    iop = iov;
+    niov = rc->rc_srclen > 0 ? 3 : 1;
+    while (niov > 0) {
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iop;
+	msg.msg_iovlen = niov;
+	if (rp->rp_type == SOCK_DGRAM) {
+	    msg.msg_name = rc->rc_addr != NULL ? rc->rc_addr : &rp->rp_addr;
+	    msg.msg_namelen = sizeof(rp->rp_addr);
+	}
+	if ((n = sendmsg(rp->rp_fd, &msg, 0)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		pfd.fd = rp->rp_fd;
+		pfd.events = POLLOUT;
+		(void) poll(&pfd, 1, -1);
+		continue;
+	    }
+	    rp->rp_stat = RPC_CANTSEND;
+	    return 0;
+	}
+	if (rp->rp_type == SOCK_DGRAM)
+	    break;
+
+	/* a stream may take part of it, carry on behind that */
+	for (; niov > 0 && n >= iop->iov_len; iop++, niov--)
+	    n -= iop->iov_len;
+	if (niov > 0) {
+	    iop->iov_base = (char *) iop->iov_base + n;
+	    iop->iov_len -= n;
+	}
+    }
+    gettimeofday(&rc->rc_sent, NULL);
+    return 1;
+}
+
+/*
+ * Receive one reply message into the pipe's buffer. On TCP this
+ * reassembles all fragments of a record. Returns the message length,
+ * or -1 if the transport failed. A long reply to a call with a sink
+ * is decoded and finished right here instead; it is returned in
+ * 'done' (otherwise set to NULL) and the length is 0.
+ */
+static int
+receive(struct rpcpipe *rp, struct rpccall **done)
+{
+    u_int32_t mark;
+    u_int len, frag, got;
+    char *buf;
+    int n;
+
+    *done = NULL;
+    if (rp->rp_type == SOCK_DGRAM) {
+	if (rp->rp_sinks > 0)
+	    return recvdgram(rp, done);
+	while ((n = recv(rp->rp_fd, rp->rp_buf, rp->rp_bufsize, 0)) < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	    if (errno != EINTR) {
+		rp->rp_stat = RPC_CANTRECV;
+		return -1;
+	    }
+	}
+	return n;
+    }
+
+    for (len = 0; ; len += frag) {
+	if (!readall(rp, (char *)&mark, sizeof(mark)))
+	    return -1;
+	mark = ntohl(mark);
+	frag = mark & ~LAST_FRAG;
+	got = 0;
+	if (len == 0 && (mark & LAST_FRAG) && frag > RPCPEEK &&
+	  rp->rp_sinks > 0) {
+	    if ((n = recvsink(rp, frag, done)) != 0)
+		return n < 0 ? -1 : 0;
+	    got = RPCPEEK;
+	}
+	if (len + frag > rp->rp_bufsize) {
+	    if ((buf = realloc(rp->rp_buf, len + frag)) == NULL) {
+		rp->rp_stat = RPC_SYSTEMERROR;
+		return -1;
+	    }
+	    rp->rp_buf = buf;
+	    rp->rp_bufsize = len + frag;
+	}
+	if (!readall(rp, rp->rp_buf + len + got, frag - got))
+	    return -1;
+	if (mark & LAST_FRAG)
+	    return len + frag;
+    }
+}
+
+/*
+ * Read the start of a single fragment TCP record of 'frag' bytes into
+ * the buffer. If it answers a call with a sink, decode the header and
+ * read the bulk data from the socket straight into the sink; returns
+ * 1 with the call in 'done'. Returns 0 when the first RPCPEEK bytes
+ * are in the buffer and the rest is up to the caller, -1 on failure.
+ */
+static int
+recvsink(struct rpcpipe *rp, u_int frag, struct rpccall **done)
+{
+    struct rpccall *rc;
+    u_int pos, have, rest, n;
+
+    if (!readall(rp, rp->rp_buf, RPCPEEK))
+	return -1;
+    if ((rc = lookup(rp, RPCPEEK)) == NULL || rc->rc_sink == NULL)
+	return 0;
+    pos = decode(rp, rc, rp->rp_buf, RPCPEEK);
+    if (rc->rc_stat != RPC_SUCCESS)
+	return 0;		/* try again with the whole reply */
+
+    fillsink(rc, rp->rp_buf + pos, RPCPEEK - pos);
+    have = rc->rc_sinklen;
+    rest = frag - RPCPEEK;
+    n = MIN(rest, rc->rc_sinksize - have);
+    if (!readall(rp, rc->rc_sink + have, n))
+	return -1;
+    rc->rc_sinklen += n;
+    for (rest -= n; rest > 0; rest -= n) {
+	n = MIN(rest, rp->rp_bufsize);	/* padding */
+	if (!readall(rp, rp->rp_buf, n))
+	    return -1;
+    }
+    finish(rp, rc, frag);
+    *done = rc;
+    return 1;
+}
+
+/*
+ * Receive a datagram while calls with a sink are outstanding. Its
+ * start is looked at first; if it is a reply to such a call, the
+ * header goes into the buffer and the bulk data straight into the
+ * sink with a single recvmsg. Return values are as for receive.
+ */
+static int
+recvdgram(struct rpcpipe *rp, struct rpccall **done)
+{
+    struct rpccall *rc;
+    struct msghdr msg;
+    struct iovec iov[3];
+    u_int pos;
+    int n;
+
+    while ((n = recv(rp->rp_fd, rp->rp_buf, RPCPEEK, MSG_PEEK)) < 0) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	if (errno != EINTR) {
+	    rp->rp_stat = RPC_CANTRECV;
+	    return -1;
+	}
+    }
+    rc = n == RPCPEEK ? lookup(rp, n) : NULL;
+    if (rc != NULL && rc->rc_sink != NULL) {
+	pos = decode(rp, rc, rp->rp_buf, n);
+	if (rc->rc_stat == RPC_SUCCESS) {
+	    iov[0].iov_base = rp->rp_buf;
+	    iov[0].iov_len = pos;
+	    iov[1].iov_base = rc->rc_sink;
+	    iov[1].iov_len = rc->rc_sinksize;
+	    iov[2].iov_base = rp->rp_buf + pos;	/* padding */
+	    iov[2].iov_len = rp->rp_bufsize - pos;
+	    memset(&msg, 0, sizeof(msg));
+	    msg.msg_iov = iov;
+	    msg.msg_iovlen = 3;
+	    while ((n = recvmsg(rp->rp_fd, &msg, 0)) < 0) {
+		if (errno != EINTR) {
+		    rp->rp_stat = RPC_CANTRECV;
+		    return -1;
+		}
+	    }
+	    rc->rc_sinklen = MIN(n - pos, rc->rc_sinksize);
+	    finish(rp, rc, n);
+	    *done = rc;
+	    return 0;
+	}
+    }
+    while ((n = recv(rp->rp_fd, rp->rp_buf, rp->rp_bufsize, 0)) < 0) {
+	if (errno != EINTR) {
+	    rp->rp_stat = RPC_CANTRECV;
+	    return -1;
+	}
+    }
+    return n;
+}
+
+/*
+ * Read exactly 'len' bytes from a stream transport
+ */
+static int
+readall(struct rpcpipe *rp, char *buf, u_int len)
+{
+    struct pollfd pfd;
+    int n;
+
+    while (len > 0) {
+	pfd.fd = rp->rp_fd;
+	pfd.events = POLLIN;
+	n = poll(&pfd, 1, rp->rp_timeout.tv_sec * 1000 +
+	    rp->rp_timeout.tv_usec / 1000);
+	if (n == 0) {
+	    rp->rp_stat = RPC_TIMEDOUT;
+	    return 0;
+	}
+	if (n > 0)
+	    n = read(rp->rp_fd, buf, len);
+	if (n < 0) {
+	    if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+		continue;
+	    rp->rp_stat = RPC_CANTRECV;
+	    return 0;
+	}
+	if (n == 0) {
+	    rp->rp_stat = RPC_CANTRECV;
+	    return 0;
+	}
+	buf += n;
+	len -= n;
+    }
+    return 1;
+}
+
+/*
+ * Decode a reply message of 'len' bytes at 'buf' into the result area
+ * of its call. Returns how far the decoding got.
+ */
+static u_int
+decode(struct rpcpipe *rp, struct rpccall *rc, char *buf, u_int len)
+{
+    struct rpc_msg msg;
+    struct rpc_err err;
+    XDR xdrs;
+    u_int pos;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.acpted_rply.ar_verf = _null_auth;
+    msg.acpted_rply.ar_results.where = rc->rc_res;
+    msg.acpted_rply.ar_results.proc = rc->rc_xres;
+    xdrmem_create(&xdrs, buf, len, XDR_DECODE);
+    if (xdr_replymsg(&xdrs, &msg)) {
+	_seterr_reply(&msg, &err);
+	rc->rc_stat = err.re_status;
+	if (rc->rc_stat == RPC_SUCCESS &&
+	  !AUTH_VALIDATE(rp->rp_auth, &msg.acpted_rply.ar_verf))
+	    rc->rc_stat = RPC_AUTHERROR;
+	if (msg.acpted_rply.ar_verf.oa_base != NULL) {
+	    xdrs.x_op = XDR_FREE;
+	    (void) xdr_opaque_auth(&xdrs, &msg.acpted_rply.ar_verf);
+	}
+    } else
+	rc->rc_stat = RPC_CANTDECODERES;
+    pos = XDR_GETPOS(&xdrs);
+    XDR_DESTROY(&xdrs);
+    return pos;
+}
+
+/*
+ * Store the bulk data of a reply that was read into the buffer
+ */
+static void
+fillsink(struct rpccall *rc, char *data, u_int len)
+{
+    rc->rc_sinklen = MIN(len, rc->rc_sinksize);
+    memcpy(rc->rc_sink, data, rc->rc_sinklen);
+}
+
+/*
+ * Milliseconds between two points in time
+ */
+static long
+elapsed(struct timeval *now, struct timeval *then)
+{
+    return (now->tv_sec - then->tv_sec) * 1000L +
+	(now->tv_usec - then->tv_usec) / 1000;
+}
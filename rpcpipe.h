@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * rpcpipe - keep several RPC calls in flight on one transport, and
+ * drive any number of such transports from one event loop
+ */
+#ifndef _RPCPIPE_H
+#define	_RPCPIPE_H
+
+#include <rpc/rpc.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+
+#define	RPCPIPE_INITRTO	500	/* retransmission timeout to start with (ms) */
+#define	RPCPIPE_MINRTO	200	/* least retransmission timeout (ms) */
+#define	RPCPIPE_MAXSET	16	/* most pipes rpcpipe_recvany waits on */
+#define	RPCPIPE_HASH	64	/* buckets of the xid table, a power of 2 */
+#define	RPCLOOP_EVENTS	32	/* ready transports taken per epoll_wait */
+
+struct rpcpipe;
+struct rpcloop;
+
+/*
+ * A single outstanding call. The storage is owned by the caller,
+ * so a slot can be reused for many calls without reallocating
+ * its message buffer.
+ */
+struct rpccall {
+    u_int32_t rc_xid;		/* transaction id of this call */
+    u_long rc_proc;		/* procedure called */
+    xdrproc_t rc_xres;		/* result decoding routine */
+    caddr_t rc_res;		/* where to decode the result */
+    enum clnt_stat rc_stat;	/* RPC status of the reply */
+    char *rc_msg;		/* encoded call, kept for retransmission */
+    u_int rc_len;		/* length of encoded part of the call */
+    u_int rc_size;		/* allocated size of rc_msg */
+    struct timeval rc_first;	/* time of first transmission */
+    struct timeval rc_sent;	/* time of last transmission */
+    int rc_retrans;		/* number of retransmissions */
+    long rc_rto;		/* its retransmission timeout (ms) */
+    void *rc_data;		/* owner's private data */
+    void (*rc_done)(struct rpcpipe *, struct rpccall *);
+				/* completion, for rpcloop_run */
+    char *rc_src;		/* bulk data of the call, or NULL */
+    u_int rc_srclen;		/* its length */
+    char *rc_sink;		/* bulk data of the reply goes here, or NULL */
+    u_int rc_sinksize;		/* room at rc_sink */
+    u_int rc_sinklen;		/* bulk data bytes stored at rc_sink */
+    struct sockaddr_in *rc_addr; /* UDP: send it here, not to rp_addr */
+    struct rpccall *rc_next;	/* next outstanding call */
+    struct rpccall *rc_prev;	/* previous outstanding call */
+    struct rpccall *rc_hnext;	/* next call in the same xid bucket */
+};
+
+/*
+ * A pipe borrows the socket and credentials of an already
+ * established CLIENT handle. It keeps an estimate of the round trip
+ * time, from which the retransmission timeout of UDP calls follows.
+ */
+struct rpcpipe {
+    int rp_fd;			/* transport socket */
+    int rp_type;		/* SOCK_STREAM or SOCK_DGRAM */
+    struct sockaddr_in rp_addr;	/* server address */
+    AUTH *rp_auth;		/* credentials to use */
+    u_long rp_prog;		/* program number */
+    u_long rp_vers;		/* program version */
+    u_int32_t rp_xid;		/* next transaction id */
+    int rp_outstanding;		/* number of calls in flight */
+    int rp_sinks;		/* calls in flight with a sink */
+    int rp_retrans;		/* number of UDP retransmissions */
+    struct rpccall *rp_calls;	/* list of calls in flight */
+    struct rpccall *rp_hash[RPCPIPE_HASH]; /* the same, by xid */
+    char *rp_buf;		/* receive buffer */
+    u_int rp_bufsize;		/* size of receive buffer */
+    struct timeval rp_timeout;	/* give up on a call after this */
+    struct timeval rp_retry;	/* retransmission timeout to start with */
+    long rp_minrto;		/* least retransmission timeout (ms) */
+    long rp_srtt;		/* smoothed round trip time (us), -1 if none */
+    long rp_rttvar;		/* its mean deviation (us) */
+    int rp_backoff;		/* timeout doublings since the last sample */
+    struct rpccall *rp_expired;	/* call that timed out */
+    enum clnt_stat rp_stat;	/* status of last transport failure */
+    struct rpcloop *rp_loop;	/* event loop the pipe belongs to */
+    struct rpcpipe *rp_lnext;	/* next pipe of that loop */
+};
+
+/*
+ * An event loop waits on all its pipes with a single epoll instance.
+ * Replies can either be taken one at a time (rpcloop_recv), or be
+ * handed to the completion function of their call (rpcloop_run).
+ */
+struct rpcloop {
+    int rl_fd;			/* the epoll instance */
+    struct rpcpipe *rl_pipes;	/* the pipes */
+    int rl_npipes;		/* number of pipes */
+    struct epoll_event rl_events[RPCLOOP_EVENTS]; /* ready transports */
+    int rl_nready;		/* number of entries in rl_events */
+    int rl_cur;			/* next one to deal with */
+};
+
+int rpcpipe_open(struct rpcpipe *, CLIENT *, u_long, u_long, u_int);
+int rpcpipe_openfd(struct rpcpipe *, int, AUTH *, u_long, u_long, u_int);
+void rpcpipe_close(struct rpcpipe *);
+int rpcpipe_send(struct rpcpipe *, struct rpccall *, u_long,
+    xdrproc_t, caddr_t, xdrproc_t, caddr_t);
+struct rpccall *rpcpipe_recv(struct rpcpipe *);
+struct rpccall *rpcpipe_recvany(struct rpcpipe *, int, struct rpcpipe **);
+struct rpcpipe *rpcpipe_pick(struct rpcpipe *, int);
+long rpcpipe_rto(struct rpcpipe *);
+void rpccall_free(struct rpccall *);
+int rpcloop_open(struct rpcloop *);
+void rpcloop_close(struct rpcloop *);
+int rpcloop_add(struct rpcloop *, struct rpcpipe *);
+void rpcloop_remove(struct rpcloop *, struct rpcpipe *);
+struct rpccall *rpcloop_recv(struct rpcloop *, struct rpcpipe **);
+void rpcloop_run(struct rpcloop *);
+
+#endif /* _RPCPIPE_H */
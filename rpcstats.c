@@ -0,0 +1,693 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * rpcstats - per procedure call counts, volumes and latencies
+ *
+ * Calls made through the rpcgen stubs are timed by interposing on
+ * the cl_call operation of the client handle, calls sent through an
+ * rpcpipe are recorded by the pipe itself. Only NFS and MOUNT are
+ * tracked, those are the only programs nfsshell talks to for more
+ * than a single call.
+ *
+ * Every thread counts in a block of its own, aligned to a cache line,
+ * which only that thread writes to. Recording a call takes no lock
+ * and shares no cache line with other threads; the blocks are merged
+ * when the statistics are shown. Counters are read and written with
+ * relaxed atomic operations, so a thread showing them sees whole
+ * values. Clearing the statistics starts a new epoch, and each thread
+ * clears its own block when it next records a call in it. When a
+ * thread exits its counts are added to those of the threads before
+ * it, and its block is kept for the next thread.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <rpc/rpc.h>
+#include "mount.h"
+#include "nfs_prot.h"
+#include "rpcstats.h"
+
+/*
+ * Latencies (in microseconds) are kept in a log-linear histogram:
+ * every power of two is split in 2^HIST_SUBBITS buckets, so that a
+ * percentile is off by less than 1/2^HIST_SUBBITS whatever its size.
+ */
+#define	HIST_SUBBITS	4
+#define	HIST_SUB	(1 << HIST_SUBBITS)
+#define	HIST_MAXBITS	40	/* about 12 days */
+#define	HIST_BUCKETS	((HIST_MAXBITS - HIST_SUBBITS + 1) * HIST_SUB)
+
+#define	NNFSPROCS	(NFS3_COMMIT + 1)
+#define	NMNTPROCS	(MOUNT3_EXPORT + 1)
+#define	NPROCS		(NMNTPROCS + NNFSPROCS)
+#define	NWRAPPERS	4	/* distinct transports times programs */
+#define	CACHELINE	64	/* bytes in a cache line */
+
+#define	LOAD(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define	STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define	ADD(x, n)	STORE(x, LOAD(x) + (n))	/* by the owner only */
+
+struct rpcstat {
+    u_long rs_calls;		/* completed calls */
+    u_long rs_errors;		/* calls that failed at the RPC level */
+    u_long rs_retrans;		/* retransmissions */
+    long rs_inflight;		/* calls sent and not yet completed */
+    unsigned long long rs_bytes; /* call and reply bytes */
+    unsigned long long rs_max;	/* largest latency */
+    long long rs_first;		/* start of the first call (us) */
+    long long rs_last;		/* end of the last call (us) */
+    u_long rs_hist[HIST_BUCKETS]; /* latency histogram */
+};
+
+/*
+ * The counters of one thread. A statistic indexes the MOUNT procedures
+ * first, then the NFS ones.
+ */
+struct rpcthread {
+    struct rpcstat rt_stat[NPROCS]; /* per procedure */
+    u_int rt_epoch;		/* epoch the counters belong to */
+    int rt_inuse;		/* a thread owns the block */
+    char rt_name[RPCSTATS_NAMELEN]; /* what the thread does */
+    unsigned long long rt_ops;	/* rpcstats_top: calls at the last view */
+    unsigned long long rt_bytes; /* and bytes */
+    unsigned long long rt_retrans; /* and retransmissions */
+    struct rpcthread *rt_next;	/* next thread */
+} __attribute__((aligned(CACHELINE)));
+
+/*
+ * A copy of the operations vector of a transport, with cl_call
+ * replaced by timedcall
+ */
+struct wrapper {
+    struct clnt_ops *w_orig;	/* operations of the transport */
+    struct clnt_ops w_ops;	/* the same, but timed */
+    u_long w_prog;		/* program the calls are for */
+};
+
+static struct rpcthread *threads; /* every block handed out */
+static int nthreads;		/* number of those */
+static __thread struct rpcthread *self; /* block of this thread */
+static struct rpcstat retired[NPROCS]; /* counts of threads that exited */
+static struct rpcstat total[NPROCS]; /* all counts, see collect */
+static unsigned long long topprev[NPROCS][3]; /* rpcstats_top: last view */
+static long long toptime;	/* when that was */
+static u_int topepoch;		/* and in which epoch */
+static unsigned long long goneprev[3]; /* rpcstats_top: exited threads */
+static u_int epoch;		/* bumped by rpcstats_reset */
+static struct wrapper wrappers[NWRAPPERS];
+static int nwrappers;
+static long long since;		/* last reset, or the first call (us) */
+static pthread_key_t key;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *nfsnames[NNFSPROCS] = {
+    "NULL", "GETATTR", "SETATTR", "LOOKUP", "ACCESS", "READLINK",
+    "READ", "WRITE", "CREATE", "MKDIR", "SYMLINK", "MKNOD", "REMOVE",
+    "RMDIR", "RENAME", "LINK", "READDIR", "READDIRPLUS", "FSSTAT",
+    "FSINFO", "PATHCONF", "COMMIT"
+};
+static char *mntnames[NMNTPROCS] = {
+    "NULL", "MNT", "DUMP", "UMNT", "UMNTALL", "EXPORT"
+};
+
+static enum clnt_stat timedcall(CLIENT *, rpcproc_t, xdrproc_t, void *,
+    xdrproc_t, void *, struct timeval);
+static struct rpcstat *lookupstat(u_long, u_long);
+static struct rpcthread *thisthread(void);
+static void makekey(void);
+static void endthread(void *);
+static void merge(struct rpcstat *, struct rpcstat *);
+static void collect(void);
+static void procname(int, char **, char **);
+static long long now_us(void);
+static int bucket(unsigned long long);
+static unsigned long long bucketvalue(int);
+static unsigned long long percentile(struct rpcstat *, int);
+
+/*
+ * Time all calls made on 'clnt', which talks to program 'prog'
+ */
+void
+rpcstats_attach(CLIENT *clnt, u_long prog)
+{
+    struct wrapper *w;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < nwrappers; i++) {
+	w = &wrappers[i];
+	if (clnt->cl_ops == &w->w_ops)
+	    break;			/* already timed */
+	if (clnt->cl_ops == w->w_orig && w->w_prog == prog) {
+	    clnt->cl_ops = &w->w_ops;
+	    break;
+	}
+    }
+    if (i == nwrappers && nwrappers < NWRAPPERS) {
+	w = &wrappers[nwrappers++];
+	w->w_orig = clnt->cl_ops;
+	w->w_ops = *clnt->cl_ops;
+	w->w_ops.cl_call = timedcall;
+	w->w_prog = prog;
+	clnt->cl_ops = &w->w_ops;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Replacement cl_call: time the call made by the original one
+ */
+static enum clnt_stat
+timedcall(CLIENT *clnt, rpcproc_t proc, xdrproc_t xargs, void *args,
+    xdrproc_t xres, void *res, struct timeval timeout)
+{
+    struct wrapper *w;
+    struct timeval start;
+    enum clnt_stat stat;
+    u_long bytes;
+
+    w = (struct wrapper *) ((char *) clnt->cl_ops -
+	offsetof(struct wrapper, w_ops));
+    gettimeofday(&start, NULL);
+    rpcstats_sent(w->w_prog, proc);
+    stat = (*w->w_orig->cl_call)(clnt, proc, xargs, args, xres, res, timeout);
+    bytes = xdr_sizeof(xargs, args);
+    if (stat == RPC_SUCCESS)
+	bytes += xdr_sizeof(xres, res);
+    rpcstats_record(w->w_prog, proc, &start, bytes, 0, stat);
+    return stat;
+}
+
+/*
+ * A call to procedure 'proc' of program 'prog' went out
+ */
+void
+rpcstats_sent(u_long prog, u_long proc)
+{
+    struct rpcstat *rs;
+
+    if ((rs = lookupstat(prog, proc)) != NULL)
+	ADD(rs->rs_inflight, 1);
+}
+
+/*
+ * A call that went out will not be completed: its transport is closed
+ */
+void
+rpcstats_abandon(u_long prog, u_long proc)
+{
+    struct rpcstat *rs;
+
+    if ((rs = lookupstat(prog, proc)) != NULL)
+	ADD(rs->rs_inflight, -1);
+}
+
+/*
+ * Account for a call to procedure 'proc' of program 'prog' that was
+ * sent at 'start' and has just completed
+ */
+void
+rpcstats_record(u_long prog, u_long proc, struct timeval *start,
+    u_long bytes, int retrans, enum clnt_stat stat)
+{
+    struct rpcstat *rs;
+    long long us, first, unset = 0, now = now_us();
+
+    first = start->tv_sec * 1000000LL + start->tv_usec;
+    us = now - first;
+    if (us < 0)
+	us = 0;
+    if (LOAD(since) == 0)
+	(void) __atomic_compare_exchange_n(&since, &unset, first, 0,
+	    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    if ((rs = lookupstat(prog, proc)) == NULL)
+	return;
+    ADD(rs->rs_inflight, -1);
+    if (LOAD(rs->rs_calls) == 0 && LOAD(rs->rs_errors) == 0)
+	STORE(rs->rs_first, first);
+    STORE(rs->rs_last, now);
+    ADD(rs->rs_retrans, retrans);
+    ADD(rs->rs_bytes, bytes);
+    if (stat != RPC_SUCCESS)
+	ADD(rs->rs_errors, 1);
+    else {
+	ADD(rs->rs_calls, 1);
+	ADD(rs->rs_hist[bucket(us)], 1);
+	if (us > LOAD(rs->rs_max))
+	    STORE(rs->rs_max, us);
+    }
+}
+
+/*
+ * Say what the calling thread does, for rpcstats_top
+ */
+void
+rpcstats_name(char *name)
+{
+    struct rpcthread *rt;
+
+    if ((rt = thisthread()) == NULL)
+	return;
+    pthread_mutex_lock(&lock);
+    strncpy(rt->rt_name, name, sizeof(rt->rt_name) - 1);
+    rt->rt_name[sizeof(rt->rt_name) - 1] = '\0';
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Print the statistics of every procedure that was called, either
+ * as a table or (when 'json' is set) as a single JSON object, which
+ * also tells how long ago the statistics were cleared
+ */
+void
+rpcstats_print(FILE *fp, int json)
+{
+    struct rpcstat *rs;
+    char *prog, *name;
+    double secs, mbs;
+    long long now = now_us();
+    int i, first = 1;
+
+    pthread_mutex_lock(&lock);
+    collect();
+    if (json)
+	fprintf(fp, "{\"elapsed_us\":%lld,\"procedures\":[",
+	    LOAD(since) == 0 ? 0LL : now - LOAD(since));
+    else
+	fprintf(fp, "%-17s %8s %6s %7s %12s %9s %9s %9s %8s\n",
+	    "procedure", "calls", "errors", "retrans", "bytes",
+	    "p50 ms", "p99 ms", "max ms", "MB/s");
+    for (i = 0; i < NPROCS; i++) {
+	rs = &total[i];
+	procname(i, &prog, &name);
+	if (rs->rs_calls == 0 && rs->rs_errors == 0)
+	    continue;
+	secs = (rs->rs_last - rs->rs_first) / 1e6;
+	mbs = secs > 0 ? rs->rs_bytes / secs / 1e6 : 0;
+	if (json) {
+	    fprintf(fp, "%s{\"program\":\"%s\",\"procedure\":\"%s\","
+		"\"calls\":%lu,\"errors\":%lu,\"retrans\":%lu,"
+		"\"bytes\":%llu,\"p50_us\":%llu,\"p99_us\":%llu,"
+		"\"max_us\":%llu,\"mb_per_s\":%.3f}",
+		first ? "" : ",", prog, name, rs->rs_calls, rs->rs_errors,
+		rs->rs_retrans, rs->rs_bytes, percentile(rs, 50),
+		percentile(rs, 99), rs->rs_max, mbs);
+	} else {
+	    fprintf(fp, "%-5s %-11s %8lu %6lu %7lu %12llu %9.3f %9.3f %9.3f %8.2f\n",
+		prog, name, rs->rs_calls, rs->rs_errors, rs->rs_retrans,
+		rs->rs_bytes, percentile(rs, 50) / 1e3,
+		percentile(rs, 99) / 1e3, rs->rs_max / 1e3, mbs);
+	}
+	first = 0;
+    }
+    if (json)
+	fprintf(fp, "]}\n");
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Show the rates since the previous call (or since the statistics
+ * were cleared): calls and bytes per second, calls in flight and the
+ * share of calls retransmitted. A 'brief' view is a single line of
+ * totals, the full one has a line per thread and per procedure.
+ */
+void
+rpcstats_top(FILE *fp, int brief)
+{
+    unsigned long long ops, bytes, retrans, dops, dbytes, dretrans;
+    struct rpcthread *rt;
+    struct rpcstat *rs;
+    long long now = now_us();
+    double secs;
+    char *prog, *name, stamp[16];
+    long inflight, tinflight = 0;
+    unsigned long long tops = 0, tbytes = 0, tretrans = 0;
+    time_t t = time(NULL);
+    int i, cur;
+
+    pthread_mutex_lock(&lock);
+    collect();
+    if (topepoch != epoch || toptime == 0) {
+	memset(topprev, 0, sizeof(topprev));
+	memset(goneprev, 0, sizeof(goneprev));
+	for (rt = threads; rt != NULL; rt = rt->rt_next)
+	    rt->rt_ops = rt->rt_bytes = rt->rt_retrans = 0;
+	toptime = LOAD(since) != 0 ? LOAD(since) : now;
+	topepoch = epoch;
+    }
+    secs = (now - toptime) / 1e6;
+    if (secs <= 0)
+	secs = 1e-6;
+    for (i = 0; i < NPROCS; i++) {
+	rs = &total[i];
+	tops += rs->rs_calls + rs->rs_errors - topprev[i][0];
+	tbytes += rs->rs_bytes - topprev[i][1];
+	tretrans += rs->rs_retrans - topprev[i][2];
+	if (rs->rs_inflight > 0)
+	    tinflight += rs->rs_inflight;
+    }
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&t));
+    fprintf(fp, "%s %10.1f ops/s %9.2f MB/s %6ld in flight %6.2f%% retrans\n",
+	stamp, tops / secs, tbytes / secs / 1e6, tinflight,
+	tops ? tretrans * 100.0 / tops : 0.0);
+
+    /* every view moves the threads on, even when they are not shown */
+    if (!brief)
+	fprintf(fp, "\n%-23s %10s %9s %9s %8s\n",
+	    "thread", "ops/s", "MB/s", "in flight", "retrans");
+    for (rt = threads; rt != NULL; rt = rt->rt_next) {
+	if (!rt->rt_inuse)
+	    continue;
+	cur = LOAD(rt->rt_epoch) == epoch;
+	ops = bytes = retrans = 0;
+	inflight = 0;
+	for (i = 0; i < NPROCS; i++) {
+	    rs = &rt->rt_stat[i];
+	    inflight += LOAD(rs->rs_inflight);
+	    if (!cur)
+		continue;
+	    ops += LOAD(rs->rs_calls) + LOAD(rs->rs_errors);
+	    bytes += LOAD(rs->rs_bytes);
+	    retrans += LOAD(rs->rs_retrans);
+	}
+	if (ops < rt->rt_ops)
+	    rt->rt_ops = rt->rt_bytes = rt->rt_retrans = 0;
+	dops = ops - rt->rt_ops;
+	dbytes = bytes - rt->rt_bytes;
+	dretrans = retrans - rt->rt_retrans;
+	rt->rt_ops = ops;
+	rt->rt_bytes = bytes;
+	rt->rt_retrans = retrans;
+	if (brief || (dops == 0 && inflight <= 0))
+	    continue;
+	fprintf(fp, "%-23s %10.1f %9.2f %9ld %7.2f%%\n", rt->rt_name,
+	    dops / secs, dbytes / secs / 1e6, inflight > 0 ? inflight : 0,
+	    dops ? dretrans * 100.0 / dops : 0.0);
+    }
+
+    /* and what the threads that exited since the last view did */
+    ops = bytes = retrans = 0;
+    for (i = 0; i < NPROCS; i++) {
+	ops += retired[i].rs_calls + retired[i].rs_errors;
+	bytes += retired[i].rs_bytes;
+	retrans += retired[i].rs_retrans;
+    }
+    dops = ops - goneprev[0];
+    dbytes = bytes - goneprev[1];
+    dretrans = retrans - goneprev[2];
+    goneprev[0] = ops;
+    goneprev[1] = bytes;
+    goneprev[2] = retrans;
+    if (!brief && dops != 0)
+	fprintf(fp, "%-23s %10.1f %9.2f %9d %7.2f%%\n", "(exited)",
+	    dops / secs, dbytes / secs / 1e6, 0, dretrans * 100.0 / dops);
+    if (!brief) {
+	fprintf(fp, "\n%-23s %10s %9s %9s %8s\n",
+	    "procedure", "ops/s", "MB/s", "in flight", "retrans");
+	for (i = 0; i < NPROCS; i++) {
+	    rs = &total[i];
+	    procname(i, &prog, &name);
+	    dops = rs->rs_calls + rs->rs_errors - topprev[i][0];
+	    dbytes = rs->rs_bytes - topprev[i][1];
+	    dretrans = rs->rs_retrans - topprev[i][2];
+	    if (dops == 0 && rs->rs_inflight <= 0)
+		continue;
+	    fprintf(fp, "%-5s %-17s %10.1f %9.2f %9ld %7.2f%%\n", prog, name,
+		dops / secs, dbytes / secs / 1e6,
+		rs->rs_inflight > 0 ? rs->rs_inflight : 0L,
+		dops ? dretrans * 100.0 / dops : 0.0);
+	}
+    }
+    for (i = 0; i < NPROCS; i++) {
+	topprev[i][0] = total[i].rs_calls + total[i].rs_errors;
+	topprev[i][1] = total[i].rs_bytes;
+	topprev[i][2] = total[i].rs_retrans;
+    }
+    toptime = now;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Forget everything recorded so far
+ */
+void
+rpcstats_reset(void)
+{
+    pthread_mutex_lock(&lock);
+    memset(retired, 0, sizeof(retired));
+    STORE(epoch, epoch + 1);
+    STORE(since, now_us());
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * The counters of procedure 'proc' of program 'prog', in the block of
+ * the calling thread
+ */
+static struct rpcstat *
+lookupstat(u_long prog, u_long proc)
+{
+    struct rpcthread *rt;
+    long inflight;
+    int i;
+
+    if ((rt = self) == NULL && (rt = thisthread()) == NULL)
+	return NULL;
+    if (LOAD(rt->rt_epoch) != LOAD(epoch)) {
+	/* cleared: start over, but calls in flight are still out there */
+	for (i = 0; i < NPROCS; i++) {
+	    inflight = LOAD(rt->rt_stat[i].rs_inflight);
+	    memset(&rt->rt_stat[i], 0, sizeof(rt->rt_stat[i]));
+	    STORE(rt->rt_stat[i].rs_inflight, inflight);
+	}
+	STORE(rt->rt_epoch, LOAD(epoch));
+    }
+    if (prog == MOUNT_PROGRAM && proc < NMNTPROCS)
+	return &rt->rt_stat[proc];
+    if (prog == NFS_PROGRAM && proc < NNFSPROCS)
+	return &rt->rt_stat[NMNTPROCS + proc];
+    return NULL;
+}
+
+/*
+ * The block of the calling thread, handed out on its first call
+ */
+static struct rpcthread *
+thisthread(void)
+{
+    struct rpcthread *rt;
+
+    if (self != NULL)
+	return self;
+    (void) pthread_once(&once, makekey);
+    pthread_mutex_lock(&lock);
+    for (rt = threads; rt != NULL && rt->rt_inuse; rt = rt->rt_next)
+	/* do nothing */;
+    if (rt == NULL) {
+	if (posix_memalign((void **) &rt, CACHELINE, sizeof(*rt)) != 0) {
+	    pthread_mutex_unlock(&lock);
+	    return NULL;
+	}
+	memset(rt, 0, sizeof(*rt));
+	rt->rt_next = threads;
+	threads = rt;
+	nthreads++;
+    }
+    memset(rt->rt_stat, 0, sizeof(rt->rt_stat));
+    rt->rt_epoch = epoch;
+    rt->rt_inuse = 1;
+    rt->rt_ops = rt->rt_bytes = rt->rt_retrans = 0;
+    snprintf(rt->rt_name, sizeof(rt->rt_name), "thread %d", nthreads);
+    pthread_mutex_unlock(&lock);
+    (void) pthread_setspecific(key, rt);
+    self = rt;
+    return rt;
+}
+
+static void
+makekey(void)
+{
+    (void) pthread_key_create(&key, endthread);
+}
+
+/*
+ * A thread exits: keep its counts and free its block for another one
+ */
+static void
+endthread(void *arg)
+{
+    struct rpcthread *rt = (struct rpcthread *) arg;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < NPROCS; i++) {
+	if (rt->rt_epoch == epoch)
+	    merge(&retired[i], &rt->rt_stat[i]);
+	else
+	    retired[i].rs_inflight += rt->rt_stat[i].rs_inflight;
+    }
+    /* rpcstats_top has shown this much of it already */
+    goneprev[0] += rt->rt_ops;
+    goneprev[1] += rt->rt_bytes;
+    goneprev[2] += rt->rt_retrans;
+    rt->rt_inuse = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Add the counters of 'src', which its owner may be updating, to 'dst'
+ */
+static void
+merge(struct rpcstat *dst, struct rpcstat *src)
+{
+    unsigned long long max;
+    long long first, last;
+    u_long n;
+    int b;
+
+    n = LOAD(src->rs_calls) + LOAD(src->rs_errors);
+    dst->rs_inflight += LOAD(src->rs_inflight);
+    if (n == 0)
+	return;
+    first = LOAD(src->rs_first);
+    last = LOAD(src->rs_last);
+    if (dst->rs_calls + dst->rs_errors == 0 || first < dst->rs_first)
+	dst->rs_first = first;
+    if (last > dst->rs_last)
+	dst->rs_last = last;
+    dst->rs_calls += LOAD(src->rs_calls);
+    dst->rs_errors += LOAD(src->rs_errors);
+    dst->rs_retrans += LOAD(src->rs_retrans);
+    dst->rs_bytes += LOAD(src->rs_bytes);
+    if ((max = LOAD(src->rs_max)) > dst->rs_max)
+	dst->rs_max = max;
+    for (b = 0; b < HIST_BUCKETS; b++)
+	dst->rs_hist[b] += LOAD(src->rs_hist[b]);
+}
+
+/*
+ * Add up the counts of all threads in 'total'. Blocks of an earlier
+ * epoch only add their calls in flight.
+ */
+static void
+collect(void)
+{
+    struct rpcthread *rt;
+    int i;
+
+    memcpy(total, retired, sizeof(total));
+    for (rt = threads; rt != NULL; rt = rt->rt_next) {
+	if (!rt->rt_inuse)
+	    continue;
+	for (i = 0; i < NPROCS; i++) {
+	    if (LOAD(rt->rt_epoch) == epoch)
+		merge(&total[i], &rt->rt_stat[i]);
+	    else
+		total[i].rs_inflight += LOAD(rt->rt_stat[i].rs_inflight);
+	}
+    }
+}
+
+static void
+procname(int i, char **progp, char **namep)
+{
+    if (i < NMNTPROCS) {
+	*progp = "MOUNT";
+	*namep = mntnames[i];
+    } else {
+	*progp = "NFS";
+	*namep = nfsnames[i - NMNTPROCS];
+    }
+}
+
+static long long
+now_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/*
+ * Histogram bucket of a latency. Values below HIST_SUB have a bucket
+ * each; above that the top HIST_SUBBITS + 1 bits select the bucket.
+ */
+static int
+bucket(unsigned long long v)
+{
+    int e;
+
+    if (v < HIST_SUB)
+	return (int) v;
+    for (e = HIST_SUBBITS; e < HIST_MAXBITS - 1 && (v >> (e + 1)) != 0; e++)
+	;
+    if ((v >> (e + 1)) != 0)
+	return HIST_BUCKETS - 1;
+    return (e - HIST_SUBBITS + 1) * HIST_SUB +
+	(int) (v >> (e - HIST_SUBBITS)) - HIST_SUB;
+}
+
+/*
+ * Largest latency that falls in bucket 'b'
+ */
+static unsigned long long
+bucketvalue(int b)
+{
+    int e = b / HIST_SUB + HIST_SUBBITS - 1;
+
+    if (b < HIST_SUB)
+	return b;
+    return ((unsigned long long) (b % HIST_SUB + HIST_SUB + 1) <<
+	(e - HIST_SUBBITS)) - 1;
+}
+
+/*
+ * The 'pct' percentile latency of a procedure
+ */
+static unsigned long long
+percentile(struct rpcstat *rs, int pct)
+{
+    unsigned long long want, seen = 0;
+    int b;
+
+    if (rs->rs_calls == 0)
+	return 0;
+    want = (rs->rs_calls * (unsigned long long) pct + 99) / 100;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+	if ((seen += rs->rs_hist[b]) >= want)
+	    return bucketvalue(b) < rs->rs_max ? bucketvalue(b) : rs->rs_max;
+    }
+    return rs->rs_max;
+}
@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * scan - probe many hosts for exported file systems at once
+ *
+ * Asking one host at a time for its exports costs a portmapper round
+ * trip and two MOUNT round trips, or a full timeout when nobody is
+ * home, which makes sweeping a network painfully slow. Here all
+ * portmapper calls share one unconnected datagram socket and all
+ * MOUNT calls another, each wrapped in an rpcpipe whose calls carry
+ * their own destination. Both pipes sit in a single event loop, and
+ * the completion of one call sends the next one for that host, so a
+ * whole window of hosts is in flight at once. Every host gets:
+ *
+ *	GETPORT mountd/udp	then EXPORT and DUMP to that port
+ *	GETPORT nfs v3/tcp
+ *
+ * Timeouts follow the round trip times of the hosts that do answer,
+ * so silent addresses cost little more than a live one. A host is
+ * reported as one JSON line as soon as all its calls are done.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <rpc/rpc.h>
+#include <rpc/pmap_prot.h>
+#include "mount.h"
+#include "nfs_prot.h"
+#include "rpcpipe.h"
+#include "scan.h"
+
+#define	SCAN_PMAPBUF	1024	/* receive buffer of the portmapper pipe */
+#define	SCAN_MNTBUF	65536	/* receive buffer of the MOUNT pipe */
+#define	SCAN_SOCKBUF	(1 << 20) /* socket buffers, for a window of replies */
+
+#define	S_MNTPORT	0	/* GETPORT of mountd */
+#define	S_NFSPORT	1	/* GETPORT of nfs */
+#define	S_EXPORT	2	/* EXPORT */
+#define	S_DUMP		3	/* DUMP */
+#define	NSLOTS		4
+
+struct scanstate;
+
+/*
+ * A host being probed. Hosts are recycled, so that the call slots
+ * keep their message buffers.
+ */
+struct scanhost {
+    struct scanstate *sh_state;	/* the scan it is part of */
+    struct sockaddr_in sh_pmap;	/* its portmapper */
+    struct sockaddr_in sh_mount; /* its mountd */
+    struct rpccall sh_call[NSLOTS]; /* the calls, indexed by S_* */
+    enum clnt_stat sh_stat[NSLOTS]; /* and how they went */
+    struct pmap sh_args[2];	/* GETPORT arguments */
+    u_long sh_port[2];		/* GETPORT results */
+    exports sh_exports;		/* EXPORT result */
+    mountlist sh_mounts;	/* DUMP result */
+    int sh_pending;		/* calls in flight */
+    struct scanhost *sh_next;	/* next free host */
+};
+
+/*
+ * Where the addresses come from: the arguments first, then the lines
+ * of the list. A CIDR range is handed out one address at a time.
+ */
+struct targets {
+    int tg_argc;		/* arguments left */
+    char **tg_argv;		/* the next one */
+    FILE *tg_list;		/* list of more, or NULL */
+    int tg_inrange;		/* in the middle of a range */
+    u_int32_t tg_next;		/* next address of that range */
+    u_int32_t tg_last;		/* its last address */
+};
+
+struct scanstate {
+    struct scan *ss_scan;	/* what was asked for */
+    struct targets ss_targets;	/* addresses still to probe */
+    struct rpcloop ss_loop;	/* the event loop */
+    struct rpcpipe ss_pmap;	/* portmapper calls */
+    struct rpcpipe ss_mnt;	/* MOUNT calls */
+    AUTH *ss_none;		/* credentials of the portmapper calls */
+    struct scanhost *ss_free;	/* hosts to recycle */
+    int ss_active;		/* hosts being probed */
+};
+
+static int nexttarget(struct targets *, struct in_addr *);
+static int parsetarget(struct targets *, char *);
+static int scannext(struct scanstate *);
+static int scansend(struct scanhost *, int, struct rpcpipe *, u_long,
+    xdrproc_t, caddr_t, xdrproc_t, caddr_t);
+static void scandone(struct rpcpipe *, struct rpccall *);
+static void scanreport(struct scanstate *, struct scanhost *);
+static void scantimeout(struct rpcpipe *);
+static void putstring(FILE *, char *);
+
+/*
+ * Probe all hosts named by 'argv' and 'list' (which may be NULL), at
+ * most sc_window of them at a time. Returns 0 if the scan could not
+ * be set up.
+ */
+int
+scan_run(struct scan *sc, int argc, char **argv, FILE *list)
+{
+    struct scanstate ss;
+    struct scanhost *sh;
+    int i, size, ok = 0;
+
+    memset(&ss, 0, sizeof(ss));
+    ss.ss_scan = sc;
+    ss.ss_targets.tg_argc = argc;
+    ss.ss_targets.tg_argv = argv;
+    ss.ss_targets.tg_list = list;
+    if (!rpcloop_open(&ss.ss_loop)) {
+	fprintf(stderr, "scan: cannot create event loop\n");
+	close(sc->sc_pmapfd);
+	close(sc->sc_mntfd);
+	return 0;
+    }
+    ss.ss_none = authnone_create();
+    if (!rpcpipe_openfd(&ss.ss_pmap, sc->sc_pmapfd, ss.ss_none, PMAPPROG,
+      PMAPVERS, SCAN_PMAPBUF)) {
+	clnt_perrno(ss.ss_pmap.rp_stat);
+	goto out;
+    }
+    if (!rpcpipe_openfd(&ss.ss_mnt, sc->sc_mntfd, sc->sc_auth,
+      MOUNT_PROGRAM, MOUNT_V3, SCAN_MNTBUF)) {
+	clnt_perrno(ss.ss_mnt.rp_stat);
+	goto out;
+    }
+    if (!rpcloop_add(&ss.ss_loop, &ss.ss_pmap) ||
+      !rpcloop_add(&ss.ss_loop, &ss.ss_mnt)) {
+	fprintf(stderr, "scan: cannot create event loop\n");
+	goto out;
+    }
+    for (i = 0; i < 2; i++) {
+	struct rpcpipe *rp = i == 0 ? &ss.ss_pmap : &ss.ss_mnt;
+
+	rp->rp_retry.tv_sec = SCAN_INITRTO / 1000;
+	rp->rp_retry.tv_usec = (SCAN_INITRTO % 1000) * 1000;
+	rp->rp_minrto = SCAN_MINRTO;
+	scantimeout(rp);
+	size = SCAN_SOCKBUF;
+	(void) setsockopt(rp->rp_fd, SOL_SOCKET, SO_RCVBUF, &size,
+	    sizeof(size));
+    }
+
+    while (ss.ss_active < sc->sc_window && scannext(&ss))
+	;
+    rpcloop_run(&ss.ss_loop);
+    ok = 1;
+
+out:
+    while ((sh = ss.ss_free) != NULL) {
+	ss.ss_free = sh->sh_next;
+	for (i = 0; i < NSLOTS; i++)
+	    rpccall_free(&sh->sh_call[i]);
+	free(sh);
+    }
+    rpcpipe_close(&ss.ss_pmap);
+    rpcpipe_close(&ss.ss_mnt);
+    rpcloop_close(&ss.ss_loop);
+    close(sc->sc_pmapfd);
+    close(sc->sc_mntfd);
+    auth_destroy(ss.ss_none);
+    return ok;
+}
+
+/*
+ * Start probing the next host. Returns 0 when there is none, or the
+ * scan was stopped.
+ */
+static int
+scannext(struct scanstate *ss)
+{
+    struct scan *sc = ss->ss_scan;
+    struct scanhost *sh;
+    struct in_addr addr;
+    int i;
+
+    if (*sc->sc_stop || !nexttarget(&ss->ss_targets, &addr))
+	return 0;
+    if ((sh = ss->ss_free) != NULL)
+	ss->ss_free = sh->sh_next;
+    else if ((sh = calloc(1, sizeof(*sh))) == NULL) {
+	fprintf(stderr, "scan: out of memory\n");
+	return 0;
+    }
+    sh->sh_state = ss;
+    memset(&sh->sh_pmap, 0, sizeof(sh->sh_pmap));
+    sh->sh_pmap.sin_family = AF_INET;
+    sh->sh_pmap.sin_addr = addr;
+    sh->sh_pmap.sin_port = htons(PMAPPORT);
+    sh->sh_mount = sh->sh_pmap;
+    for (i = 0; i < NSLOTS; i++)
+	sh->sh_stat[i] = RPC_FAILED;
+    sh->sh_args[0].pm_prog = MOUNT_PROGRAM;
+    sh->sh_args[0].pm_vers = MOUNT_V3;
+    sh->sh_args[0].pm_prot = IPPROTO_UDP;
+    sh->sh_args[0].pm_port = 0;
+    sh->sh_args[1].pm_prog = NFS_PROGRAM;
+    sh->sh_args[1].pm_vers = NFS_V3;
+    sh->sh_args[1].pm_prot = IPPROTO_TCP;
+    sh->sh_args[1].pm_port = 0;
+    sh->sh_port[0] = sh->sh_port[1] = 0;
+    sh->sh_exports = NULL;
+    sh->sh_mounts = NULL;
+    sh->sh_pending = 0;
+    ss->ss_active++;
+    sc->sc_probed++;
+
+    /* retransmissions to one address say nothing about the next */
+    ss->ss_pmap.rp_backoff = 0;
+    (void) scansend(sh, S_MNTPORT, &ss->ss_pmap, PMAPPROC_GETPORT,
+	(xdrproc_t) xdr_pmap, (caddr_t) &sh->sh_args[0],
+	(xdrproc_t) xdr_u_long, (caddr_t) &sh->sh_port[0]);
+    (void) scansend(sh, S_NFSPORT, &ss->ss_pmap, PMAPPROC_GETPORT,
+	(xdrproc_t) xdr_pmap, (caddr_t) &sh->sh_args[1],
+	(xdrproc_t) xdr_u_long, (caddr_t) &sh->sh_port[1]);
+    if (sh->sh_pending == 0) {
+	/* could not even send to it */
+	scanreport(ss, sh);
+	sh->sh_next = ss->ss_free;
+	ss->ss_free = sh;
+	ss->ss_active--;
+    }
+    return 1;
+}
+
+/*
+ * Send call 'slot' of a host
+ */
+static int
+scansend(struct scanhost *sh, int slot, struct rpcpipe *rp, u_long proc,
+    xdrproc_t xargs, caddr_t args, xdrproc_t xres, caddr_t res)
+{
+    struct rpccall *rc = &sh->sh_call[slot];
+
+    rc->rc_data = sh;
+    rc->rc_done = scandone;
+    rc->rc_addr = slot == S_MNTPORT || slot == S_NFSPORT ?
+	&sh->sh_pmap : &sh->sh_mount;
+    if (!rpcpipe_send(rp, rc, proc, xargs, args, xres, res)) {
+	sh->sh_stat[slot] = rp->rp_stat;
+	return 0;
+    }
+    sh->sh_pending++;
+    return 1;
+}
+
+/*
+ * Completion of any call of a host. When its mountd is found, ask it
+ * for the exports and mounts; when nothing is pending anymore, report
+ * the host and take the next one.
+ */
+static void
+scandone(struct rpcpipe *rp, struct rpccall *rc)
+{
+    struct scanhost *sh = rc->rc_data;
+    struct scanstate *ss = sh->sh_state;
+    int slot = rc - sh->sh_call;
+
+    sh->sh_stat[slot] = rc->rc_stat;
+    sh->sh_pending--;
+    if (rc->rc_stat == RPC_SUCCESS)
+	scantimeout(rp);
+
+    if (slot == S_MNTPORT && rc->rc_stat == RPC_SUCCESS &&
+      sh->sh_port[slot] != 0) {
+	sh->sh_mount.sin_port = htons((u_short) sh->sh_port[slot]);
+	(void) scansend(sh, S_EXPORT, &ss->ss_mnt, MOUNT3_EXPORT,
+	    (xdrproc_t) xdr_void, NULL,
+	    (xdrproc_t) xdr_exports, (caddr_t) &sh->sh_exports);
+	(void) scansend(sh, S_DUMP, &ss->ss_mnt, MOUNT3_DUMP,
+	    (xdrproc_t) xdr_void, NULL,
+	    (xdrproc_t) xdr_mountlist, (caddr_t) &sh->sh_mounts);
+    }
+    if (sh->sh_pending > 0)
+	return;
+
+    scanreport(ss, sh);
+    xdr_free((xdrproc_t) xdr_exports, (char *) &sh->sh_exports);
+    xdr_free((xdrproc_t) xdr_mountlist, (char *) &sh->sh_mounts);
+    sh->sh_next = ss->ss_free;
+    ss->ss_free = sh;
+    ss->ss_active--;
+    while (ss->ss_active < ss->ss_scan->sc_window && scannext(ss))
+	;
+}
+
+/*
+ * Write the JSON line of a host. Hosts whose portmapper did not
+ * answer are only reported when all hosts were asked for.
+ */
+static void
+scanreport(struct scanstate *ss, struct scanhost *sh)
+{
+    struct scan *sc = ss->ss_scan;
+    FILE *out = sc->sc_out;
+    exports ex;
+    groups gr;
+    mountlist ml;
+
+    if (sh->sh_stat[S_MNTPORT] != RPC_SUCCESS &&
+      sh->sh_stat[S_NFSPORT] != RPC_SUCCESS) {
+	if (!sc->sc_all)
+	    return;
+	fprintf(out, "{\"host\":\"%s\",\"portmap\":false,\"error\":",
+	    inet_ntoa(sh->sh_pmap.sin_addr));
+	putstring(out, clnt_sperrno(sh->sh_stat[S_MNTPORT]));
+	fprintf(out, "}\n");
+	fflush(out);
+	return;
+    }
+    sc->sc_answered++;
+    fprintf(out, "{\"host\":\"%s\",\"portmap\":true",
+	inet_ntoa(sh->sh_pmap.sin_addr));
+    if (sh->sh_stat[S_NFSPORT] != RPC_SUCCESS) {
+	fprintf(out, ",\"nfs\":null,\"nfs_error\":");
+	putstring(out, clnt_sperrno(sh->sh_stat[S_NFSPORT]));
+    } else if (sh->sh_port[1] == 0)
+	fprintf(out, ",\"nfs\":null");
+    else
+	fprintf(out, ",\"nfs\":%lu", sh->sh_port[1]);
+    if (sh->sh_stat[S_MNTPORT] != RPC_SUCCESS) {
+	fprintf(out, ",\"mountd\":null,\"mountd_error\":");
+	putstring(out, clnt_sperrno(sh->sh_stat[S_MNTPORT]));
+    } else if (sh->sh_port[0] == 0)
+	fprintf(out, ",\"mountd\":null");
+    else {
+	fprintf(out, ",\"mountd\":%lu", sh->sh_port[0]);
+	if (sh->sh_stat[S_EXPORT] != RPC_SUCCESS) {
+	    fprintf(out, ",\"exports\":null,\"exports_error\":");
+	    putstring(out, clnt_sperrno(sh->sh_stat[S_EXPORT]));
+	} else {
+	    fprintf(out, ",\"exports\":[");
+	    for (ex = sh->sh_exports; ex != NULL; ex = ex->ex_next) {
+		fprintf(out, "{\"dir\":");
+		putstring(out, ex->ex_dir);
+		fprintf(out, ",\"groups\":[");
+		for (gr = ex->ex_groups; gr != NULL; gr = gr->gr_next) {
+		    putstring(out, gr->gr_name);
+		    if (gr->gr_next != NULL)
+			putc(',', out);
+		}
+		fprintf(out, "]}%s", ex->ex_next != NULL ? "," : "");
+	    }
+	    fprintf(out, "]");
+	}
+	if (sh->sh_stat[S_DUMP] != RPC_SUCCESS) {
+	    fprintf(out, ",\"mounts\":null,\"mounts_error\":");
+	    putstring(out, clnt_sperrno(sh->sh_stat[S_DUMP]));
+	} else {
+	    fprintf(out, ",\"mounts\":[");
+	    for (ml = sh->sh_mounts; ml != NULL; ml = ml->ml_next) {
+		fprintf(out, "{\"host\":");
+		putstring(out, ml->ml_hostname);
+		fprintf(out, ",\"dir\":");
+		putstring(out, ml->ml_directory);
+		fprintf(out, "}%s", ml->ml_next != NULL ? "," : "");
+	    }
+	    fprintf(out, "]");
+	}
+    }
+    fprintf(out, "}\n");
+    fflush(out);
+}
+
+/*
+ * Give up on a call after about three transmissions at the current
+ * retransmission timeout, which follows the hosts that answer
+ */
+static void
+scantimeout(struct rpcpipe *rp)
+{
+    long t;
+
+    /* rpcpipe_rto is capped by the old timeout */
+    rp->rp_timeout.tv_sec = SCAN_MAXWAIT / 1000;
+    rp->rp_timeout.tv_usec = (SCAN_MAXWAIT % 1000) * 1000;
+    t = MIN(rpcpipe_rto(rp) * 7, SCAN_MAXWAIT);
+    rp->rp_timeout.tv_sec = t / 1000;
+    rp->rp_timeout.tv_usec = (t % 1000) * 1000;
+}
+
+/*
+ * Produce the next address to probe
+ */
+static int
+nexttarget(struct targets *tg, struct in_addr *addr)
+{
+    char line[BUFSIZ], *word, *cp;
+
+    for (;;) {
+	if (tg->tg_inrange) {
+	    addr->s_addr = htonl(tg->tg_next);
+	    if (tg->tg_next++ == tg->tg_last)
+		tg->tg_inrange = 0;
+	    return 1;
+	}
+	if (tg->tg_argc > 0) {
+	    word = *tg->tg_argv++;
+	    tg->tg_argc--;
+	} else if (tg->tg_list != NULL &&
+	  fgets(line, sizeof(line), tg->tg_list) != NULL) {
+	    if ((cp = strchr(line, '#')) != NULL)
+		*cp = '\0';
+	    for (word = line; isspace((unsigned char) *word); word++)
+		;
+	    for (cp = word; *cp && !isspace((unsigned char) *cp); cp++)
+		;
+	    *cp = '\0';
+	    if (*word == '\0')
+		continue;
+	} else
+	    return 0;
+	(void) parsetarget(tg, word);
+    }
+}
+
+/*
+ * Turn an address, a.b.c.d/n range or host name into a range of
+ * addresses
+ */
+static int
+parsetarget(struct targets *tg, char *word)
+{
+    struct hostent *hp;
+    struct in_addr addr;
+    u_int32_t mask;
+    char *cp, *end;
+    long bits;
+
+    if ((cp = strchr(word, '/')) != NULL) {
+	*cp++ = '\0';
+	bits = strtol(cp, &end, 10);
+	if (*cp == '\0' || *end != '\0' || bits < 0 || bits > 32 ||
+	  !inet_aton(word, &addr)) {
+	    fprintf(stderr, "scan: %s/%s: bad address range\n", word, cp);
+	    return 0;
+	}
+	mask = bits == 0 ? 0 : ~(u_int32_t) 0 << (32 - bits);
+	tg->tg_next = ntohl(addr.s_addr) & mask;
+	tg->tg_last = tg->tg_next | ~mask;
+    } else {
+	if (!inet_aton(word, &addr)) {
+	    if ((hp = gethostbyname(word)) == NULL ||
+	      hp->h_addrtype != AF_INET) {
+		fprintf(stderr, "scan: %s: unknown host\n", word);
+		return 0;
+	    }
+	    memcpy(&addr, hp->h_addr, sizeof(addr));
+	}
+	tg->tg_next = tg->tg_last = ntohl(addr.s_addr);
+    }
+    tg->tg_inrange = 1;
+    return 1;
+}
+
+/*
+ * Write a JSON string
+ */
+static void
+putstring(FILE *out, char *s)
+{
+    unsigned char *cp;
+
+    putc('"', out);
+    for (cp = (unsigned char *) (s != NULL ? s : ""); *cp; cp++) {
+	switch (*cp) {
+	case '"': fputs("\\\"", out); break;
+	case '\\': fputs("\\\\", out); break;
+	case '\n': fputs("\\n", out); break;
+	case '\r': fputs("\\r", out); break;
+	case '\t': fputs("\\t", out); break;
+	default:
+	    if (*cp < 0x20 || *cp >= 0x7f)
+		fprintf(out, "\\u%04x", *cp);
+	    else
+		putc(*cp, out);
+	    break;
+	}
+    }
+    putc('"', out);
+}
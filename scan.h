@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 1990-1998 by Leendert van Doorn <leendert@paramecium.org>
+ * Copyright (c) 2013 by Michael Brown, Net Direct <michael@netdirect.ca>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Vrije Universiteit, Net Direct nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL LEENDERT VAN DOORN, VRIJE UNIVERSITEIT
+ * (AMSTERDAM), MICHAEL BROWN, OR NET DIRECT (CANADA) BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * scan - probe many hosts for exported file systems at once
+ */
+#ifndef _SCAN_H
+#define	_SCAN_H
+
+#include <stdio.h>
+#include <signal.h>
+#include <rpc/rpc.h>
+
+#define	SCAN_WINDOW	1024	/* default number of hosts probed at once */
+#define	SCAN_MINRTO	50	/* least retransmission timeout (ms) */
+#define	SCAN_INITRTO	500	/* retransmission timeout to start with (ms) */
+#define	SCAN_MAXWAIT	5000	/* longest a probe may take (ms) */
+
+/*
+ * What to scan and how. The sockets are datagram sockets, preferably
+ * bound to privileged ports, that scan_run takes over and closes.
+ */
+struct scan {
+    int sc_window;		/* hosts probed at once */
+    int sc_all;			/* also report hosts that did not answer */
+    int sc_pmapfd;		/* socket for the portmapper calls */
+    int sc_mntfd;		/* socket for the MOUNT calls */
+    AUTH *sc_auth;		/* credentials for the MOUNT calls */
+    FILE *sc_out;		/* where the JSON lines go */
+    volatile sig_atomic_t *sc_stop; /* set to stop starting new hosts */
+    u_long sc_probed;		/* hosts probed */
+    u_long sc_answered;		/* hosts whose portmapper answered */
+};
+
+int scan_run(struct scan *, int, char **, FILE *);
+
+#endif /* _SCAN_H */
